@@ -0,0 +1,116 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "batch.h"
+
+// Batch runs of a rom that sends "ok" over the serial port and then keeps writing memory, on
+// 1, 2, 4... threads up to the number of cores and at least 4: jobs per second and the
+// speedup over one thread, which should grow with the threads as long as there are cores for
+// them. Every job has to run its whole budget with its own serial output.
+
+namespace
+{
+
+std::vector<uint8_t> make_busy_program()
+{
+	constexpr uint8_t s_main[] = {
+		0x3E, 'o',        //     ld a, 'o'
+		0xE0, 0x01,       //     ldh ($01), a
+		0x3E, 0x81,       //     ld a, $81
+		0xE0, 0x02,       //     ldh ($02), a
+		0x3E, 'k',        //     ld a, 'k'
+		0xE0, 0x01,       //     ldh ($01), a
+		0x3E, 0x81,       //     ld a, $81
+		0xE0, 0x02,       //     ldh ($02), a
+		0x21, 0x00, 0xC0, //     ld hl, $c000
+		0x34,             // .loop inc (hl)
+		0x2C,             //     inc l
+		0x18, 0xFC,       //     jr .loop
+	};
+	return bench::make_program(0x00, 0x00, 0x00, s_main, sizeof(s_main));
+}
+
+}
+
+int bench::batch(int argc, char* argv[])
+{
+	uint32_t count = argc >= 1 ? static_cast<uint32_t>(strtoul(argv[0], nullptr, 10)) : 32;
+	uint64_t frames = argc >= 2 ? strtoull(argv[1], nullptr, 10) : 60;
+	uint32_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+	// a few threads even on fewer cores, they still have to get every job right
+	uint32_t max_threads = std::max(cores, 4u);
+
+	printf("batch: %u jobs of %llu frames, %u cores\n", count, static_cast<unsigned long long>(frames), cores);
+
+	std::filesystem::path directory = std::filesystem::temp_directory_path();
+	std::string rom_path = (directory / "gb-bench-batch.gb").string();
+	std::string jobs_path = (directory / "gb-bench-batch.jobs").string();
+	std::string results_path = (directory / "gb-bench-batch.jsonl").string();
+
+	std::vector<uint8_t> rom = make_busy_program();
+	std::ofstream(rom_path, std::ios::binary).write(reinterpret_cast<char const*>(rom.data()), static_cast<std::streamsize>(rom.size()));
+	{
+		std::ofstream list(jobs_path);
+		list << "# gb-bench batch\n";
+		for (uint32_t job = 0; job < count; job++)
+			list << rom_path << ' ' << frames << "f\n";
+	}
+
+	std::vector<::batch::Job> jobs;
+	if (!::batch::read_jobs(jobs_path, jobs) || jobs.size() != count)
+		return 1;
+
+	// maps the rom into the page cache first, the one thread run would pay for it
+	::batch::run(jobs, Dmg::Execution::Block, 1);
+
+	double single = 0;
+	for (uint32_t threads = 1;; threads = std::min(threads * 2, max_threads))
+	{
+		Timer timer;
+		std::vector<::batch::Result> results = ::batch::run(jobs, Dmg::Execution::Block, threads);
+		double seconds = timer.seconds();
+
+		for (::batch::Result const& result : results)
+		{
+			if (result.status != ::batch::Result::Status::Done || result.serial != "ok" || result.frames != frames)
+			{
+				printf("  job ended %d after %llu frames with serial '%s'\n", static_cast<int>(result.status),
+					static_cast<unsigned long long>(result.frames), result.serial.c_str());
+				return 1;
+			}
+		}
+		if (threads == 1)
+		{
+			single = seconds;
+			if (!::batch::write_results(results_path, jobs, results))
+				return 1;
+		}
+
+		printf("  %2u threads %8.2f jobs/s %8.2f emulated MHz  %5.2fx\n", threads, count / seconds,
+			count * frames * Dmg::s_frame_cycles * 4 / seconds / 1e6, single / seconds);
+		if (threads == max_threads)
+			break;
+	}
+
+	std::ifstream results(results_path);
+	uint32_t lines = static_cast<uint32_t>(std::count(std::istreambuf_iterator<char>(results), {}, '\n'));
+	if (lines != count)
+	{
+		printf("  %u lines of results for %u jobs\n", lines, count);
+		return 1;
+	}
+	printf("  batch ok\n");
+
+	std::filesystem::remove(rom_path);
+	std::filesystem::remove(jobs_path);
+	std::filesystem::remove(results_path);
+	return 0;
+}
@@ -0,0 +1,270 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+namespace bench
+{
+
+// roms/test-loop.z80
+static constexpr uint8_t s_test_loop[] = {
+	0xAF,       //     xor a
+	0x06, 0xE9, //     ld b, 233
+	0x4F,       //     ld c, a
+	0x0C,       // .loop inc c
+	0x79,       //     ld a, c
+	0xB8,       //     cp b
+	0x20, 0xFA, //     jr nz, .loop
+	0x40,       //     ld b, b
+	0x76,       //     halt
+	0x00,       //     nop
+};
+
+void load_rom(Dmg& dmg, char const* path)
+{
+	if (path)
+	{
+		if (!dmg.insert_cartridge(path))
+			exit(1);
+		return;
+	}
+
+	memcpy(dmg.mem().direct_ram() + 0x0100, s_test_loop, sizeof(s_test_loop));
+	dmg.cpu().invalidate_blocks();
+}
+
+void load_random_program(Dmg& dmg, uint32_t seed)
+{
+	std::mt19937 random(seed);
+	uint8_t* ram = dmg.mem().direct_ram();
+
+	for (uint32_t addr = 0; addr < 0x10000; addr++)
+	{
+		uint8_t byte = static_cast<uint8_t>(random());
+		switch (byte)
+		{
+			case 0x10: // STOP
+			case 0x76: // HALT
+			case 0xD3: case 0xDB: case 0xDD: case 0xE3: case 0xE4: case 0xEB:
+			case 0xEC: case 0xED: case 0xF4: case 0xFC: case 0xFD:
+				byte = 0x00;
+				break;
+		}
+		ram[addr] = byte;
+	}
+
+	// no serial output
+	ram[0xFF02] = 0x00;
+
+	dmg.cpu().invalidate_blocks();
+}
+
+std::vector<uint8_t> make_rom(uint8_t type, uint8_t rom_code, uint8_t ram_code)
+{
+	std::vector<uint8_t> rom(size_t(0x8000) << rom_code);
+	for (size_t bank = 0; bank < rom.size() / 0x4000; bank++)
+	{
+		rom[bank * 0x4000] = static_cast<uint8_t>(bank);
+		rom[bank * 0x4000 + 1] = static_cast<uint8_t>(bank >> 8);
+	}
+
+	rom[0x0147] = type;
+	rom[0x0148] = rom_code;
+	rom[0x0149] = ram_code;
+	uint8_t checksum = 0;
+	for (uint16_t addr = 0x0134; addr <= 0x014C; addr++)
+		checksum = checksum - rom[addr] - 1;
+	rom[0x014D] = checksum;
+	return rom;
+}
+
+std::vector<uint8_t> make_program(uint8_t type, uint8_t rom_code, uint8_t ram_code, uint8_t const* code, size_t size)
+{
+	std::vector<uint8_t> rom = make_rom(type, rom_code, ram_code);
+	rom[0x0100] = 0x00; // nop
+	rom[0x0101] = 0xC3; // jp $0150
+	rom[0x0102] = 0x50;
+	rom[0x0103] = 0x01;
+	std::copy(code, code + size, rom.begin() + 0x0150);
+	return rom;
+}
+
+Result run(Dmg& dmg, uint64_t m_cycles)
+{
+	Timer timer;
+
+	for (uint64_t i = 0; i < m_cycles; i++)
+	{
+		dmg.clock();
+		if (dmg.cpu().stopped())
+			dmg.cpu().reset();
+	}
+
+	return { m_cycles, timer.seconds() };
+}
+
+Result run_steps(Dmg& dmg, uint64_t m_cycles)
+{
+	Timer timer;
+	uint64_t cycles = 0;
+
+	while (cycles < m_cycles)
+	{
+		cycles += dmg.step();
+		if (dmg.cpu().stopped())
+			dmg.cpu().reset();
+	}
+
+	return { cycles, timer.seconds() };
+}
+
+bool lockstep(Dmg& reference, Dmg& candidate, uint64_t steps)
+{
+	// cores are compared instruction by instruction, see idle.cpp for skipping
+	reference.set_fast_forward(false);
+	candidate.set_fast_forward(false);
+
+	bool reset = true;
+
+	for (uint64_t i = 0; i < steps; i++)
+	{
+		Cpu::Registers before = candidate.cpu().registers();
+
+		// the candidate may run several instructions per step, the reference catches up to it
+		uint32_t candidate_cycles = candidate.step();
+		uint32_t reference_cycles = 0;
+		do
+			reference_cycles += reference.step();
+		while (reference_cycles < candidate_cycles && !reference.cpu().stopped());
+
+		// the M-cycle core spends one extra cycle on the fetch after a reset
+		bool cycles_match = reset ? reference_cycles - candidate_cycles + 1 <= 2
+			: reference_cycles == candidate_cycles;
+
+		Cpu::Registers r = reference.cpu().registers();
+		Cpu::Registers c = candidate.cpu().registers();
+
+		if (r != c || !cycles_match || reference.cpu().stopped() != candidate.cpu().stopped())
+		{
+			printf("diverged after %llu steps, step from $%04x ($%02x)\n",
+				static_cast<unsigned long long>(i), before.pc, reference.mem().read(before.pc));
+			printf("  reference AF=%04x BC=%04x DE=%04x HL=%04x SP=%04x PC=%04x %u cycles\n", r.af, r.bc, r.de, r.hl, r.sp, r.pc, reference_cycles);
+			printf("  candidate AF=%04x BC=%04x DE=%04x HL=%04x SP=%04x PC=%04x %u cycles\n", c.af, c.bc, c.de, c.hl, c.sp, c.pc, candidate_cycles);
+			return false;
+		}
+
+		reset = reference.cpu().stopped();
+		if (reset)
+		{
+			reference.cpu().reset();
+			candidate.cpu().reset();
+		}
+
+		if ((i & 0xFFF) == 0 || i + 1 == steps)
+		{
+			uint8_t const* reference_ram = reference.mem().direct_ram();
+			uint8_t const* candidate_ram = candidate.mem().direct_ram();
+
+			for (uint32_t addr = 0; addr < 0x10000; addr++)
+			{
+				if (reference_ram[addr] != candidate_ram[addr])
+				{
+					printf("memory diverged after %llu steps at $%04x: $%02x != $%02x\n",
+						static_cast<unsigned long long>(i), addr, reference_ram[addr], candidate_ram[addr]);
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+uint64_t fingerprint(Dmg& dmg)
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+	auto add = [&](uint64_t value)
+	{
+		hash ^= value;
+		hash *= 0x100000001B3ull;
+	};
+
+	Cpu::Registers registers = dmg.cpu().registers();
+	add(registers.af);
+	add(registers.bc);
+	add(registers.de);
+	add(registers.hl);
+	add(registers.sp);
+	add(registers.pc);
+	add(registers.ime);
+	add(dmg.cpu().halted());
+	add(dmg.cpu().stopped());
+	add(dmg.mem().cycles());
+	for (uint32_t addr = 0; addr < 0xFF00; addr++)
+		add(dmg.mem().read(static_cast<uint16_t>(addr)));
+	uint8_t const* io = dmg.mem().io();
+	for (uint32_t addr = 0; addr < 0x100; addr++)
+		add(io[addr]);
+	return hash;
+}
+
+void print_result(char const* name, Result const& result, Result const* baseline)
+{
+	printf("  %-12s %9.2f MHz  %7.2fx real time", name, result.mhz(), result.realtime());
+	if (baseline)
+		printf("  %5.2fx", baseline->seconds / result.seconds);
+	printf("\n");
+}
+
+}
+
+struct Command
+{
+	char const* name;
+	char const* usage;
+	int (*run)(int argc, char* argv[]);
+};
+
+static constexpr Command s_commands[] = {
+	{ "dispatch", "[rom] [M-cycles]  emulated MHz of the switch and table dispatch", bench::dispatch },
+	{ "step", "[rom] [M-cycles]  M-cycle against instruction stepped execution", bench::step },
+	{ "instances", "[count] [threads] [instructions]  many Dmg instances side by side", bench::instances },
+	{ "blocks", "[rom] [M-cycles]  basic block cache against instruction stepped execution", bench::blocks },
+	{ "flags", "[instructions]  per opcode cost of the instruction stepped core", bench::flags },
+	{ "opcodes", "[rom]  cores generated from the opcode specification against the switch", bench::opcodes },
+	{ "idle", "[M-cycles]  skipping HALT and idle loops against running through them", bench::idle },
+	{ "fusion", "[M-cycles] [rom...]  instruction pair and triple frequencies, fused blocks against unfused ones", bench::fusion },
+	{ "memory", "[accesses]  cost of a memory access through the page table and through the bus", bench::memory },
+	{ "save", "[writes]  battery ram kept in a .sav file against plain cartridge ram", bench::save },
+	{ "state", "[count]  save states checked in lockstep, cost of saving and loading one", bench::state },
+	{ "rewind", "[rom] [seconds]  cost and size of a rewind history captured every frame", bench::rewind },
+	{ "run-ahead", "[frames]  frames presented ahead against plain frames, cost of a frame", bench::run_ahead },
+	{ "batch", "[jobs] [frames]  headless batch runs on 1, 2, 4... threads, jobs per second", bench::batch },
+	{ "lanes", "[lanes] [frames]  lockstep core of up to 16 Dmgs against running them one by one", bench::lanes },
+	{ "fork", "[children] [rounds]  copy-on-write forks of a Dmg, forks per second and bytes copied", bench::fork },
+	{ "ppu", "[frames]  scanline and FIFO PPU engines checked against a plain renderer, frames per second", bench::ppu },
+#ifdef GB_JIT
+	{ "jit", "[rom] [M-cycles]  x86-64 translation against the interpreters", bench::jit },
+#endif
+#ifdef GB_THREADED
+	{ "threaded", "[rom] [M-cycles]  computed goto dispatch against the switch and s_step", bench::threaded },
+#endif
+};
+
+int main(int argc, char* argv[])
+{
+	if (argc >= 2)
+	{
+		for (Command const& command : s_commands)
+			if (strcmp(argv[1], command.name) == 0)
+				return command.run(argc - 2, argv + 2);
+	}
+
+	printf("usage: %s <benchmark> ...\n", argv[0]);
+	for (Command const& command : s_commands)
+		printf("  %-10s %s\n", command.name, command.usage);
+	return 1;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+#include <chrono>
+#include <vector>
+
+#include "dmg.h"
+
+namespace bench
+{
+
+// T-cycles per second of the real hardware
+constexpr double s_dmg_clock_hz = 4194304.0;
+
+class Timer
+{
+public:
+	Timer() : m_start(std::chrono::steady_clock::now()) { }
+
+	double seconds() const
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+	}
+
+private:
+	std::chrono::steady_clock::time_point m_start;
+};
+
+struct Result
+{
+	uint64_t m_cycles;
+	double seconds;
+
+	double mhz() const { return m_cycles * 4 / seconds / 1e6; }
+	double realtime() const { return m_cycles * 4 / seconds / s_dmg_clock_hz; }
+};
+
+// Loads the rom at path, or roms/test-loop.z80 assembled at $0100 when path is nullptr.
+void load_rom(Dmg& dmg, char const* path);
+
+// Fills the address space with random instructions, leaving out the ones that stop the cpu
+// or are undefined, so a core can be checked against another on every opcode.
+void load_random_program(Dmg& dmg, uint32_t seed);
+
+// Header-valid image of a cartridge of the given type and size codes, every bank starting with
+// its number.
+std::vector<uint8_t> make_rom(uint8_t type, uint8_t rom_code, uint8_t ram_code);
+// make_rom() with size bytes of code at $0150, which the entry point at $0100 jumps to.
+std::vector<uint8_t> make_program(uint8_t type, uint8_t rom_code, uint8_t ram_code, uint8_t const* code, size_t size);
+
+// Runs m_cycles M-cycles, restarting the cpu from $0100 every time it stops.
+Result run(Dmg& dmg, uint64_t m_cycles);
+// Same as run() with Dmg::step().
+Result run_steps(Dmg& dmg, uint64_t m_cycles);
+
+// Steps the candidate, lets the reference step until it took as many cycles and compares their
+// registers, cycle counts and memory. The reference has to step one instruction at a time.
+// Prints the first difference and returns false when they diverge.
+bool lockstep(Dmg& reference, Dmg& candidate, uint64_t steps);
+
+// FNV-1a of the registers, time and memory, $FF00-$FFFF as stored, for checking a Dmg against
+// a reference at times. Reads memory without direct_ram(), so a fork keeps sharing its pages
+// and the PPU its decoded tiles and lines.
+uint64_t fingerprint(Dmg& dmg);
+
+void print_result(char const* name, Result const& result, Result const* baseline = nullptr);
+
+int dispatch(int argc, char* argv[]);
+int step(int argc, char* argv[]);
+int instances(int argc, char* argv[]);
+int blocks(int argc, char* argv[]);
+int flags(int argc, char* argv[]);
+int opcodes(int argc, char* argv[]);
+int idle(int argc, char* argv[]);
+int fusion(int argc, char* argv[]);
+int memory(int argc, char* argv[]);
+int save(int argc, char* argv[]);
+int state(int argc, char* argv[]);
+int rewind(int argc, char* argv[]);
+int run_ahead(int argc, char* argv[]);
+int batch(int argc, char* argv[]);
+int lanes(int argc, char* argv[]);
+int fork(int argc, char* argv[]);
+int ppu(int argc, char* argv[]);
+#ifdef GB_JIT
+int jit(int argc, char* argv[]);
+#endif
+#ifdef GB_THREADED
+int threaded(int argc, char* argv[]);
+#endif
+
+}
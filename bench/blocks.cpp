@@ -0,0 +1,59 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+// Checks the basic block cache against the instruction stepped core in lockstep, on the rom and
+// on random programs that keep writing over their own code, then compares their speed.
+
+static void print_stats(Cpu::BlockStats const& stats)
+{
+	printf("  blocks: %llu decoded, %llu invalidated, %llu chained, %llu looked up\n",
+		static_cast<unsigned long long>(stats.decoded), static_cast<unsigned long long>(stats.invalidated),
+		static_cast<unsigned long long>(stats.chained), static_cast<unsigned long long>(stats.looked_up));
+}
+
+int bench::blocks(int argc, char* argv[])
+{
+	char const* rom = argc >= 1 ? argv[0] : nullptr;
+	uint64_t m_cycles = argc >= 2 ? strtoull(argv[1], nullptr, 10) : 50'000'000;
+
+	printf("blocks: %s, %llu M-cycles\n", rom ? rom : "roms/test-loop.z80", static_cast<unsigned long long>(m_cycles));
+
+	auto reference = std::make_unique<Dmg>();
+	auto candidate = std::make_unique<Dmg>();
+	reference->set_execution(Dmg::Execution::Instruction);
+	candidate->set_execution(Dmg::Execution::Block);
+
+	load_rom(*reference, rom);
+	load_rom(*candidate, rom);
+	if (!lockstep(*reference, *candidate, 100'000))
+		return 1;
+
+	for (uint32_t seed = 1; seed <= 64; seed++)
+	{
+		reference->cpu().reset();
+		candidate->cpu().reset();
+		load_random_program(*reference, seed);
+		load_random_program(*candidate, seed);
+		if (!lockstep(*reference, *candidate, 10'000))
+			return 1;
+	}
+	printf("  lockstep ok\n");
+	print_stats(candidate->cpu().block_stats());
+
+	reference = std::make_unique<Dmg>();
+	candidate = std::make_unique<Dmg>();
+	reference->set_execution(Dmg::Execution::Instruction);
+	candidate->set_execution(Dmg::Execution::Block);
+	load_rom(*reference, rom);
+	load_rom(*candidate, rom);
+
+	Result instruction = run_steps(*reference, m_cycles);
+	print_result("instruction", instruction);
+	print_result("block", run_steps(*candidate, m_cycles), &instruction);
+	print_stats(candidate->cpu().block_stats());
+
+	return 0;
+}
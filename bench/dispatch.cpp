@@ -0,0 +1,66 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+// Compares the opcode switch with the dispatch table on the same rom.
+// Both run the same number of M-cycles from reset, so they must end in the same state. Both
+// run the M-cycle handlers generated from the opcode specification, so only the way to the
+// next handler differs: a switch on the opcode and one on the remaining cycles, against one
+// indirect call through the row kept from the cycle before. The rounds alternate and the
+// fastest of each counts, as a single run varies by more than the two differ.
+
+int bench::dispatch(int argc, char* argv[])
+{
+	char const* rom = argc >= 1 ? argv[0] : nullptr;
+	uint64_t m_cycles = argc >= 2 ? strtoull(argv[1], nullptr, 10) : 50'000'000;
+
+	auto dmg = std::make_unique<Dmg>();
+	load_rom(*dmg, rom);
+
+	printf("dispatch: %s, %llu M-cycles\n", rom ? rom : "roms/test-loop.z80", static_cast<unsigned long long>(m_cycles));
+
+	struct Mode
+	{
+		char const* name;
+		Cpu::Dispatch dispatch;
+		Result result;
+		Cpu::Registers registers;
+	};
+	Mode modes[] = {
+		{ "switch", Cpu::Dispatch::Switch, {}, {} },
+		{ "table", Cpu::Dispatch::Table, {}, {} },
+	};
+
+	constexpr uint32_t s_rounds = 5;
+	for (uint32_t round = 0; round < s_rounds; round++)
+	{
+		for (Mode& mode : modes)
+		{
+			dmg->cpu().set_dispatch(mode.dispatch);
+
+			dmg->cpu().reset();
+			(void)run(*dmg, m_cycles / 10); // warm up
+
+			dmg->cpu().reset();
+			Result result = run(*dmg, m_cycles);
+			if (!round || result.seconds < mode.result.seconds)
+				mode.result = result;
+			mode.registers = dmg->cpu().registers();
+		}
+	}
+	for (Mode const& mode : modes)
+		print_result(mode.name, mode.result, &modes[0].result);
+
+	for (Mode const& mode : modes)
+	{
+		if (mode.registers != modes[0].registers)
+		{
+			printf("%s ended in a different state than %s!\n", mode.name, modes[0].name);
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,372 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include "cpu_alu.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <csignal>
+#include <x86intrin.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Per opcode cost of the instruction stepped core, and of the alu operations with lazy flags
+// against the eager flags they replaced. Each opcode is repeated 64 times in a loop closed by a
+// JP. Time is averaged over many steps. On x86-64 Linux TSC ticks are averaged as well and host
+// instructions are counted exactly over a few thousand, elsewhere only the time is reported.
+
+namespace
+{
+
+#if defined(__x86_64__) && defined(__linux__)
+constexpr bool s_host_counters = true;
+
+uint64_t ticks()
+{
+	return __rdtsc();
+}
+
+// Host instructions executed by n calls of step, counted by single stepping a forked copy of the
+// process under ptrace. Returns 0 when the process may not be traced.
+template <typename F>
+uint64_t host_instructions(uint64_t n, F step)
+{
+	pid_t child = fork();
+	if (child == 0)
+	{
+		if (ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) != 0)
+			_exit(1);
+		raise(SIGSTOP);
+		for (uint64_t i = 0; i < n; i++)
+			step();
+		raise(SIGSTOP);
+		_exit(0);
+	}
+	if (child < 0)
+		return 0;
+
+	int status;
+	waitpid(child, &status, 0);
+	if (!WIFSTOPPED(status))
+		return 0;
+
+	uint64_t count = 0;
+	for (;;)
+	{
+		ptrace(PTRACE_SINGLESTEP, child, nullptr, nullptr);
+		waitpid(child, &status, 0);
+		if (!WIFSTOPPED(status) || WSTOPSIG(status) == SIGSTOP)
+			break;
+		++count;
+	}
+
+	kill(child, SIGKILL);
+	waitpid(child, &status, 0);
+	return count;
+}
+#else
+constexpr bool s_host_counters = false;
+
+uint64_t ticks()
+{
+	return 0;
+}
+
+template <typename F>
+uint64_t host_instructions(uint64_t, F)
+{
+	return 0;
+}
+#endif
+
+// host instructions per call of step, the difference cancels the cost of getting in and out of
+// the traced loop
+template <typename F>
+double host_instructions_per(F step)
+{
+	constexpr uint64_t s_counted = 2048;
+	uint64_t host = host_instructions(s_counted, step);
+	uint64_t overhead = host_instructions(0, step);
+	return host ? static_cast<double>(host - overhead) / s_counted : 0.0;
+}
+
+struct Case
+{
+	char const* name;
+	uint8_t bytes[3];
+	uint8_t length;
+};
+
+constexpr Case s_cases[] = {
+	{ "LD B,C",     { 0x41 },       1 },
+	{ "ADD A,B",    { 0x80 },       1 },
+	{ "ADC A,B",    { 0x88 },       1 },
+	{ "SUB B",      { 0x90 },       1 },
+	{ "SBC A,B",    { 0x98 },       1 },
+	{ "AND B",      { 0xA0 },       1 },
+	{ "XOR B",      { 0xA8 },       1 },
+	{ "OR B",       { 0xB0 },       1 },
+	{ "CP B",       { 0xB8 },       1 },
+	{ "ADD A,d8",   { 0xC6, 0x11 }, 2 },
+	{ "CP d8",      { 0xFE, 0x11 }, 2 },
+	{ "INC B",      { 0x04 },       1 },
+	{ "DEC B",      { 0x05 },       1 },
+	{ "ADD HL,BC",  { 0x09 },       1 },
+	{ "RLCA",       { 0x07 },       1 },
+	{ "RLC B",      { 0xCB, 0x00 }, 2 },
+	{ "BIT 0,B",    { 0xCB, 0x40 }, 2 },
+	{ "DAA",        { 0x27 },       1 },
+	{ "SCF",        { 0x37 },       1 },
+	{ "JR NZ,+0",   { 0x20, 0x00 }, 2 },
+	{ "JR C,+0",    { 0x38, 0x00 }, 2 },
+	{ "PUSH AF",    { 0xF5 },       1 }, // followed by POP AF
+};
+
+// The flags as the alu kept them before they were lazy, four bitfields of F written one at a time
+// by every operation. The baseline for the lazy flags of cpu_alu.h.
+struct Eager
+{
+	union {
+		uint16_t RAF;
+		struct {
+			uint8_t F0 : 1;
+			uint8_t F1 : 1;
+			uint8_t F2 : 1;
+			uint8_t F3 : 1;
+			uint8_t FC : 1;
+			uint8_t FH : 1;
+			uint8_t FN : 1;
+			uint8_t FZ : 1;
+			uint8_t RA;
+		};
+	};
+	uint8_t RB;
+	uint16_t RHL;
+	// where the cases leave the flags they read
+	uint8_t taken;
+	uint8_t pushed;
+
+	bool flag_z() const { return FZ; }
+	uint8_t flags() const { return lsb(RAF); }
+
+	void alu_add(uint8_t r)
+	{
+		uint16_t result = RA + r;
+		FN = 0;
+		FH = ((RA & 0x0F) + (r & 0x0F)) > 0x0F;
+		FC = result > 0xFF;
+
+		RA = static_cast<uint8_t>(result);
+		FZ = (RA == 0);
+	}
+	void alu_adc(uint8_t r)
+	{
+		uint8_t carry = FC;
+		uint16_t result = RA + r + carry;
+		FN = 0;
+		FH = ((RA & 0x0F) + (r & 0x0F) + carry) > 0x0F;
+		FC = result > 0xFF;
+
+		RA = static_cast<uint8_t>(result);
+		FZ = (RA == 0);
+	}
+	void alu_sub(uint8_t r)
+	{
+		FN = 1;
+		FH = (RA & 0x0F) < (r & 0x0F);
+		FC = RA < r;
+
+		RA -= r;
+		FZ = (RA == 0);
+	}
+	void alu_sbc(uint8_t r)
+	{
+		uint8_t carry = FC;
+		FN = 1;
+		FH = (RA & 0x0F) < (r & 0x0F) + carry;
+		FC = RA < r + carry;
+
+		RA = static_cast<uint8_t>(RA - r - carry);
+		FZ = (RA == 0);
+	}
+	void alu_and(uint8_t r)
+	{
+		RA &= r;
+		FZ = (RA == 0);
+		FN = 0;
+		FH = 1;
+		FC = 0;
+	}
+	void alu_xor(uint8_t r)
+	{
+		RA ^= r;
+		FZ = (RA == 0);
+		FN = 0;
+		FH = 0;
+		FC = 0;
+	}
+	void alu_cp(uint8_t r)
+	{
+		FZ = (RA == r);
+		FN = 1;
+		FH = (RA & 0x0F) < (r & 0x0F);
+		FC = RA < r;
+	}
+	uint8_t alu_inc(uint8_t r)
+	{
+		++r;
+		FZ = (r == 0);
+		FN = 0;
+		FH = (r & 0x0F) == 0x00;
+		return r;
+	}
+	void alu_add_hl(uint16_t rr)
+	{
+		uint32_t result = RHL + rr;
+		FN = 0;
+		FH = ((RHL & 0x0FFF) + (rr & 0x0FFF)) > 0x0FFF;
+		FC = result > 0xFFFF;
+
+		RHL = static_cast<uint16_t>(result);
+	}
+};
+
+// The lazy flags of cpu_alu.h on the registers the cases use.
+struct Lazy : Alu<Lazy>
+{
+	uint8_t RA;
+	uint8_t RB;
+	uint16_t RHL;
+	uint16_t m_flag_result;
+	uint8_t m_flag_a;
+	uint8_t m_flag_b;
+	bool m_flag_n;
+	uint8_t taken;
+	uint8_t pushed;
+};
+
+uint8_t s_operands[0x100];
+// keeps the results alive
+volatile uint8_t s_sink;
+
+// ns per operation. Every operation is one call through a pointer like an instruction handler of
+// the cores, so the flags are stored as they are in Cpu instead of being optimized away.
+template <typename Regs>
+double alu_ns(void (*step)(Regs&, uint8_t), uint64_t operations, double& host)
+{
+	void (*volatile call)(Regs&, uint8_t) = step;
+	auto run = call;
+	Regs regs{};
+
+	bench::Timer timer;
+	for (uint64_t i = 0; i < operations; i++)
+		run(regs, s_operands[i & 0xFF]);
+	double seconds = timer.seconds();
+
+	uint64_t i = 0;
+	host = host_instructions_per([&] { run(regs, s_operands[i++ & 0xFF]); });
+
+	s_sink = static_cast<uint8_t>(regs.RA ^ regs.RB ^ regs.RHL ^ regs.taken ^ regs.pushed ^ regs.flags());
+	return seconds * 1e9 / operations;
+}
+
+template <typename F>
+void compare_alu(char const* name, uint64_t operations, F f)
+{
+	double eager_host;
+	double lazy_host;
+	double eager = alu_ns<Eager>(f, operations, eager_host);
+	double lazy = alu_ns<Lazy>(f, operations, lazy_host);
+
+	printf("  %-14s %8.2f %8.2f", name, eager, lazy);
+	if (eager_host && lazy_host)
+		printf(" %10.2f %10.2f", eager_host, lazy_host);
+	printf("\n");
+}
+
+}
+
+int bench::flags(int argc, char* argv[])
+{
+	uint64_t instructions = argc >= 1 ? strtoull(argv[0], nullptr, 10) : 20'000'000;
+
+	printf("flags: %llu instructions per opcode, instruction stepped core\n", static_cast<unsigned long long>(instructions));
+	printf("  %-10s %8s", "opcode", "ns");
+	if (s_host_counters)
+		printf(" %8s %10s", "ticks", "host ins");
+	printf("\n");
+
+	for (Case const& c : s_cases)
+	{
+		auto dmg = std::make_unique<Dmg>();
+		dmg->set_execution(Dmg::Execution::Instruction);
+
+		uint8_t* ram = dmg->mem().direct_ram();
+		uint16_t addr = 0x0100;
+		for (uint32_t i = 0; i < 64; i++)
+		{
+			memcpy(ram + addr, c.bytes, c.length);
+			addr += c.length;
+			if (c.bytes[0] == 0xF5)
+				ram[addr++] = 0xF1; // POP AF
+		}
+		ram[addr++] = 0xC3; // JP $0100
+		ram[addr++] = 0x00;
+		ram[addr++] = 0x01;
+		dmg->cpu().invalidate_blocks();
+
+		// warm up
+		for (uint32_t i = 0; i < 100'000; i++)
+			dmg->step();
+
+		Timer timer;
+		uint64_t start = ticks();
+		for (uint64_t i = 0; i < instructions; i++)
+			dmg->step();
+		uint64_t elapsed = ticks() - start;
+		double seconds = timer.seconds();
+
+		printf("  %-10s %8.2f", c.name, seconds * 1e9 / instructions);
+		if (s_host_counters)
+		{
+			printf(" %8.2f", static_cast<double>(elapsed) / instructions);
+			if (double host = host_instructions_per([&] { dmg->step(); }))
+				printf(" %10.2f", host);
+		}
+		printf("\n");
+	}
+
+	// the operations alone, eager flags against lazy ones
+	uint32_t seed = 1;
+	for (uint8_t& operand : s_operands)
+	{
+		seed = seed * 1103515245 + 12345;
+		operand = static_cast<uint8_t>(seed >> 16);
+	}
+
+	printf("\nflags: %llu alu operations, eager flags against lazy ones\n", static_cast<unsigned long long>(instructions));
+	printf("  %-14s %8s %8s", "operation", "eager ns", "lazy ns");
+	if (s_host_counters)
+		printf(" %10s %10s", "eager ins", "lazy ins");
+	printf("\n");
+
+	compare_alu("ADD A,r", instructions, [](auto& r, uint8_t n) { r.alu_add(n); });
+	compare_alu("ADC A,r", instructions, [](auto& r, uint8_t n) { r.alu_adc(n); });
+	compare_alu("SUB r", instructions, [](auto& r, uint8_t n) { r.alu_sub(n); });
+	compare_alu("SBC A,r", instructions, [](auto& r, uint8_t n) { r.alu_sbc(n); });
+	compare_alu("AND r", instructions, [](auto& r, uint8_t n) { r.alu_and(n); });
+	compare_alu("XOR r", instructions, [](auto& r, uint8_t n) { r.alu_xor(n); });
+	compare_alu("CP r", instructions, [](auto& r, uint8_t n) { r.alu_cp(n); });
+	compare_alu("INC r", instructions, [](auto& r, uint8_t n) { r.RB = r.alu_inc(n); });
+	compare_alu("ADD HL,rr", instructions, [](auto& r, uint8_t n) { r.alu_add_hl(static_cast<uint16_t>(n * 0x0101)); });
+	// the flags read back, by a conditional jump and by PUSH AF
+	compare_alu("CP r, JR Z", instructions, [](auto& r, uint8_t n) { r.alu_cp(n); r.taken += r.flag_z(); });
+	compare_alu("ADD A,r, PUSH", instructions, [](auto& r, uint8_t n) { r.alu_add(n); r.pushed = r.flags(); });
+
+	return 0;
+}
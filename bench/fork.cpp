@@ -0,0 +1,188 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+// Forks for a tree search: children forked from one state with different buttons held have to
+// run on exactly like a Dmg loaded from that state, and so do the parent and children forked
+// from a child. Then forks per second and the bytes copied by a fork and by a frame run after
+// it, against loading a save state into every child.
+
+namespace
+{
+
+// MBC1+RAM with 8 KiB of external ram, adding the direction lines into $C000-$DFFF a few
+// pages a frame
+std::vector<uint8_t> make_search_program()
+{
+	constexpr uint8_t s_main[] = {
+		0x21, 0x00, 0xC0, //     ld hl, $c000
+		0x3E, 0x20,       // .loop ld a, $20
+		0xE0, 0x00,       //     ldh ($00), a
+		0xF0, 0x00,       //     ldh a, ($00)
+		0x2F,             //     cpl
+		0xE6, 0x0F,       //     and $0f
+		0x47,             //     ld b, a
+		0x7E,             //     ld a, (hl)
+		0x80,             //     add a, b
+		0x22,             //     ld (hl+), a
+		0x7C,             //     ld a, h
+		0xE6, 0x1F,       //     and $1f
+		0xF6, 0xC0,       //     or $c0
+		0x67,             //     ld h, a
+		0x18, 0xEB,       //     jr .loop
+	};
+	return bench::make_program(0x02, 0x00, 0x02, s_main, sizeof(s_main));
+}
+
+uint8_t buttons(uint32_t child)
+{
+	return static_cast<uint8_t>(Dmg::s_right << (child % 4));
+}
+
+// runs dmg frames with buttons held and checks it against a Dmg loaded from state doing the same
+bool check_run(Dmg& dmg, Dmg::State const& state, std::vector<uint8_t> const& rom, uint8_t held, uint64_t frames,
+	char const* name)
+{
+	auto reference = std::make_unique<Dmg>();
+	reference->insert_cartridge(rom.data(), rom.size());
+	reference->set_execution(dmg.execution());
+	if (!reference->load_state(state))
+		return false;
+
+	dmg.set_buttons(held);
+	reference->set_buttons(held);
+	dmg.run_until(dmg.mem().cycles() + frames * Dmg::s_frame_cycles);
+	reference->run_until(reference->mem().cycles() + frames * Dmg::s_frame_cycles);
+	if (bench::fingerprint(dmg) != bench::fingerprint(*reference))
+	{
+		printf("  %s differs from a Dmg loaded from the same state\n", name);
+		return false;
+	}
+	return true;
+}
+
+}
+
+int bench::fork(int argc, char* argv[])
+{
+	uint32_t count = argc >= 1 ? static_cast<uint32_t>(strtoul(argv[0], nullptr, 10)) : 8;
+	uint32_t rounds = argc >= 2 ? static_cast<uint32_t>(strtoul(argv[1], nullptr, 10)) : 1000;
+	count = std::max(count, 1u);
+
+	printf("fork: %u children, %u rounds\n", count, rounds);
+
+	std::vector<uint8_t> rom = make_search_program();
+	auto state = std::make_unique<Dmg::State>();
+
+	for (Dmg::Execution execution : { Dmg::Execution::Instruction, Dmg::Execution::Block })
+	{
+		auto owner = std::make_unique<Dmg>();
+		Dmg& parent = *owner;
+		parent.insert_cartridge(rom.data(), rom.size());
+		parent.set_execution(execution);
+		parent.run_until(10 * Dmg::s_frame_cycles);
+		parent.save_state(*state);
+
+		std::vector<std::unique_ptr<Dmg>> children;
+		for (uint32_t child = 0; child < count; child++)
+		{
+			children.push_back(std::make_unique<Dmg>());
+			parent.fork(*children.back());
+		}
+		for (uint32_t child = 0; child < count; child++)
+			if (!check_run(*children[child], *state, rom, buttons(child), 5, "a child"))
+				return 1;
+		if (!check_run(parent, *state, rom, Dmg::s_a, 5, "the parent"))
+			return 1;
+
+		// grandchildren, into children that ran before
+		Dmg& child = *children[0];
+		child.save_state(*state);
+		for (uint32_t grandchild = 1; grandchild < count; grandchild++)
+			child.fork(*children[grandchild]);
+		for (uint32_t grandchild = 1; grandchild < count; grandchild++)
+			if (!check_run(*children[grandchild], *state, rom, buttons(grandchild + 1), 5, "a grandchild"))
+				return 1;
+	}
+	printf("  forks ok\n");
+
+	// A search round forks every child from the node and runs it a frame, the children
+	// reused from round to round.
+	auto owner = std::make_unique<Dmg>();
+	Dmg& parent = *owner;
+	parent.insert_cartridge(rom.data(), rom.size());
+	parent.set_execution(Dmg::Execution::Block);
+	parent.run_until(10 * Dmg::s_frame_cycles);
+	std::vector<std::unique_ptr<Dmg>> children;
+	for (uint32_t child = 0; child < count; child++)
+	{
+		children.push_back(std::make_unique<Dmg>());
+		parent.fork(*children.back());
+	}
+
+	auto copied = [&]
+	{
+		uint64_t bytes = parent.mem().copied();
+		for (std::unique_ptr<Dmg> const& child : children)
+			bytes += child->mem().copied();
+		return bytes;
+	};
+
+	double fork_seconds = 0;
+	double run_seconds = 0;
+	uint64_t fork_bytes = 0;
+	uint64_t run_bytes = 0;
+	for (uint32_t round = 0; round < rounds; round++)
+	{
+		// the node moves on a frame every few rounds, its writes are shared again
+		if (round % 8 == 0)
+			parent.run_frame();
+
+		uint64_t before = copied();
+		Timer timer;
+		for (uint32_t child = 0; child < count; child++)
+			parent.fork(*children[child]);
+		fork_seconds += timer.seconds();
+		uint64_t forked = copied();
+		fork_bytes += forked - before;
+
+		Timer run;
+		for (uint32_t child = 0; child < count; child++)
+		{
+			children[child]->set_buttons(buttons(child));
+			children[child]->run_frame();
+		}
+		run_seconds += run.seconds();
+		run_bytes += copied() - forked;
+	}
+
+	double loads_seconds = 0;
+	for (uint32_t round = 0; round < rounds; round++)
+	{
+		if (round % 8 == 0)
+			parent.run_frame();
+
+		Timer timer;
+		parent.save_state(*state);
+		for (uint32_t child = 0; child < count; child++)
+			children[child]->load_state(*state);
+		loads_seconds += timer.seconds();
+
+		for (uint32_t child = 0; child < count; child++)
+		{
+			children[child]->set_buttons(buttons(child));
+			children[child]->run_frame();
+		}
+	}
+
+	double forks = static_cast<double>(rounds) * count;
+	printf("  save and load      %10.0f loads/s  %8zu bytes of state\n", forks / loads_seconds, sizeof(Dmg::State));
+	printf("  fork               %10.0f forks/s  %8.0f bytes copied per fork, %.0f in the frame after it  %5.2fx\n",
+		forks / fork_seconds, fork_bytes / forks, run_bytes / forks, loads_seconds / fork_seconds);
+	printf("  frame after fork   %10.2f us\n", run_seconds / forks * 1e6);
+	return 0;
+}
@@ -0,0 +1,251 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+// Counts how often pairs and triples of instructions run back to back in the roms, the numbers
+// the fusions of the block cache are picked from. Then checks fused blocks against the
+// instruction stepped core in lockstep and compares the speed with and without fusion.
+
+namespace
+{
+
+// opcode, 0x100 | byte1 for the CB prefixed ones
+using Id = uint16_t;
+
+struct Sequence
+{
+	uint32_t key;
+	uint64_t count;
+};
+
+struct Frequencies
+{
+	uint64_t instructions = 0;
+	std::vector<uint64_t> pairs = std::vector<uint64_t>(0x200 * 0x200);
+	std::unordered_map<uint32_t, uint64_t> triples;
+};
+
+// Runs the rom one instruction at a time. A sequence counts when each of its instructions fell
+// through to the next one and none but the last ends a block, as only those can be fused.
+void count(Dmg& dmg, uint64_t m_cycles, Frequencies& frequencies)
+{
+	dmg.set_execution(Dmg::Execution::Instruction);
+	dmg.set_fast_forward(false);
+
+	Mem& mem = dmg.mem();
+	Id history[2] = {};
+	uint8_t fused = 0; // instructions in history that can start or continue a sequence
+	uint16_t expected = 0;
+	uint64_t cycles = 0;
+
+	while (cycles < m_cycles)
+	{
+		uint16_t pc = dmg.cpu().pc();
+		bool halted = dmg.cpu().halted();
+		uint8_t byte0 = mem.read(pc);
+		Id id = byte0 == 0xCB ? 0x100 | mem.read(pc + 1) : byte0;
+
+		if (halted || pc != expected)
+			fused = 0;
+		if (!halted)
+		{
+			++frequencies.instructions;
+			if (fused >= 1)
+				++frequencies.pairs[history[1] << 9 | id];
+			if (fused >= 2)
+				++frequencies.triples[static_cast<uint32_t>(history[0]) << 18 | history[1] << 9 | id];
+
+			history[0] = history[1];
+			history[1] = id;
+			fused = Cpu::ends_block(byte0) ? 0 : std::min<uint8_t>(fused + 1, 2);
+			expected = static_cast<uint16_t>(pc + Cpu::instruction_length(byte0));
+		}
+
+		cycles += dmg.step();
+		if (dmg.cpu().stopped())
+		{
+			dmg.cpu().reset();
+			fused = 0;
+		}
+	}
+}
+
+void print_sequence(uint32_t key, uint8_t length, uint64_t count, uint64_t instructions)
+{
+	printf("    %10llu %6.2f%%  ", static_cast<unsigned long long>(count), 100.0 * count / instructions);
+	for (uint8_t i = 0; i < length; i++)
+	{
+		Id id = key >> 9 * (length - 1 - i) & 0x1FF;
+		printf("%s%s", i ? " / " : "", Cpu::instruction_name(id > 0xFF ? 0xCB : static_cast<uint8_t>(id), id & 0xFF));
+	}
+	printf("\n");
+}
+
+void print_top(char const* name, std::vector<Sequence>& sequences, uint8_t length, uint64_t instructions)
+{
+	static constexpr size_t s_top = 16;
+
+	size_t top = std::min(s_top, sequences.size());
+	std::partial_sort(sequences.begin(), sequences.begin() + top, sequences.end(),
+		[](Sequence const& a, Sequence const& b) { return a.count > b.count; });
+
+	printf("  %s\n", name);
+	for (size_t i = 0; i < top; i++)
+		print_sequence(sequences[i].key, length, sequences[i].count, instructions);
+}
+
+// the sequences of Cpu::BlockCache::s_fusions, operands filled in at random
+struct Idiom
+{
+	uint8_t length;
+	uint8_t code[8];
+};
+
+constexpr Idiom s_idioms[] = {
+	{ 5, { 0x0C, 0x79, 0xB8, 0x20, 0x00 } },
+	{ 5, { 0x0B, 0x78, 0xB1, 0x20, 0x00 } },
+	{ 3, { 0x2A, 0x12, 0x13 } },
+	{ 4, { 0x22, 0x05, 0x20, 0x00 } },
+	{ 6, { 0xF0, 0x00, 0xFE, 0x00, 0x20, 0x00 } },
+	{ 6, { 0xF0, 0x00, 0xFE, 0x00, 0x28, 0x00 } },
+	{ 3, { 0x05, 0x20, 0x00 } },
+	{ 3, { 0x3D, 0x20, 0x00 } },
+	{ 4, { 0xFE, 0x00, 0x38, 0x00 } },
+	{ 4, { 0xE6, 0x00, 0x28, 0x00 } },
+};
+
+// random program with an idiom every few bytes, operands and jump offsets taken from it as well
+void load_idiom_program(Dmg& dmg, uint32_t seed)
+{
+	bench::load_random_program(dmg, seed);
+
+	std::mt19937 random(seed);
+	uint8_t* ram = dmg.mem().direct_ram();
+
+	for (uint32_t addr = 0x0100; addr < 0xFE00; addr += 8 + random() % 8)
+	{
+		Idiom const& idiom = s_idioms[random() % std::size(s_idioms)];
+		for (uint8_t i = 0; i < idiom.length; i++)
+			ram[addr + i] = idiom.code[i] || i == 0 ? idiom.code[i] : ram[random() % 0xFE00];
+	}
+
+	dmg.cpu().invalidate_blocks();
+}
+
+// copies $400 bytes and counts b down from 256, forever
+constexpr uint8_t s_idiom_loop[] = {
+	0x21, 0x00, 0xC0, //     ld hl, $c000
+	0x11, 0x00, 0xD0, //     ld de, $d000
+	0x01, 0x00, 0x04, //     ld bc, $0400
+	0x2A,             // .copy ld a, (hl+)
+	0x12,             //     ld (de), a
+	0x13,             //     inc de
+	0x0B,             //     dec bc
+	0x78,             //     ld a, b
+	0xB1,             //     or c
+	0x20, 0xF8,       //     jr nz, .copy
+	0x06, 0x00,       //     ld b, 0
+	0x05,             // .count dec b
+	0x20, 0xFD,       //     jr nz, .count
+	0xC3, 0x00, 0x01, //     jp $0100
+};
+
+void load(Dmg& dmg, char const* rom)
+{
+	if (rom && strcmp(rom, "idioms") == 0)
+	{
+		memcpy(dmg.mem().direct_ram() + 0x0100, s_idiom_loop, sizeof(s_idiom_loop));
+		dmg.cpu().invalidate_blocks();
+	}
+	else
+		bench::load_rom(dmg, rom);
+}
+
+}
+
+int bench::fusion(int argc, char* argv[])
+{
+	uint64_t m_cycles = argc >= 1 ? strtoull(argv[0], nullptr, 10) : 10'000'000;
+	std::vector<char const*> roms(argv + std::min(argc, 1), argv + argc);
+	if (roms.empty())
+		roms = { nullptr, "idioms" };
+
+	printf("fusion: %zu roms, %llu M-cycles each\n", roms.size(), static_cast<unsigned long long>(m_cycles));
+
+	Frequencies frequencies;
+	for (char const* rom : roms)
+	{
+		auto dmg = std::make_unique<Dmg>();
+		load(*dmg, rom);
+		count(*dmg, m_cycles, frequencies);
+	}
+
+	std::vector<Sequence> pairs;
+	for (uint32_t key = 0; key < frequencies.pairs.size(); key++)
+		if (frequencies.pairs[key])
+			pairs.push_back({ key, frequencies.pairs[key] });
+	std::vector<Sequence> triples;
+	for (auto const& [key, count] : frequencies.triples)
+		triples.push_back({ key, count });
+
+	printf("  %llu instructions\n", static_cast<unsigned long long>(frequencies.instructions));
+	print_top("pairs", pairs, 2, frequencies.instructions);
+	print_top("triples", triples, 3, frequencies.instructions);
+
+	for (char const* rom : roms)
+	{
+		auto reference = std::make_unique<Dmg>();
+		auto candidate = std::make_unique<Dmg>();
+		reference->set_execution(Dmg::Execution::Instruction);
+		candidate->set_execution(Dmg::Execution::Block);
+		load(*reference, rom);
+		load(*candidate, rom);
+		if (!lockstep(*reference, *candidate, 100'000))
+			return 1;
+	}
+	for (uint32_t seed = 1; seed <= 64; seed++)
+	{
+		auto reference = std::make_unique<Dmg>();
+		auto candidate = std::make_unique<Dmg>();
+		reference->set_execution(Dmg::Execution::Instruction);
+		candidate->set_execution(Dmg::Execution::Block);
+		load_idiom_program(*reference, seed);
+		load_idiom_program(*candidate, seed);
+		if (!lockstep(*reference, *candidate, 10'000))
+			return 1;
+	}
+	printf("  lockstep ok\n");
+
+	for (char const* rom : roms)
+	{
+		printf("  %s\n", rom ? rom : "roms/test-loop.z80");
+
+		auto instruction = std::make_unique<Dmg>();
+		auto block = std::make_unique<Dmg>();
+		auto fused = std::make_unique<Dmg>();
+		instruction->set_execution(Dmg::Execution::Instruction);
+		block->set_execution(Dmg::Execution::Block);
+		block->cpu().set_fusion(false);
+		fused->set_execution(Dmg::Execution::Block);
+		load(*instruction, rom);
+		load(*block, rom);
+		load(*fused, rom);
+
+		Result baseline = run_steps(*instruction, m_cycles);
+		print_result("instruction", baseline);
+		print_result("block", run_steps(*block, m_cycles), &baseline);
+		print_result("fused", run_steps(*fused, m_cycles), &baseline);
+		printf("  %llu fused handlers in %llu decoded blocks\n",
+			static_cast<unsigned long long>(fused->cpu().block_stats().fused),
+			static_cast<unsigned long long>(fused->cpu().block_stats().decoded));
+	}
+
+	return 0;
+}
@@ -0,0 +1,189 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+// Programs waiting for the timer interrupt in HALT, in a loop polling a flag the interrupt
+// handler sets and in a loop polling DIV. Checks that skipping HALT and idle loops ends up in
+// the same state as running through them, then compares their speed.
+
+namespace
+{
+
+// timer interrupt every 1024 M-cycles, then the program at $0113
+constexpr uint8_t s_setup[] = {
+	0x31, 0xFE, 0xFF, //     ld sp, $fffe
+	0x3E, 0x04,       //     ld a, $04
+	0xE0, 0xFF,       //     ldh (IE), a
+	0x3E, 0x00,       //     ld a, $00
+	0xE0, 0x06,       //     ldh (TMA), a
+	0x3E, 0x05,       //     ld a, $05
+	0xE0, 0x07,       //     ldh (TAC), a
+	0xAF,             //     xor a
+	0xE0, 0x0F,       //     ldh (IF), a
+	0xFB,             //     ei
+};
+
+struct Program
+{
+	char const* name;
+	uint8_t code[16];
+	uint8_t handler[8]; // at $0050
+};
+
+constexpr Program s_programs[] = {
+	{
+		"halt",
+		{
+			0x76,       // .wait halt
+			0x04,       //     inc b
+			0x18, 0xFC, //     jr .wait
+		},
+		{
+			0x0C,       //     inc c
+			0xD9,       //     reti
+		},
+	},
+	{
+		"poll flag",
+		{
+			0xF0, 0x80, // .wait ldh a, ($80)
+			0xA7,       //     and a
+			0x28, 0xFB, //     jr z, .wait
+			0xAF,       //     xor a
+			0xE0, 0x80, //     ldh ($80), a
+			0x04,       //     inc b
+			0x18, 0xF5, //     jr .wait
+		},
+		{
+			0xF5,       //     push af
+			0x3E, 0x01, //     ld a, 1
+			0xE0, 0x80, //     ldh ($80), a
+			0xF1,       //     pop af
+			0xD9,       //     reti
+		},
+	},
+	{
+		"poll div",
+		{
+			0xF0, 0x04, // .wait ldh a, (DIV)
+			0xFE, 0x80, //     cp $80
+			0x20, 0xFA, //     jr nz, .wait
+			0x04,       //     inc b
+			0xF0, 0x04, // .next ldh a, (DIV)
+			0xFE, 0x80, //     cp $80
+			0x28, 0xFA, //     jr z, .next
+			0x18, 0xF1, //     jr .wait
+		},
+		{
+			0x0C,       //     inc c
+			0xD9,       //     reti
+		},
+	},
+};
+
+void load_program(Dmg& dmg, Program const& program)
+{
+	uint8_t* ram = dmg.mem().direct_ram();
+	memcpy(ram + 0x0100, s_setup, sizeof(s_setup));
+	memcpy(ram + 0x0100 + sizeof(s_setup), program.code, sizeof(program.code));
+	memcpy(ram + 0x0050, program.handler, sizeof(program.handler));
+	dmg.cpu().invalidate_blocks();
+}
+
+// Steps the skipping Dmg and lets the running one catch up to the same M-cycle, which it has
+// to hit exactly with the same registers.
+bool compare(Dmg& skipping, Dmg& running, uint64_t m_cycles)
+{
+	while (skipping.mem().cycles() < m_cycles)
+	{
+		skipping.step();
+		while (running.mem().cycles() < skipping.mem().cycles())
+			running.step();
+
+		Cpu::Registers s = skipping.cpu().registers();
+		Cpu::Registers r = running.cpu().registers();
+
+		if (s != r || skipping.mem().cycles() != running.mem().cycles())
+		{
+			printf("  diverged at M-cycle %llu\n", static_cast<unsigned long long>(running.mem().cycles()));
+			printf("  skipping AF=%04x BC=%04x DE=%04x HL=%04x SP=%04x PC=%04x at %llu\n", s.af, s.bc, s.de, s.hl, s.sp, s.pc,
+				static_cast<unsigned long long>(skipping.mem().cycles()));
+			printf("  running  AF=%04x BC=%04x DE=%04x HL=%04x SP=%04x PC=%04x\n", r.af, r.bc, r.de, r.hl, r.sp, r.pc);
+			return false;
+		}
+	}
+
+	if (memcmp(skipping.mem().direct_ram(), running.mem().direct_ram(), 0x10000) != 0)
+	{
+		printf("  memory diverged\n");
+		return false;
+	}
+	return true;
+}
+
+}
+
+int bench::idle(int argc, char* argv[])
+{
+	uint64_t m_cycles = argc >= 1 ? strtoull(argv[0], nullptr, 10) : 50'000'000;
+
+	printf("idle: %llu M-cycles\n", static_cast<unsigned long long>(m_cycles));
+
+	static constexpr Dmg::Execution s_executions[] = {
+		Dmg::Execution::MCycle,
+		Dmg::Execution::Instruction,
+		Dmg::Execution::Block,
+#ifdef GB_JIT
+		Dmg::Execution::Jit,
+#endif
+#ifdef GB_THREADED
+		Dmg::Execution::Threaded,
+#endif
+	};
+
+	for (Program const& program : s_programs)
+	{
+		for (Dmg::Execution execution : s_executions)
+		{
+			auto skipping = std::make_unique<Dmg>();
+			auto running = std::make_unique<Dmg>();
+			skipping->set_execution(execution);
+			running->set_execution(Dmg::Execution::Instruction);
+			running->set_fast_forward(false);
+			load_program(*skipping, program);
+			load_program(*running, program);
+			if (!compare(*skipping, *running, 1'000'000))
+			{
+				printf("  %s diverged with execution %d\n", program.name, static_cast<int>(execution));
+				return 1;
+			}
+		}
+	}
+	printf("  skipping ok\n");
+
+	for (Program const& program : s_programs)
+	{
+		auto skipping = std::make_unique<Dmg>();
+		auto running = std::make_unique<Dmg>();
+		skipping->set_execution(Dmg::Execution::Instruction);
+		running->set_execution(Dmg::Execution::Instruction);
+		running->set_fast_forward(false);
+		load_program(*skipping, program);
+		load_program(*running, program);
+
+		printf("  %s\n", program.name);
+		Result run = run_steps(*running, m_cycles);
+		print_result("running", run);
+		print_result("skipping", run_steps(*skipping, m_cycles), &run);
+
+		Dmg::IdleStats stats = skipping->idle_stats();
+		printf("  %llu M-cycles skipped in HALT, %llu in %llu idle loops\n",
+			static_cast<unsigned long long>(stats.halted), static_cast<unsigned long long>(stats.idle_loops),
+			static_cast<unsigned long long>(stats.skips));
+	}
+
+	return 0;
+}
@@ -0,0 +1,121 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Runs many Dmg instances side by side and checks each ends in the same state as when it runs
+// alone. Every instance gets its own loop count and cycles through the execution modes, so
+// any state shared between instances shows up as a mismatch.
+
+namespace
+{
+
+struct Instance
+{
+	std::unique_ptr<Dmg> dmg;
+	Cpu::Registers registers;
+	uint64_t memory_hash;
+};
+
+// ld hl,$C000 / ld b,n / .loop ld a,b / ld (hl+),a / push bc / pop de / dec b / jr nz,.loop / halt
+void load_program(Dmg& dmg, uint8_t n)
+{
+	uint8_t const program[] = { 0x21, 0x00, 0xC0, 0x06, n, 0x78, 0x22, 0xC5, 0xD1, 0x05, 0x20, 0xF9, 0x76 };
+	memcpy(dmg.mem().direct_ram() + 0x0100, program, sizeof(program));
+}
+
+std::unique_ptr<Dmg> make_instance(size_t i)
+{
+	auto dmg = std::make_unique<Dmg>();
+
+	switch (i % 3)
+	{
+		case 0: dmg->cpu().set_dispatch(Cpu::Dispatch::Switch); break;
+		case 1: dmg->cpu().set_dispatch(Cpu::Dispatch::Table); break;
+		case 2: dmg->set_execution(Dmg::Execution::Instruction); break;
+	}
+
+	load_program(*dmg, static_cast<uint8_t>(1 + i % 251));
+	return dmg;
+}
+
+uint64_t hash_memory(Dmg& dmg)
+{
+	// FNV-1a
+	uint64_t hash = 0xcbf29ce484222325;
+	uint8_t const* ram = dmg.mem().direct_ram();
+	for (uint32_t addr = 0; addr < 0x10000; addr++)
+		hash = (hash ^ ram[addr]) * 0x100000001b3;
+	return hash;
+}
+
+void step_instance(Dmg& dmg)
+{
+	(void)dmg.step();
+	if (dmg.cpu().stopped())
+		dmg.cpu().reset();
+}
+
+// round robin, one instruction per instance per round
+void run_interleaved(std::vector<Instance>& instances, size_t begin, size_t end, uint64_t steps)
+{
+	for (uint64_t s = 0; s < steps; s++)
+		for (size_t i = begin; i < end; i++)
+			step_instance(*instances[i].dmg);
+}
+
+}
+
+int bench::instances(int argc, char* argv[])
+{
+	size_t count = argc >= 1 ? strtoull(argv[0], nullptr, 10) : 256;
+	size_t threads = argc >= 2 ? strtoull(argv[1], nullptr, 10) : std::max(1u, std::thread::hardware_concurrency());
+	uint64_t steps = argc >= 3 ? strtoull(argv[2], nullptr, 10) : 20'000;
+
+	printf("instances: %zu instances on %zu threads, %llu instructions each\n", count, threads, static_cast<unsigned long long>(steps));
+
+	// expected state of every instance running alone
+	std::vector<Instance> expected(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		auto dmg = make_instance(i);
+		for (uint64_t s = 0; s < steps; s++)
+			step_instance(*dmg);
+
+		expected[i].registers = dmg->cpu().registers();
+		expected[i].memory_hash = hash_memory(*dmg);
+	}
+
+	std::vector<Instance> instances(count);
+	for (size_t i = 0; i < count; i++)
+		instances[i].dmg = make_instance(i);
+
+	Timer timer;
+	std::vector<std::thread> workers;
+	for (size_t t = 0; t < threads; t++)
+		workers.emplace_back(run_interleaved, std::ref(instances), count * t / threads, count * (t + 1) / threads, steps);
+	for (std::thread& worker : workers)
+		worker.join();
+	double seconds = timer.seconds();
+
+	size_t mismatches = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		Cpu::Registers r = instances[i].dmg->cpu().registers();
+		Cpu::Registers const& e = expected[i].registers;
+
+		if (r != e || hash_memory(*instances[i].dmg) != expected[i].memory_hash)
+		{
+			if (mismatches++ < 8)
+				printf("  instance %zu: AF=%04x BC=%04x DE=%04x HL=%04x SP=%04x PC=%04x, expected AF=%04x BC=%04x DE=%04x HL=%04x SP=%04x PC=%04x\n",
+					i, r.af, r.bc, r.de, r.hl, r.sp, r.pc, e.af, e.bc, e.de, e.hl, e.sp, e.pc);
+		}
+	}
+
+	printf("  %zu/%zu instances independent, %.0f instructions/s\n", count - mismatches, count, count * steps / seconds);
+	return mismatches == 0 ? 0 : 1;
+}
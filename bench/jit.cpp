@@ -0,0 +1,66 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+// Checks the x86-64 translation against the instruction stepped core in lockstep, on the rom and
+// on random programs that keep writing over their own code, then compares it with the
+// interpreters. Only built by the bench-jit target.
+
+static void print_stats(Cpu::JitStats const& stats)
+{
+	printf("  jit: %llu translated, %llu invalidated, %llu instructions inline, %llu called, %llu bytes\n",
+		static_cast<unsigned long long>(stats.translated), static_cast<unsigned long long>(stats.invalidated),
+		static_cast<unsigned long long>(stats.native), static_cast<unsigned long long>(stats.called),
+		static_cast<unsigned long long>(stats.code_bytes));
+}
+
+int bench::jit(int argc, char* argv[])
+{
+	char const* rom = argc >= 1 ? argv[0] : nullptr;
+	uint64_t m_cycles = argc >= 2 ? strtoull(argv[1], nullptr, 10) : 50'000'000;
+
+	printf("jit: %s, %llu M-cycles\n", rom ? rom : "roms/test-loop.z80", static_cast<unsigned long long>(m_cycles));
+
+	auto reference = std::make_unique<Dmg>();
+	auto candidate = std::make_unique<Dmg>();
+	reference->set_execution(Dmg::Execution::Instruction);
+	candidate->set_execution(Dmg::Execution::Jit);
+
+	load_rom(*reference, rom);
+	load_rom(*candidate, rom);
+	if (!lockstep(*reference, *candidate, 100'000))
+		return 1;
+
+	for (uint32_t seed = 1; seed <= 64; seed++)
+	{
+		reference->cpu().reset();
+		candidate->cpu().reset();
+		load_random_program(*reference, seed);
+		load_random_program(*candidate, seed);
+		if (!lockstep(*reference, *candidate, 10'000))
+			return 1;
+	}
+	printf("  lockstep ok\n");
+	print_stats(candidate->cpu().jit_stats());
+
+	Result baseline {};
+	for (Dmg::Execution execution : { Dmg::Execution::Instruction, Dmg::Execution::Block, Dmg::Execution::Jit })
+	{
+		static char const* const s_names[] = { "m-cycle", "instruction", "block", "jit" };
+
+		auto dmg = std::make_unique<Dmg>();
+		dmg->set_execution(execution);
+		load_rom(*dmg, rom);
+
+		Result result = run_steps(*dmg, m_cycles);
+		print_result(s_names[static_cast<int>(execution)], result, execution == Dmg::Execution::Instruction ? nullptr : &baseline);
+		if (execution == Dmg::Execution::Instruction)
+			baseline = result;
+		if (execution == Dmg::Execution::Jit)
+			print_stats(dmg->cpu().jit_stats());
+	}
+
+	return 0;
+}
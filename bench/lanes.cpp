@@ -0,0 +1,195 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "lanes.h"
+
+// The lockstep core against Dmgs run one by one. First random programs with different
+// registers in every lane, checked against the instruction stepped core every few hundred
+// M-cycles, then copies of a rom reading the joypad with different buttons held in every lane:
+// emulated MHz of all lanes together against running them one after the other.
+
+namespace
+{
+
+// adds the direction lines into $C000-$DFFF and branches on the right button, so the lanes
+// holding it run apart and meet again
+std::vector<uint8_t> make_joypad_program()
+{
+	constexpr uint8_t s_main[] = {
+		0x21, 0x00, 0xC0, //     ld hl, $c000
+		0x3E, 0x20,       // .loop ld a, $20
+		0xE0, 0x00,       //     ldh ($00), a
+		0xF0, 0x00,       //     ldh a, ($00)
+		0x2F,             //     cpl
+		0xE6, 0x0F,       //     and $0f
+		0x47,             //     ld b, a
+		0xCB, 0x40,       //     bit 0, b
+		0x28, 0x02,       //     jr z, .still
+		0x0C,             //     inc c
+		0x0C,             //     inc c
+		0x16, 0x08,       // .still ld d, 8
+		0xCB, 0x03,       // .mix rlc e
+		0x7B,             //     ld a, e
+		0xA8,             //     xor b
+		0x81,             //     add a, c
+		0x5F,             //     ld e, a
+		0x15,             //     dec d
+		0x20, 0xF8,       //     jr nz, .mix
+		0x86,             //     add a, (hl)
+		0x22,             //     ld (hl+), a
+		0x7C,             //     ld a, h
+		0xE6, 0x1F,       //     and $1f
+		0xF6, 0xC0,       //     or $c0
+		0x67,             //     ld h, a
+		0x18, 0xDD,       //     jr .loop
+	};
+	return bench::make_program(0x00, 0x00, 0x00, s_main, sizeof(s_main));
+}
+
+// the same random program in every lane, with registers of their own
+void load_random_lane(Dmg& dmg, uint32_t lane)
+{
+	bench::load_random_program(dmg, 0x1A2E5);
+
+	std::mt19937 random(lane);
+	Dmg::State state;
+	dmg.save_state(state);
+	state.cpu.af = static_cast<uint16_t>(random());
+	state.cpu.flag_result = static_cast<uint16_t>(random() & 0x1FF);
+	state.cpu.flag_a = static_cast<uint8_t>(random());
+	state.cpu.flag_b = static_cast<uint8_t>(random());
+	state.cpu.flag_n = random() & 1;
+	state.cpu.bc = static_cast<uint16_t>(random());
+	state.cpu.de = static_cast<uint16_t>(random());
+	state.cpu.hl = static_cast<uint16_t>(random());
+	state.cpu.sp = static_cast<uint16_t>(random());
+	// a few lanes start elsewhere
+	if (lane % 4 == 3)
+		state.cpu.pc = static_cast<uint16_t>(random());
+	dmg.load_state(state);
+}
+
+bool check_random(uint32_t count, uint32_t chunks)
+{
+	Lanes lanes(count);
+	std::vector<std::unique_ptr<Dmg>> references;
+	for (uint32_t lane = 0; lane < count; lane++)
+	{
+		load_random_lane(lanes.dmg(lane), lane);
+		references.push_back(std::make_unique<Dmg>());
+		references.back()->set_execution(Dmg::Execution::Instruction);
+		references.back()->set_fast_forward(false);
+		load_random_lane(*references.back(), lane);
+	}
+
+	uint64_t end = 0;
+	for (uint32_t chunk = 0; chunk < chunks; chunk++)
+	{
+		end += 331;
+		lanes.run_until(end);
+		for (uint32_t lane = 0; lane < count; lane++)
+		{
+			references[lane]->run_until(end);
+			if (bench::fingerprint(lanes.dmg(lane)) != bench::fingerprint(*references[lane]))
+			{
+				Cpu::Registers l = lanes.dmg(lane).cpu().registers();
+				Cpu::Registers r = references[lane]->cpu().registers();
+				printf("  %u lanes: lane %u differs before M-cycle %llu\n", count, lane, static_cast<unsigned long long>(end));
+				printf("    lanes     af %04X bc %04X de %04X hl %04X sp %04X pc %04X cycles %llu\n", l.af, l.bc, l.de, l.hl,
+					l.sp, l.pc, static_cast<unsigned long long>(lanes.dmg(lane).mem().cycles()));
+				printf("    reference af %04X bc %04X de %04X hl %04X sp %04X pc %04X cycles %llu\n", r.af, r.bc, r.de, r.hl,
+					r.sp, r.pc, static_cast<unsigned long long>(references[lane]->mem().cycles()));
+				return false;
+			}
+		}
+	}
+
+	Lanes::Stats stats = lanes.stats();
+	printf("  %2u lanes, random programs: %5.2f lanes per group, %llu of %llu instructions stepped\n", count,
+		static_cast<double>(stats.grouped) / stats.groups, static_cast<unsigned long long>(stats.stepped),
+		static_cast<unsigned long long>(stats.grouped + stats.stepped));
+	return true;
+}
+
+}
+
+int bench::lanes(int argc, char* argv[])
+{
+	uint32_t count = argc >= 1 ? static_cast<uint32_t>(strtoul(argv[0], nullptr, 10)) : Lanes::s_max_lanes;
+	uint64_t frames = argc >= 2 ? strtoull(argv[1], nullptr, 10) : 60;
+	count = std::clamp(count, 1u, Lanes::s_max_lanes);
+
+	printf("lanes: %u lanes, %llu frames\n", count, static_cast<unsigned long long>(frames));
+
+	for (uint32_t lanes : { 1u, count / 2, count })
+		if (lanes && !check_random(lanes, 200))
+			return 1;
+
+	std::vector<uint8_t> rom = make_joypad_program();
+	uint64_t end = frames * Dmg::s_frame_cycles;
+	auto buttons = [](uint32_t lane) { return static_cast<uint8_t>(lane * 0x35); };
+
+	// one after the other, each core on its own
+	std::vector<uint64_t> expected(count);
+	double seconds[2] = {};
+	Dmg::Execution const executions[2] = { Dmg::Execution::Instruction, Dmg::Execution::Block };
+	for (uint32_t e = 0; e < 2; e++)
+	{
+		std::vector<std::unique_ptr<Dmg>> dmgs;
+		for (uint32_t lane = 0; lane < count; lane++)
+		{
+			dmgs.push_back(std::make_unique<Dmg>());
+			dmgs.back()->insert_cartridge(rom.data(), rom.size());
+			dmgs.back()->set_execution(executions[e]);
+			dmgs.back()->set_buttons(buttons(lane));
+		}
+
+		Timer timer;
+		for (std::unique_ptr<Dmg>& dmg : dmgs)
+			dmg->run_until(end);
+		seconds[e] = timer.seconds();
+
+		// the block cache ends on block boundaries, only the instruction stepped core ends where
+		// the lanes have to
+		if (executions[e] == Dmg::Execution::Instruction)
+			for (uint32_t lane = 0; lane < count; lane++)
+				expected[lane] = bench::fingerprint(*dmgs[lane]);
+	}
+
+	Lanes lanes(count);
+	for (uint32_t lane = 0; lane < count; lane++)
+	{
+		lanes.dmg(lane).insert_cartridge(rom.data(), rom.size());
+		lanes.dmg(lane).set_buttons(buttons(lane));
+	}
+	Timer timer;
+	lanes.run_until(end);
+	double lockstep = timer.seconds();
+
+	for (uint32_t lane = 0; lane < count; lane++)
+	{
+		if (bench::fingerprint(lanes.dmg(lane)) != expected[lane])
+		{
+			printf("  lane %u of the joypad rom ends elsewhere\n", lane);
+			return 1;
+		}
+	}
+	printf("  lanes ok\n");
+
+	double m_cycles = static_cast<double>(end) * count;
+	Lanes::Stats stats = lanes.stats();
+	printf("  %2u lanes, joypad rom: %5.2f lanes per group, %llu of %llu instructions stepped\n", count,
+		static_cast<double>(stats.grouped) / stats.groups, static_cast<unsigned long long>(stats.stepped),
+		static_cast<unsigned long long>(stats.grouped + stats.stepped));
+	printf("  one by one, instruction %8.2f emulated MHz\n", m_cycles * 4 / seconds[0] / 1e6);
+	printf("  one by one, block       %8.2f emulated MHz\n", m_cycles * 4 / seconds[1] / 1e6);
+	printf("  lockstep                %8.2f emulated MHz  %5.2fx instruction  %5.2fx block\n", m_cycles * 4 / lockstep / 1e6,
+		seconds[0] / lockstep, seconds[1] / lockstep);
+	return 0;
+}
@@ -0,0 +1,307 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <vector>
+
+// Cost of a single memory access: a plain array load or store as the floor, Mem::read() and
+// Mem::write() through the page table, and the bus handshake of the M-cycle core where the
+// cpu puts the address on the bus and Mem::clock() answers it. Then checks the mappers on
+// generated roms and times switching banks.
+
+namespace
+{
+
+struct Case
+{
+	char const* name;
+	uint16_t base;
+	uint16_t mask;
+};
+
+// addresses drawn at random from base to base + mask
+constexpr Case s_cases[] = {
+	{ "rom", 0x0000, 0x7FFF },
+	{ "wram", 0xC000, 0x1FFF },
+	{ "hram", 0xFF80, 0x007E },
+	{ "div", 0xFF04, 0x0000 },
+};
+
+struct Bench
+{
+	Cartridge cartridge;
+	Bus bus;
+	Mem mem{ bus };
+};
+
+uint16_t bank_at(Mem& mem, uint16_t addr)
+{
+	return mem.read(addr) | mem.read(addr + 1) << 8;
+}
+
+struct Check
+{
+	char const* name;
+	uint32_t got;
+	uint32_t expected;
+};
+
+bool check_mappers()
+{
+	auto bench = std::make_unique<Bench>();
+	Mem& mem = bench->mem;
+	std::vector<Check> checks;
+
+	// MBC1, 1 MiB rom and 32 KiB ram
+	std::vector<uint8_t> mbc1 = bench::make_rom(0x03, 0x05, 0x03);
+	bench->cartridge.map(mbc1.data(), mbc1.size());
+	mem.map_cartridge(&bench->cartridge);
+	checks.push_back({ "mbc1 initial bank", bank_at(mem, 0x4000), 1 });
+	mem.write(0x2000, 0x05);
+	checks.push_back({ "mbc1 bank 5", bank_at(mem, 0x4000), 5 });
+	mem.write(0x2000, 0x00);
+	checks.push_back({ "mbc1 bank 0 selects 1", bank_at(mem, 0x4000), 1 });
+	mem.write(0x4000, 0x01);
+	checks.push_back({ "mbc1 upper bits", bank_at(mem, 0x4000), 0x21 });
+	checks.push_back({ "mbc1 mode 0 bank 0", bank_at(mem, 0x0000), 0 });
+	mem.write(0x6000, 0x01);
+	checks.push_back({ "mbc1 mode 1 bank 0", bank_at(mem, 0x0000), 0x20 });
+	checks.push_back({ "mbc1 ram disabled", mem.read(0xA000), 0xFF });
+	mem.write(0x0000, 0x0A);
+	mem.write(0xA000, 0x42);
+	mem.write(0x4000, 0x00);
+	mem.write(0xA000, 0x17);
+	mem.write(0x4000, 0x01);
+	checks.push_back({ "mbc1 ram bank 1", mem.read(0xA000), 0x42 });
+	mem.write(0x4000, 0x00);
+	checks.push_back({ "mbc1 ram bank 0", mem.read(0xA000), 0x17 });
+
+	// MBC2, 256 KiB rom
+	std::vector<uint8_t> mbc2 = bench::make_rom(0x06, 0x03, 0x00);
+	bench->cartridge.map(mbc2.data(), mbc2.size());
+	mem.map_cartridge(&bench->cartridge);
+	mem.write(0x2100, 0x03);
+	checks.push_back({ "mbc2 bank 3", bank_at(mem, 0x4000), 3 });
+	mem.write(0x2000, 0x07);
+	checks.push_back({ "mbc2 ram enable ignores bank", bank_at(mem, 0x4000), 3 });
+	mem.write(0x0000, 0x0A);
+	mem.write(0xA001, 0x12);
+	checks.push_back({ "mbc2 half bytes", mem.read(0xA001), 0xF2 });
+	checks.push_back({ "mbc2 echo", mem.read(0xA201), 0xF2 });
+
+	// MBC3, 2 MiB rom, 32 KiB ram and the clock
+	std::vector<uint8_t> mbc3 = bench::make_rom(0x10, 0x06, 0x03);
+	bench->cartridge.map(mbc3.data(), mbc3.size());
+	mem.map_cartridge(&bench->cartridge);
+	mem.write(0x2000, 0x45);
+	checks.push_back({ "mbc3 bank $45", bank_at(mem, 0x4000), 0x45 });
+	mem.write(0x0000, 0x0A);
+	mem.write(0x4000, 0x02);
+	mem.write(0xA000, 0x33);
+	mem.write(0x4000, 0x08);
+	mem.add_cycles(uint64_t(61) << 20);
+	mem.write(0x6000, 0x00);
+	mem.write(0x6000, 0x01);
+	checks.push_back({ "mbc3 clock seconds", mem.read(0xA000), 1 });
+	mem.write(0x4000, 0x09);
+	checks.push_back({ "mbc3 clock minutes", mem.read(0xA000), 1 });
+	mem.write(0x4000, 0x02);
+	checks.push_back({ "mbc3 ram bank 2", mem.read(0xA000), 0x33 });
+
+	// MBC5, 8 MiB rom and 128 KiB ram
+	std::vector<uint8_t> mbc5 = bench::make_rom(0x1B, 0x08, 0x04);
+	bench->cartridge.map(mbc5.data(), mbc5.size());
+	mem.map_cartridge(&bench->cartridge);
+	mem.write(0x2000, 0x34);
+	mem.write(0x3000, 0x01);
+	checks.push_back({ "mbc5 bank $134", bank_at(mem, 0x4000), 0x134 });
+	mem.write(0x2000, 0x00);
+	mem.write(0x3000, 0x00);
+	checks.push_back({ "mbc5 bank 0", bank_at(mem, 0x4000), 0 });
+	checks.push_back({ "mbc5 block cache bank", mem.bank(0x4000), 0 });
+
+	mem.map_cartridge(nullptr);
+
+	bool ok = true;
+	for (Check const& check : checks)
+	{
+		if (check.got != check.expected)
+		{
+			printf("  %s: $%x, $%x expected\n", check.name, check.got, check.expected);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+// Bank 0 calls $4000 in banks 1 to 15 in turn, each of which switches to the next bank in
+// the middle of a block and carries on in it with a different opcode.
+std::vector<uint8_t> make_banked_program()
+{
+	constexpr uint8_t s_main[] = {
+		0x0E, 0x01,       //     ld c, 1
+		0x79,             // .loop ld a, c
+		0xEA, 0x00, 0x20, //     ld ($2000), a
+		0xCD, 0x00, 0x40, //     call $4000
+		0x79,             //     ld a, c
+		0xE6, 0x0F,       //     and $0f
+		0x3C,             //     inc a
+		0x4F,             //     ld c, a
+		0x18, 0xF2,       //     jr .loop
+	};
+	std::vector<uint8_t> rom = bench::make_program(0x19, 0x03, 0x00, s_main, sizeof(s_main));
+
+	for (uint32_t bank = 1; bank < 16; bank++)
+	{
+		uint8_t* code = rom.data() + bank * 0x4000;
+		uint8_t next = static_cast<uint8_t>(bank % 15 + 1);
+		uint8_t const routine[] = {
+			0x3E, next,                                // ld a, next
+			0x14,                                      // inc d
+			0xEA, 0x00, 0x20,                          // ld ($2000), a
+			static_cast<uint8_t>(bank & 1 ? 0x16 : 0x1E), static_cast<uint8_t>(bank), // ld d or e, bank
+			0xC9,                                      // ret
+		};
+		std::copy(std::begin(routine), std::end(routine), code);
+	}
+	return rom;
+}
+
+void print(char const* name, uint64_t accesses, double seconds, double const* baseline)
+{
+	printf("    %-12s %8.2f M/s %6.2f ns", name, accesses / seconds / 1e6, seconds * 1e9 / accesses);
+	if (baseline)
+		printf("  %5.2fx", *baseline / seconds);
+	printf("\n");
+}
+
+}
+
+int bench::memory(int argc, char* argv[])
+{
+	uint64_t accesses = argc >= 1 ? strtoull(argv[0], nullptr, 10) : 100'000'000;
+
+	printf("memory: %llu accesses\n", static_cast<unsigned long long>(accesses));
+
+	auto bench = std::make_unique<Bench>();
+	Mem& mem = bench->mem;
+	Bus& bus = bench->bus;
+	uint8_t* ram = mem.direct_ram();
+
+	std::mt19937 random(1);
+	for (uint32_t addr = 0; addr < 0x10000; addr++)
+		ram[addr] = static_cast<uint8_t>(random());
+
+	std::vector<uint16_t> addrs(4096);
+	uint32_t sum = 0;
+
+	for (Case const& c : s_cases)
+	{
+		for (uint16_t& addr : addrs)
+			addr = static_cast<uint16_t>(c.base + (random() & c.mask));
+
+		printf("  %s reads\n", c.name);
+
+		Timer array_timer;
+		for (uint64_t i = 0; i < accesses; i++)
+			sum += ram[addrs[i & 0xFFF]];
+		double array = array_timer.seconds();
+		print("array", accesses, array, nullptr);
+
+		Timer table_timer;
+		for (uint64_t i = 0; i < accesses; i++)
+			sum += mem.read(addrs[i & 0xFFF]);
+		print("page table", accesses, table_timer.seconds(), &array);
+
+		Timer bus_timer;
+		for (uint64_t i = 0; i < accesses; i++)
+		{
+			bus.write_addr(addrs[i & 0xFFF]);
+			mem.clock();
+			sum += bus.read_data();
+		}
+		print("bus", accesses, bus_timer.seconds(), &array);
+	}
+
+	// stores stay away from the I/O page, writing its registers has side effects
+	for (uint16_t& addr : addrs)
+		addr = static_cast<uint16_t>(0xC000 + (random() & 0x1FFF));
+
+	printf("  wram writes\n");
+
+	Timer array_timer;
+	for (uint64_t i = 0; i < accesses; i++)
+		ram[addrs[i & 0xFFF]] = static_cast<uint8_t>(i);
+	double array = array_timer.seconds();
+	print("array", accesses, array, nullptr);
+
+	Timer table_timer;
+	for (uint64_t i = 0; i < accesses; i++)
+		mem.write(addrs[i & 0xFFF], static_cast<uint8_t>(i));
+	print("page table", accesses, table_timer.seconds(), &array);
+
+	Timer bus_timer;
+	for (uint64_t i = 0; i < accesses; i++)
+	{
+		bus.write_addr(addrs[i & 0xFFF]);
+		bus.write_data(static_cast<uint8_t>(i));
+		mem.clock();
+	}
+	print("bus", accesses, bus_timer.seconds(), &array);
+
+	if (!check_mappers())
+		return 1;
+
+	// reference and candidate, the M-cycle core can only be the reference
+	static constexpr Dmg::Execution s_pairs[][2] = {
+		{ Dmg::Execution::MCycle, Dmg::Execution::Instruction },
+		{ Dmg::Execution::Instruction, Dmg::Execution::Block },
+#ifdef GB_JIT
+		{ Dmg::Execution::Instruction, Dmg::Execution::Jit },
+#endif
+#ifdef GB_THREADED
+		{ Dmg::Execution::Instruction, Dmg::Execution::Threaded },
+#endif
+	};
+
+	std::vector<uint8_t> program = make_banked_program();
+	for (auto const& pair : s_pairs)
+	{
+		auto reference = std::make_unique<Dmg>();
+		auto candidate = std::make_unique<Dmg>();
+		reference->set_execution(pair[0]);
+		candidate->set_execution(pair[1]);
+		reference->insert_cartridge(program.data(), program.size());
+		candidate->insert_cartridge(program.data(), program.size());
+		if (!lockstep(*reference, *candidate, 100'000))
+		{
+			printf("  banked code diverged with execution %d\n", static_cast<int>(pair[1]));
+			return 1;
+		}
+	}
+	printf("  mappers ok\n");
+
+	// every switch repoints $4000-$7FFF and ends the block being run
+	std::vector<uint8_t> rom = make_rom(0x19, 0x08, 0x00);
+	bench->cartridge.map(rom.data(), rom.size());
+	mem.map_cartridge(&bench->cartridge);
+
+	printf("  mbc5 bank switches\n");
+	Timer switch_timer;
+	for (uint64_t i = 0; i < accesses; i++)
+	{
+		mem.write(0x2000, static_cast<uint8_t>(i));
+		sum += mem.read(0x4000);
+	}
+	print("switch+read", accesses, switch_timer.seconds(), nullptr);
+	mem.map_cartridge(nullptr);
+
+	// keeps the loads from being optimized away
+	printf("  checksum %08x\n", sum);
+
+	return 0;
+}
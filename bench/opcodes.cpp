@@ -0,0 +1,63 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <memory>
+
+// Checks the cores instantiated from the opcode specification, the dispatch table and the
+// instruction stepped core, against the hand written opcode switch in lockstep, on the rom and
+// on random programs covering every opcode.
+
+static bool check(char const* name, Cpu::Dispatch dispatch, Dmg::Execution execution, char const* rom)
+{
+	auto reference = std::make_unique<Dmg>();
+	auto candidate = std::make_unique<Dmg>();
+	reference->cpu().set_dispatch(Cpu::Dispatch::Switch);
+	candidate->cpu().set_dispatch(dispatch);
+	candidate->set_execution(execution);
+
+	bench::load_rom(*reference, rom);
+	bench::load_rom(*candidate, rom);
+	if (!bench::lockstep(*reference, *candidate, 100'000))
+		return false;
+
+	for (uint32_t seed = 1; seed <= 64; seed++)
+	{
+		reference->cpu().reset();
+		candidate->cpu().reset();
+		bench::load_random_program(*reference, seed);
+		bench::load_random_program(*candidate, seed);
+		if (!bench::lockstep(*reference, *candidate, 10'000))
+			return false;
+	}
+
+	printf("  %-12s lockstep ok\n", name);
+	return true;
+}
+
+int bench::opcodes(int argc, char* argv[])
+{
+	char const* rom = argc >= 1 ? argv[0] : nullptr;
+
+	printf("opcodes: %s\n", rom ? rom : "roms/test-loop.z80");
+
+	if (!check("table", Cpu::Dispatch::Table, Dmg::Execution::MCycle, rom)
+		|| !check("instruction", Cpu::Dispatch::Table, Dmg::Execution::Instruction, rom))
+		return 1;
+
+	// the first instructions of the rom as the specification names them
+	auto dmg = std::make_unique<Dmg>();
+	load_rom(*dmg, rom);
+	uint8_t const* ram = dmg->mem().direct_ram();
+
+	for (uint32_t i = 0, addr = 0x0100; i < 8; i++)
+	{
+		uint8_t length = Cpu::instruction_length(ram[addr]);
+		printf("  $%04x:", addr);
+		for (uint8_t b = 0; b < 3; b++)
+			b < length ? printf(" %02X", ram[addr + b]) : printf("   ");
+		printf("  %s\n", Cpu::instruction_name(ram[addr], ram[addr + 1]));
+		addr += length;
+	}
+
+	return 0;
+}
@@ -0,0 +1,635 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Both PPU engines on a rom scrolling background and window and moving 40 sprites of both
+// palettes, flipped and behind the background, and changing a tile every VBlank. LY, STAT and the LYC interrupt are
+// checked through a frame, the length of mode 3 in the FIFO engine against the penalties of
+// scrolling, window and sprites, and each frame against a plain renderer testing every pixel's
+// bits, also with the engine switched during a line and a state loaded into the other engine.
+// Frames left undrawn have to leave LY, STAT, the interrupts and the rom the same. Then the
+// share of tile rows the scanline engine takes from its cache of decoded tiles, frames per
+// second of the whole Dmg drawing with either engine against that renderer drawing alone, and
+// drawing every 4th frame or none against drawing all of them.
+
+namespace
+{
+
+// waits for VBlank and runs the handler, from $0200
+std::vector<uint8_t> make_vblank_program(uint8_t const* handler, size_t size)
+{
+	constexpr uint8_t s_main[] = {
+		0x3E, 0x01,       //     ld a, $01
+		0xE0, 0xFF,       //     ldh ($ff), a
+		0xFB,             //     ei
+		0x76,             // .loop halt
+		0x18, 0xFD,       //     jr .loop
+	};
+	std::vector<uint8_t> rom = bench::make_program(0x00, 0x00, 0x00, s_main, sizeof(s_main));
+	rom[0x0040] = 0xC3; // jp $0200
+	rom[0x0041] = 0x00;
+	rom[0x0042] = 0x02;
+	std::copy(handler, handler + size, rom.begin() + 0x0200);
+	return rom;
+}
+
+std::vector<uint8_t> make_scroll_program()
+{
+	constexpr uint8_t s_vblank[] = {
+		0xF0, 0x43,       //     ldh a, ($43)
+		0x3C,             //     inc a
+		0xE0, 0x43,       //     ldh ($43), a
+		0xF0, 0x42,       //     ldh a, ($42)
+		0x3D,             //     dec a
+		0xE0, 0x42,       //     ldh ($42), a
+		0x21, 0x01, 0xFE, //     ld hl, $fe01
+		0x06, 0x28,       //     ld b, 40
+		0x34,             // .sprite inc (hl)
+		0x7D,             //     ld a, l
+		0xC6, 0x04,       //     add a, 4
+		0x6F,             //     ld l, a
+		0x05,             //     dec b
+		0x20, 0xF8,       //     jr nz, .sprite
+		0xF0, 0x4B,       //     ldh a, ($4b)
+		0x3C,             //     inc a
+		0xE6, 0x7F,       //     and $7f
+		0xE0, 0x4B,       //     ldh ($4b), a
+		0x21, 0x12, 0x90, //     ld hl, $9012
+		0x34,             //     inc (hl)
+		0xD9,             //     reti
+	};
+	return make_vblank_program(s_vblank, sizeof(s_vblank));
+}
+
+// a still screen but for the cursor, sprite 0, moving between two lines and an entry of each
+// map changing every 8 frames
+std::vector<uint8_t> make_menu_program()
+{
+	constexpr uint8_t s_vblank[] = {
+		0xF0, 0x80,       //     ldh a, ($80)
+		0x3C,             //     inc a
+		0xE0, 0x80,       //     ldh ($80), a
+		0xE6, 0x07,       //     and $07
+		0x20, 0x0F,       //     jr nz, .done
+		0x21, 0x00, 0xFE, //     ld hl, $fe00
+		0x7E,             //     ld a, (hl)
+		0xEE, 0x18,       //     xor $18
+		0x77,             //     ld (hl), a
+		0x21, 0xA3, 0x98, //     ld hl, $98a3
+		0x34,             //     inc (hl)
+		0x21, 0x45, 0x9C, //     ld hl, $9c45
+		0x34,             //     inc (hl)
+		0xD9,             // .done reti
+	};
+	return make_vblank_program(s_vblank, sizeof(s_vblank));
+}
+
+// tiles, maps, sprites and registers, before the rom starts
+void set_up_lcd(Mem& mem)
+{
+	for (uint32_t addr = 0x8000; addr < 0x9800; addr++)
+		mem.write(static_cast<uint16_t>(addr), static_cast<uint8_t>(addr * 0x9D >> 3 ^ addr >> 4));
+	for (uint32_t addr = 0x9800; addr < 0xA000; addr++)
+		mem.write(static_cast<uint16_t>(addr), static_cast<uint8_t>(addr * 7 + (addr >> 5)));
+	for (uint32_t sprite = 0; sprite < 40; sprite++)
+	{
+		uint16_t oam = static_cast<uint16_t>(0xFE00 + sprite * 4);
+		mem.write(oam, static_cast<uint8_t>(sprite * 11 % 170));
+		mem.write(static_cast<uint16_t>(oam + 1), static_cast<uint8_t>(sprite * 37 % 176));
+		mem.write(static_cast<uint16_t>(oam + 2), static_cast<uint8_t>(sprite * 5));
+		mem.write(static_cast<uint16_t>(oam + 3), static_cast<uint8_t>(sprite << 4));
+	}
+	mem.write(0xFE00, 50);
+	mem.write(0xFE01, 40);
+
+	mem.write(0xFF47, 0xE4); // BGP
+	mem.write(0xFF48, 0xD2); // OBP0
+	mem.write(0xFF49, 0x1B); // OBP1
+	mem.write(0xFF4A, 60);   // WY
+	mem.write(0xFF4B, 3);    // WX
+	// window map at $9C00, tiles at $8800, 8x16 sprites
+	mem.write(0xFF40, 0xE7);
+}
+
+// Draws the frame with the registers as they are, one pixel at a time. The registers stay the
+// same through a frame of the rom.
+void reference_frame(Mem& mem, uint8_t* frame)
+{
+	uint8_t lcdc = mem.read(0xFF40);
+	uint8_t scy = mem.read(0xFF42);
+	uint8_t scx = mem.read(0xFF43);
+	uint8_t bgp = mem.read(0xFF47);
+	uint8_t obp[2] = { mem.read(0xFF48), mem.read(0xFF49) };
+	uint8_t wy = mem.read(0xFF4A);
+	uint8_t wx = mem.read(0xFF4B);
+	uint32_t height = lcdc & 0x04 ? 16 : 8;
+
+	auto pixel = [&](uint16_t data, uint32_t bit)
+	{
+		uint8_t low = mem.read(data);
+		uint8_t high = mem.read(static_cast<uint16_t>(data + 1));
+		return static_cast<uint8_t>((low >> bit & 1) | (high >> bit & 1) << 1);
+	};
+	auto tile_data = [&](uint8_t index, uint32_t row)
+	{
+		uint16_t base = lcdc & 0x10 ? static_cast<uint16_t>(0x8000 + index * 16) : static_cast<uint16_t>(0x9000 + static_cast<int8_t>(index) * 16);
+		return static_cast<uint16_t>(base + row * 2);
+	};
+
+	uint32_t window_line = 0;
+	for (uint32_t line = 0; line < Ppu::s_height; line++)
+	{
+		uint8_t colors[Ppu::s_width] = {};
+		bool window = (lcdc & 0x20) && wy <= line && wx < Ppu::s_width + 7;
+		for (uint32_t x = 0; x < Ppu::s_width && (lcdc & 0x01); x++)
+		{
+			uint16_t map = lcdc & 0x08 ? 0x9C00 : 0x9800;
+			uint8_t px = static_cast<uint8_t>(scx + x);
+			uint8_t py = static_cast<uint8_t>(scy + line);
+			if (window && x + 7 >= wx)
+			{
+				map = lcdc & 0x40 ? 0x9C00 : 0x9800;
+				px = static_cast<uint8_t>(x + 7 - wx);
+				py = static_cast<uint8_t>(window_line);
+			}
+			uint8_t index = mem.read(static_cast<uint16_t>(map + (py >> 3) * 32 + (px >> 3)));
+			colors[x] = pixel(tile_data(index, py & 7), 7 - (px & 7));
+		}
+		if (window && (lcdc & 0x01))
+			++window_line;
+
+		uint8_t sprites[10];
+		uint32_t count = 0;
+		for (uint32_t sprite = 0; sprite < 40 && count < 10 && (lcdc & 0x02); sprite++)
+		{
+			int32_t top = mem.read(static_cast<uint16_t>(0xFE00 + sprite * 4)) - 16;
+			if (static_cast<int32_t>(line) >= top && static_cast<int32_t>(line) < top + static_cast<int32_t>(height))
+				sprites[count++] = static_cast<uint8_t>(sprite);
+		}
+
+		for (uint32_t x = 0; x < Ppu::s_width; x++)
+		{
+			uint8_t shade = bgp >> colors[x] * 2 & 3;
+			// the sprite with the lowest X and then the lowest index with a pixel here
+			int32_t best_x = 256;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				uint16_t oam = static_cast<uint16_t>(0xFE00 + sprites[i] * 4);
+				int32_t left = mem.read(static_cast<uint16_t>(oam + 1)) - 8;
+				uint8_t attributes = mem.read(static_cast<uint16_t>(oam + 3));
+				int32_t column = static_cast<int32_t>(x) - left;
+				if (column < 0 || column > 7 || left + 8 >= best_x)
+					continue;
+				uint32_t row = line - (mem.read(oam) - 16);
+				if (attributes & 0x40)
+					row = height - 1 - row;
+				uint8_t tile = mem.read(static_cast<uint16_t>(oam + 2));
+				if (height == 16)
+					tile &= 0xFE;
+				uint8_t color = pixel(static_cast<uint16_t>(0x8000 + tile * 16 + row * 2), attributes & 0x20 ? column : 7 - column);
+				if (!color)
+					continue;
+				best_x = left + 8;
+				bool behind = (attributes & 0x80) && colors[x];
+				shade = behind ? static_cast<uint8_t>(bgp >> colors[x] * 2 & 3) : static_cast<uint8_t>(obp[attributes >> 4 & 1] >> color * 2 & 3);
+			}
+			frame[line * Ppu::s_width + x] = shade;
+		}
+	}
+}
+
+// LY, the mode and coincidence in STAT and the LYC interrupt at times through a frame
+bool check_timing(std::vector<uint8_t> const& rom)
+{
+	auto dmg = std::make_unique<Dmg>();
+	dmg->insert_cartridge(rom.data(), rom.size());
+	dmg->set_execution(Dmg::Execution::Instruction);
+	set_up_lcd(dmg->mem());
+	Mem& mem = dmg->mem();
+	mem.write(0xFF45, 100);
+	mem.write(0xFF41, 0x40);
+	// what frame 0 requested is out of the way
+	dmg->run_until(Dmg::s_frame_cycles);
+	mem.update();
+	mem.write(0xFF0F, 0x00);
+	uint64_t previous = mem.cycles();
+	uint64_t edge = Dmg::s_frame_cycles + 100 * Ppu::s_line_cycles;
+
+	for (uint32_t line : { 0u, 1u, 99u, 100u, 143u, 144u, 153u })
+	{
+		for (uint32_t cycle : { 0u, 19u, 20u, 62u, 63u, 113u })
+		{
+			dmg->run_until(Dmg::s_frame_cycles + line * Ppu::s_line_cycles + cycle);
+			// the rom may end past the time asked for
+			uint64_t in_frame = mem.cycles() % Dmg::s_frame_cycles;
+			uint32_t ly = static_cast<uint32_t>(in_frame / Ppu::s_line_cycles);
+			uint32_t at = static_cast<uint32_t>(in_frame % Ppu::s_line_cycles);
+			uint8_t mode = ly >= Ppu::s_height ? 1 : at < 20 ? 2 : at < 63 ? 3 : 0;
+			uint8_t stat = static_cast<uint8_t>(0xC0 | (ly == 100 ? 0x04 : 0) | mode);
+			if (mem.read(0xFF44) != ly || mem.read(0xFF41) != stat)
+			{
+				printf("  LY %02X STAT %02X at line %u M-cycle %u, expected %02X %02X\n", mem.read(0xFF44), mem.read(0xFF41),
+					ly, at, ly, stat);
+				return false;
+			}
+
+			// the LYC interrupt is requested as line 100 starts
+			mem.update();
+			bool requested = mem.read(0xFF0F) & Ppu::s_stat;
+			if (requested != (previous < edge && edge <= mem.cycles()))
+			{
+				printf("  LYC interrupt %s at line %u M-cycle %u\n", requested ? "requested" : "missing", ly, at);
+				return false;
+			}
+			mem.write(0xFF0F, 0x00);
+			previous = mem.cycles();
+		}
+	}
+	return true;
+}
+
+// a rom of nothing but nops, so runs end on the M-cycle asked for
+std::vector<uint8_t> make_nop_program()
+{
+	std::vector<uint8_t> code(0x8000 - 0x0150, 0x00); // nop
+	code[0x7FFD - 0x0150] = 0xC3; // jp $0150
+	code[0x7FFE - 0x0150] = 0x50;
+	code[0x7FFF - 0x0150] = 0x01;
+	return bench::make_program(0x00, 0x00, 0x00, code.data(), code.size());
+}
+
+// M-cycle into line 10 at which the FIFO engine starts mode 0
+uint32_t mode0_cycle(std::vector<uint8_t> const& rom, uint8_t lcdc, uint8_t scx, uint8_t wx,
+	std::initializer_list<uint8_t> sprite_x)
+{
+	auto dmg = std::make_unique<Dmg>();
+	dmg->insert_cartridge(rom.data(), rom.size());
+	dmg->set_execution(Dmg::Execution::Instruction);
+	dmg->set_ppu_engine(Ppu::Engine::Fifo);
+	Mem& mem = dmg->mem();
+	for (uint32_t addr = 0xFE00; addr < 0xFEA0; addr++)
+		mem.write(static_cast<uint16_t>(addr), 0);
+	uint16_t oam = 0xFE00;
+	for (uint8_t x : sprite_x)
+	{
+		mem.write(oam, 10 + 16);
+		mem.write(static_cast<uint16_t>(oam + 1), x);
+		oam = static_cast<uint16_t>(oam + 4);
+	}
+	mem.write(0xFF43, scx);
+	mem.write(0xFF4A, 0);
+	mem.write(0xFF4B, wx);
+	mem.write(0xFF40, lcdc);
+
+	uint64_t line_start = Dmg::s_frame_cycles + 10 * Ppu::s_line_cycles;
+	for (uint32_t cycle = 0; cycle < Ppu::s_line_cycles; cycle++)
+	{
+		dmg->run_until(line_start + cycle);
+		if (mem.cycles() != line_start + cycle)
+			return 0;
+		if ((mem.read(0xFF41) & 0x03) == 0)
+			return cycle;
+	}
+	return 0;
+}
+
+// mode 3 of the FIFO engine, 172 dots and the penalties of docs/gbctr.pdf, from dot 80 of a line
+bool check_mode3()
+{
+	struct Case
+	{
+		char const* name;
+		uint8_t lcdc;
+		uint8_t scx;
+		uint8_t wx;
+		std::initializer_list<uint8_t> sprite_x;
+		uint32_t dots;
+	};
+	Case const cases[] = {
+		{ "background alone", 0x81, 0, 0xFF, {}, 172 },
+		{ "SCX 3", 0x81, 3, 0xFF, {}, 175 },
+		{ "SCX 5", 0x81, 5, 0xFF, {}, 177 },
+		{ "window at 80", 0xA1, 0, 87, {}, 178 },
+		{ "sprite at 0", 0x83, 0, 0xFF, { 8 }, 183 },
+		{ "sprite at 21", 0x83, 0, 0xFF, { 29 }, 178 },
+		{ "sprite at 18 with SCX 3", 0x83, 3, 0xFF, { 26 }, 181 },
+		{ "sprites off", 0x81, 0, 0xFF, { 8, 29 }, 172 },
+		{ "10 sprites at 16", 0x83, 0, 0xFF, { 24, 24, 24, 24, 24, 24, 24, 24, 24, 24 }, 237 },
+		{ "11 sprites, 10 on the line", 0x83, 0, 0xFF, { 8, 16, 24, 32, 40, 48, 56, 64, 72, 80, 88 }, 282 },
+	};
+	std::vector<uint8_t> rom = make_nop_program();
+	for (Case const& c : cases)
+	{
+		uint32_t expected = (80 + c.dots + 3) / 4;
+		uint32_t cycle = mode0_cycle(rom, c.lcdc, c.scx, c.wx, c.sprite_x);
+		if (cycle != expected)
+		{
+			printf("  %s: mode 0 at M-cycle %u, expected %u\n", c.name, cycle, expected);
+			return false;
+		}
+	}
+	return true;
+}
+
+// Every frame when VBlank starts against the reference. Switching changes the engine in the
+// middle of line 50 every frame, loading loads a state there into a Dmg of the other engine
+// every other frame and checks the frame after.
+enum class Switch
+{
+	None,
+	Engine,
+	State,
+};
+
+bool check_frames(std::vector<uint8_t> const& rom, Ppu::Engine engine, Switch change, uint64_t frames)
+{
+	Ppu::Engine first = engine;
+	std::unique_ptr<Dmg> dmgs[2];
+	for (std::unique_ptr<Dmg>& dmg : dmgs)
+	{
+		dmg = std::make_unique<Dmg>();
+		dmg->insert_cartridge(rom.data(), rom.size());
+		dmg->set_execution(Dmg::Execution::Block);
+		dmg->set_ppu_engine(engine);
+		set_up_lcd(dmg->mem());
+		engine = engine == Ppu::Engine::Fifo ? Ppu::Engine::Scanline : Ppu::Engine::Fifo;
+	}
+	auto state = std::make_unique<Dmg::State>();
+	std::vector<uint8_t> expected(Ppu::s_width * Ppu::s_height);
+	std::vector<uint8_t> before(Ppu::s_width * Ppu::s_height);
+
+	uint32_t current = 0;
+	for (uint64_t frame = 0; frame < frames; frame++)
+	{
+		Dmg& dmg = *dmgs[current];
+		uint64_t start = frame * Dmg::s_frame_cycles;
+		if (change != Switch::None)
+			dmg.run_until(start + 50 * Ppu::s_line_cycles + 40);
+		if (change == Switch::Engine)
+			dmg.set_ppu_engine(dmg.ppu_engine() == Ppu::Engine::Fifo ? Ppu::Engine::Scanline : Ppu::Engine::Fifo);
+		if (change == Switch::State && frame % 2 == 0)
+		{
+			dmg.save_state(*state);
+			current ^= 1;
+			dmgs[current]->load_state(*state);
+			continue;
+		}
+
+		Dmg& drawing = *dmgs[current];
+		drawing.run_until(start + Ppu::s_height * Ppu::s_line_cycles);
+		reference_frame(drawing.mem(), expected.data());
+		bool counted = change != Switch::None || drawing.ppu().frames() == frame + 1;
+		if (!counted || memcmp(drawing.ppu().frame(), expected.data(), expected.size()) != 0)
+		{
+			printf("  %s engine%s: frame %llu differs from the reference\n",
+				first == Ppu::Engine::Fifo ? "fifo" : "scanline",
+				change == Switch::Engine ? " switched" : change == Switch::State ? " loading" : "",
+				static_cast<unsigned long long>(frame));
+			return false;
+		}
+
+		// the lines left out of changed_lines() are the same as in the frame before
+		for (uint32_t line = 0; line < Ppu::s_height && change == Switch::None && frame > 0; line++)
+		{
+			uint32_t at = line * Ppu::s_width;
+			if (!drawing.ppu().changed_lines()[line] && memcmp(drawing.ppu().frame() + at, before.data() + at, Ppu::s_width) != 0)
+			{
+				printf("  line %u of frame %llu changed unreported\n", line, static_cast<unsigned long long>(frame));
+				return false;
+			}
+		}
+		memcpy(before.data(), drawing.ppu().frame(), before.size());
+	}
+	return true;
+}
+
+// what the rom can see of a Dmg at a time, with LY, STAT and IF up to date, and the line of
+// the window, which only shows when drawn
+struct Seen
+{
+	uint64_t fingerprint;
+	uint8_t ly;
+	uint8_t stat;
+	uint8_t interrupts;
+	uint8_t window_line;
+
+	bool operator==(Seen const&) const = default;
+};
+
+Seen seen(Dmg& dmg)
+{
+	Mem& mem = dmg.mem();
+	mem.update();
+	Ppu::State ppu;
+	mem.ppu().save_state(ppu);
+	return { bench::fingerprint(dmg), mem.read(0xFF44), mem.read(0xFF41), mem.read(0xFF0F), ppu.window_line };
+}
+
+// Dmgs drawing every frame, every 4th and none run side by side and compared at times through
+// each frame, the 4th frames against the frames drawn by the first.
+bool check_render_every(std::vector<uint8_t> const& rom, Ppu::Engine engine, uint64_t frames)
+{
+	constexpr uint32_t s_every[3] = { 1, 4, 0 };
+	std::unique_ptr<Dmg> dmgs[3];
+	for (uint32_t d = 0; d < 3; d++)
+	{
+		dmgs[d] = std::make_unique<Dmg>();
+		dmgs[d]->insert_cartridge(rom.data(), rom.size());
+		dmgs[d]->set_execution(Dmg::Execution::Block);
+		dmgs[d]->set_ppu_engine(engine);
+		dmgs[d]->set_render_every(s_every[d]);
+		set_up_lcd(dmgs[d]->mem());
+	}
+
+	char const* name = engine == Ppu::Engine::Fifo ? "fifo" : "scanline";
+	for (uint64_t frame = 0; frame < frames; frame++)
+	{
+		uint64_t start = frame * Dmg::s_frame_cycles;
+		for (uint32_t line : { 0u, 50u, 143u, 150u })
+		{
+			for (uint32_t cycle : { 10u, 45u, 70u })
+			{
+				Seen seens[3];
+				for (uint32_t d = 0; d < 3; d++)
+				{
+					dmgs[d]->run_until(start + line * Ppu::s_line_cycles + cycle);
+					seens[d] = seen(*dmgs[d]);
+				}
+				if (seens[1] != seens[0] || seens[2] != seens[0])
+				{
+					printf("  %s engine: drawing every %u frames runs differently at line %u M-cycle %u of frame %llu\n",
+						name, seens[1] != seens[0] ? s_every[1] : s_every[2], line, cycle,
+						static_cast<unsigned long long>(frame));
+					return false;
+				}
+			}
+
+			Dmg& every = *dmgs[1];
+			if (line == 150 && frame % s_every[1] == 0
+				&& memcmp(every.ppu().frame(), dmgs[0]->ppu().frame(), Ppu::s_width * Ppu::s_height) != 0)
+			{
+				printf("  %s engine: frame %llu drawn every %u frames differs\n", name, static_cast<unsigned long long>(frame),
+					s_every[1]);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+}
+
+int bench::ppu(int argc, char* argv[])
+{
+	uint64_t frames = argc >= 1 ? strtoull(argv[0], nullptr, 10) : 600;
+
+	printf("ppu: %llu frames\n", static_cast<unsigned long long>(frames));
+
+	std::vector<uint8_t> rom = make_scroll_program();
+	std::vector<uint8_t> menu = make_menu_program();
+	if (!check_timing(rom) || !check_mode3())
+		return 1;
+
+	uint64_t checked = std::min<uint64_t>(frames, 300);
+	for (std::vector<uint8_t> const* scene : { &rom, &menu })
+		for (Ppu::Engine engine : { Ppu::Engine::Scanline, Ppu::Engine::Fifo })
+			for (Switch change : { Switch::None, Switch::Engine, Switch::State })
+				if (!check_frames(*scene, engine, change, checked))
+					return 1;
+	for (std::vector<uint8_t> const* scene : { &rom, &menu })
+		for (Ppu::Engine engine : { Ppu::Engine::Scanline, Ppu::Engine::Fifo })
+			if (!check_render_every(*scene, engine, std::min<uint64_t>(checked, 100)))
+				return 1;
+	printf("  frames ok\n");
+
+	// the first frame decodes every tile it shows, the ones after only the tile changed
+	{
+		auto dmg = std::make_unique<Dmg>();
+		dmg->insert_cartridge(rom.data(), rom.size());
+		dmg->set_execution(Dmg::Execution::Block);
+		set_up_lcd(dmg->mem());
+		Ppu::TileStats first = {};
+		Ppu::TileStats total = {};
+		double lowest = 1;
+		for (uint64_t frame = 0; frame < checked; frame++)
+		{
+			dmg->run_until(frame * Dmg::s_frame_cycles + Ppu::s_height * Ppu::s_line_cycles);
+			Ppu::TileStats stats = dmg->ppu().tile_stats();
+			if (frame == 0)
+			{
+				first = stats;
+				continue;
+			}
+			total.lookups += stats.lookups;
+			total.decodes += stats.decodes;
+			lowest = std::min(lowest, 1 - static_cast<double>(stats.decodes) / stats.lookups);
+		}
+		uint64_t later = std::max<uint64_t>(checked - 1, 1);
+		printf("  tile cache   first frame %llu rows looked up, %llu tiles decoded\n",
+			static_cast<unsigned long long>(first.lookups), static_cast<unsigned long long>(first.decodes));
+		printf("               after it %.1f rows, %.2f tiles decoded a frame, hit rate %.3f%% on average, %.3f%% lowest\n",
+			static_cast<double>(total.lookups) / later, static_cast<double>(total.decodes) / later,
+			100 - 100.0 * total.decodes / std::max<uint64_t>(total.lookups, 1), 100 * lowest);
+	}
+
+	// Lines drawn again a frame, and the menu with every line drawn again as if all of VRAM
+	// changed every frame.
+	double menu_seconds[2] = {};
+	double drawn[2] = {};
+	for (uint32_t scene = 0; scene < 2; scene++)
+	{
+		for (bool every_line : { false, true })
+		{
+			auto dmg = std::make_unique<Dmg>();
+			dmg->insert_cartridge(scene ? menu.data() : rom.data(), rom.size());
+			dmg->set_execution(Dmg::Execution::Block);
+			set_up_lcd(dmg->mem());
+
+			uint64_t lines = 0;
+			Timer timer;
+			for (uint64_t frame = 0; frame < frames; frame++)
+			{
+				if (every_line)
+					dmg->mem().direct_ram();
+				dmg->run_until(frame * Dmg::s_frame_cycles + Ppu::s_height * Ppu::s_line_cycles);
+				lines += dmg->ppu().changed_lines().count();
+			}
+			if (scene)
+				menu_seconds[every_line] = timer.seconds();
+			if (!every_line)
+				drawn[scene] = static_cast<double>(lines) / frames;
+		}
+	}
+	printf("  lines drawn  %6.1f a frame scrolling, %5.1f in the menu\n", drawn[0], drawn[1]);
+	printf("  menu         %10.0f frames/s, %10.0f drawing every line  %5.2fx\n", frames / menu_seconds[0],
+		frames / menu_seconds[1], menu_seconds[1] / menu_seconds[0]);
+
+	struct Run
+	{
+		Dmg::Execution execution;
+		Ppu::Engine engine;
+	};
+	Run const runs[3] = {
+		{ Dmg::Execution::Instruction, Ppu::Engine::Scanline },
+		{ Dmg::Execution::Block, Ppu::Engine::Scanline },
+		{ Dmg::Execution::Block, Ppu::Engine::Fifo },
+	};
+	double seconds[3] = {};
+	std::unique_ptr<Dmg> dmg;
+	for (uint32_t r = 0; r < 3; r++)
+	{
+		dmg = std::make_unique<Dmg>();
+		dmg->insert_cartridge(rom.data(), rom.size());
+		dmg->set_execution(runs[r].execution);
+		dmg->set_ppu_engine(runs[r].engine);
+		set_up_lcd(dmg->mem());
+
+		Timer timer;
+		dmg->run_until(frames * Dmg::s_frame_cycles);
+		seconds[r] = timer.seconds();
+	}
+
+	// the plain renderer drawing as many frames on its own
+	std::vector<uint8_t> expected(Ppu::s_width * Ppu::s_height);
+	uint64_t reference_frames = std::max<uint64_t>(frames / 20, 1);
+	Timer timer;
+	for (uint64_t frame = 0; frame < reference_frames; frame++)
+		reference_frame(dmg->mem(), expected.data());
+	double reference = timer.seconds() / reference_frames * frames;
+
+	printf("  instruction  %10.0f frames/s\n", frames / seconds[0]);
+	printf("  block        %10.0f frames/s  %8.2f us per frame\n", frames / seconds[1], seconds[1] / frames * 1e6);
+	printf("  block, fifo  %10.0f frames/s  %8.2f us per frame  %5.2fx the scanline engine\n", frames / seconds[2],
+		seconds[2] / frames * 1e6, seconds[2] / seconds[1]);
+	printf("  bit by bit   %10.0f frames/s  %8.2f us per frame, drawing alone  %5.2fx\n", frames / reference,
+		reference / frames * 1e6, reference / seconds[1]);
+
+	// the scrolling scene, which draws most of every line again, with frames left undrawn
+	for (Ppu::Engine engine : { Ppu::Engine::Scanline, Ppu::Engine::Fifo })
+	{
+		double every_seconds[3] = {};
+		uint32_t const every[3] = { 1, 4, 0 };
+		for (uint32_t e = 0; e < 3; e++)
+		{
+			dmg = std::make_unique<Dmg>();
+			dmg->insert_cartridge(rom.data(), rom.size());
+			dmg->set_execution(Dmg::Execution::Block);
+			dmg->set_ppu_engine(engine);
+			dmg->set_render_every(every[e]);
+			set_up_lcd(dmg->mem());
+
+			Timer timer;
+			dmg->run_until(frames * Dmg::s_frame_cycles);
+			every_seconds[e] = timer.seconds();
+		}
+		printf("  %-9s    %10.0f frames/s drawing all, %10.0f every 4th  %5.2fx, %10.0f none  %5.2fx\n",
+			engine == Ppu::Engine::Fifo ? "fifo" : "scanline", frames / every_seconds[0], frames / every_seconds[1],
+			every_seconds[0] / every_seconds[1], frames / every_seconds[2], every_seconds[0] / every_seconds[2]);
+	}
+	return 0;
+}
@@ -0,0 +1,129 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+#include "rewind.h"
+
+// Rewind history captured every frame: what a capture costs next to the frame it follows and
+// to a frame of the real hardware, and how many seconds of history the ring holds. Rewinding
+// by various numbers of frames, across keyframes and after capturing on from a rewound frame,
+// has to give back the Dmg it saved, checked in lockstep against a plain save state.
+
+namespace
+{
+
+// frames of plain save states kept to check rewinding against
+constexpr uint32_t s_reference_frames = 128;
+
+struct History
+{
+	Rewind rewind;
+	std::unique_ptr<Dmg::State[]> references{ new Dmg::State[s_reference_frames] };
+	uint64_t frames = 0;
+	double run_seconds = 0;
+	double capture_seconds = 0;
+	double slowest_capture = 0;
+
+	History(size_t bytes) : rewind(bytes) { }
+};
+
+void run_frames(Dmg& dmg, History& history, uint64_t frames)
+{
+	for (uint64_t i = 0; i < frames; i++)
+	{
+		bench::Timer run_timer;
+		dmg.run_frame();
+		if (dmg.cpu().stopped())
+			dmg.cpu().reset();
+		history.run_seconds += run_timer.seconds();
+
+		bench::Timer capture_timer;
+		history.rewind.capture(dmg);
+		double capture = capture_timer.seconds();
+		history.capture_seconds += capture;
+		history.slowest_capture = std::max(history.slowest_capture, capture);
+
+		dmg.save_state(history.references[history.frames++ % s_reference_frames]);
+	}
+}
+
+// rewinds by frames and checks dmg carries on like the state saved at that frame
+bool check_rewind(Dmg& dmg, History& history, char const* rom, uint32_t frames)
+{
+	if (!history.rewind.rewind(dmg, frames))
+	{
+		printf("  rewinding %u frames failed\n", frames);
+		return false;
+	}
+	history.frames -= frames;
+
+	auto reference = std::make_unique<Dmg>();
+	reference->set_execution(Dmg::Execution::Instruction);
+	bench::load_rom(*reference, rom);
+	reference->load_state(history.references[(history.frames - 1) % s_reference_frames]);
+	if (!bench::lockstep(*reference, dmg, 10'000))
+	{
+		printf("  rewinding %u frames diverged\n", frames);
+		return false;
+	}
+
+	// lockstep ran dmg on, back to the frame again
+	history.rewind.rewind(dmg, 0);
+	return true;
+}
+
+}
+
+int bench::rewind(int argc, char* argv[])
+{
+	char const* rom = argc >= 1 ? argv[0] : nullptr;
+	uint64_t seconds = argc >= 2 ? strtoull(argv[1], nullptr, 10) : 120;
+	uint64_t frames = seconds * 60;
+
+	printf("rewind: %s, %llu frames\n", rom ? rom : "roms/test-loop.z80", static_cast<unsigned long long>(frames));
+
+	auto dmg = std::make_unique<Dmg>();
+	dmg->set_execution(Dmg::Execution::Block);
+	load_rom(*dmg, rom);
+
+	auto history = std::make_unique<History>(Rewind::s_default_bytes);
+	run_frames(*dmg, *history, frames);
+
+	Rewind const& rewind = history->rewind;
+	double capture = history->capture_seconds / frames;
+	// a frame of the real hardware
+	double frame = Dmg::s_frame_cycles * 4 / s_dmg_clock_hz;
+	printf("  capture      %8.2f us, slowest %.2f us\n", capture * 1e6, history->slowest_capture * 1e6);
+	printf("  frame        %8.2f us emulated, %.2f us real\n", history->run_seconds / frames * 1e6, frame * 1e6);
+	printf("  capture      %8.3f%% of an emulated frame, %.3f%% of a real one\n",
+		100 * history->capture_seconds / history->run_seconds, 100 * capture / frame);
+	printf("  history      %8u frames, %.1f s in %zu of %zu KiB, %.0f bytes per frame\n", rewind.frames(),
+		rewind.frames() / 60.0, rewind.bytes_used() >> 10, rewind.capacity() >> 10,
+		static_cast<double>(rewind.bytes_used()) / rewind.frames());
+
+	// back and forth across keyframes, capturing on in between
+	for (uint32_t back : { 0u, 1u, 7u, 52u, 60u })
+		if (!check_rewind(*dmg, *history, rom, back))
+			return 1;
+	run_frames(*dmg, *history, 100);
+	for (uint32_t back : { 61u, 2u, 59u })
+		if (!check_rewind(*dmg, *history, rom, back))
+			return 1;
+
+	// a ring too small for the run keeps what fits and can go back to the oldest of it
+	auto small = std::make_unique<History>(1 << 20);
+	run_frames(*dmg, *small, 600);
+	uint32_t kept = small->rewind.frames();
+	if (small->rewind.bytes_used() > small->rewind.capacity() || !small->rewind.rewind(*dmg, kept - 1))
+	{
+		printf("  small ring failed\n");
+		return 1;
+	}
+	printf("  small ring   %8u frames in %zu KiB\n", kept, small->rewind.capacity() >> 10);
+	printf("  rewind ok\n");
+
+	return 0;
+}
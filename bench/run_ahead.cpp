@@ -0,0 +1,128 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "run_ahead.h"
+
+// Run-ahead on a program adding the joypad lines into memory: the frame presented after
+// holding the same buttons for N + 1 frames has to be the frame a plain Dmg reaches N frames
+// later, with and without the second thread. Then the cost of a frame with each.
+
+namespace
+{
+
+// adds P1 into $C000-$DFFF one byte after the other, the direction and button lines in turn
+std::vector<uint8_t> make_joypad_program()
+{
+	constexpr uint8_t s_main[] = {
+		0x21, 0x00, 0xC0, //     ld hl, $c000
+		0x3E, 0x20,       // .loop ld a, $20
+		0xA9,             //     xor c
+		0xE0, 0x00,       //     ldh ($00), a
+		0x79,             //     ld a, c
+		0xEE, 0x30,       //     xor $30
+		0x4F,             //     ld c, a
+		0xF0, 0x00,       //     ldh a, ($00)
+		0x86,             //     add a, (hl)
+		0x22,             //     ld (hl+), a
+		0x7C,             //     ld a, h
+		0xE6, 0x1F,       //     and $1f
+		0xF6, 0xC0,       //     or $c0
+		0x67,             //     ld h, a
+		0x18, 0xEB,       //     jr .loop
+	};
+	return bench::make_program(0x00, 0x00, 0x00, s_main, sizeof(s_main));
+}
+
+// buttons held in frame, changing every 8 frames
+uint8_t buttons(uint64_t frame)
+{
+	return static_cast<uint8_t>((frame / 8) * 0x9D);
+}
+
+struct Config
+{
+	char const* name;
+	uint32_t frames;
+	bool second_thread;
+};
+
+constexpr Config s_configs[] = {
+	{ "off", 0, false },
+	{ "1 frame", 1, false },
+	{ "2 frames", 2, false },
+	{ "1, thread", 1, true },
+	{ "2, thread", 2, true },
+};
+
+}
+
+int bench::run_ahead(int argc, char* argv[])
+{
+	uint64_t frames = argc >= 1 ? strtoull(argv[0], nullptr, 10) : 600;
+
+	printf("run-ahead: %llu frames\n", static_cast<unsigned long long>(frames));
+
+	std::vector<uint8_t> rom = make_joypad_program();
+
+	// what the frames look like without running ahead
+	std::vector<uint64_t> reference(frames + 2);
+	auto plain = std::make_unique<Dmg>();
+	plain->set_execution(Dmg::Execution::Block);
+	plain->insert_cartridge(rom.data(), rom.size());
+	for (uint64_t frame = 0; frame < reference.size(); frame++)
+	{
+		plain->set_buttons(buttons(frame));
+		plain->run_frame();
+		reference[frame] = bench::fingerprint(*plain);
+	}
+
+	for (Config const& config : s_configs)
+	{
+		auto dmg = std::make_unique<Dmg>();
+		dmg->insert_cartridge(rom.data(), rom.size());
+		dmg->set_execution(Dmg::Execution::Block);
+		RunAhead run_ahead(*dmg, config.frames, config.second_thread);
+
+		for (uint64_t frame = 0; frame < frames; frame++)
+		{
+			Dmg& presented = run_ahead.run_frame(buttons(frame));
+
+			// the buttons stay the same over the frames run ahead
+			uint64_t ahead = frame + config.frames;
+			if (buttons(ahead) == buttons(frame) && bench::fingerprint(presented) != reference[ahead])
+			{
+				printf("  %s: frame %llu presented something else than frame %llu\n", config.name,
+					static_cast<unsigned long long>(frame), static_cast<unsigned long long>(ahead));
+				return 1;
+			}
+		}
+	}
+	printf("  run-ahead ok\n");
+
+	double off = 0;
+	for (Config const& config : s_configs)
+	{
+		auto dmg = std::make_unique<Dmg>();
+		dmg->insert_cartridge(rom.data(), rom.size());
+		dmg->set_execution(Dmg::Execution::Block);
+		RunAhead run_ahead(*dmg, config.frames, config.second_thread);
+
+		Timer timer;
+		for (uint64_t frame = 0; frame < frames; frame++)
+			run_ahead.run_frame(buttons(frame));
+		double seconds = timer.seconds();
+		if (!config.frames)
+			off = seconds;
+
+		printf("  %-12s %8.2f us per frame", config.name, seconds / frames * 1e6);
+		if (config.frames)
+			printf("  %5.2fx", off / seconds);
+		printf("\n");
+	}
+
+	return 0;
+}
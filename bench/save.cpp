@@ -0,0 +1,172 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Battery ram kept in a .sav file: writes a pattern across all banks of an MBC5 cartridge's
+// ram, maps the file again and checks it is all there. Then times guest writes to ram backed
+// by the file, with an update between runs of them handing the changed pages to the flush
+// thread every few milliseconds, against plain cartridge ram, and the slowest run of writes
+// for each, which would show a write waiting for the disk.
+
+namespace
+{
+
+struct Bench
+{
+	Cartridge cartridge;
+	Bus bus;
+	Mem mem{ bus };
+};
+
+constexpr std::chrono::milliseconds s_interval{ 5 };
+// writes timed together for the slowest run
+constexpr uint64_t s_run = 1024;
+
+uint8_t pattern(uint32_t bank, uint32_t offset)
+{
+	return static_cast<uint8_t>(bank * 31 + offset * 7 + (offset >> 8));
+}
+
+bool insert(Bench& bench, std::vector<uint8_t> const& rom, std::string const& save)
+{
+	bench.mem.map_cartridge(nullptr);
+	if (!bench.cartridge.map(rom.data(), rom.size()))
+		return false;
+	if (!save.empty() && !bench.cartridge.map_save(save, s_interval))
+		return false;
+	bench.mem.map_cartridge(&bench.cartridge);
+	bench.mem.write(0x0000, 0x0A);
+	return true;
+}
+
+struct Timing
+{
+	double seconds;
+	double slowest; // seconds of the slowest s_run writes
+};
+
+Timing time_writes(Mem& mem, std::vector<uint16_t> const& addrs, uint64_t writes)
+{
+	Timing timing{ 0, 0 };
+	bench::Timer timer;
+	for (uint64_t i = 0; i < writes; i += s_run)
+	{
+		bench::Timer run;
+		for (uint64_t j = i; j < i + s_run; j++)
+		{
+			// a bank switch now and then spreads the writes over the whole ram
+			if ((j & 0xFFF) == 0)
+				mem.write(0x4000, static_cast<uint8_t>(j >> 12));
+			mem.write(addrs[j & 0xFFF], static_cast<uint8_t>(j));
+		}
+		// where a Dmg would reach an event
+		mem.update();
+		timing.slowest = std::max(timing.slowest, run.seconds());
+	}
+	timing.seconds = timer.seconds();
+	return timing;
+}
+
+void print(char const* name, uint64_t writes, Timing const& timing, double const* baseline)
+{
+	printf("    %-12s %8.2f M/s %6.2f ns  slowest %6.2f us", name, writes / timing.seconds / 1e6,
+		timing.seconds * 1e9 / writes, timing.slowest * 1e6);
+	if (baseline)
+		printf("  %5.2fx", *baseline / timing.seconds);
+	printf("\n");
+}
+
+}
+
+int bench::save(int argc, char* argv[])
+{
+	uint64_t writes = argc >= 1 ? strtoull(argv[0], nullptr, 10) : 100'000'000;
+	writes = (writes + s_run - 1) / s_run * s_run;
+
+	std::string path = (std::filesystem::temp_directory_path() / "gb-bench-save.sav").string();
+	std::filesystem::remove(path);
+
+	printf("save: %llu writes, flushed every %lld ms to %s\n", static_cast<unsigned long long>(writes),
+		static_cast<long long>(s_interval.count()), path.c_str());
+
+	// MBC5+RAM+BATTERY with 128K of ram, and the same without the battery
+	std::vector<uint8_t> battery_rom = make_rom(0x1B, 0x01, 0x04);
+	std::vector<uint8_t> plain_rom = make_rom(0x1A, 0x01, 0x04);
+
+	auto bench = std::make_unique<Bench>();
+	Mem& mem = bench->mem;
+	Cartridge& cartridge = bench->cartridge;
+
+	if (!insert(*bench, battery_rom, path))
+		return 1;
+	for (uint32_t bank = 0; bank < 16; bank++)
+	{
+		mem.write(0x4000, static_cast<uint8_t>(bank));
+		for (uint32_t offset = 0; offset < 0x2000; offset++)
+			mem.write(static_cast<uint16_t>(0xA000 + offset), pattern(bank, offset));
+	}
+
+	// the next update after an interval hands it all to the thread, which writes it back
+	// without being asked
+	std::this_thread::sleep_for(s_interval * 2);
+	mem.update();
+	std::this_thread::sleep_for(s_interval * 4);
+	uint64_t flushed = cartridge.save().pages_flushed();
+	printf("  %llu pages flushed in the background\n", static_cast<unsigned long long>(flushed));
+	if (flushed < 0x20000 / 4096)
+	{
+		printf("  background flush missed pages\n");
+		return 1;
+	}
+
+	cartridge.unmap();
+	if (!insert(*bench, battery_rom, path))
+		return 1;
+	for (uint32_t bank = 0; bank < 16; bank++)
+	{
+		mem.write(0x4000, static_cast<uint8_t>(bank));
+		for (uint32_t offset = 0; offset < 0x2000; offset++)
+		{
+			uint8_t got = mem.read(static_cast<uint16_t>(0xA000 + offset));
+			if (got != pattern(bank, offset))
+			{
+				printf("  bank %u $%04x: %02x, expected %02x\n", bank, 0xA000 + offset, got, pattern(bank, offset));
+				return 1;
+			}
+		}
+	}
+	printf("  save ok\n");
+
+	std::mt19937 random(1);
+	std::vector<uint16_t> addrs(4096);
+	for (uint16_t& addr : addrs)
+		addr = static_cast<uint16_t>(0xA000 + (random() & 0x1FFF));
+
+	printf("  cartridge ram writes\n");
+
+	if (!insert(*bench, plain_rom, ""))
+		return 1;
+	Timing plain = time_writes(mem, addrs, writes);
+	print("plain", writes, plain, nullptr);
+
+	if (!insert(*bench, battery_rom, path))
+		return 1;
+	uint64_t flushed_before = cartridge.save().pages_flushed();
+	Timing battery = time_writes(mem, addrs, writes);
+	print("battery", writes, battery, &plain.seconds);
+	printf("  %llu pages flushed meanwhile\n",
+		static_cast<unsigned long long>(cartridge.save().pages_flushed() - flushed_before));
+
+	mem.map_cartridge(nullptr);
+	cartridge.unmap();
+	std::filesystem::remove(path);
+	return 0;
+}
@@ -0,0 +1,245 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Save states: a Dmg loaded from a state has to carry on exactly like the one that saved it,
+// checked in lockstep for every core on the rom, random programs and a cartridge banking
+// through 128 KiB of external ram, and for the M-cycle core in the middle of an instruction.
+// A Dmg that ran on and rewrote its code has to go back as well. Then times saving and
+// loading against a plain copy of the same bytes.
+
+namespace
+{
+
+// MBC5+RAM+BATTERY without a save file, adding a byte of every ram bank in turn into another
+std::vector<uint8_t> make_ram_program()
+{
+	constexpr uint8_t s_main[] = {
+		0x3E, 0x0A,       //     ld a, $0a
+		0xEA, 0x00, 0x00, //     ld ($0000), a
+		0x78,             // .loop ld a, b
+		0xE6, 0x0F,       //     and $0f
+		0xEA, 0x00, 0x40, //     ld ($4000), a
+		0x79,             //     ld a, c
+		0xE6, 0x1F,       //     and $1f
+		0xF6, 0xA0,       //     or $a0
+		0x67,             //     ld h, a
+		0x69,             //     ld l, c
+		0x7E,             //     ld a, (hl)
+		0x80,             //     add a, b
+		0x77,             //     ld (hl), a
+		0x04,             //     inc b
+		0x79,             //     ld a, c
+		0xC6, 0x35,       //     add a, $35
+		0x4F,             //     ld c, a
+		0x18, 0xE9,       //     jr .loop
+	};
+	return bench::make_program(0x1B, 0x01, 0x04, s_main, sizeof(s_main));
+}
+
+// a Dmg running the same program as dmg
+using Load = void (*)(Dmg& dmg, uint32_t seed);
+
+void load_test_loop(Dmg& dmg, uint32_t)
+{
+	bench::load_rom(dmg, nullptr);
+}
+
+std::vector<uint8_t> const& ram_program()
+{
+	static std::vector<uint8_t> const s_rom = make_ram_program();
+	return s_rom;
+}
+
+void load_ram_program(Dmg& dmg, uint32_t)
+{
+	dmg.insert_cartridge(ram_program().data(), ram_program().size());
+}
+
+void load_random(Dmg& dmg, uint32_t seed)
+{
+	bench::load_random_program(dmg, seed);
+}
+
+struct Program
+{
+	char const* name;
+	Load load;
+	uint32_t seeds;
+};
+
+constexpr Program s_programs[] = {
+	{ "test-loop", load_test_loop, 1 },
+	{ "cartridge ram", load_ram_program, 1 },
+	{ "random", load_random, 16 },
+};
+
+constexpr Dmg::Execution s_executions[] = {
+	Dmg::Execution::Instruction,
+	Dmg::Execution::Block,
+#ifdef GB_JIT
+	Dmg::Execution::Jit,
+#endif
+#ifdef GB_THREADED
+	Dmg::Execution::Threaded,
+#endif
+};
+
+// Runs the saving Dmg on from the state and the loading one, stepping one instruction at a
+// time, after it in lockstep.
+bool check_load(Dmg& saved, Dmg::State const& state, Program const& program, uint32_t seed)
+{
+	auto loaded = std::make_unique<Dmg>();
+	loaded->set_execution(Dmg::Execution::Instruction);
+	program.load(*loaded, seed);
+	if (!loaded->load_state(state))
+	{
+		printf("  %s: state not loaded\n", program.name);
+		return false;
+	}
+	return bench::lockstep(*loaded, saved, 10'000);
+}
+
+bool check_program(Program const& program, uint32_t seed, Dmg::Execution execution, Dmg::State& state)
+{
+	auto dmg = std::make_unique<Dmg>();
+	dmg->set_execution(execution);
+	program.load(*dmg, seed);
+	for (uint32_t i = 0; i < 5'000; i++)
+		dmg->step();
+
+	// into another Dmg
+	dmg->save_state(state);
+	if (!check_load(*dmg, state, program, seed))
+		return false;
+
+	// back into the same one after it ran on, rewriting memory and maybe its code
+	for (uint32_t i = 0; i < 5'000; i++)
+		dmg->step();
+	if (!dmg->load_state(state))
+	{
+		printf("  %s: state not loaded back\n", program.name);
+		return false;
+	}
+	return check_load(*dmg, state, program, seed);
+}
+
+// the M-cycle core saved in the middle of an instruction
+bool check_m_cycle(Dmg::State& state)
+{
+	auto saved = std::make_unique<Dmg>();
+	auto loaded = std::make_unique<Dmg>();
+	bench::load_rom(*saved, nullptr);
+	bench::load_rom(*loaded, nullptr);
+	for (uint32_t i = 0; i < 10'003; i++)
+		saved->clock();
+	if (saved->cpu().instruction_boundary())
+		saved->clock();
+
+	saved->save_state(state);
+	loaded->load_state(state);
+	for (uint32_t i = 0; i < 100'000; i++)
+	{
+		saved->clock();
+		loaded->clock();
+	}
+
+	bool same = saved->cpu().registers() == loaded->cpu().registers() && saved->mem().cycles() == loaded->mem().cycles()
+		&& memcmp(saved->mem().direct_ram(), loaded->mem().direct_ram(), 0x10000) == 0;
+	if (!same)
+		printf("  m-cycle core diverged after loading in the middle of an instruction\n");
+	return same;
+}
+
+void print(char const* name, uint64_t count, double seconds, double const* baseline)
+{
+	printf("    %-12s %8.2f us", name, seconds * 1e6 / count);
+	if (baseline)
+		printf("  %5.2fx", *baseline / seconds);
+	printf("\n");
+}
+
+}
+
+int bench::state(int argc, char* argv[])
+{
+	uint64_t count = argc >= 1 ? strtoull(argv[0], nullptr, 10) : 100'000;
+
+	printf("state: %llu saves and loads, %zu bytes per state\n", static_cast<unsigned long long>(count), sizeof(Dmg::State));
+
+	// the one allocation, every check and timing below reuses it
+	auto state = std::make_unique<Dmg::State>();
+
+	for (Program const& program : s_programs)
+		for (uint32_t seed = 1; seed <= program.seeds; seed++)
+			for (Dmg::Execution execution : s_executions)
+				if (!check_program(program, seed, execution, *state))
+				{
+					printf("  %s seed %u diverged with execution %d\n", program.name, seed, static_cast<int>(execution));
+					return 1;
+				}
+	if (!check_m_cycle(*state))
+		return 1;
+
+	// a state only fits the cartridge it was saved with
+	auto cartridge = std::make_unique<Dmg>();
+	auto none = std::make_unique<Dmg>();
+	load_ram_program(*cartridge, 0);
+	cartridge->save_state(*state);
+	if (none->load_state(*state))
+	{
+		printf("  loaded a state of another cartridge\n");
+		return 1;
+	}
+	printf("  lockstep ok\n");
+
+	auto copy = std::make_unique<Dmg::State>();
+	uint64_t sum = 0;
+
+	for (Program const& program : { s_programs[0], s_programs[1] })
+	{
+		auto dmg = std::make_unique<Dmg>();
+		dmg->set_execution(Dmg::Execution::Block);
+		program.load(*dmg, 0);
+		for (uint32_t i = 0; i < 5'000; i++)
+			dmg->step();
+
+		printf("  %s\n", program.name);
+
+		// the floor, every byte of the state
+		Timer copy_timer;
+		for (uint64_t i = 0; i < count; i++)
+		{
+			memcpy(copy.get(), state.get(), sizeof(Dmg::State));
+			sum += copy->mem.ram[i & 0xFFFF];
+		}
+		double copied = copy_timer.seconds();
+		print("memcpy", count, copied, nullptr);
+
+		Timer save_timer;
+		for (uint64_t i = 0; i < count; i++)
+		{
+			dmg->save_state(*state);
+			sum += state->mem.ram[i & 0xFFFF];
+		}
+		print("save", count, save_timer.seconds(), &copied);
+
+		// loads that change nothing the block cache decoded, as in a search going back
+		// to the same state
+		Timer load_timer;
+		for (uint64_t i = 0; i < count; i++)
+		{
+			dmg->load_state(*state);
+			sum += dmg->step();
+		}
+		print("load+step", count, load_timer.seconds(), &copied);
+	}
+
+	// keeps the copies from being optimized away
+	printf("  checksum %016llx\n", static_cast<unsigned long long>(sum));
+	return 0;
+}
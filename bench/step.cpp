@@ -0,0 +1,47 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+// Checks the instruction stepped core against the M-cycle core in lockstep, on the rom and on
+// random programs covering every opcode, then compares their speed.
+
+int bench::step(int argc, char* argv[])
+{
+	char const* rom = argc >= 1 ? argv[0] : nullptr;
+	uint64_t m_cycles = argc >= 2 ? strtoull(argv[1], nullptr, 10) : 50'000'000;
+
+	printf("step: %s, %llu M-cycles\n", rom ? rom : "roms/test-loop.z80", static_cast<unsigned long long>(m_cycles));
+
+	auto reference = std::make_unique<Dmg>();
+	auto candidate = std::make_unique<Dmg>();
+	candidate->set_execution(Dmg::Execution::Instruction);
+
+	load_rom(*reference, rom);
+	load_rom(*candidate, rom);
+	if (!lockstep(*reference, *candidate, 100'000))
+		return 1;
+
+	for (uint32_t seed = 1; seed <= 64; seed++)
+	{
+		reference->cpu().reset();
+		candidate->cpu().reset();
+		load_random_program(*reference, seed);
+		load_random_program(*candidate, seed);
+		if (!lockstep(*reference, *candidate, 10'000))
+			return 1;
+	}
+	printf("  lockstep ok\n");
+
+	reference->cpu().reset();
+	candidate->cpu().reset();
+	load_rom(*reference, rom);
+	load_rom(*candidate, rom);
+
+	Result m_cycle = run(*reference, m_cycles);
+	print_result("m-cycle", m_cycle);
+	print_result("instruction", run_steps(*candidate, m_cycles), &m_cycle);
+
+	return 0;
+}
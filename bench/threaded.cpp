@@ -0,0 +1,157 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Checks the threaded interpreter against the instruction stepped core in lockstep, then
+// compares the opcode switch, the s_step table and the threaded interpreter on the rom and on
+// a long run of random register instructions, counting branch misses where perf events are
+// available. Only built by the bench-threaded target.
+
+namespace
+{
+
+// hardware counter of the calling thread, reads 0 where perf events are not available
+class Counter
+{
+public:
+	explicit Counter(uint64_t config)
+	{
+		perf_event_attr attr {};
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = config;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		m_fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+	}
+	~Counter()
+	{
+		if (m_fd >= 0)
+			close(m_fd);
+	}
+
+	bool available() const { return m_fd >= 0; }
+
+	uint64_t read() const
+	{
+		uint64_t value = 0;
+		if (m_fd < 0 || ::read(m_fd, &value, sizeof(value)) != sizeof(value))
+			return 0;
+		return value;
+	}
+
+private:
+	int m_fd;
+};
+
+// 4096 random loads and alu operations between registers, then jp $0100
+void load_mix(Dmg& dmg)
+{
+	std::mt19937 random(1);
+	uint8_t* ram = dmg.mem().direct_ram();
+
+	uint16_t addr = 0x0100;
+	while (addr < 0x1100)
+	{
+		uint8_t opcode = static_cast<uint8_t>(0x40 + random() % 0x80);
+		bool hl = (opcode & 0x07) == 6 || (opcode >= 0x70 && opcode < 0x78);
+		if (!hl)
+			ram[addr++] = opcode;
+	}
+	ram[addr++] = 0xC3;
+	ram[addr++] = 0x00;
+	ram[addr++] = 0x01;
+
+	dmg.cpu().invalidate_blocks();
+}
+
+void measure(char const* workload, char const* rom, bool mix, uint64_t m_cycles)
+{
+	struct Core
+	{
+		char const* name;
+		Dmg::Execution execution;
+		Cpu::Dispatch dispatch;
+	};
+	static constexpr Core s_cores[] = {
+		{ "switch", Dmg::Execution::MCycle, Cpu::Dispatch::Switch },
+		{ "instruction", Dmg::Execution::Instruction, Cpu::Dispatch::Table },
+		{ "threaded", Dmg::Execution::Threaded, Cpu::Dispatch::Table },
+	};
+
+	printf("  %s\n", workload);
+
+	bench::Result baseline {};
+	for (Core const& core : s_cores)
+	{
+		auto dmg = std::make_unique<Dmg>();
+		dmg->set_execution(core.execution);
+		dmg->cpu().set_dispatch(core.dispatch);
+		if (mix)
+			load_mix(*dmg);
+		else
+			bench::load_rom(*dmg, rom);
+
+		Counter branches(PERF_COUNT_HW_BRANCH_INSTRUCTIONS);
+		Counter misses(PERF_COUNT_HW_BRANCH_MISSES);
+		uint64_t branches_before = branches.read();
+		uint64_t misses_before = misses.read();
+
+		bench::Result result = bench::run_steps(*dmg, m_cycles);
+
+		uint64_t branch_count = branches.read() - branches_before;
+		uint64_t miss_count = misses.read() - misses_before;
+
+		bench::print_result(core.name, result, core.execution == Dmg::Execution::MCycle ? nullptr : &baseline);
+		if (core.execution == Dmg::Execution::MCycle)
+			baseline = result;
+
+		if (misses.available())
+			printf("  %-12s %9.2f branches %6.3f misses per M-cycle\n", "",
+				static_cast<double>(branch_count) / result.m_cycles, static_cast<double>(miss_count) / result.m_cycles);
+		else
+			printf("  %-12s branch counters not available\n", "");
+	}
+}
+
+}
+
+int bench::threaded(int argc, char* argv[])
+{
+	char const* rom = argc >= 1 ? argv[0] : nullptr;
+	uint64_t m_cycles = argc >= 2 ? strtoull(argv[1], nullptr, 10) : 50'000'000;
+
+	printf("threaded: %s, %llu M-cycles\n", rom ? rom : "roms/test-loop.z80", static_cast<unsigned long long>(m_cycles));
+
+	auto reference = std::make_unique<Dmg>();
+	auto candidate = std::make_unique<Dmg>();
+	reference->set_execution(Dmg::Execution::Instruction);
+	candidate->set_execution(Dmg::Execution::Threaded);
+
+	load_rom(*reference, rom);
+	load_rom(*candidate, rom);
+	if (!lockstep(*reference, *candidate, 100'000))
+		return 1;
+
+	for (uint32_t seed = 1; seed <= 64; seed++)
+	{
+		reference->cpu().reset();
+		candidate->cpu().reset();
+		load_random_program(*reference, seed);
+		load_random_program(*candidate, seed);
+		if (!lockstep(*reference, *candidate, 10'000))
+			return 1;
+	}
+	printf("  lockstep ok\n");
+
+	measure("rom", rom, false, m_cycles);
+	measure("register mix", nullptr, true, m_cycles);
+
+	return 0;
+}
@@ -0,0 +1,206 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+namespace
+{
+
+using Input = std::vector<std::pair<uint64_t, uint8_t>>;
+
+bool read_input(std::string const& path, Input& input)
+{
+	std::ifstream file(path);
+	if (!file)
+		return false;
+
+	uint64_t frame;
+	uint32_t buttons;
+	while (file >> std::dec >> frame >> std::hex >> buttons)
+		input.emplace_back(frame, static_cast<uint8_t>(buttons));
+	if (!file.eof())
+		return false;
+
+	std::stable_sort(input.begin(), input.end(), [](auto const& a, auto const& b) { return a.first < b.first; });
+	return true;
+}
+
+void run_job(Dmg& dmg, batch::Job const& job, batch::Result& result)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	result = {};
+	Input input;
+	if (!job.input.empty() && !read_input(job.input, input))
+	{
+		result.status = batch::Result::Status::Error;
+		result.error = "could not read input file";
+		return;
+	}
+
+	// the cartridge first, the reset clears what the last job left in memory
+	if (!dmg.insert_cartridge(job.rom, false))
+	{
+		result.status = batch::Result::Status::Error;
+		result.error = "could not load rom";
+		return;
+	}
+	dmg.reset();
+	dmg.set_serial_output(&result.serial);
+
+	uint64_t end = job.frames ? job.budget * Dmg::s_frame_cycles : job.budget;
+	size_t next_input = 0;
+	result.status = batch::Result::Status::Done;
+
+	for (uint64_t frame = 0; dmg.mem().cycles() < end; frame++)
+	{
+		while (next_input < input.size() && input[next_input].first <= frame)
+			dmg.set_buttons(input[next_input++].second);
+
+		dmg.run_until(std::min((frame + 1) * Dmg::s_frame_cycles, end));
+		if (dmg.cpu().stopped())
+		{
+			result.status = batch::Result::Status::Stopped;
+			break;
+		}
+	}
+
+	dmg.set_serial_output(nullptr);
+	result.m_cycles = dmg.mem().cycles();
+	result.frames = result.m_cycles / Dmg::s_frame_cycles;
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void write_string(std::ostream& out, std::string const& string)
+{
+	// bytes above $7F are taken as Latin-1, the serial port sends whatever the game likes
+	out << '"';
+	for (char c : string)
+	{
+		uint8_t byte = static_cast<uint8_t>(c);
+		if (byte == '"' || byte == '\\')
+			out << '\\' << c;
+		else if (byte == '\n')
+			out << "\\n";
+		else if (byte < 0x20 || byte >= 0x7F)
+		{
+			char escape[8];
+			snprintf(escape, sizeof(escape), "\\u%04x", byte);
+			out << escape;
+		}
+		else
+			out << c;
+	}
+	out << '"';
+}
+
+char const* status_name(batch::Result::Status status)
+{
+	switch (status)
+	{
+		case batch::Result::Status::Done: return "done";
+		case batch::Result::Status::Stopped: return "stopped";
+		default: return "error";
+	}
+}
+
+}
+
+bool batch::read_jobs(std::string const& path, std::vector<Job>& jobs)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		printf("Could not open job list '%s'.\n", path.c_str());
+		return false;
+	}
+
+	std::string line;
+	for (uint32_t number = 1; std::getline(file, line); number++)
+	{
+		std::istringstream fields(line);
+		std::string rom;
+		std::string budget;
+		if (!(fields >> rom) || rom[0] == '#')
+			continue;
+
+		Job job;
+		job.rom = rom;
+		fields >> budget >> job.input;
+
+		char* unit = nullptr;
+		job.budget = strtoull(budget.c_str(), &unit, 10);
+		job.frames = *unit == 'f';
+		if (budget.empty() || unit == budget.c_str() || (*unit && strcmp(unit, "f") != 0))
+		{
+			printf("%s:%u: expected <rom> <M-cycles>|<frames>f [<input file>]\n", path.c_str(), number);
+			return false;
+		}
+		jobs.push_back(std::move(job));
+	}
+	return true;
+}
+
+std::vector<batch::Result> batch::run(std::vector<Job> const& jobs, Dmg::Execution execution, uint32_t threads)
+{
+	std::vector<Result> results(jobs.size());
+	if (!threads)
+		threads = std::max(std::thread::hardware_concurrency(), 1u);
+	threads = static_cast<uint32_t>(std::min<size_t>(threads, jobs.size()));
+
+	// jobs are taken one at a time, a long one doesn't hold up the others
+	std::atomic<size_t> next{ 0 };
+	auto worker = [&]
+	{
+		auto dmg = std::make_unique<Dmg>();
+		dmg->set_execution(execution);
+		// results hold no pixels
+		dmg->set_render_every(0);
+		for (size_t job = next++; job < jobs.size(); job = next++)
+			run_job(*dmg, jobs[job], results[job]);
+	};
+
+	std::vector<std::thread> pool;
+	for (uint32_t thread = 0; thread < threads; thread++)
+		pool.emplace_back(worker);
+	for (std::thread& thread : pool)
+		thread.join();
+	return results;
+}
+
+bool batch::write_results(std::string const& path, std::vector<Job> const& jobs, std::vector<Result> const& results)
+{
+	std::ofstream out(path);
+	if (!out)
+	{
+		printf("Could not open results file '%s' for writing.\n", path.c_str());
+		return false;
+	}
+
+	for (size_t job = 0; job < jobs.size(); job++)
+	{
+		Result const& result = results[job];
+		out << "{\"job\": " << job << ", \"rom\": ";
+		write_string(out, jobs[job].rom);
+		out << ", \"status\": \"" << status_name(result.status) << '"';
+		if (result.status == Result::Status::Error)
+		{
+			out << ", \"error\": ";
+			write_string(out, result.error);
+		}
+		out << ", \"m_cycles\": " << result.m_cycles << ", \"frames\": " << result.frames
+			<< ", \"seconds\": " << result.seconds << ", \"serial\": ";
+		write_string(out, result.serial);
+		out << "}\n";
+	}
+	return static_cast<bool>(out);
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "dmg.h"
+
+// Headless batch runs: a list of jobs, each a rom run for a budget of M-cycles or frames
+// with the buttons from an input file, spread over a pool of threads with one Dmg each.
+// Serial output is kept per job and the results are written as JSON lines.
+// See batch.cpp.
+
+namespace batch
+{
+
+struct Job
+{
+	std::string rom;
+	uint64_t budget;
+	bool frames;       // budget counts frames instead of M-cycles
+	// lines of <frame> <buttons>, the Dmg::Button bits in hex held from that frame on, empty
+	// for no buttons
+	std::string input;
+};
+
+struct Result
+{
+	enum class Status
+	{
+		Done,    // ran for the whole budget
+		Stopped, // the cpu stopped before
+		Error,   // rom or input file not loaded
+	};
+
+	Status status;
+	uint64_t m_cycles;
+	uint64_t frames;
+	double seconds;
+	std::string serial;
+	std::string error;
+};
+
+// Reads a job list, one job per line:
+//     <rom> <M-cycles>|<frames>f [<input file>]
+// Empty lines and lines starting with # are skipped. Prints why and returns false when a line
+// doesn't parse.
+bool read_jobs(std::string const& path, std::vector<Job>& jobs);
+
+// Runs the jobs on threads, 0 for one per core, results in the order of the jobs. Battery
+// backed ram starts blank, jobs never touch save files and no frames are drawn.
+std::vector<Result> run(std::vector<Job> const& jobs, Dmg::Execution execution, uint32_t threads = 0);
+
+// one JSON object per line and job
+bool write_results(std::string const& path, std::vector<Job> const& jobs, std::vector<Result> const& results);
+
+}
@@ -0,0 +1,259 @@
+#include "battery.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+BatteryRam::BatteryRam()
+	: m_data()
+	, m_shadow()
+	, m_file_data(nullptr)
+	, m_size(0)
+	, m_page_size(4096)
+	, m_pages_flushed(0)
+#ifdef _WIN32
+	, m_file(nullptr)
+	, m_mapping(nullptr)
+#endif
+	, m_sync_due(false)
+	, m_writing(false)
+	, m_stop(false)
+{ }
+
+BatteryRam::~BatteryRam()
+{
+	unmap();
+}
+
+#ifdef _WIN32
+
+bool BatteryRam::map_file(std::string const& path, size_t size, size_t& old_size)
+{
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		printf("Could not open save file '%s'.\n", path.c_str());
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	GetFileSizeEx(file, &file_size);
+	old_size = static_cast<size_t>(file_size.QuadPart);
+
+	// the mapping extends the file to size
+	m_file = file;
+	m_mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(size), nullptr);
+	if (m_mapping)
+		m_file_data = static_cast<uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, size));
+	if (!m_file_data)
+	{
+		printf("Could not map save file '%s'.\n", path.c_str());
+		unmap_file();
+		return false;
+	}
+
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	m_page_size = info.dwPageSize;
+	m_size = size;
+	return true;
+}
+
+void BatteryRam::write_back(size_t offset, size_t size)
+{
+	FlushViewOfFile(m_file_data + offset, size);
+	FlushFileBuffers(m_file);
+}
+
+void BatteryRam::unmap_file()
+{
+	if (m_file_data)
+		UnmapViewOfFile(m_file_data);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	if (m_file)
+		CloseHandle(m_file);
+	m_mapping = nullptr;
+	m_file = nullptr;
+}
+
+#else
+
+bool BatteryRam::map_file(std::string const& path, size_t size, size_t& old_size)
+{
+	int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+	{
+		printf("Could not open save file '%s'.\n", path.c_str());
+		return false;
+	}
+
+	struct stat st;
+	old_size = fstat(fd, &st) == 0 ? static_cast<size_t>(st.st_size) : 0;
+	if (old_size < size && ftruncate(fd, static_cast<off_t>(size)) != 0)
+	{
+		printf("Could not extend save file '%s'.\n", path.c_str());
+		close(fd);
+		return false;
+	}
+
+	void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		printf("Could not map save file '%s'.\n", path.c_str());
+		return false;
+	}
+
+	m_file_data = static_cast<uint8_t*>(data);
+	m_size = size;
+	m_page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	return true;
+}
+
+void BatteryRam::write_back(size_t offset, size_t size)
+{
+	msync(m_file_data + offset, size, MS_SYNC);
+}
+
+void BatteryRam::unmap_file()
+{
+	if (m_file_data)
+		munmap(m_file_data, m_size);
+}
+
+#endif
+
+bool BatteryRam::map(std::string const& path, size_t size, std::chrono::milliseconds interval)
+{
+	unmap();
+
+	size_t old_size = 0;
+	if (!map_file(path, size, old_size))
+		return false;
+
+	// what a new cartridge's ram holds, the first sync hands it to the thread
+	m_shadow = std::make_unique<uint8_t[]>(size);
+	memcpy(m_shadow.get(), m_file_data, size);
+	m_data = std::make_unique<uint8_t[]>(size);
+	size_t kept = std::min(old_size, size);
+	memcpy(m_data.get(), m_shadow.get(), kept);
+	memset(m_data.get() + kept, 0xFF, size - kept);
+
+	m_sync_due.store(false, std::memory_order_relaxed);
+	m_stop = false;
+	m_thread = std::thread(&BatteryRam::run, this, interval);
+	return true;
+}
+
+void BatteryRam::unmap()
+{
+	if (m_thread.joinable())
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			m_stop = true;
+		}
+		m_wake.notify_one();
+		m_thread.join();
+	}
+
+	// the thread is gone, what it left and what changed since go to the file from here
+	if (m_file_data)
+	{
+		stage_changed();
+		write(m_pending);
+		m_pending.clear();
+	}
+	unmap_file();
+	m_data.reset();
+	m_shadow.reset();
+	m_file_data = nullptr;
+	m_size = 0;
+}
+
+void BatteryRam::run(std::chrono::milliseconds interval)
+{
+	std::unique_lock lock(m_mutex);
+	while (!m_stop)
+	{
+		// the guest's thread hands over the changes at its next sync() once the interval is up
+		if (!m_wake.wait_for(lock, interval, [this] { return m_stop || !m_pending.empty(); }))
+		{
+			m_sync_due.store(true, std::memory_order_relaxed);
+			continue;
+		}
+		if (m_pending.empty())
+			continue;
+
+		std::vector<Run> runs;
+		runs.swap(m_pending);
+		m_writing = true;
+		lock.unlock();
+		write(runs);
+		lock.lock();
+		m_writing = false;
+		m_written.notify_all();
+	}
+}
+
+void BatteryRam::stage_changed()
+{
+	m_sync_due.store(false, std::memory_order_relaxed);
+
+	std::vector<Run> changed;
+	bool in_run = false;
+	for (size_t offset = 0; offset < m_size; offset += m_page_size)
+	{
+		size_t size = std::min(m_page_size, m_size - offset);
+		uint8_t const* page = m_data.get() + offset;
+		if (memcmp(page, m_shadow.get() + offset, size) == 0)
+		{
+			in_run = false;
+			continue;
+		}
+
+		// runs of changed pages go to the disk in one go
+		memcpy(m_shadow.get() + offset, page, size);
+		if (!in_run)
+			changed.push_back({ offset, {} });
+		changed.back().bytes.insert(changed.back().bytes.end(), page, page + size);
+		in_run = true;
+	}
+	if (changed.empty())
+		return;
+
+	{
+		std::lock_guard lock(m_mutex);
+		for (Run& run : changed)
+			m_pending.push_back(std::move(run));
+	}
+	m_wake.notify_one();
+}
+
+void BatteryRam::write(std::vector<Run> const& runs)
+{
+	for (Run const& run : runs)
+	{
+		memcpy(m_file_data + run.offset, run.bytes.data(), run.bytes.size());
+		write_back(run.offset, run.bytes.size());
+		m_pages_flushed.fetch_add((run.bytes.size() + m_page_size - 1) / m_page_size, std::memory_order_relaxed);
+	}
+}
+
+void BatteryRam::flush()
+{
+	stage_changed();
+	std::unique_lock lock(m_mutex);
+	m_written.wait(lock, [this] { return m_pending.empty() && !m_writing; });
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Battery backed cartridge ram, kept in its .sav file mapped read-write.
+// The guest reads and writes a copy of its own at page table speed. Writing to the mapping
+// would fault on every page a flush cleaned and could wait there for the disk, so only a thread
+// of its own touches the mapping. Once an interval has passed, sync() on the thread running the
+// guest compares the copy with a shadow of what it handed over last and copies the pages that
+// changed into the shadow and into runs for the thread, which copies them into the mapping and
+// waits for the disk to have them, so the emulation never does. Up to about one interval of
+// writes is lost when the process or the machine goes down.
+// See battery.cpp.
+
+class BatteryRam
+{
+public:
+	static constexpr std::chrono::milliseconds s_default_interval{ 1000 };
+
+	BatteryRam();
+	~BatteryRam();
+
+	BatteryRam(BatteryRam const&) = delete;
+	BatteryRam& operator=(BatteryRam const&) = delete;
+
+	// Maps size bytes of the file at path, creating it or filling what it lacks with $FF, and
+	// starts flushing every interval. Prints why and returns false when it can't.
+	bool map(std::string const& path, size_t size, std::chrono::milliseconds interval = s_default_interval);
+	// flushes and unmaps
+	void unmap();
+
+	bool mapped() const { return m_file_data; }
+	// the copy the guest uses
+	uint8_t* data() { return m_data.get(); }
+	size_t size() const { return m_size; }
+
+	// On the thread running the guest, at points it reaches often: hands the pages that
+	// changed to the flush thread once an interval has passed since the last time, else
+	// returns at once.
+	void sync()
+	{
+		if (m_sync_due.load(std::memory_order_relaxed))
+			stage_changed();
+	}
+	// on the same thread, hands the pages that changed to the flush thread and waits for it to
+	// have written them to the disk
+	void flush();
+
+	// pages written to the file so far
+	uint64_t pages_flushed() const { return m_pages_flushed.load(std::memory_order_relaxed); }
+
+private:
+	// changed pages in a row, copied for the flush thread
+	struct Run
+	{
+		size_t offset;
+		std::vector<uint8_t> bytes;
+	};
+
+	std::unique_ptr<uint8_t[]> m_data;
+	// the guest's copy as it was handed to the flush thread last, only the guest's thread uses it
+	std::unique_ptr<uint8_t[]> m_shadow;
+	// only the flush thread uses it while it runs
+	uint8_t* m_file_data;
+	size_t m_size;
+	size_t m_page_size;
+	std::atomic<uint64_t> m_pages_flushed;
+#ifdef _WIN32
+	void* m_file;
+	void* m_mapping;
+#endif
+
+	// set by the flush thread every interval
+	std::atomic<bool> m_sync_due;
+
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	// signalled when the flush thread has written what it took
+	std::condition_variable m_written;
+	// runs handed over and not taken by the flush thread yet, under m_mutex
+	std::vector<Run> m_pending;
+	// the flush thread is writing runs it took, under m_mutex
+	bool m_writing;
+	bool m_stop;
+
+	// platform part of map(), sets old_size to the size of the file before
+	bool map_file(std::string const& path, size_t size, size_t& old_size);
+	void run(std::chrono::milliseconds interval);
+	// copies the pages that differ from the shadow into it and hands them to the flush thread
+	void stage_changed();
+	// copies the runs into the mapping and writes them back
+	void write(std::vector<Run> const& runs);
+	// writes back size bytes at offset, whole pages
+	void write_back(size_t offset, size_t size);
+	void unmap_file();
+};
@@ -0,0 +1,249 @@
+#include "cartridge.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// smallest rom, two banks of 16 KiB
+static constexpr size_t s_min_size = 0x8000;
+
+Cartridge::Cartridge()
+	: m_rom(nullptr)
+	, m_size(0)
+	, m_file(false)
+	, m_header()
+	, m_ram()
+	, m_save()
+#ifdef _WIN32
+	, m_mapping(nullptr)
+#endif
+{ }
+
+Cartridge::~Cartridge()
+{
+	unmap();
+}
+
+#ifdef _WIN32
+
+bool Cartridge::map(std::string const& path, bool save)
+{
+	unmap();
+
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		printf("Could not open file '%s' for reading.\n", path.c_str());
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart < static_cast<LONGLONG>(s_min_size))
+	{
+		printf("'%s' is too small for a rom.\n", path.c_str());
+		CloseHandle(file);
+		return false;
+	}
+
+	// the mapping keeps the file open
+	m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (m_mapping)
+		m_rom = static_cast<uint8_t const*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!m_rom)
+	{
+		printf("Could not map '%s'.\n", path.c_str());
+		unmap_file();
+		m_rom = nullptr;
+		return false;
+	}
+	m_size = static_cast<size_t>(size.QuadPart);
+	m_file = true;
+
+	if (!check_header(path))
+	{
+		unmap();
+		return false;
+	}
+	if (save && m_header.battery && !m_ram.empty())
+		map_save(path.substr(0, path.find_last_of('.')) + ".sav");
+	return true;
+}
+
+void Cartridge::unmap_file()
+{
+	if (m_rom)
+		UnmapViewOfFile(m_rom);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	m_mapping = nullptr;
+}
+
+#else
+
+bool Cartridge::map(std::string const& path, bool save)
+{
+	unmap();
+
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		printf("Could not open file '%s' for reading.\n", path.c_str());
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(s_min_size))
+	{
+		printf("'%s' is too small for a rom.\n", path.c_str());
+		close(fd);
+		return false;
+	}
+
+	// the mapping keeps the file open
+	void* rom = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (rom == MAP_FAILED)
+	{
+		printf("Could not map '%s'.\n", path.c_str());
+		return false;
+	}
+	m_rom = static_cast<uint8_t const*>(rom);
+	m_size = static_cast<size_t>(st.st_size);
+	m_file = true;
+
+	if (!check_header(path))
+	{
+		unmap();
+		return false;
+	}
+	if (save && m_header.battery && !m_ram.empty())
+		map_save(path.substr(0, path.find_last_of('.')) + ".sav");
+	return true;
+}
+
+void Cartridge::unmap_file()
+{
+	if (m_rom)
+		munmap(const_cast<uint8_t*>(m_rom), m_size);
+}
+
+#endif
+
+static bool battery(uint8_t cartridge_type)
+{
+	switch (cartridge_type)
+	{
+		case 0x03: case 0x06: case 0x09: case 0x0D: case 0x0F: case 0x10: case 0x13: case 0x1B: case 0x1E:
+			return true;
+		default:
+			return false;
+	}
+}
+
+bool Cartridge::map(uint8_t const* rom, size_t size)
+{
+	unmap();
+
+	if (size < s_min_size)
+	{
+		printf("The rom image is too small.\n");
+		return false;
+	}
+
+	m_rom = rom;
+	m_size = size;
+	if (!check_header("image"))
+	{
+		unmap();
+		return false;
+	}
+	return true;
+}
+
+bool Cartridge::map_save(std::string const& path, std::chrono::milliseconds interval)
+{
+	// runs on without a save file, like a cartridge with a dead battery
+	if (!m_save.map(path, m_ram.size(), interval))
+		return false;
+
+	// MBC2 has ram that reads $F in the upper half of each byte
+	if (m_header.mapper == Mapper::Kind::Mbc2)
+		for (size_t offset = 0; offset < m_save.size(); offset++)
+			m_save.data()[offset] |= 0xF0;
+	return true;
+}
+
+void Cartridge::unmap()
+{
+	m_save.unmap();
+	if (m_file)
+		unmap_file();
+	m_rom = nullptr;
+	m_size = 0;
+	m_file = false;
+	m_header = {};
+	m_ram.clear();
+}
+
+bool Cartridge::check_header(std::string const& path)
+{
+	// what the boot rom checks before it starts the cartridge
+	uint8_t checksum = 0;
+	for (uint16_t addr = 0x0134; addr <= 0x014C; addr++)
+		checksum = checksum - m_rom[addr] - 1;
+	if (checksum != m_rom[0x014D])
+	{
+		printf("'%s' has a header checksum of $%02x, $%02x expected.\n", path.c_str(), m_rom[0x014D], checksum);
+		return false;
+	}
+
+	uint8_t rom_code = m_rom[0x0148];
+	if (rom_code > 0x08)
+	{
+		printf("'%s' has an unknown rom size $%02x.\n", path.c_str(), rom_code);
+		return false;
+	}
+	m_header.rom_size = static_cast<uint32_t>(s_min_size) << rom_code;
+	if (m_size < m_header.rom_size)
+	{
+		printf("'%s' is %zu bytes, its header says %u.\n", path.c_str(), m_size, m_header.rom_size);
+		return false;
+	}
+
+	static constexpr uint32_t s_ram_sizes[] = { 0, 0x800, 0x2000, 0x8000, 0x20000, 0x10000 };
+	uint8_t ram_code = m_rom[0x0149];
+	if (ram_code >= std::size(s_ram_sizes))
+	{
+		printf("'%s' has an unknown ram size $%02x.\n", path.c_str(), ram_code);
+		return false;
+	}
+	m_header.ram_size = s_ram_sizes[ram_code];
+
+	m_header.type = m_rom[0x0147];
+	m_header.mapper = Mapper::kind(m_header.type);
+	m_header.battery = battery(m_header.type);
+	if (m_header.mapper == Mapper::Kind::Unsupported)
+	{
+		printf("'%s' has an unsupported cartridge type $%02x.\n", path.c_str(), m_header.type);
+		return false;
+	}
+
+	// 16 characters on the first cartridges, 11 plus a manufacturer code and the cgb flag later
+	memcpy(m_header.title, m_rom + 0x0134, 16);
+	m_header.title[16] = '\0';
+
+	// MBC2 has its ram built in, whatever the header says
+	m_ram.assign(m_header.mapper == Mapper::Kind::Mbc2 ? 0x200 : m_header.ram_size, 0xFF);
+	return true;
+}
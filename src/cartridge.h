@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "battery.h"
+#include "mapper.h"
+
+// ROM image of a cartridge, mapped read-only from its file instead of read into memory, so
+// loading costs nothing up front and every process running the same rom shares its pages
+// through the page cache. The header is checked before the image is used. Also holds the
+// external ram the cartridge carries, kept in the .sav file next to the rom when a battery
+// backs it.
+// See cartridge.cpp.
+
+class Cartridge
+{
+public:
+	// $0134-$014F
+	struct Header
+	{
+		char title[17];
+		uint8_t type;      // mapper and extras, $0147
+		Mapper::Kind mapper;
+		bool battery;      // keeps the external ram while switched off
+		uint32_t rom_size; // bytes, from $0148
+		uint32_t ram_size; // bytes of external ram, from $0149
+	};
+
+	Cartridge();
+	~Cartridge();
+
+	Cartridge(Cartridge const&) = delete;
+	Cartridge& operator=(Cartridge const&) = delete;
+
+	// Maps the rom at path, replacing the one mapped before. Prints why and returns false when
+	// the file can't be mapped or its header is invalid, leaving no rom mapped. Battery backed
+	// ram is mapped from the path with a .sav extension, unless save is false.
+	bool map(std::string const& path, bool save = true);
+	// same with an image already in memory, which has to outlive the cartridge
+	bool map(uint8_t const* rom, size_t size);
+	void unmap();
+
+	bool mapped() const { return m_rom; }
+	uint8_t const* rom() const { return m_rom; }
+	size_t size() const { return m_size; }
+	Header const& header() const { return m_header; }
+
+	// external ram, MBC2's 512 half bytes take a byte each
+	uint8_t* ram() { return m_save.mapped() ? m_save.data() : m_ram.data(); }
+	size_t ram_size() const { return m_save.mapped() ? m_save.size() : m_ram.size(); }
+
+	// Keeps the external ram in the file at path from now on, flushed every interval. Done by
+	// map() for battery backed cartridges, before Mem maps the cartridge in.
+	bool map_save(std::string const& path, std::chrono::milliseconds interval = BatteryRam::s_default_interval);
+	// hands the external ram changed to the flush thread once an interval has passed, see
+	// BatteryRam::sync()
+	void sync_save() { if (m_save.mapped()) m_save.sync(); }
+	// writes the external ram out to its file now
+	void flush_save() { if (m_save.mapped()) m_save.flush(); }
+	BatteryRam const& save() const { return m_save; }
+
+private:
+	uint8_t const* m_rom;
+	size_t m_size;
+	bool m_file; // m_rom is a mapping of our own
+	Header m_header;
+	std::vector<uint8_t> m_ram;
+	BatteryRam m_save;
+#ifdef _WIN32
+	void* m_mapping;
+#endif
+
+	bool check_header(std::string const& path);
+	void unmap_file();
+};
@@ -1,19 +1,194 @@
 #include "cpu.h"
-#include "cpu_instruction_name_table.h"
+#include "cpu_alu.h"
+#include "cpu_block.h"
+#ifdef GB_JIT
+#include "cpu_jit.h"
+#endif
+#include "cpu_opcodes.h"
 
 // temp
 #include "dmg.h"
 
+#include <bit>
 #include <cassert>
 #include <cstdio>
 
 Cpu::Cpu(Bus& bus, Mem& mem)
 	: m_bus(bus)
 	, m_mem(mem)
-	, m_instruction_remaining_cycles(-1)
+	, m_undefined_opcodes(0)
+	, m_last_undefined_opcode(0)
+	, m_dispatch(Dispatch::Table)
+	, m_dispatch_row(nullptr)
+	, m_fusion(true)
 { 
+	reset();
+}
+
+Cpu::~Cpu() = default;
+
+void Cpu::reset()
+{
+	RAF = 0x0000;
+	set_flags(0x00);
+	RBC = 0x0000;
+	RDE = 0x0000;
+	RHL = 0x0000;
 	RPC = 0x0100;
 	RSP = 0xFFFE;
+
+	m_stop = false;
+	m_ime = false;
+	m_ei_pending = false;
+	m_halted = false;
+	m_instruction_remaining_cycles = -1;
+	m_instruction_cycles = 0;
+	m_interrupt_cycles = 0;
+	m_mem.request_update();
+}
+
+void Cpu::save_state(State& state) const
+{
+	state.af = RAF;
+	state.bc = RBC;
+	state.de = RDE;
+	state.hl = RHL;
+	state.sp = RSP;
+	state.pc = RPC;
+	state.flag_result = m_flag_result;
+	state.flag_a = m_flag_a;
+	state.flag_b = m_flag_b;
+	state.flag_n = m_flag_n;
+	state.stop = m_stop;
+	state.ime = m_ime;
+	state.ei_pending = m_ei_pending;
+	state.halted = m_halted;
+	state.instruction_bytes[0] = m_instruction_byte0;
+	state.instruction_bytes[1] = m_instruction_byte1;
+	state.instruction_bytes[2] = m_instruction_byte2;
+	state.instruction_remaining_cycles = m_instruction_remaining_cycles;
+	state.instruction_cycles = m_instruction_cycles;
+	state.interrupt_cycles = m_interrupt_cycles;
+	state.dispatch_row = m_dispatch_row;
+}
+
+void Cpu::load_state(State const& state)
+{
+	RAF = state.af;
+	RBC = state.bc;
+	RDE = state.de;
+	RHL = state.hl;
+	RSP = state.sp;
+	RPC = state.pc;
+	m_flag_result = state.flag_result;
+	m_flag_a = state.flag_a;
+	m_flag_b = state.flag_b;
+	m_flag_n = state.flag_n;
+	m_stop = state.stop;
+	m_ime = state.ime;
+	m_ei_pending = state.ei_pending;
+	m_halted = state.halted;
+	m_instruction_byte0 = state.instruction_bytes[0];
+	m_instruction_byte1 = state.instruction_bytes[1];
+	m_instruction_byte2 = state.instruction_bytes[2];
+	m_instruction_remaining_cycles = state.instruction_remaining_cycles;
+	m_instruction_cycles = state.instruction_cycles;
+	m_interrupt_cycles = state.interrupt_cycles;
+	m_dispatch_row = static_cast<MCycle const*>(state.dispatch_row);
+}
+
+char const* Cpu::instruction_name(uint8_t byte0, uint8_t byte1)
+{
+	return byte0 == 0xCB ? s_opcodes[0x100 | byte1].name : s_opcodes[byte0].name;
+}
+
+uint8_t Cpu::instruction_length(uint8_t byte0)
+{
+	return s_opcodes[byte0].length;
+}
+
+void Cpu::invalidate_blocks()
+{
+	if (m_block_cache)
+		m_block_cache->invalidate_all();
+#ifdef GB_JIT
+	if (m_jit)
+		m_jit->invalidate_all();
+#endif
+}
+
+void Cpu::set_fusion(bool fusion)
+{
+	m_fusion = fusion;
+	if (m_block_cache)
+		m_block_cache->invalidate_all();
+}
+
+void Cpu::invalidate_written_code()
+{
+	if (m_block_cache)
+		m_block_cache->invalidate_written(m_mem);
+#ifdef GB_JIT
+	if (m_jit)
+		m_jit->invalidate_written(m_mem);
+#endif
+	m_mem.clear_written_code();
+}
+
+void Cpu::halt()
+{
+	// nothing could ever wake the cpu
+	uint8_t const* io = m_mem.io();
+	if (!(io[0xFF] & io[0x0F] & 0x1F) && m_mem.next_interrupt() == Mem::s_never)
+	{
+		stop();
+		return;
+	}
+
+	m_halted = true;
+	m_mem.request_update();
+}
+
+uint8_t Cpu::update()
+{
+	if (m_mem.code_written())
+		invalidate_written_code();
+	m_mem.update();
+
+	uint8_t* io = m_mem.io();
+	uint8_t requested = io[0xFF] & io[0x0F] & 0x1F;
+
+	if (m_halted)
+	{
+		if (!requested)
+		{
+			m_mem.request_update();
+			return 0;
+		}
+		m_halted = false;
+	}
+
+	if (m_ei_pending)
+	{
+		// the instruction after EI runs before any interrupt
+		m_ei_pending = false;
+		m_ime = true;
+		m_mem.request_update();
+		return 0;
+	}
+
+	if (!m_ime || !requested)
+		return 0;
+
+	// lowest bit first: VBlank, STAT, timer, serial, joypad
+	uint8_t bit = static_cast<uint8_t>(std::countr_zero(requested));
+	io[0x0F] &= ~(1 << bit);
+	m_ime = false;
+	m_mem.write(--RSP, RPC >> 8);
+	m_mem.write(--RSP, RPC & 0xFF);
+	RPC = 0x40 + bit * 8;
+	m_mem.add_cycles(5);
+	return 5;
 }
 
 void Cpu::clock()
@@ -21,11 +196,7 @@ void Cpu::clock()
 	// docs/gbctr.pdf figure 1.1
 
 	if (m_stop)
-	{
-		printf("CPU STOP!\n");
-		exit(0);
 		return;
-	}
 
 	if (m_instruction_remaining_cycles < 0)
 	{
@@ -40,8 +211,34 @@ void Cpu::clock()
 		return;
 	}
 
+	if (m_interrupt_cycles > 0)
+	{
+		// dispatch in progress, update() already wrote the return address
+		if (--m_interrupt_cycles == 0)
+			m_bus.write_addr(RPC);
+		return;
+	}
+
 	if (m_instruction_remaining_cycles == 0)
+	{
+		if (m_mem.cycles() >= m_mem.deadline())
+		{
+			if (uint8_t cycles = update())
+			{
+				m_interrupt_cycles = cycles - 1;
+				return;
+			}
+			if (m_halted)
+			{
+				m_mem.add_cycles(1);
+				return;
+			}
+		}
+
 		m_instruction_byte0 = m_bus.read_data();
+		m_dispatch_row = s_dispatch[m_instruction_byte0].cycle;
+		m_instruction_cycles = 0;
+	}
 
 
 #if 0
@@ -49,28 +246,28 @@ void Cpu::clock()
 	if (m_instruction_remaining_cycles == 0)
 	{
 		printf("$%04x:", RPC);
-		if (s_instruction_names.contains(m_instruction_byte0))
-		{
-			int8_t instruction_size = std::get<1>(s_instruction_names.at(m_instruction_byte0));
-
-			for (int8_t i = 0; i < instruction_size; i++)
-				printf(" %02X", m_mem.direct_ram()[RPC + i]);
-			for (int8_t i = instruction_size; i < 6; i++)
-				printf("   ");
-			
-			if (m_instruction_byte0 == 0xCB) // PREFIX CB
-				printf(" %s\n", s_prefixed_instruction_names[m_mem.direct_ram()[RPC + 1]]);
-			else
-				printf(" %s\n", std::get<0>(s_instruction_names.at(m_instruction_byte0)).c_str());
-		}
-		else
-			printf(" %02X                %#04x\n",m_mem.direct_ram()[RPC], m_instruction_byte0);
+		Opcode const& opcode = s_opcodes[m_instruction_byte0];
+
+		for (uint8_t i = 0; i < opcode.length; i++)
+			printf(" %02X", m_mem.direct_ram()[RPC + i]);
+		for (uint8_t i = opcode.length; i < 6; i++)
+			printf("   ");
+
+		printf(" %s\n", instruction_name(m_instruction_byte0, m_mem.direct_ram()[RPC + 1]));
 	}
 #endif
 
 
-	m_instruction_remaining_cycles = execute_instruction();
+	if (m_dispatch == Dispatch::Table)
+		m_instruction_remaining_cycles = m_dispatch_row[m_instruction_remaining_cycles](*this);
+	else
+		m_instruction_remaining_cycles = execute_instruction();
+
+	++m_instruction_cycles;
 
 	if (m_instruction_remaining_cycles == 0)
+	{
+		m_mem.add_cycles(m_instruction_cycles);
 		m_bus.write_addr(RPC); // fetch next instruction
+	}
 }
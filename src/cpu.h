@@ -1,19 +1,176 @@
 #pragma once
 #include <cstdint>
-#include <string>
-#include <map>
-#include <tuple>
+#include <array>
+#include <memory>
 
 #include "bus.h"
 #include "mem.h"
 
-class Cpu
+// The alu and the lazy flags, written once against the register storage Regs: Cpu itself, or
+// one lane of Lanes. Regs holds RA, RHL, RSP and the lazy flags m_flag_result, m_flag_a,
+// m_flag_b and m_flag_n. See cpu_alu.h.
+template <typename Regs>
+class Alu
 {
 public:
+	bool flag_z() const { return static_cast<uint8_t>(regs().m_flag_result) == 0; }
+	bool flag_n() const { return regs().m_flag_n; }
+	bool flag_h() const { return (regs().m_flag_a ^ regs().m_flag_b ^ regs().m_flag_result) & 0x10; }
+	bool flag_c() const { return regs().m_flag_result & 0x100; }
+	uint8_t flags() const
+	{
+		Regs const& cpu = regs();
+		return static_cast<uint8_t>(flag_z() << 7 | flag_n() << 6 | ((cpu.m_flag_a ^ cpu.m_flag_b ^ cpu.m_flag_result) & 0x10) << 1
+			| (cpu.m_flag_result >> 4 & 0x10));
+	}
+	void set_flags(bool z, bool n, bool h, bool c);
+	void set_flags(uint8_t f);
+	void set_result_flags(uint8_t result, bool c);
+
+	void alu_add(uint8_t r);
+	void alu_adc(uint8_t r);
+	void alu_sub(uint8_t r);
+	void alu_sbc(uint8_t r);
+	void alu_and(uint8_t r);
+	void alu_xor(uint8_t r);
+	void alu_or(uint8_t r);
+	void alu_cp(uint8_t r);
+	uint8_t alu_inc(uint8_t r);
+	uint8_t alu_dec(uint8_t r);
+	void alu_add_hl(uint16_t rr);
+	uint16_t alu_add_sp(uint8_t n);
+	void alu_daa();
+	uint8_t alu_rlc(uint8_t r);
+	uint8_t alu_rrc(uint8_t r);
+	uint8_t alu_rl(uint8_t r);
+	uint8_t alu_rr(uint8_t r);
+	uint8_t alu_sla(uint8_t r);
+	uint8_t alu_sra(uint8_t r);
+	uint8_t alu_swap(uint8_t r);
+	uint8_t alu_srl(uint8_t r);
+	void alu_bit(uint8_t bit, uint8_t r);
+
+private:
+	Regs& regs() { return static_cast<Regs&>(*this); }
+	Regs const& regs() const { return static_cast<Regs const&>(*this); }
+};
+
+class Cpu : private Alu<Cpu>
+{
+public:
+	enum class Dispatch
+	{
+		Switch, // execute_instruction() re-enters the opcode switch every M-cycle
+		Table,  // one indirect call per M-cycle through s_dispatch
+	};
+
+	struct Registers
+	{
+		uint16_t af;
+		uint16_t bc;
+		uint16_t de;
+		uint16_t hl;
+		uint16_t sp;
+		uint16_t pc;
+		bool ime;
+
+		bool operator==(Registers const&) const = default;
+	};
+
+	struct BlockStats
+	{
+		uint64_t decoded;     // blocks decoded from memory
+		uint64_t invalidated; // blocks dropped because their code was written
+		uint64_t chained;     // blocks entered through a direct jump without a lookup
+		uint64_t looked_up;   // blocks found in the cache by (bank, pc)
+		uint64_t fused;       // runs of instructions decoded into one fused handler
+	};
+
+#ifdef GB_JIT
+	struct JitStats
+	{
+		uint64_t translated;  // blocks translated to host code
+		uint64_t invalidated; // translations dropped because their code was written
+		uint64_t native;      // instructions translated inline
+		uint64_t called;      // instructions left to their s_step handler
+		uint64_t code_bytes;  // host code emitted
+	};
+#endif
+
+	// everything that changes while running, including an instruction of the M-cycle core in
+	// flight, see Dmg::State
+	struct State
+	{
+		uint16_t af, bc, de, hl, sp, pc;
+		uint16_t flag_result;
+		uint8_t flag_a;
+		uint8_t flag_b;
+		bool flag_n;
+		bool stop;
+		bool ime;
+		bool ei_pending;
+		bool halted;
+		uint8_t instruction_bytes[3];
+		int8_t instruction_remaining_cycles;
+		uint8_t instruction_cycles;
+		uint8_t interrupt_cycles;
+		void const* dispatch_row;
+	};
+
 	Cpu(Bus& bus, Mem& mem);
-	~Cpu() = default;
+	~Cpu();
 
+	// advance one M-cycle through the bus
 	void clock();
+	// execute one whole instruction with direct memory access, returns the M-cycles it took
+	uint8_t step();
+	// execute one predecoded basic block with direct memory access, returns the M-cycles it took
+	uint32_t run_block();
+#ifdef GB_JIT
+	// execute one basic block translated to x86-64, returns the M-cycles it took
+	uint32_t run_jit();
+#endif
+#ifdef GB_THREADED
+	// execute instructions through computed gotos until an event is due or a slice of M-cycles
+	// is over, returns the M-cycles it took
+	uint32_t run_threaded();
+#endif
+	void reset();
+
+	void save_state(State& state) const;
+	void load_state(State const& state);
+
+	// drops every predecoded and translated block, needed after changing code through Mem::direct_ram()
+	void invalidate_blocks();
+	BlockStats block_stats() const;
+#ifdef GB_JIT
+	JitStats jit_stats() const;
+#endif
+
+	// name and length in bytes of the instruction starting with byte0, byte1 selects the CB prefixed ones
+	static char const* instruction_name(uint8_t byte0, uint8_t byte1);
+	static uint8_t instruction_length(uint8_t byte0);
+	// true for the instructions a basic block ends at: jumps, calls, returns, RST, DI, EI, STOP and HALT
+	static bool ends_block(uint8_t byte0);
+
+	// lets the block cache run common instruction sequences through one fused handler, on by default
+	void set_fusion(bool fusion);
+	bool fusion() const { return m_fusion; }
+
+	void set_dispatch(Dispatch dispatch) { m_dispatch = dispatch; }
+	Dispatch dispatch() const { return m_dispatch; }
+
+	bool stopped() const { return m_stop; }
+	// Undefined opcodes run since construction, which take an M-cycle and do nothing else, and
+	// the last of them. Left to the frontend to report.
+	uint64_t undefined_opcodes() const { return m_undefined_opcodes; }
+	uint8_t last_undefined_opcode() const { return m_last_undefined_opcode; }
+	// HALT waiting for an interrupt, the next step() or clock() wakes the cpu once one is requested
+	bool halted() const { return m_halted; }
+	// true between instructions of the M-cycle core
+	bool instruction_boundary() const { return m_instruction_remaining_cycles == 0 && m_interrupt_cycles == 0; }
+	Registers registers() const { return { static_cast<uint16_t>(RA << 8 | flags()), RBC, RDE, RHL, RSP, RPC, m_ime }; }
+	uint16_t pc() const { return RPC; }
 
 private:
 	Bus& m_bus;
@@ -23,14 +180,7 @@ private:
 	union {
 		uint16_t RAF;
 		struct {
-			uint8_t F0 : 1;
-			uint8_t F1 : 1;
-			uint8_t F2 : 1;
-			uint8_t F3 : 1;
-			uint8_t FC : 1;
-			uint8_t FH : 1;
-			uint8_t FN : 1;
-			uint8_t FZ : 1;
+			uint8_t RF; // only valid around PUSH AF and POP AF, see the flags below
 			uint8_t RA;
 		};
 	};
@@ -58,15 +208,101 @@ private:
 	uint16_t RSP;
 	uint16_t RPC;
 
+	// Lazy flags, see cpu_alu.h. F is derived from the last operation that set flags.
+	uint16_t m_flag_result;
+	uint8_t m_flag_a;
+	uint8_t m_flag_b;
+	bool m_flag_n;
+
 	bool m_stop;
+	uint64_t m_undefined_opcodes;
+	uint8_t m_last_undefined_opcode;
+
+	// interrupts
+	bool m_ime;
+	bool m_ei_pending; // EI sets IME after the next instruction
+	bool m_halted;
+
+	// ends whatever core is running at the next instruction
+	void stop() { m_stop = true; m_mem.request_update(); }
+	void halt();
+	void undefined_opcode()
+	{
+		++m_undefined_opcodes;
+		m_last_undefined_opcode = m_instruction_byte0;
+	}
+	void enable_interrupts() { m_ei_pending = true; m_mem.request_update(); }
+	void disable_interrupts() { m_ime = false; m_ei_pending = false; }
+	void return_from_interrupt() { m_ime = true; m_mem.request_update(); }
+	// Everything that happens between instructions once Mem's deadline is reached: written
+	// code, events, EI, waking from HALT and interrupt dispatch. Returns the M-cycles of a
+	// dispatch, already added to Mem::cycles(), or 0.
+	uint8_t update();
 
 	uint8_t m_instruction_byte0;
 	uint8_t m_instruction_byte1;
 	uint8_t m_instruction_byte2;
 	int8_t m_instruction_remaining_cycles;
+	// of the M-cycle core, spent on the current instruction and left of an interrupt dispatch
+	uint8_t m_instruction_cycles;
+	uint8_t m_interrupt_cycles;
+
+	Dispatch m_dispatch;
 
 	int8_t execute_instruction();
 	int8_t execute_prefixed_instruction();
 
-	static std::map<uint8_t, std::tuple<std::string, int8_t>> const s_instruction_names;
-};
\ No newline at end of file
+	// Opcode specification, see cpu_opcodes.h. The single source of the names, lengths,
+	// cycle counts and operands of all opcodes.
+	struct Opcode;
+	static std::array<Opcode, 0x200> const s_opcodes;
+
+	// Shared building blocks of the execution cores, see cpu_ops.h. Regs is the register
+	// storage they run on: Cpu itself, or one lane of Lanes.
+	template <typename Regs>
+	struct BasicOps;
+	using Ops = BasicOps<Cpu>;
+
+	// Table dispatch, see cpu_dispatch.cpp.
+	// Every M-cycle of every opcode is its own handler. A row holds the handlers of one
+	// opcode indexed by m_instruction_remaining_cycles and fills exactly one cache line.
+	// Rows 0x000-0x0FF are the unprefixed opcodes, rows 0x100-0x1FF the CB prefixed ones.
+	struct MCycleOps;
+	using MCycle = int8_t (*)(Cpu&);
+	struct alignas(64) DispatchRow
+	{
+		MCycle cycle[8];
+	};
+	static std::array<DispatchRow, 0x200> const s_dispatch;
+
+	MCycle const* m_dispatch_row;
+
+	// Instruction stepped core, see cpu_step.cpp. Same layout as s_dispatch with one
+	// handler per opcode.
+	template <typename Regs>
+	struct BasicStepOps;
+	using StepOps = BasicStepOps<Cpu>;
+	using Step = uint8_t (*)(Cpu&);
+	static std::array<Step, 0x200> const s_step;
+
+	// Basic block cache, see cpu_block.cpp. Holds runs of s_step handlers decoded once per
+	// (bank, pc) and is allocated by the first run_block().
+	struct Block;
+	struct BlockCache;
+	std::unique_ptr<BlockCache> m_block_cache;
+	bool m_fusion;
+
+#ifdef GB_JIT
+	// x86-64 translation of basic blocks, see cpu_jit.cpp
+	struct Jit;
+	std::unique_ptr<Jit> m_jit;
+#endif
+
+	// drops the blocks of every cache on pages Mem saw written
+	void invalidate_written_code();
+
+	friend class Alu<Cpu>;
+
+	// lockstep core of many cpus, keeps their registers in arrays of its own, see lanes.cpp
+	friend class Lanes;
+};
@@ -0,0 +1,274 @@
+#pragma once
+#include "cpu.h"
+
+constexpr uint8_t lsb(uint16_t u16)
+{
+	return static_cast<uint8_t>(u16 & 0x00FF);
+}
+constexpr uint8_t msb(uint16_t u16)
+{
+	return static_cast<uint8_t>((u16 & 0xFF00) >> 8);
+}
+constexpr void set_lsb(uint16_t& u16, uint8_t u8)
+{
+	u16 = (u16 & 0xFF00) | static_cast<uint16_t>(u8);
+}
+constexpr void set_msb(uint16_t& u16, uint8_t u8)
+{
+	u16 = (static_cast<uint16_t>(u8) << 8) | (u16 & 0x00FF);
+}
+
+// Flag semantics shared by every execution core and the lanes of Lanes, on the registers of
+// Regs, see Alu in cpu.h.
+// https://gbdev.io/gb-opcodes/optables/
+//
+// Flags are lazy: the operations store what they worked on and F is derived when something
+// reads it, see flag_z() and friends in cpu.h. Arithmetic stores its operands and the 16-bit
+// result, which holds C in bit 8 and H in bit 4 of a ^ b ^ result. Everything else is encoded
+// the same way so no kind of operation has to be remembered.
+
+template <typename Regs>
+inline void Alu<Regs>::set_flags(bool z, bool n, bool h, bool c)
+{
+	Regs& cpu = regs();
+	cpu.m_flag_result = static_cast<uint16_t>((z ? 0 : 1) | c << 8);
+	cpu.m_flag_a = static_cast<uint8_t>(h << 4);
+	cpu.m_flag_b = 0;
+	cpu.m_flag_n = n;
+}
+
+template <typename Regs>
+inline void Alu<Regs>::set_flags(uint8_t f)
+{
+	Regs& cpu = regs();
+	cpu.m_flag_result = static_cast<uint16_t>((~f >> 7 & 1) | (f & 0x10) << 4);
+	cpu.m_flag_a = (f & 0x20) >> 1;
+	cpu.m_flag_b = 0;
+	cpu.m_flag_n = (f & 0x40) != 0;
+}
+
+// Z from result, N and H clear, C given
+template <typename Regs>
+inline void Alu<Regs>::set_result_flags(uint8_t result, bool c)
+{
+	Regs& cpu = regs();
+	cpu.m_flag_result = static_cast<uint16_t>(result | c << 8);
+	cpu.m_flag_a = result;
+	cpu.m_flag_b = 0;
+	cpu.m_flag_n = false;
+}
+
+template <typename Regs>
+inline void Alu<Regs>::alu_add(uint8_t r)
+{
+	Regs& cpu = regs();
+	cpu.m_flag_a = cpu.RA;
+	cpu.m_flag_b = r;
+	cpu.m_flag_result = static_cast<uint16_t>(cpu.RA + r);
+	cpu.m_flag_n = false;
+	cpu.RA = static_cast<uint8_t>(cpu.m_flag_result);
+}
+
+template <typename Regs>
+inline void Alu<Regs>::alu_adc(uint8_t r)
+{
+	Regs& cpu = regs();
+	cpu.m_flag_a = cpu.RA;
+	cpu.m_flag_b = r;
+	cpu.m_flag_result = static_cast<uint16_t>(cpu.RA + r + flag_c());
+	cpu.m_flag_n = false;
+	cpu.RA = static_cast<uint8_t>(cpu.m_flag_result);
+}
+
+template <typename Regs>
+inline void Alu<Regs>::alu_sub(uint8_t r)
+{
+	Regs& cpu = regs();
+	alu_cp(r);
+	cpu.RA = static_cast<uint8_t>(cpu.m_flag_result);
+}
+
+template <typename Regs>
+inline void Alu<Regs>::alu_sbc(uint8_t r)
+{
+	Regs& cpu = regs();
+	cpu.m_flag_a = cpu.RA;
+	cpu.m_flag_b = r;
+	cpu.m_flag_result = static_cast<uint16_t>(cpu.RA - r - flag_c());
+	cpu.m_flag_n = true;
+	cpu.RA = static_cast<uint8_t>(cpu.m_flag_result);
+}
+
+template <typename Regs>
+inline void Alu<Regs>::alu_and(uint8_t r)
+{
+	Regs& cpu = regs();
+	cpu.RA &= r;
+	set_result_flags(cpu.RA, false);
+	cpu.m_flag_a ^= 0x10; // H
+}
+
+template <typename Regs>
+inline void Alu<Regs>::alu_xor(uint8_t r)
+{
+	Regs& cpu = regs();
+	cpu.RA ^= r;
+	set_result_flags(cpu.RA, false);
+}
+
+template <typename Regs>
+inline void Alu<Regs>::alu_or(uint8_t r)
+{
+	Regs& cpu = regs();
+	cpu.RA |= r;
+	set_result_flags(cpu.RA, false);
+}
+
+template <typename Regs>
+inline void Alu<Regs>::alu_cp(uint8_t r)
+{
+	Regs& cpu = regs();
+	cpu.m_flag_a = cpu.RA;
+	cpu.m_flag_b = r;
+	cpu.m_flag_result = static_cast<uint16_t>(cpu.RA - r);
+	cpu.m_flag_n = true;
+}
+
+template <typename Regs>
+inline uint8_t Alu<Regs>::alu_inc(uint8_t r)
+{
+	// C is left alone
+	Regs& cpu = regs();
+	cpu.m_flag_a = r;
+	cpu.m_flag_b = 1;
+	cpu.m_flag_result = static_cast<uint16_t>(static_cast<uint8_t>(r + 1) | (cpu.m_flag_result & 0x100));
+	cpu.m_flag_n = false;
+	return static_cast<uint8_t>(cpu.m_flag_result);
+}
+
+template <typename Regs>
+inline uint8_t Alu<Regs>::alu_dec(uint8_t r)
+{
+	// C is left alone
+	Regs& cpu = regs();
+	cpu.m_flag_a = r;
+	cpu.m_flag_b = 1;
+	cpu.m_flag_result = static_cast<uint16_t>(static_cast<uint8_t>(r - 1) | (cpu.m_flag_result & 0x100));
+	cpu.m_flag_n = true;
+	return static_cast<uint8_t>(cpu.m_flag_result);
+}
+
+template <typename Regs>
+inline void Alu<Regs>::alu_add_hl(uint16_t rr)
+{
+	Regs& cpu = regs();
+	uint32_t result = cpu.RHL + rr;
+	set_flags(flag_z(), false, ((cpu.RHL & 0x0FFF) + (rr & 0x0FFF)) > 0x0FFF, result > 0xFFFF);
+
+	cpu.RHL = static_cast<uint16_t>(result);
+}
+
+template <typename Regs>
+inline uint16_t Alu<Regs>::alu_add_sp(uint8_t n)
+{
+	Regs& cpu = regs();
+	set_flags(false, false, ((cpu.RSP & 0x0F) + (n & 0x0F)) > 0x0F, ((cpu.RSP & 0xFF) + n) > 0xFF);
+	return static_cast<uint16_t>(cpu.RSP + static_cast<int8_t>(n));
+}
+
+template <typename Regs>
+inline void Alu<Regs>::alu_daa()
+{
+	Regs& cpu = regs();
+	bool c = flag_c();
+
+	if (!flag_n())
+	{
+		if (c || cpu.RA > 0x99)
+		{
+			cpu.RA += 0x60;
+			c = true;
+		}
+		if (flag_h() || (cpu.RA & 0x0F) > 0x09)
+			cpu.RA += 0x06;
+	}
+	else
+	{
+		if (c)
+			cpu.RA -= 0x60;
+		if (flag_h())
+			cpu.RA -= 0x06;
+	}
+
+	set_flags(cpu.RA == 0, flag_n(), false, c);
+}
+
+template <typename Regs>
+inline uint8_t Alu<Regs>::alu_rlc(uint8_t r)
+{
+	r = static_cast<uint8_t>((r << 1) | (r >> 7));
+	set_result_flags(r, r & 0b00000001);
+	return r;
+}
+
+template <typename Regs>
+inline uint8_t Alu<Regs>::alu_rrc(uint8_t r)
+{
+	r = static_cast<uint8_t>((r >> 1) | (r << 7));
+	set_result_flags(r, r & 0b10000000);
+	return r;
+}
+
+template <typename Regs>
+inline uint8_t Alu<Regs>::alu_rl(uint8_t r)
+{
+	uint8_t result = static_cast<uint8_t>((r << 1) | flag_c());
+	set_result_flags(result, r & 0b10000000);
+	return result;
+}
+
+template <typename Regs>
+inline uint8_t Alu<Regs>::alu_rr(uint8_t r)
+{
+	uint8_t result = static_cast<uint8_t>((r >> 1) | (flag_c() << 7));
+	set_result_flags(result, r & 0b00000001);
+	return result;
+}
+
+template <typename Regs>
+inline uint8_t Alu<Regs>::alu_sla(uint8_t r)
+{
+	uint8_t result = static_cast<uint8_t>(r << 1);
+	set_result_flags(result, r & 0b10000000);
+	return result;
+}
+
+template <typename Regs>
+inline uint8_t Alu<Regs>::alu_sra(uint8_t r)
+{
+	uint8_t result = static_cast<uint8_t>((r >> 1) | (r & 0b10000000));
+	set_result_flags(result, r & 0b00000001);
+	return result;
+}
+
+template <typename Regs>
+inline uint8_t Alu<Regs>::alu_swap(uint8_t r)
+{
+	r = static_cast<uint8_t>((r << 4) | (r >> 4));
+	set_result_flags(r, false);
+	return r;
+}
+
+template <typename Regs>
+inline uint8_t Alu<Regs>::alu_srl(uint8_t r)
+{
+	uint8_t result = r >> 1;
+	set_result_flags(result, r & 0b00000001);
+	return result;
+}
+
+template <typename Regs>
+inline void Alu<Regs>::alu_bit(uint8_t bit, uint8_t r)
+{
+	set_flags(!(r & (1 << bit)), false, true, flag_c());
+}
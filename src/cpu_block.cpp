@@ -0,0 +1,268 @@
+#include "cpu.h"
+#include "cpu_block.h"
+#include "cpu_step.h"
+
+// Basic block cache.
+// Operands are still read by the handlers, only the opcodes are decoded ahead. Mem flags writes
+// to the pages they came from, the block doing such a write ends right after that instruction and
+// every block on a written page is dropped.
+// A fused handler adds the cycles of each of its instructions to Mem before the next one and
+// stops early when that reaches the deadline, leaving RPC on the next opcode, so events still
+// happen between the same instructions as with step().
+
+template <size_t F, uint8_t I>
+uint8_t Cpu::BlockCache::fused(Cpu& cpu)
+{
+	constexpr Fusion fusion = s_fusions[F];
+	uint8_t cycles = StepOps::execute<fusion.opcode[I]>(cpu);
+
+	if constexpr (I + 1 == fusion.count)
+		return cycles;
+	else
+	{
+		// run_block() hands the rest over to the next block
+		cpu.m_mem.add_cycles(cycles);
+		if (cpu.m_mem.cycles() >= cpu.m_mem.deadline())
+			return 0;
+
+		++cpu.RPC;
+		cpu.m_instruction_byte0 = fusion.opcode[I + 1];
+		return fused<F, I + 1>(cpu);
+	}
+}
+
+template <size_t... F>
+constexpr std::array<Cpu::Step, sizeof...(F)> Cpu::BlockCache::make_fused_table(std::index_sequence<F...>)
+{
+	return { fused<F>... };
+}
+
+constinit std::array<Cpu::Step, std::size(Cpu::BlockCache::s_fusions)> const Cpu::BlockCache::s_fused =
+	make_fused_table(std::make_index_sequence<std::size(s_fusions)>());
+
+bool Cpu::ends_block(uint8_t byte0)
+{
+	switch (byte0)
+	{
+		case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR
+		case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA: case 0xE9: // JP
+		case 0xC4: case 0xCC: case 0xCD: case 0xD4: case 0xDC: // CALL
+		case 0xC0: case 0xC8: case 0xC9: case 0xD0: case 0xD8: case 0xD9: // RET, RETI
+		case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF: // RST
+		case 0xF3: case 0xFB: case 0x10: case 0x76: // DI, EI, STOP, HALT
+			return true;
+		default:
+			return false;
+	}
+}
+
+int Cpu::BlockCache::match(Mem& mem, uint16_t addr, uint8_t instructions)
+{
+	for (size_t f = 0; f < std::size(s_fusions); f++)
+	{
+		Fusion const& fusion = s_fusions[f];
+		if (fusion.count > instructions)
+			continue;
+
+		uint16_t at = addr;
+		uint8_t i = 0;
+		while (i < fusion.count && mem.read(at) == fusion.opcode[i])
+			at += Block::length(fusion.opcode[i++]);
+
+		// blocks stay inside one bank
+		if (i == fusion.count && !(((at - 1) ^ addr) & 0xC000))
+			return static_cast<int>(f);
+	}
+	return -1;
+}
+
+void Cpu::BlockCache::decode(Block& block, Mem& mem, uint16_t pc, uint16_t bank, bool fusion)
+{
+	block.pc = pc;
+	block.bank = bank;
+	block.valid = true;
+	block.count = 0;
+	block.pages[0] = pc >> 8;
+	block.has_exit[0] = false;
+	block.has_exit[1] = false;
+	block.exit[0] = nullptr;
+	block.exit[1] = nullptr;
+
+	uint16_t addr = pc;
+	uint8_t instructions = 0;
+	bool ends = false;
+
+	while (!ends)
+	{
+		uint8_t opcode = mem.read(addr);
+		uint8_t i = block.count++;
+
+		block.opcode[i] = opcode;
+		int f = fusion ? match(mem, addr, Block::s_max_instructions - instructions) : -1;
+		if (f >= 0)
+		{
+			// everything but the last instruction, which ends the block like on its own
+			for (uint8_t j = 0; j + 1 < s_fusions[f].count; j++)
+			{
+				mem.mark_code(addr);
+				addr += Block::length(opcode);
+				opcode = mem.read(addr);
+			}
+			instructions += s_fusions[f].count - 1;
+			block.step[i] = s_fused[f];
+			block.opcode_length[i] = 1;
+			++stats.fused;
+		}
+		else if (opcode == 0xCB)
+		{
+			block.step[i] = s_step[0x100 | mem.read(addr + 1)];
+			block.opcode_length[i] = 2;
+		}
+		else
+		{
+			block.step[i] = s_step[opcode];
+			block.opcode_length[i] = 1;
+		}
+
+		uint16_t next = addr + Block::length(opcode);
+		uint16_t last = addr + block.opcode_length[i] - 1;
+		++instructions;
+		block.pages[1] = last >> 8;
+		mem.mark_code(addr);
+		mem.mark_code(last);
+
+		ends = true;
+		switch (opcode)
+		{
+			case 0x20: case 0x28: case 0x30: case 0x38: // JR cc,r8
+				block.has_exit[1] = true;
+				[[fallthrough]];
+			case 0x18: // JR r8
+				block.has_exit[0] = true;
+				block.exit_pc[0] = next + static_cast<int8_t>(mem.read(addr + 1));
+				break;
+			case 0xC2: case 0xCA: case 0xD2: case 0xDA: // JP cc,a16
+			case 0xC4: case 0xCC: case 0xD4: case 0xDC: // CALL cc,a16
+				block.has_exit[1] = true;
+				[[fallthrough]];
+			case 0xC3: case 0xCD: // JP a16 / CALL a16
+				block.has_exit[0] = true;
+				block.exit_pc[0] = mem.read(addr + 1) | mem.read(static_cast<uint16_t>(addr + 2)) << 8;
+				break;
+			case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF: // RST
+				block.has_exit[0] = true;
+				block.exit_pc[0] = opcode & 0x38;
+				break;
+			case 0xC0: case 0xC8: case 0xD0: case 0xD8: // RET cc
+			case 0xF3: case 0xFB: // DI / EI
+				block.has_exit[1] = true;
+				break;
+			case 0xC9: case 0xD9: case 0xE9: // RET / RETI / JP (HL)
+			case 0x10: case 0x76: // STOP / HALT
+				break;
+			default:
+				// blocks stay inside one bank
+				ends = instructions == Block::s_max_instructions || ((next ^ pc) & 0xC000);
+				block.has_exit[1] = ends;
+				break;
+		}
+
+		addr = next;
+	}
+
+	block.exit_pc[1] = addr;
+}
+
+void Cpu::BlockCache::invalidate_written(Mem const& mem)
+{
+	for (Block& block : blocks)
+	{
+		if (block.valid && (mem.code_page_written(block.pages[0]) || mem.code_page_written(block.pages[1])))
+		{
+			block.valid = false;
+			++stats.invalidated;
+		}
+	}
+
+	next = nullptr;
+	from = nullptr;
+}
+
+void Cpu::BlockCache::invalidate_all()
+{
+	for (Block& block : blocks)
+		block.valid = false;
+	next = nullptr;
+	from = nullptr;
+}
+
+uint32_t Cpu::run_block()
+{
+	if (m_stop)
+		return 0;
+
+	// clock() refetches from RPC when the M-cycle core takes over again
+	m_instruction_remaining_cycles = -1;
+
+	if (!m_block_cache)
+		m_block_cache = std::make_unique<BlockCache>();
+	BlockCache& cache = *m_block_cache;
+
+	// interrupts, HALT and code written by the last block are handled between instructions
+	if (m_mem.cycles() >= m_mem.deadline())
+		return step();
+
+	uint16_t bank = m_mem.bank(RPC);
+	Block* block = cache.next;
+
+	if (block && block->valid && block->pc == RPC && block->bank == bank)
+		++cache.stats.chained;
+	else
+	{
+		block = &cache.blocks[RPC % BlockCache::s_slots];
+		if (block->valid && block->pc == RPC && block->bank == bank)
+			++cache.stats.looked_up;
+		else
+		{
+			cache.decode(*block, m_mem, RPC, bank, m_fusion);
+			++cache.stats.decoded;
+		}
+
+		if (cache.from)
+			cache.from->exit[cache.from_exit] = block;
+	}
+
+	cache.next = nullptr;
+	cache.from = nullptr;
+
+	uint64_t start = m_mem.cycles();
+
+	for (uint8_t i = 0; i < block->count; i++)
+	{
+		RPC += block->opcode_length[i];
+		m_instruction_byte0 = block->opcode[i];
+		m_mem.add_cycles(block->step[i](*this));
+
+		// an event is due or the instruction wrote code, the next run_block() hands it to step()
+		if (m_mem.cycles() >= m_mem.deadline())
+			return static_cast<uint32_t>(m_mem.cycles() - start);
+	}
+
+	for (uint8_t exit = 0; exit < 2; exit++)
+	{
+		if (block->has_exit[exit] && block->exit_pc[exit] == RPC)
+		{
+			cache.next = block->exit[exit];
+			cache.from = block;
+			cache.from_exit = exit;
+			break;
+		}
+	}
+
+	return static_cast<uint32_t>(m_mem.cycles() - start);
+}
+
+Cpu::BlockStats Cpu::block_stats() const
+{
+	return m_block_cache ? m_block_cache->stats : BlockStats{};
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include "cpu.h"
+#include "cpu_opcodes.h"
+
+#include <iterator>
+#include <utility>
+
+// Basic block cache.
+// Straight-line code is decoded once into the s_step handlers it runs through, keyed by the bank
+// and address it starts at. A block ends at the first instruction that changes the control flow,
+// stops the cpu or switches interrupts on or off, and is left early after any instruction that
+// reaches Mem's deadline, so anything that has to happen between instructions can happen
+// between blocks. Each block remembers the blocks at its direct exits
+// (jump target and fall through) and enters them without a lookup.
+// Common sequences of instructions are decoded into a single fused handler that runs all of
+// them, see BlockCache::s_fusions.
+// See cpu_block.cpp.
+
+struct Cpu::Block
+{
+	static constexpr uint8_t s_max_instructions = 16;
+
+	// bytes including the opcode
+	static constexpr uint8_t length(uint8_t opcode)
+	{
+		return s_opcodes[opcode].length;
+	}
+
+	uint16_t pc;
+	uint16_t bank;
+	bool valid;
+	uint8_t count;        // handlers, fused ones count once
+	uint8_t pages[2]; // pages of the first and last opcode
+
+	// direct exits, taken jump and fall through
+	bool has_exit[2];
+	uint16_t exit_pc[2];
+	Block* exit[2];
+
+	Step step[s_max_instructions];
+	uint8_t opcode_length[s_max_instructions]; // 2 for CB prefixed, else 1
+	uint8_t opcode[s_max_instructions]; // first opcode of fused handlers
+};
+
+struct Cpu::BlockCache
+{
+	static constexpr uint32_t s_slots = 2048;
+
+	// Instruction sequences run by one handler, longest first as decode() takes the first one
+	// that matches. Only the last instruction may end a block. Picked from the pair and triple
+	// frequencies gb-bench fusion counts over a rom corpus.
+	struct Fusion
+	{
+		uint8_t count;
+		uint8_t opcode[4];
+	};
+	static constexpr Fusion s_fusions[] = {
+		{ 4, { 0x0C, 0x79, 0xB8, 0x20 } }, // inc c / ld a,c / cp b / jr nz, roms/test-loop.z80
+		{ 4, { 0x0B, 0x78, 0xB1, 0x20 } }, // dec bc / ld a,b / or c / jr nz
+		{ 3, { 0x2A, 0x12, 0x13 } },       // ld a,(hl+) / ld (de),a / inc de
+		{ 3, { 0x22, 0x05, 0x20 } },       // ld (hl+),a / dec b / jr nz
+		{ 3, { 0xF0, 0xFE, 0x20 } },       // ldh a,(n) / cp n / jr nz
+		{ 3, { 0xF0, 0xFE, 0x28 } },       // ldh a,(n) / cp n / jr z
+		{ 2, { 0x2A, 0x12 } },             // ld a,(hl+) / ld (de),a
+		{ 2, { 0x05, 0x20 } },             // dec r / jr nz
+		{ 2, { 0x0D, 0x20 } },
+		{ 2, { 0x15, 0x20 } },
+		{ 2, { 0x1D, 0x20 } },
+		{ 2, { 0x25, 0x20 } },
+		{ 2, { 0x2D, 0x20 } },
+		{ 2, { 0x3D, 0x20 } },
+		{ 2, { 0xFE, 0x20 } },             // cp n / jr cc
+		{ 2, { 0xFE, 0x28 } },
+		{ 2, { 0xFE, 0x30 } },
+		{ 2, { 0xFE, 0x38 } },
+		{ 2, { 0xE6, 0x20 } },             // and n / jr nz, jr z
+		{ 2, { 0xE6, 0x28 } },
+	};
+	static std::array<Step, std::size(s_fusions)> const s_fused;
+
+	// runs instruction I of s_fusions[F] and the ones after it
+	template <size_t F, uint8_t I = 0>
+	static uint8_t fused(Cpu& cpu);
+	template <size_t... F>
+	static constexpr std::array<Step, sizeof...(F)> make_fused_table(std::index_sequence<F...>);
+	// index in s_fusions of the sequence starting at addr, -1 when none fits in instructions
+	static int match(Mem& mem, uint16_t addr, uint8_t instructions);
+
+	// direct mapped on pc, a block evicts whatever started at the same pc modulo s_slots
+	Block blocks[s_slots];
+
+	// successor of the last block when it left through a direct exit
+	Block* next;
+	Block* from;
+	uint8_t from_exit;
+
+	BlockStats stats;
+
+	BlockCache()
+		: blocks()
+		, next(nullptr)
+		, from(nullptr)
+		, from_exit(0)
+		, stats()
+	{ }
+
+	void decode(Block& block, Mem& mem, uint16_t pc, uint16_t bank, bool fusion);
+	void invalidate_written(Mem const& mem);
+	void invalidate_all();
+};
@@ -0,0 +1,4 @@
+#include "cpu.h"
+#include "cpu_dispatch.h"
+
+constinit std::array<Cpu::DispatchRow, 0x200> const Cpu::s_dispatch = Cpu::MCycleOps::make_dispatch_table(std::make_index_sequence<0x200>());
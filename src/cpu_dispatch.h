@@ -0,0 +1,610 @@
+#pragma once
+#include "cpu.h"
+#include "cpu_ops.h"
+
+#include <cassert>
+#include <utility>
+
+// M-cycle handlers of the table driven core (cpu_dispatch.cpp) and the opcode switch
+// (cpu_instructions.cpp).
+// Every M-cycle of an instruction is a separate handler. A handler returns the number of
+// remaining cycles like execute_instruction() does, which is also the index of the handler
+// that runs next, so the rows below list the handlers by the remaining cycle count they run
+// at: { 0, 1, 2, ... } executes as 0 -> N -> N-1 -> ... -> 1.
+// Conditional instructions test their condition in the M-cycle where the taken and not
+// taken paths split, that way both paths share one row.
+
+struct Cpu::MCycleOps : Cpu::Ops
+{
+	static void read(Cpu& cpu, uint16_t addr)
+	{
+		cpu.m_bus.write_addr(addr);
+	}
+	static void write(Cpu& cpu, uint16_t addr, uint8_t data)
+	{
+		cpu.m_bus.write_addr(addr);
+		cpu.m_bus.write_data(data);
+	}
+	static uint8_t data(Cpu& cpu)
+	{
+		return cpu.m_bus.read_data();
+	}
+
+	// shared M-cycles
+
+	static int8_t invalid(Cpu&)
+	{
+		assert(!"m_instruction_remaining_cycles out of bounds!");
+		return -2;
+	}
+	// last cycle of an instruction that has nothing left to do
+	static int8_t done(Cpu&)
+	{
+		return 0;
+	}
+	template <int8_t Next>
+	static int8_t idle(Cpu&)
+	{
+		return Next;
+	}
+	template <int8_t Next>
+	static int8_t skip_opcode(Cpu& cpu)
+	{
+		++cpu.RPC;
+		return Next;
+	}
+	template <int8_t Next>
+	static int8_t read_imm(Cpu& cpu)
+	{
+		++cpu.RPC;
+		read(cpu, cpu.RPC);
+		return Next;
+	}
+	// store the lsb of an a16 operand and read its msb
+	template <int8_t Next>
+	static int8_t read_imm_msb(Cpu& cpu)
+	{
+		cpu.m_instruction_byte1 = data(cpu);
+		return read_imm<Next>(cpu);
+	}
+	template <int8_t Next>
+	static int8_t read_sp(Cpu& cpu)
+	{
+		++cpu.RPC;
+		read(cpu, cpu.RSP);
+		return Next;
+	}
+	template <R16 RR, int8_t Next>
+	static int8_t read_rr(Cpu& cpu)
+	{
+		++cpu.RPC;
+		read(cpu, cpu.*RR);
+		return Next;
+	}
+	template <R8 R>
+	static int8_t LD_r_data(Cpu& cpu)
+	{
+		cpu.*R = data(cpu);
+		return 0;
+	}
+	template <ModifyOp Op, int8_t Next>
+	static int8_t modify_hl(Cpu& cpu)
+	{
+		write(cpu, cpu.RHL, Op(cpu, data(cpu)));
+		return Next;
+	}
+
+
+	// 8-bit loads
+
+	template <R8 R1, R8 R2>
+	static int8_t LD_r_r(Cpu& cpu)
+	{
+		++cpu.RPC;
+		cpu.*R1 = cpu.*R2;
+		return 0;
+	}
+	template <R8 R>
+	static int8_t LD_r_n(Cpu& cpu)
+	{
+		++cpu.RPC;
+		cpu.*R = data(cpu);
+		return 0;
+	}
+	template <R16 RR, R8 R>
+	static int8_t LD_rr_address_r(Cpu& cpu)
+	{
+		++cpu.RPC;
+		write(cpu, cpu.*RR, cpu.*R);
+		return 1;
+	}
+	template <int8_t Delta>
+	static int8_t LD_HLi_A(Cpu& cpu)
+	{
+		++cpu.RPC;
+		write(cpu, cpu.RHL, cpu.RA);
+		cpu.RHL += Delta;
+		return 1;
+	}
+	template <int8_t Delta>
+	static int8_t LD_A_HLi(Cpu& cpu)
+	{
+		++cpu.RPC;
+		read(cpu, cpu.RHL);
+		cpu.RHL += Delta;
+		return 1;
+	}
+	static int8_t LD_HL_n(Cpu& cpu)
+	{
+		++cpu.RPC;
+		write(cpu, cpu.RHL, data(cpu));
+		return 1;
+	}
+	static int8_t LDH_a8_A(Cpu& cpu)
+	{
+		++cpu.RPC;
+		write(cpu, 0xFF00 | data(cpu), cpu.RA);
+		return 1;
+	}
+	static int8_t LDH_A_a8(Cpu& cpu)
+	{
+		++cpu.RPC;
+		read(cpu, 0xFF00 | data(cpu));
+		return 1;
+	}
+	static int8_t LD_C_address_A(Cpu& cpu)
+	{
+		++cpu.RPC;
+		write(cpu, 0xFF00 | cpu.RC, cpu.RA);
+		return 1;
+	}
+	static int8_t LD_A_C_address(Cpu& cpu)
+	{
+		++cpu.RPC;
+		read(cpu, 0xFF00 | cpu.RC);
+		return 1;
+	}
+	static int8_t LD_a16_A(Cpu& cpu)
+	{
+		++cpu.RPC;
+		write(cpu, word(cpu.m_instruction_byte1, data(cpu)), cpu.RA);
+		return 1;
+	}
+	static int8_t LD_A_a16(Cpu& cpu)
+	{
+		++cpu.RPC;
+		read(cpu, word(cpu.m_instruction_byte1, data(cpu)));
+		return 1;
+	}
+
+
+	// 16-bit loads
+
+	template <R16 RR>
+	static int8_t LD_rr_nn_lsb(Cpu& cpu)
+	{
+		++cpu.RPC;
+		set_lsb(cpu.*RR, data(cpu));
+		read(cpu, cpu.RPC);
+		return 1;
+	}
+	template <R16 RR>
+	static int8_t LD_rr_nn_msb(Cpu& cpu)
+	{
+		++cpu.RPC;
+		set_msb(cpu.*RR, data(cpu));
+		return 0;
+	}
+	static int8_t LD_a16_SP_lsb(Cpu& cpu)
+	{
+		++cpu.RPC;
+		cpu.m_instruction_byte2 = data(cpu);
+		write(cpu, word(cpu.m_instruction_byte1, cpu.m_instruction_byte2), lsb(cpu.RSP));
+		return 2;
+	}
+	static int8_t LD_a16_SP_msb(Cpu& cpu)
+	{
+		write(cpu, word(cpu.m_instruction_byte1, cpu.m_instruction_byte2) + 1, msb(cpu.RSP));
+		return 1;
+	}
+	static int8_t LD_SP_HL(Cpu& cpu)
+	{
+		++cpu.RPC;
+		cpu.RSP = cpu.RHL;
+		return 1;
+	}
+	static int8_t LD_HL_SP_n(Cpu& cpu)
+	{
+		++cpu.RPC;
+		cpu.RHL = cpu.alu_add_sp(data(cpu));
+		return 1;
+	}
+	template <R16 RR>
+	static int8_t POP_rr_lsb(Cpu& cpu)
+	{
+		set_lsb(cpu.*RR, data(cpu));
+		++cpu.RSP;
+		read(cpu, cpu.RSP);
+		return 1;
+	}
+	template <R16 RR>
+	static int8_t POP_rr_msb(Cpu& cpu)
+	{
+		set_msb(cpu.*RR, data(cpu));
+		++cpu.RSP;
+		if constexpr (RR == &Cpu::RAF)
+			cpu.set_flags(cpu.RF); // the low nibble of F is always 0
+		return 0;
+	}
+	template <R16 RR>
+	static int8_t PUSH_rr_msb(Cpu& cpu)
+	{
+		--cpu.RSP;
+		write(cpu, cpu.RSP, msb(cpu.*RR));
+		return 2;
+	}
+	template <R16 RR>
+	static int8_t PUSH_rr_lsb(Cpu& cpu)
+	{
+		if constexpr (RR == &Cpu::RAF)
+			cpu.RF = cpu.flags();
+		--cpu.RSP;
+		write(cpu, cpu.RSP, lsb(cpu.*RR));
+		return 1;
+	}
+
+
+	// 8-bit alu
+
+	template <AluOp Op, R8 R>
+	static int8_t ALU_r(Cpu& cpu)
+	{
+		++cpu.RPC;
+		Op(cpu, cpu.*R);
+		return 0;
+	}
+	template <AluOp Op>
+	static int8_t ALU_data(Cpu& cpu)
+	{
+		Op(cpu, data(cpu));
+		return 0;
+	}
+	template <AluOp Op>
+	static int8_t ALU_n(Cpu& cpu)
+	{
+		++cpu.RPC;
+		Op(cpu, data(cpu));
+		return 0;
+	}
+	template <ModifyOp Op, R8 R>
+	static int8_t MODIFY_r(Cpu& cpu)
+	{
+		++cpu.RPC;
+		cpu.*R = Op(cpu, cpu.*R);
+		return 0;
+	}
+	// RLCA, RRCA, RLA and RRA always clear Z
+	template <ModifyOp Op>
+	static int8_t ROTATE_A(Cpu& cpu)
+	{
+		++cpu.RPC;
+		cpu.RA = Op(cpu, cpu.RA);
+		cpu.set_flags(false, false, false, cpu.flag_c());
+		return 0;
+	}
+	static int8_t DAA(Cpu& cpu)
+	{
+		++cpu.RPC;
+		cpu.alu_daa();
+		return 0;
+	}
+	static int8_t CPL(Cpu& cpu)
+	{
+		++cpu.RPC;
+		cpu.RA = ~cpu.RA;
+		cpu.set_flags(cpu.flag_z(), true, true, cpu.flag_c());
+		return 0;
+	}
+	static int8_t SCF(Cpu& cpu)
+	{
+		++cpu.RPC;
+		cpu.set_flags(cpu.flag_z(), false, false, true);
+		return 0;
+	}
+	static int8_t CCF(Cpu& cpu)
+	{
+		++cpu.RPC;
+		cpu.set_flags(cpu.flag_z(), false, false, !cpu.flag_c());
+		return 0;
+	}
+
+
+	// 16-bit alu
+
+	template <R16 RR>
+	static int8_t INC_rr(Cpu& cpu)
+	{
+		++cpu.RPC;
+		++(cpu.*RR);
+		return 1;
+	}
+	template <R16 RR>
+	static int8_t DEC_rr(Cpu& cpu)
+	{
+		++cpu.RPC;
+		--(cpu.*RR);
+		return 1;
+	}
+	template <R16 RR>
+	static int8_t ADD_HL_rr(Cpu& cpu)
+	{
+		++cpu.RPC;
+		cpu.alu_add_hl(cpu.*RR);
+		return 1;
+	}
+	static int8_t ADD_SP_n(Cpu& cpu)
+	{
+		++cpu.RPC;
+		cpu.m_instruction_byte1 = data(cpu);
+		return 2;
+	}
+	static int8_t ADD_SP_n_result(Cpu& cpu)
+	{
+		cpu.RSP = cpu.alu_add_sp(cpu.m_instruction_byte1);
+		return 1;
+	}
+
+
+	// jumps and calls
+
+	template <Cond CC>
+	static int8_t JR_cc_n(Cpu& cpu)
+	{
+		++cpu.RPC;
+		cpu.m_instruction_byte1 = data(cpu);
+		return cond<CC>(cpu) ? 1 : 0;
+	}
+	static int8_t JR_n_taken(Cpu& cpu)
+	{
+		cpu.RPC += static_cast<int8_t>(cpu.m_instruction_byte1);
+		return 0;
+	}
+	template <Cond CC, int8_t Taken>
+	static int8_t read_a16_msb_cc(Cpu& cpu)
+	{
+		++cpu.RPC;
+		cpu.m_instruction_byte2 = data(cpu);
+		return cond<CC>(cpu) ? Taken : 0;
+	}
+	static int8_t JP_nn_taken(Cpu& cpu)
+	{
+		cpu.RPC = word(cpu.m_instruction_byte1, cpu.m_instruction_byte2);
+		return 0;
+	}
+	static int8_t JP_HL(Cpu& cpu)
+	{
+		cpu.RPC = cpu.RHL;
+		return 0;
+	}
+	static int8_t PUSH_PC_msb(Cpu& cpu)
+	{
+		--cpu.RSP;
+		write(cpu, cpu.RSP, msb(cpu.RPC));
+		return 2;
+	}
+	static int8_t CALL_nn_push_lsb(Cpu& cpu)
+	{
+		--cpu.RSP;
+		write(cpu, cpu.RSP, lsb(cpu.RPC));
+		cpu.RPC = word(cpu.m_instruction_byte1, cpu.m_instruction_byte2);
+		return 1;
+	}
+	template <uint8_t N>
+	static int8_t RST_push_lsb(Cpu& cpu)
+	{
+		--cpu.RSP;
+		write(cpu, cpu.RSP, lsb(cpu.RPC));
+		cpu.RPC = N;
+		return 1;
+	}
+	template <Cond CC, int8_t Taken>
+	static int8_t RET_cc(Cpu& cpu)
+	{
+		++cpu.RPC;
+		if (!cond<CC>(cpu))
+			return 1;
+
+		read(cpu, cpu.RSP);
+		++cpu.RSP;
+		return Taken;
+	}
+	template <int8_t Next>
+	static int8_t RET_pop_lsb(Cpu& cpu)
+	{
+		cpu.m_instruction_byte1 = data(cpu);
+		read(cpu, cpu.RSP);
+		++cpu.RSP;
+		return Next;
+	}
+	template <int8_t Next>
+	static int8_t RET_pop_msb(Cpu& cpu)
+	{
+		cpu.RPC = word(cpu.m_instruction_byte1, data(cpu));
+		return Next;
+	}
+
+
+	// misc/control
+
+	static int8_t NOP(Cpu& cpu)
+	{
+		++cpu.RPC;
+		return 0;
+	}
+	static int8_t STOP(Cpu& cpu)
+	{
+		++cpu.RPC;
+		cpu.stop();
+		return 0;
+	}
+	static int8_t HALT(Cpu& cpu)
+	{
+		++cpu.RPC;
+		cpu.halt();
+		return 0;
+	}
+	static int8_t DI(Cpu& cpu)
+	{
+		++cpu.RPC;
+		cpu.disable_interrupts();
+		return 0;
+	}
+	static int8_t EI(Cpu& cpu)
+	{
+		++cpu.RPC;
+		cpu.enable_interrupts();
+		return 0;
+	}
+	static int8_t RETI(Cpu& cpu)
+	{
+		cpu.return_from_interrupt();
+		return 0;
+	}
+	static int8_t UNDEFINED(Cpu& cpu)
+	{
+		++cpu.RPC;
+		cpu.undefined_opcode();
+		return 0;
+	}
+	// switch to the row of the CB prefixed opcode for the rest of the instruction
+	static int8_t PREFIX_CB(Cpu& cpu)
+	{
+		cpu.m_instruction_byte1 = data(cpu);
+		cpu.m_dispatch_row = s_dispatch[0x100 | cpu.m_instruction_byte1].cycle;
+		return cpu.m_dispatch_row[1](cpu);
+	}
+
+
+	// CB prefixed, these run from remaining cycle 1 on since cycle 0 fetched the opcode
+
+	template <uint8_t B, R8 R>
+	static int8_t BIT_r(Cpu& cpu)
+	{
+		++cpu.RPC;
+		cpu.alu_bit(B, cpu.*R);
+		return 0;
+	}
+	template <uint8_t B>
+	static int8_t BIT_data(Cpu& cpu)
+	{
+		cpu.alu_bit(B, data(cpu));
+		return 0;
+	}
+
+
+	// table
+
+	static constexpr DispatchRow row(MCycle c0, MCycle c1 = invalid, MCycle c2 = invalid, MCycle c3 = invalid, MCycle c4 = invalid, MCycle c5 = invalid)
+	{
+		return { { c0, c1, c2, c3, c4, c5, invalid, invalid } };
+	}
+
+	// The row of an opcode, specialized on the operands of its s_opcodes entry
+	template <uint16_t Op>
+	static constexpr DispatchRow make_row()
+	{
+		constexpr Opcode o = s_opcodes[Op];
+		constexpr R8 dst = r8(o.dst);
+		constexpr R8 src = r8(o.src);
+		constexpr R16 rr = r16(o.rr);
+		constexpr R8 A = &Cpu::RA;
+		constexpr R16 HL = &Cpu::RHL;
+
+		if constexpr (o.kind == Kind::NOP) return row(NOP);
+		else if constexpr (o.kind == Kind::STOP) return row(skip_opcode<1>, STOP);
+		else if constexpr (o.kind == Kind::HALT) return row(HALT);
+		else if constexpr (o.kind == Kind::DI) return row(DI);
+		else if constexpr (o.kind == Kind::EI) return row(EI);
+		else if constexpr (o.kind == Kind::UNDEFINED) return row(UNDEFINED);
+		else if constexpr (o.kind == Kind::PREFIX_CB) return row(read_imm<1>, PREFIX_CB);
+
+		else if constexpr (o.kind == Kind::LD && dst == nullptr) return row(LD_rr_address_r<HL, src>, done);
+		else if constexpr (o.kind == Kind::LD && src == nullptr) return row(read_rr<HL, 1>, LD_r_data<dst>);
+		else if constexpr (o.kind == Kind::LD) return row(LD_r_r<dst, src>);
+		else if constexpr (o.kind == Kind::LD_n && dst == nullptr) return row(read_imm<2>, done, LD_HL_n);
+		else if constexpr (o.kind == Kind::LD_n) return row(read_imm<1>, LD_r_n<dst>);
+		else if constexpr (o.kind == Kind::LD_rr_A) return row(LD_rr_address_r<rr, A>, done);
+		else if constexpr (o.kind == Kind::LD_A_rr) return row(read_rr<rr, 1>, LD_r_data<A>);
+		else if constexpr (o.kind == Kind::LD_HLi_A) return row(LD_HLi_A<o.delta>, done);
+		else if constexpr (o.kind == Kind::LD_A_HLi) return row(LD_A_HLi<o.delta>, LD_r_data<A>);
+		else if constexpr (o.kind == Kind::LDH_a8_A) return row(read_imm<2>, done, LDH_a8_A);
+		else if constexpr (o.kind == Kind::LDH_A_a8) return row(read_imm<2>, LD_r_data<A>, LDH_A_a8);
+		else if constexpr (o.kind == Kind::LD_C_A) return row(LD_C_address_A, done);
+		else if constexpr (o.kind == Kind::LD_A_C) return row(LD_A_C_address, LD_r_data<A>);
+		else if constexpr (o.kind == Kind::LD_a16_A) return row(read_imm<3>, done, LD_a16_A, read_imm_msb<2>);
+		else if constexpr (o.kind == Kind::LD_A_a16) return row(read_imm<3>, LD_r_data<A>, LD_A_a16, read_imm_msb<2>);
+
+		else if constexpr (o.kind == Kind::LD_rr_nn) return row(read_imm<2>, LD_rr_nn_msb<rr>, LD_rr_nn_lsb<rr>);
+		else if constexpr (o.kind == Kind::LD_a16_SP) return row(read_imm<4>, done, LD_a16_SP_msb, LD_a16_SP_lsb, read_imm_msb<3>);
+		else if constexpr (o.kind == Kind::LD_SP_HL) return row(LD_SP_HL, done);
+		else if constexpr (o.kind == Kind::LD_HL_SP_n) return row(read_imm<2>, done, LD_HL_SP_n);
+		else if constexpr (o.kind == Kind::POP) return row(read_sp<2>, POP_rr_msb<rr>, POP_rr_lsb<rr>);
+		else if constexpr (o.kind == Kind::PUSH) return row(skip_opcode<3>, done, PUSH_rr_lsb<rr>, PUSH_rr_msb<rr>);
+
+		else if constexpr (o.kind == Kind::ALU && src == nullptr) return row(read_rr<HL, 1>, ALU_data<alu(o.alu)>);
+		else if constexpr (o.kind == Kind::ALU) return row(ALU_r<alu(o.alu), src>);
+		else if constexpr (o.kind == Kind::ALU_n) return row(read_imm<1>, ALU_n<alu(o.alu)>);
+		else if constexpr ((o.kind == Kind::INC || o.kind == Kind::DEC) && dst == nullptr) return row(read_rr<HL, 2>, done, modify_hl<modify<Op>(), 1>);
+		else if constexpr (o.kind == Kind::INC || o.kind == Kind::DEC) return row(MODIFY_r<modify<Op>(), dst>);
+		else if constexpr (o.kind == Kind::ROTATE_A) return row(ROTATE_A<modify<Op>()>);
+		else if constexpr (o.kind == Kind::DAA) return row(DAA);
+		else if constexpr (o.kind == Kind::CPL) return row(CPL);
+		else if constexpr (o.kind == Kind::SCF) return row(SCF);
+		else if constexpr (o.kind == Kind::CCF) return row(CCF);
+
+		else if constexpr (o.kind == Kind::INC_rr) return row(INC_rr<rr>, done);
+		else if constexpr (o.kind == Kind::DEC_rr) return row(DEC_rr<rr>, done);
+		else if constexpr (o.kind == Kind::ADD_HL_rr) return row(ADD_HL_rr<rr>, done);
+		else if constexpr (o.kind == Kind::ADD_SP_n) return row(read_imm<3>, done, ADD_SP_n_result, ADD_SP_n);
+
+		else if constexpr (o.kind == Kind::JR) return row(read_imm<2>, JR_n_taken, JR_cc_n<o.cc>);
+		else if constexpr (o.kind == Kind::JP) return row(read_imm<3>, JP_nn_taken, read_a16_msb_cc<o.cc, 1>, read_imm_msb<2>);
+		else if constexpr (o.kind == Kind::JP_HL) return row(JP_HL);
+		else if constexpr (o.kind == Kind::CALL) return row(read_imm<5>, done, CALL_nn_push_lsb, PUSH_PC_msb, read_a16_msb_cc<o.cc, 3>, read_imm_msb<4>);
+		else if constexpr (o.kind == Kind::RST) return row(skip_opcode<3>, done, RST_push_lsb<o.n>, PUSH_PC_msb);
+		else if constexpr (o.kind == Kind::RET_cc) return row(RET_cc<o.cc, 4>, done, idle<1>, RET_pop_msb<2>, RET_pop_lsb<3>);
+		else if constexpr (o.kind == Kind::RET) return row(RET_cc<Cond::Always, 3>, done, RET_pop_msb<1>, RET_pop_lsb<2>);
+		else if constexpr (o.kind == Kind::RETI) return row(RET_cc<Cond::Always, 3>, RETI, RET_pop_msb<1>, RET_pop_lsb<2>);
+
+		// CB prefixed
+		else if constexpr (o.kind == Kind::BIT && dst == nullptr) return row(invalid, read_rr<HL, 3>, invalid, BIT_data<o.n>);
+		else if constexpr (o.kind == Kind::BIT) return row(invalid, BIT_r<o.n, dst>);
+		// SHIFT, RES and SET
+		else if constexpr (dst == nullptr) return row(invalid, read_rr<HL, 3>, done, modify_hl<modify<Op>(), 2>);
+		else return row(invalid, MODIFY_r<modify<Op>(), dst>);
+	}
+
+	// one M-cycle of the row of an opcode, called directly for the opcode switch
+	template <uint16_t Op>
+	static int8_t execute(Cpu& cpu, int8_t remaining_cycles)
+	{
+		constexpr DispatchRow r = make_row<Op>();
+
+		switch (remaining_cycles)
+		{
+			case 0: return r.cycle[0](cpu);
+			case 1: return r.cycle[1](cpu);
+			case 2: return r.cycle[2](cpu);
+			case 3: return r.cycle[3](cpu);
+			case 4: return r.cycle[4](cpu);
+			case 5: return r.cycle[5](cpu);
+			default: return invalid(cpu);
+		}
+	}
+
+	template <size_t... Op>
+	static constexpr std::array<DispatchRow, 0x200> make_dispatch_table(std::index_sequence<Op...>)
+	{
+		return { make_row<Op>()... };
+	}
+};
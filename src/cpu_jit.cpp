@@ -0,0 +1,532 @@
+#include "cpu.h"
+#include "cpu_block.h"
+#include "cpu_jit.h"
+#include "cpu_opcodes.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// x86-64 translation of basic blocks.
+// Blocks end where the block cache ends them. Register loads, 8-bit alu operations on registers
+// and immediates, INC/DEC and direct jumps are translated inline, working on the Cpu's registers
+// in memory. Everything else calls its s_step handler, so anything the translator does not know
+// falls back to the interpreter one instruction at a time.
+// Inline instructions add their cycles at compile time, handlers return theirs into r12d and the
+// sum is returned at every block exit. Mem::cycles() is brought up to date before every handler
+// and at every exit, and a handler that reaches Mem's deadline ends the block right after it.
+// Operands are baked into the code, so every byte of a translated instruction is marked as code
+// in Mem, and writing to it moves the deadline. A block is only entered when it cannot run past
+// the deadline with inline instructions alone.
+//
+// Flags are written in the lazy form of cpu_alu.h, which maps directly onto the x86 result and
+// carry flag. Parts of them a later instruction in the block overwrites unread are not stored.
+//
+// Generated code is entered as uint32_t(Cpu&) with the System V calling convention:
+// rbx holds the Cpu, r12d the cycles returned by handlers.
+
+namespace
+{
+
+class Emitter
+{
+public:
+	Emitter(uint8_t* begin, uint8_t* end) : m_begin(begin), m_p(begin), m_end(end) { }
+
+	uint32_t size() const { return static_cast<uint32_t>(m_p - m_begin); }
+	uint32_t space() const { return static_cast<uint32_t>(m_end - m_p); }
+
+	void byte(uint8_t b) { *m_p++ = b; }
+	void bytes(std::initializer_list<uint8_t> bs) { for (uint8_t b : bs) byte(b); }
+	void imm16(uint16_t v) { memcpy(m_p, &v, 2); m_p += 2; }
+	void imm32(uint32_t v) { memcpy(m_p, &v, 4); m_p += 4; }
+	void imm64(uint64_t v) { memcpy(m_p, &v, 8); m_p += 8; }
+
+	// ModRM for [rbx + disp32]
+	void rbx(uint8_t reg, int32_t disp)
+	{
+		byte(0x80 | reg << 3 | 3);
+		imm32(static_cast<uint32_t>(disp));
+	}
+
+	void prologue()
+	{
+		bytes({ 0x53 });                   // push rbx
+		bytes({ 0x41, 0x54 });             // push r12
+		bytes({ 0x48, 0x83, 0xEC, 0x08 }); // sub rsp, 8
+		bytes({ 0x48, 0x89, 0xFB });       // mov rbx, rdi
+		bytes({ 0x45, 0x31, 0xE4 });       // xor r12d, r12d
+	}
+	// add qword [counter], cycles
+	void add_cycles(uint64_t* counter, uint32_t cycles)
+	{
+		bytes({ 0x48, 0xB8 }); imm64(reinterpret_cast<uint64_t>(counter)); // mov rax, counter
+		bytes({ 0x48, 0x81, 0x00 }); imm32(cycles);                          // add qword [rax], cycles
+	}
+	// eax = r12d + cycles, then return
+	void exit(uint32_t cycles)
+	{
+		bytes({ 0x44, 0x89, 0xE0 });       // mov eax, r12d
+		byte(0x05); imm32(cycles);         // add eax, cycles
+		bytes({ 0x48, 0x83, 0xC4, 0x08 }); // add rsp, 8
+		bytes({ 0x41, 0x5C });             // pop r12
+		bytes({ 0x5B });                   // pop rbx
+		bytes({ 0xC3 });                   // ret
+	}
+
+	void load_al(int32_t disp) { bytes({ 0x0F, 0xB6 }); rbx(0, disp); }   // movzx eax, byte [rbx+disp]
+	void store_al(int32_t disp) { byte(0x88); rbx(0, disp); }             // mov [rbx+disp], al
+	void store_cl(int32_t disp) { byte(0x88); rbx(1, disp); }             // mov [rbx+disp], cl
+	void store_ax(int32_t disp) { bytes({ 0x66, 0x89 }); rbx(0, disp); } // mov [rbx+disp], ax
+	void store_ah(int32_t disp) { byte(0x88); rbx(4, disp); }             // mov [rbx+disp], ah
+	void store8(int32_t disp, uint8_t v) { byte(0xC6); rbx(0, disp); byte(v); }
+	void store16(int32_t disp, uint16_t v) { bytes({ 0x66, 0xC7 }); rbx(0, disp); imm16(v); }
+
+	// forward jumps, the rel32 is patched by bind()
+	uint8_t* jcc(uint8_t cc) { bytes({ 0x0F, cc }); imm32(0); return m_p; }
+	void bind(uint8_t* after_jump)
+	{
+		uint32_t rel = static_cast<uint32_t>(m_p - after_jump);
+		memcpy(after_jump - 4, &rel, 4);
+	}
+
+private:
+	uint8_t* m_begin;
+	uint8_t* m_p;
+	uint8_t* m_end;
+};
+
+constexpr uint8_t s_jb = 0x82;
+constexpr uint8_t s_jz = 0x84;
+constexpr uint8_t s_jnz = 0x85;
+
+}
+
+Cpu::Jit::Jit(Cpu& cpu)
+	: code(nullptr)
+	, used(0)
+	, entries()
+	, stats()
+{
+	// never writable and executable at once, see protect()
+	void* memory = mmap(nullptr, s_code_size, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory != MAP_FAILED)
+		code = static_cast<uint8_t*>(memory);
+
+	auto offset = [&cpu](void const* member) {
+		return static_cast<int32_t>(static_cast<char const*>(member) - reinterpret_cast<char const*>(&cpu));
+	};
+
+	offset_flag_result = offset(&cpu.m_flag_result);
+	offset_flag_a = offset(&cpu.m_flag_a);
+	offset_flag_b = offset(&cpu.m_flag_b);
+	offset_flag_n = offset(&cpu.m_flag_n);
+	offset_r8[0] = offset(&cpu.RB);
+	offset_r8[1] = offset(&cpu.RC);
+	offset_r8[2] = offset(&cpu.RD);
+	offset_r8[3] = offset(&cpu.RE);
+	offset_r8[4] = offset(&cpu.RH);
+	offset_r8[5] = offset(&cpu.RL);
+	offset_r8[6] = 0;
+	offset_r8[7] = offset(&cpu.RA);
+	offset_r16[0] = offset(&cpu.RBC);
+	offset_r16[1] = offset(&cpu.RDE);
+	offset_r16[2] = offset(&cpu.RHL);
+	offset_r16[3] = offset(&cpu.RSP);
+	offset_pc = offset(&cpu.RPC);
+	offset_byte0 = offset(&cpu.m_instruction_byte0);
+}
+
+Cpu::Jit::~Jit()
+{
+	if (code)
+		munmap(code, s_code_size);
+}
+
+Cpu::Jit::Entry const& Cpu::Jit::lookup(Mem& mem, uint16_t pc, uint16_t bank)
+{
+	Entry& entry = entries[pc % s_slots];
+	if (entry.valid && entry.pc == pc && entry.bank == bank)
+		return entry;
+
+	if (!translate(mem, pc, bank, entry))
+	{
+		// out of code space, start over
+		invalidate_all();
+		used = 0;
+		translate(mem, pc, bank, entry);
+	}
+	return entry;
+}
+
+namespace
+{
+
+// parts of the lazy flags, see cpu_alu.h
+enum FlagPart : uint8_t
+{
+	s_part_a = 1,
+	s_part_b = 2,
+	s_part_n = 4,
+	s_part_lo = 8,  // low byte of the result, Z
+	s_part_hi = 16, // high byte of the result, C
+	s_part_all = 31,
+};
+
+struct Decoded
+{
+	uint16_t addr;
+	uint16_t next;
+	uint8_t opcode;
+	uint8_t n;
+	uint16_t nn;
+	uint8_t live; // flag parts read after the instruction, the others need no store
+};
+
+}
+
+Cpu::Jit::Code Cpu::Jit::translate(Mem& mem, uint16_t pc, uint16_t bank, Entry& entry)
+{
+	// worst case of one instruction including its exits
+	static constexpr uint32_t s_max_instruction_bytes = 160;
+
+	Emitter e(code + used, code + s_code_size);
+	if (e.space() < s_max_instructions * s_max_instruction_bytes)
+		return nullptr;
+	protect(PROT_READ | PROT_WRITE);
+
+	Decoded block[s_max_instructions];
+	uint8_t count = 0;
+
+	entry.pages[0] = pc >> 8;
+	uint16_t max_cycles = 0;
+
+	for (uint16_t addr = pc; ; )
+	{
+		Decoded& d = block[count++];
+		d.addr = addr;
+		d.opcode = mem.read(addr);
+		d.next = addr + Block::length(d.opcode);
+		d.n = mem.read(addr + 1);
+		d.nn = d.n | mem.read(static_cast<uint16_t>(addr + 2)) << 8;
+
+		Opcode const& o = s_opcodes[d.opcode == 0xCB ? 0x100 | d.n : d.opcode];
+		max_cycles += std::max(o.cycles, o.taken);
+
+		for (uint16_t i = addr; i != d.next; i++)
+			mem.mark_code(i);
+		entry.pages[1] = static_cast<uint16_t>(d.next - 1) >> 8;
+
+		if (ends_block(d.opcode) || count == s_max_instructions || ((d.next ^ pc) & 0xC000))
+			break;
+		addr = d.next;
+	}
+
+	// Flags stored by an inline instruction and overwritten by a later one before anything
+	// reads them are left out. Block exits and handlers may read all of them.
+	uint8_t live = s_part_all;
+	for (uint8_t i = count; i-- > 0; )
+	{
+		Decoded& d = block[i];
+		d.live = live;
+
+		uint8_t x = d.opcode >> 6;
+		uint8_t y = (d.opcode >> 3) & 7;
+		uint8_t z = d.opcode & 7;
+
+		if (x == 0 && (z == 4 || z == 5) && y != 6) // INC r / DEC r keep C
+			live &= ~(s_part_a | s_part_b | s_part_n | s_part_lo);
+		else if ((x == 2 && z != 6) || (x == 3 && z == 6)) // ALU, ADC and SBC read C
+			live = y == 1 || y == 3 ? s_part_hi : 0;
+		else if (d.opcode == 0x00 || (x == 1 && y != 6 && z != 6) || (x == 0 && z == 6 && y != 6)
+			|| (x == 0 && (d.opcode & 0x0F) == 0x01) || (x == 0 && z == 3))
+			; // no flags
+		else
+			live = s_part_all;
+	}
+
+	e.prologue();
+
+	uint32_t cycles = 0; // of the inline instructions so far
+	uint32_t synced = 0; // of those already added to Mem::cycles()
+	uint64_t* counter = mem.cycles_counter();
+	int32_t deadline = static_cast<int32_t>(reinterpret_cast<char const*>(mem.deadline_counter()) - reinterpret_cast<char const*>(counter));
+
+	auto leave = [&](uint32_t exit_cycles) {
+		if (exit_cycles > synced)
+			e.add_cycles(counter, exit_cycles - synced);
+		e.exit(exit_cycles);
+	};
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		Decoded const& d = block[i];
+		uint8_t opcode = d.opcode;
+		uint8_t n = d.n;
+		uint16_t nn = d.nn;
+		uint16_t next = d.next;
+		uint8_t live = d.live;
+		bool last = i + 1 == count;
+
+		uint8_t x = opcode >> 6;
+		uint8_t y = (opcode >> 3) & 7;
+		uint8_t z = opcode & 7;
+		bool native = true;
+
+		if (opcode == 0x00) // NOP
+			cycles += 1;
+		else if (x == 1 && y != 6 && z != 6) // LD r,r'
+		{
+			e.load_al(offset_r8[z]);
+			e.store_al(offset_r8[y]);
+			cycles += 1;
+		}
+		else if (x == 0 && z == 6 && y != 6) // LD r,d8
+		{
+			e.store8(offset_r8[y], n);
+			cycles += 2;
+		}
+		else if (x == 0 && (opcode & 0x0F) == 0x01) // LD rr,d16
+		{
+			e.store16(offset_r16[opcode >> 4], nn);
+			cycles += 3;
+		}
+		else if (x == 0 && z == 3) // INC rr / DEC rr
+		{
+			e.bytes({ 0x66, 0xFF });
+			e.rbx(y & 1, offset_r16[y >> 1]);
+			cycles += 2;
+		}
+		else if (x == 0 && (z == 4 || z == 5) && y != 6) // INC r / DEC r
+		{
+			// storing only the low byte of the result keeps C
+			e.load_al(offset_r8[y]);
+			if (live & s_part_a)
+				e.store_al(offset_flag_a);
+			if (live & s_part_b)
+				e.store8(offset_flag_b, 1);
+			e.bytes({ 0xFE, static_cast<uint8_t>(z == 4 ? 0xC0 : 0xC8) }); // inc al / dec al
+			if (live & s_part_lo)
+				e.store_al(offset_flag_result);
+			if (live & s_part_n)
+				e.store8(offset_flag_n, z == 5);
+			e.store_al(offset_r8[y]);
+			cycles += 1;
+		}
+		else if ((x == 2 && z != 6) || (x == 3 && z == 6)) // ALU A,r / ALU A,d8
+		{
+			// ADD ADC SUB SBC AND XOR OR, CP is a SUB without the store to A
+			static constexpr uint8_t s_op[8] = { 0x00, 0x10, 0x28, 0x18, 0x20, 0x30, 0x08, 0x28 };
+			bool logic = y >= 4 && y <= 6;
+
+			e.load_al(offset_r8[7]);
+			if (x == 2)
+			{
+				e.bytes({ 0x0F, 0xB6 }); e.rbx(1, offset_r8[z]);           // movzx ecx, byte [r]
+				cycles += 1;
+			}
+			else
+			{
+				e.byte(0xB9); e.imm32(n);                                  // mov ecx, n
+				cycles += 2;
+			}
+
+			if (!logic)
+			{
+				if (live & s_part_a)
+					e.store_al(offset_flag_a);
+				if (live & s_part_b)
+					e.store_cl(offset_flag_b);
+				if (y == 1 || y == 3)
+				{
+					e.bytes({ 0x66, 0x0F, 0xBA }); e.rbx(4, offset_flag_result); e.byte(8); // bt word [flag_result], 8
+				}
+			}
+
+			e.bytes({ s_op[y], 0xC8 });                                    // op al, cl
+
+			if (logic)
+			{
+				if (live & s_part_hi)
+					e.bytes({ 0x30, 0xE4 });                               // xor ah, ah
+			}
+			else if (live & s_part_hi)
+				e.bytes({ 0x0F, 0x92, 0xC4 });                             // setc ah
+
+			if ((live & (s_part_lo | s_part_hi)) == (s_part_lo | s_part_hi))
+				e.store_ax(offset_flag_result);
+			else if (live & s_part_lo)
+				e.store_al(offset_flag_result);
+			else if (live & s_part_hi)
+				e.store_ah(offset_flag_result + 1);
+
+			if (y != 7)
+				e.store_al(offset_r8[7]);
+
+			if (logic)
+			{
+				if (live & s_part_a)
+				{
+					if (y == 4)
+						e.bytes({ 0x34, 0x10 });                           // xor al, 0x10 (H)
+					e.store_al(offset_flag_a);
+				}
+				if (live & s_part_b)
+					e.store8(offset_flag_b, 0);
+			}
+			if (live & s_part_n)
+				e.store8(offset_flag_n, y == 2 || y == 3 || y == 7);
+		}
+		else if (opcode == 0x18 || opcode == 0xC3) // JR r8 / JP a16
+		{
+			e.store16(offset_pc, opcode == 0x18 ? static_cast<uint16_t>(next + static_cast<int8_t>(n)) : nn);
+			leave(cycles + (opcode == 0x18 ? 3 : 4));
+		}
+		else if ((x == 0 && z == 0 && y >= 4) || (x == 3 && z == 2 && y < 4)) // JR cc,r8 / JP cc,a16
+		{
+			bool jr = x == 0;
+			uint8_t cc = y & 3; // NZ Z NC C
+
+			// x86 ZF ends up set for Z and for NC
+			if (cc < 2)
+			{
+				e.byte(0xF6); e.rbx(0, offset_flag_result); e.byte(0xFF);  // test byte [flag_result], 0xFF
+			}
+			else
+			{
+				e.byte(0xF6); e.rbx(0, offset_flag_result + 1); e.byte(0x01); // test byte [flag_result + 1], 1
+			}
+			static constexpr uint8_t s_not_taken[4] = { s_jz, s_jnz, s_jnz, s_jz };
+			uint8_t* not_taken = e.jcc(s_not_taken[cc]);
+			e.store16(offset_pc, jr ? static_cast<uint16_t>(next + static_cast<int8_t>(n)) : nn);
+			leave(cycles + (jr ? 3 : 4));
+			e.bind(not_taken);
+			e.store16(offset_pc, next);
+			leave(cycles + (jr ? 2 : 3));
+		}
+		else
+			native = false;
+
+		if (native)
+		{
+			++stats.native;
+			if (last && !ends_block(opcode))
+			{
+				e.store16(offset_pc, next);
+				leave(cycles);
+			}
+		}
+		else
+		{
+			++stats.called;
+
+			Step step = s_step[opcode];
+			uint16_t after_opcode = d.addr + 1;
+			if (opcode == 0xCB)
+			{
+				step = s_step[0x100 | n];
+				after_opcode = d.addr + 2;
+			}
+			else if (step == s_step[0xD3]) // UNDEFINED records the opcode
+				e.store8(offset_byte0, opcode);
+
+			// the handler sees the time its instruction starts at
+			if (cycles > synced)
+			{
+				e.add_cycles(counter, cycles - synced);
+				synced = cycles;
+			}
+
+			e.store16(offset_pc, after_opcode);
+			e.bytes({ 0x48, 0x89, 0xDF });                                 // mov rdi, rbx
+			e.bytes({ 0x48, 0xB8 }); e.imm64(reinterpret_cast<uint64_t>(step)); // mov rax, step
+			e.bytes({ 0xFF, 0xD0 });                                       // call rax
+			e.bytes({ 0x0F, 0xB6, 0xC0 });                                 // movzx eax, al
+			e.bytes({ 0x41, 0x01, 0xC4 });                                 // add r12d, eax
+			e.bytes({ 0x48, 0xBA }); e.imm64(reinterpret_cast<uint64_t>(counter)); // mov rdx, counter
+			e.bytes({ 0x48, 0x01, 0x02 });                                 // add [rdx], rax
+
+			if (last)
+				leave(cycles); // the handler left RPC after the instruction or at its target
+			else
+			{
+				// stop when the handler reached the deadline, RPC is already past the instruction
+				e.bytes({ 0x48, 0x8B, 0x02 });                             // mov rax, [rdx]
+				e.bytes({ 0x48, 0x3B, 0x82 }); e.imm32(static_cast<uint32_t>(deadline)); // cmp rax, [rdx + deadline]
+				uint8_t* before_deadline = e.jcc(s_jb);
+				leave(cycles);
+				e.bind(before_deadline);
+			}
+		}
+	}
+
+	entry.pc = pc;
+	entry.bank = bank;
+	entry.valid = true;
+	entry.max_cycles = max_cycles;
+	entry.code = reinterpret_cast<Code>(code + used);
+
+	protect(PROT_READ | PROT_EXEC);
+	used += e.size();
+	stats.translated++;
+	stats.code_bytes += e.size();
+
+	return entry.code;
+}
+
+void Cpu::Jit::protect(int protection)
+{
+	// the pages from the first one not used up, blocks translated before stay executable
+	uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+	uintptr_t begin = reinterpret_cast<uintptr_t>(code + used) & ~(page - 1);
+	mprotect(reinterpret_cast<void*>(begin), reinterpret_cast<uintptr_t>(code) + s_code_size - begin, protection);
+}
+
+void Cpu::Jit::invalidate_written(Mem const& mem)
+{
+	for (Entry& entry : entries)
+	{
+		if (entry.valid && (mem.code_page_written(entry.pages[0]) || mem.code_page_written(entry.pages[1])))
+		{
+			entry.valid = false;
+			++stats.invalidated;
+		}
+	}
+}
+
+void Cpu::Jit::invalidate_all()
+{
+	for (Entry& entry : entries)
+		entry.valid = false;
+}
+
+uint32_t Cpu::run_jit()
+{
+	if (m_stop)
+		return 0;
+
+	if (!m_jit)
+		m_jit = std::make_unique<Jit>(*this);
+	if (!m_jit->code)
+		return run_block(); // no executable memory, stay on the interpreter
+
+	// clock() refetches from RPC when the M-cycle core takes over again
+	m_instruction_remaining_cycles = -1;
+
+	// interrupts, HALT and code written by the last block are handled between instructions
+	if (m_mem.cycles() >= m_mem.deadline())
+		return step();
+
+	// an event due in the middle of the block needs the per instruction checks of run_block()
+	Jit::Entry const& entry = m_jit->lookup(m_mem, RPC, m_mem.bank(RPC));
+	if (m_mem.cycles() + entry.max_cycles > m_mem.deadline())
+		return run_block();
+
+	return entry.code(*this);
+}
+
+Cpu::JitStats Cpu::jit_stats() const
+{
+	return m_jit ? m_jit->stats : JitStats{};
+}
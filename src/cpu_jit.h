@@ -0,0 +1,55 @@
+#pragma once
+#include "cpu.h"
+
+// x86-64 translation of basic blocks, see cpu_jit.cpp.
+// Only part of the build with GB_JIT defined, see the linux-jit and bench-jit targets.
+
+struct Cpu::Jit
+{
+	using Code = uint32_t (*)(Cpu&);
+
+	static constexpr uint32_t s_code_size = 4 << 20;
+	static constexpr uint32_t s_slots = 4096;
+	static constexpr uint8_t s_max_instructions = 32;
+
+	struct Entry
+	{
+		uint16_t pc;
+		uint16_t bank;
+		bool valid;
+		uint8_t pages[2]; // pages of the first and last byte
+		uint16_t max_cycles; // with every branch taken
+		Code code;
+	};
+
+	Jit(Cpu& cpu);
+	~Jit();
+
+	// nullptr when no executable memory could be mapped
+	uint8_t* code;
+	uint32_t used;
+
+	// direct mapped on pc like the block cache
+	Entry entries[s_slots];
+
+	// offsets of the guest registers from the Cpu the generated code gets in rbx
+	int32_t offset_flag_result;
+	int32_t offset_flag_a;
+	int32_t offset_flag_b;
+	int32_t offset_flag_n;
+	int32_t offset_r8[8]; // regular operand order, (HL) unused
+	int32_t offset_r16[4]; // BC, DE, HL, SP
+	int32_t offset_pc;
+	int32_t offset_byte0;
+
+	JitStats stats;
+
+	Entry const& lookup(Mem& mem, uint16_t pc, uint16_t bank);
+	Code translate(Mem& mem, uint16_t pc, uint16_t bank, Entry& entry);
+	// Makes the code space from the next block on writable while a block is emitted and
+	// executable again before it runs. The page the next block starts on may hold the end of
+	// the last one, which can't run meanwhile.
+	void protect(int protection);
+	void invalidate_written(Mem const& mem);
+	void invalidate_all();
+};
@@ -0,0 +1,288 @@
+#pragma once
+#include "cpu.h"
+
+// Opcode specification.
+// One entry per opcode in the same layout as s_dispatch and s_step: 0x000-0x0FF are the
+// unprefixed opcodes, 0x100-0x1FF the CB prefixed ones. The handlers of the table and the
+// instruction stepped core are instantiated from it (see cpu_dispatch.cpp and cpu_step.cpp),
+// the block cache and the translator take the instruction lengths from it and the debug
+// output the names.
+// https://www.pastraiser.com/cpu/gameboy/gameboy_opcodes.html
+
+struct Cpu::Opcode
+{
+	enum class Kind : uint8_t
+	{
+		NOP, STOP, HALT, DI, EI, UNDEFINED, PREFIX_CB,
+
+		// 8-bit loads
+		LD,        // LD dst,src
+		LD_n,      // LD dst,d8
+		LD_rr_A,   // LD (rr),A
+		LD_A_rr,   // LD A,(rr)
+		LD_HLi_A,  // LD (HL+),A / LD (HL-),A
+		LD_A_HLi,  // LD A,(HL+) / LD A,(HL-)
+		LDH_a8_A, LDH_A_a8, LD_C_A, LD_A_C, LD_a16_A, LD_A_a16,
+
+		// 16-bit loads
+		LD_rr_nn, LD_a16_SP, LD_SP_HL, LD_HL_SP_n, POP, PUSH,
+
+		// 8-bit alu
+		ALU,       // alu A,src
+		ALU_n,     // alu A,d8
+		INC, DEC,  // INC dst / DEC dst
+		ROTATE_A,  // RLCA / RRCA / RLA / RRA
+		DAA, CPL, SCF, CCF,
+
+		// 16-bit alu
+		INC_rr, DEC_rr, ADD_HL_rr, ADD_SP_n,
+
+		// jumps and calls
+		JR, JP, JP_HL, CALL, RST, RET_cc, RET, RETI,
+
+		// CB prefixed
+		SHIFT, BIT, RES, SET,
+	};
+
+	// operand order of the regular opcode blocks
+	enum class Reg8 : uint8_t { B, C, D, E, H, L, HL /* (HL) */, A };
+	enum class Reg16 : uint8_t { BC, DE, HL, SP, AF };
+	enum class Cond : uint8_t { Always, NZ, Z, NC, C };
+	enum class Alu : uint8_t { ADD, ADC, SUB, SBC, AND, XOR, OR, CP };
+	enum class Shift : uint8_t { RLC, RRC, RL, RR, SLA, SRA, SWAP, SRL };
+
+	char name[16];
+	uint8_t length = 1;       // bytes including the opcode, CB prefixed ones count the prefix
+	uint8_t cycles = 1;       // M-cycles, not taken for conditional ones, CB prefixed ones count the prefix
+	uint8_t taken = 0;        // M-cycles of a taken branch
+	Kind kind = Kind::UNDEFINED;
+	Reg8 dst = Reg8::A;
+	Reg8 src = Reg8::A;
+	Reg16 rr = Reg16::BC;
+	Cond cc = Cond::Always;
+	Alu alu = Alu::ADD;
+	Shift shift = Shift::RLC;
+	uint8_t n = 0;            // bit number or RST vector
+	int8_t delta = 0;         // HL increment of LD (HL+),A and friends
+
+	static constexpr char const* s_reg8_names[8] = { "B", "C", "D", "E", "H", "L", "(HL)", "A" };
+	static constexpr char const* s_alu_names[8] = { "ADD A,", "ADC A,", "SUB ", "SBC A,", "AND ", "XOR ", "OR ", "CP " };
+	static constexpr char const* s_shift_names[8] = { "RLC ", "RRC ", "RL ", "RR ", "SLA ", "SRA ", "SWAP ", "SRL " };
+	static constexpr char const* s_bit_names[4] = { "", "BIT ", "RES ", "SET " };
+
+	constexpr Opcode& append(char const* s)
+	{
+		size_t i = 0;
+		while (name[i])
+			++i;
+		while (*s)
+			name[i++] = *s++;
+		name[i] = '\0';
+		return *this;
+	}
+
+	// 0x40 - 0x7F
+	static constexpr Opcode ld(uint8_t op)
+	{
+		if (op == 0x76)
+			return { .name = "HALT", .kind = Kind::HALT };
+
+		Opcode o { .name = "LD ", .kind = Kind::LD, .dst = Reg8((op >> 3) & 7), .src = Reg8(op & 7) };
+		o.append(s_reg8_names[(op >> 3) & 7]).append(",").append(s_reg8_names[op & 7]);
+		o.cycles = o.dst == Reg8::HL || o.src == Reg8::HL ? 2 : 1;
+		return o;
+	}
+
+	// 0x80 - 0xBF
+	static constexpr Opcode alu_r(uint8_t op)
+	{
+		Opcode o { .name = "", .kind = Kind::ALU, .src = Reg8(op & 7), .alu = Alu((op >> 3) & 7) };
+		o.append(s_alu_names[(op >> 3) & 7]).append(s_reg8_names[op & 7]);
+		o.cycles = o.src == Reg8::HL ? 2 : 1;
+		return o;
+	}
+
+	// CB 0x00 - 0xFF
+	static constexpr Opcode prefixed(uint8_t op)
+	{
+		uint8_t y = (op >> 3) & 7;
+		bool hl = (op & 7) == 6;
+
+		Opcode o { .name = "", .length = 2, .dst = Reg8(op & 7) };
+		if (op < 0x40)
+		{
+			o.kind = Kind::SHIFT;
+			o.shift = Shift(y);
+			o.append(s_shift_names[y]).append(s_reg8_names[op & 7]);
+			o.cycles = hl ? 4 : 2;
+		}
+		else
+		{
+			char bit[] = { static_cast<char>('0' + y), ',', '\0' };
+			o.kind = op < 0x80 ? Kind::BIT : op < 0xC0 ? Kind::RES : Kind::SET;
+			o.n = y;
+			o.append(s_bit_names[op >> 6]).append(bit).append(s_reg8_names[op & 7]);
+			o.cycles = !hl ? 2 : o.kind == Kind::BIT ? 3 : 4;
+		}
+		return o;
+	}
+
+	static constexpr std::array<Opcode, 0x200> table()
+	{
+		using enum Kind;
+		constexpr Reg8 A = Reg8::A, B = Reg8::B, C = Reg8::C, D = Reg8::D, E = Reg8::E, H = Reg8::H, L = Reg8::L;
+		constexpr Reg16 AF = Reg16::AF, BC = Reg16::BC, DE = Reg16::DE, HL = Reg16::HL, SP = Reg16::SP;
+
+		std::array<Opcode, 0x200> t {};
+
+		t[0x00] = { .name = "NOP",         .length = 1, .cycles = 1, .kind = NOP };
+		t[0x01] = { .name = "LD BC,d16",   .length = 3, .cycles = 3, .kind = LD_rr_nn, .rr = BC };
+		t[0x02] = { .name = "LD (BC),A",   .length = 1, .cycles = 2, .kind = LD_rr_A, .rr = BC };
+		t[0x03] = { .name = "INC BC",      .length = 1, .cycles = 2, .kind = INC_rr, .rr = BC };
+		t[0x04] = { .name = "INC B",       .length = 1, .cycles = 1, .kind = INC, .dst = B };
+		t[0x05] = { .name = "DEC B",       .length = 1, .cycles = 1, .kind = DEC, .dst = B };
+		t[0x06] = { .name = "LD B,d8",     .length = 2, .cycles = 2, .kind = LD_n, .dst = B };
+		t[0x07] = { .name = "RLCA",        .length = 1, .cycles = 1, .kind = ROTATE_A, .shift = Shift::RLC };
+		t[0x08] = { .name = "LD (a16),SP", .length = 3, .cycles = 5, .kind = LD_a16_SP };
+		t[0x09] = { .name = "ADD HL,BC",   .length = 1, .cycles = 2, .kind = ADD_HL_rr, .rr = BC };
+		t[0x0A] = { .name = "LD A,(BC)",   .length = 1, .cycles = 2, .kind = LD_A_rr, .rr = BC };
+		t[0x0B] = { .name = "DEC BC",      .length = 1, .cycles = 2, .kind = DEC_rr, .rr = BC };
+		t[0x0C] = { .name = "INC C",       .length = 1, .cycles = 1, .kind = INC, .dst = C };
+		t[0x0D] = { .name = "DEC C",       .length = 1, .cycles = 1, .kind = DEC, .dst = C };
+		t[0x0E] = { .name = "LD C,d8",     .length = 2, .cycles = 2, .kind = LD_n, .dst = C };
+		t[0x0F] = { .name = "RRCA",        .length = 1, .cycles = 1, .kind = ROTATE_A, .shift = Shift::RRC };
+
+		t[0x10] = { .name = "STOP 0",      .length = 2, .cycles = 2, .kind = STOP };
+		t[0x11] = { .name = "LD DE,d16",   .length = 3, .cycles = 3, .kind = LD_rr_nn, .rr = DE };
+		t[0x12] = { .name = "LD (DE),A",   .length = 1, .cycles = 2, .kind = LD_rr_A, .rr = DE };
+		t[0x13] = { .name = "INC DE",      .length = 1, .cycles = 2, .kind = INC_rr, .rr = DE };
+		t[0x14] = { .name = "INC D",       .length = 1, .cycles = 1, .kind = INC, .dst = D };
+		t[0x15] = { .name = "DEC D",       .length = 1, .cycles = 1, .kind = DEC, .dst = D };
+		t[0x16] = { .name = "LD D,d8",     .length = 2, .cycles = 2, .kind = LD_n, .dst = D };
+		t[0x17] = { .name = "RLA",         .length = 1, .cycles = 1, .kind = ROTATE_A, .shift = Shift::RL };
+		t[0x18] = { .name = "JR r8",       .length = 2, .cycles = 3, .taken = 3, .kind = JR };
+		t[0x19] = { .name = "ADD HL,DE",   .length = 1, .cycles = 2, .kind = ADD_HL_rr, .rr = DE };
+		t[0x1A] = { .name = "LD A,(DE)",   .length = 1, .cycles = 2, .kind = LD_A_rr, .rr = DE };
+		t[0x1B] = { .name = "DEC DE",      .length = 1, .cycles = 2, .kind = DEC_rr, .rr = DE };
+		t[0x1C] = { .name = "INC E",       .length = 1, .cycles = 1, .kind = INC, .dst = E };
+		t[0x1D] = { .name = "DEC E",       .length = 1, .cycles = 1, .kind = DEC, .dst = E };
+		t[0x1E] = { .name = "LD E,d8",     .length = 2, .cycles = 2, .kind = LD_n, .dst = E };
+		t[0x1F] = { .name = "RRA",         .length = 1, .cycles = 1, .kind = ROTATE_A, .shift = Shift::RR };
+
+		t[0x20] = { .name = "JR NZ,r8",    .length = 2, .cycles = 2, .taken = 3, .kind = JR, .cc = Cond::NZ };
+		t[0x21] = { .name = "LD HL,d16",   .length = 3, .cycles = 3, .kind = LD_rr_nn, .rr = HL };
+		t[0x22] = { .name = "LD (HL+),A",  .length = 1, .cycles = 2, .kind = LD_HLi_A, .delta = +1 };
+		t[0x23] = { .name = "INC HL",      .length = 1, .cycles = 2, .kind = INC_rr, .rr = HL };
+		t[0x24] = { .name = "INC H",       .length = 1, .cycles = 1, .kind = INC, .dst = H };
+		t[0x25] = { .name = "DEC H",       .length = 1, .cycles = 1, .kind = DEC, .dst = H };
+		t[0x26] = { .name = "LD H,d8",     .length = 2, .cycles = 2, .kind = LD_n, .dst = H };
+		t[0x27] = { .name = "DAA",         .length = 1, .cycles = 1, .kind = DAA };
+		t[0x28] = { .name = "JR Z,r8",     .length = 2, .cycles = 2, .taken = 3, .kind = JR, .cc = Cond::Z };
+		t[0x29] = { .name = "ADD HL,HL",   .length = 1, .cycles = 2, .kind = ADD_HL_rr, .rr = HL };
+		t[0x2A] = { .name = "LD A,(HL+)",  .length = 1, .cycles = 2, .kind = LD_A_HLi, .delta = +1 };
+		t[0x2B] = { .name = "DEC HL",      .length = 1, .cycles = 2, .kind = DEC_rr, .rr = HL };
+		t[0x2C] = { .name = "INC L",       .length = 1, .cycles = 1, .kind = INC, .dst = L };
+		t[0x2D] = { .name = "DEC L",       .length = 1, .cycles = 1, .kind = DEC, .dst = L };
+		t[0x2E] = { .name = "LD L,d8",     .length = 2, .cycles = 2, .kind = LD_n, .dst = L };
+		t[0x2F] = { .name = "CPL",         .length = 1, .cycles = 1, .kind = CPL };
+
+		t[0x30] = { .name = "JR NC,r8",    .length = 2, .cycles = 2, .taken = 3, .kind = JR, .cc = Cond::NC };
+		t[0x31] = { .name = "LD SP,d16",   .length = 3, .cycles = 3, .kind = LD_rr_nn, .rr = SP };
+		t[0x32] = { .name = "LD (HL-),A",  .length = 1, .cycles = 2, .kind = LD_HLi_A, .delta = -1 };
+		t[0x33] = { .name = "INC SP",      .length = 1, .cycles = 2, .kind = INC_rr, .rr = SP };
+		t[0x34] = { .name = "INC (HL)",    .length = 1, .cycles = 3, .kind = INC, .dst = Reg8::HL };
+		t[0x35] = { .name = "DEC (HL)",    .length = 1, .cycles = 3, .kind = DEC, .dst = Reg8::HL };
+		t[0x36] = { .name = "LD (HL),d8",  .length = 2, .cycles = 3, .kind = LD_n, .dst = Reg8::HL };
+		t[0x37] = { .name = "SCF",         .length = 1, .cycles = 1, .kind = SCF };
+		t[0x38] = { .name = "JR C,r8",     .length = 2, .cycles = 2, .taken = 3, .kind = JR, .cc = Cond::C };
+		t[0x39] = { .name = "ADD HL,SP",   .length = 1, .cycles = 2, .kind = ADD_HL_rr, .rr = SP };
+		t[0x3A] = { .name = "LD A,(HL-)",  .length = 1, .cycles = 2, .kind = LD_A_HLi, .delta = -1 };
+		t[0x3B] = { .name = "DEC SP",      .length = 1, .cycles = 2, .kind = DEC_rr, .rr = SP };
+		t[0x3C] = { .name = "INC A",       .length = 1, .cycles = 1, .kind = INC, .dst = A };
+		t[0x3D] = { .name = "DEC A",       .length = 1, .cycles = 1, .kind = DEC, .dst = A };
+		t[0x3E] = { .name = "LD A,d8",     .length = 2, .cycles = 2, .kind = LD_n, .dst = A };
+		t[0x3F] = { .name = "CCF",         .length = 1, .cycles = 1, .kind = CCF };
+
+		// LD r,r' / LD r,(HL) / LD (HL),r / HALT and ADD/ADC/SUB/SBC/AND/XOR/OR/CP r
+		for (uint8_t op = 0; op < 0x40; op++)
+		{
+			t[0x40 + op] = ld(0x40 + op);
+			t[0x80 + op] = alu_r(0x80 + op);
+		}
+
+		t[0xC0] = { .name = "RET NZ",      .length = 1, .cycles = 2, .taken = 5, .kind = RET_cc, .cc = Cond::NZ };
+		t[0xC1] = { .name = "POP BC",      .length = 1, .cycles = 3, .kind = POP, .rr = BC };
+		t[0xC2] = { .name = "JP NZ,a16",   .length = 3, .cycles = 3, .taken = 4, .kind = JP, .cc = Cond::NZ };
+		t[0xC3] = { .name = "JP a16",      .length = 3, .cycles = 4, .taken = 4, .kind = JP };
+		t[0xC4] = { .name = "CALL NZ,a16", .length = 3, .cycles = 3, .taken = 6, .kind = CALL, .cc = Cond::NZ };
+		t[0xC5] = { .name = "PUSH BC",     .length = 1, .cycles = 4, .kind = PUSH, .rr = BC };
+		t[0xC6] = { .name = "ADD A,d8",    .length = 2, .cycles = 2, .kind = ALU_n, .alu = Alu::ADD };
+		t[0xC7] = { .name = "RST 00H",     .length = 1, .cycles = 4, .kind = RST, .n = 0x00 };
+		t[0xC8] = { .name = "RET Z",       .length = 1, .cycles = 2, .taken = 5, .kind = RET_cc, .cc = Cond::Z };
+		t[0xC9] = { .name = "RET",         .length = 1, .cycles = 4, .kind = RET };
+		t[0xCA] = { .name = "JP Z,a16",    .length = 3, .cycles = 3, .taken = 4, .kind = JP, .cc = Cond::Z };
+		t[0xCB] = { .name = "PREFIX CB",   .length = 2, .cycles = 1, .kind = PREFIX_CB };
+		t[0xCC] = { .name = "CALL Z,a16",  .length = 3, .cycles = 3, .taken = 6, .kind = CALL, .cc = Cond::Z };
+		t[0xCD] = { .name = "CALL a16",    .length = 3, .cycles = 6, .taken = 6, .kind = CALL };
+		t[0xCE] = { .name = "ADC A,d8",    .length = 2, .cycles = 2, .kind = ALU_n, .alu = Alu::ADC };
+		t[0xCF] = { .name = "RST 08H",     .length = 1, .cycles = 4, .kind = RST, .n = 0x08 };
+
+		t[0xD0] = { .name = "RET NC",      .length = 1, .cycles = 2, .taken = 5, .kind = RET_cc, .cc = Cond::NC };
+		t[0xD1] = { .name = "POP DE",      .length = 1, .cycles = 3, .kind = POP, .rr = DE };
+		t[0xD2] = { .name = "JP NC,a16",   .length = 3, .cycles = 3, .taken = 4, .kind = JP, .cc = Cond::NC };
+		t[0xD3] = { .name = "UNDEFINED D3" };
+		t[0xD4] = { .name = "CALL NC,a16", .length = 3, .cycles = 3, .taken = 6, .kind = CALL, .cc = Cond::NC };
+		t[0xD5] = { .name = "PUSH DE",     .length = 1, .cycles = 4, .kind = PUSH, .rr = DE };
+		t[0xD6] = { .name = "SUB d8",      .length = 2, .cycles = 2, .kind = ALU_n, .alu = Alu::SUB };
+		t[0xD7] = { .name = "RST 10H",     .length = 1, .cycles = 4, .kind = RST, .n = 0x10 };
+		t[0xD8] = { .name = "RET C",       .length = 1, .cycles = 2, .taken = 5, .kind = RET_cc, .cc = Cond::C };
+		t[0xD9] = { .name = "RETI",        .length = 1, .cycles = 4, .kind = RETI };
+		t[0xDA] = { .name = "JP C,a16",    .length = 3, .cycles = 3, .taken = 4, .kind = JP, .cc = Cond::C };
+		t[0xDB] = { .name = "UNDEFINED DB" };
+		t[0xDC] = { .name = "CALL C,a16",  .length = 3, .cycles = 3, .taken = 6, .kind = CALL, .cc = Cond::C };
+		t[0xDD] = { .name = "UNDEFINED DD" };
+		t[0xDE] = { .name = "SBC A,d8",    .length = 2, .cycles = 2, .kind = ALU_n, .alu = Alu::SBC };
+		t[0xDF] = { .name = "RST 18H",     .length = 1, .cycles = 4, .kind = RST, .n = 0x18 };
+
+		t[0xE0] = { .name = "LDH (a8),A",  .length = 2, .cycles = 3, .kind = LDH_a8_A };
+		t[0xE1] = { .name = "POP HL",      .length = 1, .cycles = 3, .kind = POP, .rr = HL };
+		t[0xE2] = { .name = "LD (C),A",    .length = 1, .cycles = 2, .kind = LD_C_A };
+		t[0xE3] = { .name = "UNDEFINED E3" };
+		t[0xE4] = { .name = "UNDEFINED E4" };
+		t[0xE5] = { .name = "PUSH HL",     .length = 1, .cycles = 4, .kind = PUSH, .rr = HL };
+		t[0xE6] = { .name = "AND d8",      .length = 2, .cycles = 2, .kind = ALU_n, .alu = Alu::AND };
+		t[0xE7] = { .name = "RST 20H",     .length = 1, .cycles = 4, .kind = RST, .n = 0x20 };
+		t[0xE8] = { .name = "ADD SP,r8",   .length = 2, .cycles = 4, .kind = ADD_SP_n };
+		t[0xE9] = { .name = "JP (HL)",     .length = 1, .cycles = 1, .kind = JP_HL };
+		t[0xEA] = { .name = "LD (a16),A",  .length = 3, .cycles = 4, .kind = LD_a16_A };
+		t[0xEB] = { .name = "UNDEFINED EB" };
+		t[0xEC] = { .name = "UNDEFINED EC" };
+		t[0xED] = { .name = "UNDEFINED ED" };
+		t[0xEE] = { .name = "XOR d8",      .length = 2, .cycles = 2, .kind = ALU_n, .alu = Alu::XOR };
+		t[0xEF] = { .name = "RST 28H",     .length = 1, .cycles = 4, .kind = RST, .n = 0x28 };
+
+		t[0xF0] = { .name = "LDH A,(a8)",  .length = 2, .cycles = 3, .kind = LDH_A_a8 };
+		t[0xF1] = { .name = "POP AF",      .length = 1, .cycles = 3, .kind = POP, .rr = AF };
+		t[0xF2] = { .name = "LD A,(C)",    .length = 1, .cycles = 2, .kind = LD_A_C };
+		t[0xF3] = { .name = "DI",          .length = 1, .cycles = 1, .kind = DI };
+		t[0xF4] = { .name = "UNDEFINED F4" };
+		t[0xF5] = { .name = "PUSH AF",     .length = 1, .cycles = 4, .kind = PUSH, .rr = AF };
+		t[0xF6] = { .name = "OR d8",       .length = 2, .cycles = 2, .kind = ALU_n, .alu = Alu::OR };
+		t[0xF7] = { .name = "RST 30H",     .length = 1, .cycles = 4, .kind = RST, .n = 0x30 };
+		t[0xF8] = { .name = "LD HL,SP+r8", .length = 2, .cycles = 3, .kind = LD_HL_SP_n };
+		t[0xF9] = { .name = "LD SP,HL",    .length = 1, .cycles = 2, .kind = LD_SP_HL };
+		t[0xFA] = { .name = "LD A,(a16)",  .length = 3, .cycles = 4, .kind = LD_A_a16 };
+		t[0xFB] = { .name = "EI",          .length = 1, .cycles = 1, .kind = EI };
+		t[0xFC] = { .name = "UNDEFINED FC" };
+		t[0xFD] = { .name = "UNDEFINED FD" };
+		t[0xFE] = { .name = "CP d8",       .length = 2, .cycles = 2, .kind = ALU_n, .alu = Alu::CP };
+		t[0xFF] = { .name = "RST 38H",     .length = 1, .cycles = 4, .kind = RST, .n = 0x38 };
+
+		for (uint16_t op = 0; op < 0x100; op++)
+			t[0x100 + op] = prefixed(op);
+
+		return t;
+	}
+};
+
+inline constexpr std::array<Cpu::Opcode, 0x200> Cpu::s_opcodes = Cpu::Opcode::table();
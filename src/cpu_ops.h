@@ -0,0 +1,88 @@
+#pragma once
+#include "cpu.h"
+#include "cpu_alu.h"
+#include "cpu_opcodes.h"
+
+// Building blocks shared by the execution cores, on the registers of Regs: Cpu, or a lane of
+// Lanes with the same register names.
+
+template <typename Regs>
+struct Cpu::BasicOps
+{
+	using R8 = uint8_t Regs::*;
+	using R16 = uint16_t Regs::*;
+	using AluOp = void (*)(Regs&, uint8_t);
+	using ModifyOp = uint8_t (*)(Regs&, uint8_t);
+
+	using Kind = Opcode::Kind;
+	using Cond = Opcode::Cond;
+
+	template <Cond CC>
+	static bool cond(Regs& cpu)
+	{
+		if constexpr (CC == Cond::NZ) return !cpu.flag_z();
+		if constexpr (CC == Cond::Z) return cpu.flag_z();
+		if constexpr (CC == Cond::NC) return !cpu.flag_c();
+		if constexpr (CC == Cond::C) return cpu.flag_c();
+		return true;
+	}
+
+	static uint16_t word(uint8_t lsb, uint8_t msb)
+	{
+		return static_cast<uint16_t>(msb) << 8 | lsb;
+	}
+
+	// alu operations on A
+	static void ADD(Regs& cpu, uint8_t r) { cpu.alu_add(r); }
+	static void ADC(Regs& cpu, uint8_t r) { cpu.alu_adc(r); }
+	static void SUB(Regs& cpu, uint8_t r) { cpu.alu_sub(r); }
+	static void SBC(Regs& cpu, uint8_t r) { cpu.alu_sbc(r); }
+	static void AND(Regs& cpu, uint8_t r) { cpu.alu_and(r); }
+	static void XOR(Regs& cpu, uint8_t r) { cpu.alu_xor(r); }
+	static void OR(Regs& cpu, uint8_t r) { cpu.alu_or(r); }
+	static void CP(Regs& cpu, uint8_t r) { cpu.alu_cp(r); }
+
+	// read-modify-write operations
+	static uint8_t INC(Regs& cpu, uint8_t r) { return cpu.alu_inc(r); }
+	static uint8_t DEC(Regs& cpu, uint8_t r) { return cpu.alu_dec(r); }
+	static uint8_t RLC(Regs& cpu, uint8_t r) { return cpu.alu_rlc(r); }
+	static uint8_t RRC(Regs& cpu, uint8_t r) { return cpu.alu_rrc(r); }
+	static uint8_t RL(Regs& cpu, uint8_t r) { return cpu.alu_rl(r); }
+	static uint8_t RR(Regs& cpu, uint8_t r) { return cpu.alu_rr(r); }
+	static uint8_t SLA(Regs& cpu, uint8_t r) { return cpu.alu_sla(r); }
+	static uint8_t SRA(Regs& cpu, uint8_t r) { return cpu.alu_sra(r); }
+	static uint8_t SWAP(Regs& cpu, uint8_t r) { return cpu.alu_swap(r); }
+	static uint8_t SRL(Regs& cpu, uint8_t r) { return cpu.alu_srl(r); }
+	template <uint8_t B>
+	static uint8_t RES(Regs&, uint8_t r) { return r & ~(1 << B); }
+	template <uint8_t B>
+	static uint8_t SET(Regs&, uint8_t r) { return r | (1 << B); }
+
+	// operands of an s_opcodes entry, in the order of Opcode::Reg8, Reg16, Alu and Shift
+	static constexpr R8 s_r8[8] = { &Regs::RB, &Regs::RC, &Regs::RD, &Regs::RE, &Regs::RH, &Regs::RL, nullptr /* (HL) */, &Regs::RA };
+	static constexpr R16 s_r16[5] = { &Regs::RBC, &Regs::RDE, &Regs::RHL, &Regs::RSP, &Regs::RAF };
+	static constexpr AluOp s_alu[8] = { ADD, ADC, SUB, SBC, AND, XOR, OR, CP };
+	static constexpr ModifyOp s_rotate[8] = { RLC, RRC, RL, RR, SLA, SRA, SWAP, SRL };
+
+	static constexpr R8 r8(Opcode::Reg8 r) { return s_r8[static_cast<uint8_t>(r)]; }
+	static constexpr R16 r16(Opcode::Reg16 rr) { return s_r16[static_cast<uint8_t>(rr)]; }
+	static constexpr AluOp alu(Opcode::Alu op) { return s_alu[static_cast<uint8_t>(op)]; }
+
+	// the read-modify-write operation of INC/DEC and the CB prefixed opcodes
+	template <uint16_t Op>
+	static constexpr ModifyOp modify()
+	{
+		constexpr Opcode o = s_opcodes[Op];
+
+		if constexpr (o.kind == Kind::INC)
+			return INC;
+		else if constexpr (o.kind == Kind::DEC)
+			return DEC;
+		else if constexpr (o.kind == Kind::RES)
+			return RES<o.n>;
+		else if constexpr (o.kind == Kind::SET)
+			return SET<o.n>;
+		else
+			return s_rotate[static_cast<uint8_t>(o.shift)];
+	}
+};
@@ -0,0 +1,34 @@
+#include "cpu.h"
+#include "cpu_step.h"
+
+// Instruction stepped core.
+// Runs a whole instruction per call and accesses Mem directly instead of going through the
+// Bus one M-cycle at a time, calling the handlers of cpu_step.h through s_step.
+
+constinit std::array<Cpu::Step, 0x200> const Cpu::s_step = Cpu::StepOps::make_step_table(std::make_index_sequence<0x200>());
+
+uint8_t Cpu::step()
+{
+	if (m_stop)
+		return 0;
+
+	// clock() refetches from RPC when the M-cycle core takes over again
+	m_instruction_remaining_cycles = -1;
+
+	if (m_mem.cycles() >= m_mem.deadline())
+	{
+		if (uint8_t cycles = update())
+			return cycles;
+		if (m_halted)
+		{
+			// idle like the M-cycle core, Dmg::step() skips ahead to the interrupt instead
+			m_mem.add_cycles(1);
+			return 1;
+		}
+	}
+
+	m_instruction_byte0 = m_mem.read(RPC++);
+	uint8_t cycles = s_step[m_instruction_byte0](*this);
+	m_mem.add_cycles(cycles);
+	return cycles;
+}
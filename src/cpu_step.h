@@ -0,0 +1,422 @@
+#pragma once
+#include "cpu.h"
+#include "cpu_ops.h"
+
+#include <utility>
+
+// Instruction handlers of the stepped core (cpu_step.cpp), the threaded interpreter
+// (cpu_threaded.cpp) and the lanes of Lanes (lanes.cpp).
+// Handlers are entered with RPC past the opcode and return the number of M-cycles the
+// instruction takes on hardware. They reach memory through the m_mem of Regs, a lane fetches
+// its operands from the bytes its group decoded instead.
+
+template <typename Regs>
+struct Cpu::BasicStepOps : Cpu::BasicOps<Regs>
+{
+	using Base = Cpu::BasicOps<Regs>;
+	using typename Base::R8;
+	using typename Base::R16;
+	using typename Base::AluOp;
+	using typename Base::ModifyOp;
+	using typename Base::Kind;
+	using typename Base::Cond;
+	using Base::word;
+	using Base::r8;
+	using Base::r16;
+	using Base::alu;
+
+	static uint8_t read(Regs& cpu, uint16_t addr)
+	{
+		return cpu.m_mem.read(addr);
+	}
+	static void write(Regs& cpu, uint16_t addr, uint8_t data)
+	{
+		cpu.m_mem.write(addr, data);
+	}
+	static uint8_t fetch(Regs& cpu)
+	{
+		if constexpr (requires { cpu.fetch(); })
+			return cpu.fetch();
+		else
+			return read(cpu, cpu.RPC++);
+	}
+	static uint16_t fetch_word(Regs& cpu)
+	{
+		uint8_t lsb = fetch(cpu);
+		return word(lsb, fetch(cpu));
+	}
+	static void push(Regs& cpu, uint16_t rr)
+	{
+		write(cpu, --cpu.RSP, msb(rr));
+		write(cpu, --cpu.RSP, lsb(rr));
+	}
+	static uint16_t pop(Regs& cpu)
+	{
+		uint8_t lsb = read(cpu, cpu.RSP++);
+		return word(lsb, read(cpu, cpu.RSP++));
+	}
+
+
+	// 8-bit loads
+
+	template <R8 R1, R8 R2>
+	static void LD_r_r(Regs& cpu)
+	{
+		cpu.*R1 = cpu.*R2;
+	}
+	template <R8 R>
+	static void LD_r_n(Regs& cpu)
+	{
+		cpu.*R = fetch(cpu);
+	}
+	template <R8 R, R16 RR>
+	static void LD_r_rr_address(Regs& cpu)
+	{
+		cpu.*R = read(cpu, cpu.*RR);
+	}
+	template <R16 RR, R8 R>
+	static void LD_rr_address_r(Regs& cpu)
+	{
+		write(cpu, cpu.*RR, cpu.*R);
+	}
+	template <int8_t Delta>
+	static void LD_HLi_A(Regs& cpu)
+	{
+		write(cpu, cpu.RHL, cpu.RA);
+		cpu.RHL += Delta;
+	}
+	template <int8_t Delta>
+	static void LD_A_HLi(Regs& cpu)
+	{
+		cpu.RA = read(cpu, cpu.RHL);
+		cpu.RHL += Delta;
+	}
+	static void LD_HL_n(Regs& cpu)
+	{
+		write(cpu, cpu.RHL, fetch(cpu));
+	}
+	static void LDH_a8_A(Regs& cpu)
+	{
+		write(cpu, 0xFF00 | fetch(cpu), cpu.RA);
+	}
+	static void LDH_A_a8(Regs& cpu)
+	{
+		cpu.RA = read(cpu, 0xFF00 | fetch(cpu));
+	}
+	static void LD_C_address_A(Regs& cpu)
+	{
+		write(cpu, 0xFF00 | cpu.RC, cpu.RA);
+	}
+	static void LD_A_C_address(Regs& cpu)
+	{
+		cpu.RA = read(cpu, 0xFF00 | cpu.RC);
+	}
+	static void LD_a16_A(Regs& cpu)
+	{
+		write(cpu, fetch_word(cpu), cpu.RA);
+	}
+	static void LD_A_a16(Regs& cpu)
+	{
+		cpu.RA = read(cpu, fetch_word(cpu));
+	}
+
+
+	// 16-bit loads
+
+	template <R16 RR>
+	static void LD_rr_nn(Regs& cpu)
+	{
+		cpu.*RR = fetch_word(cpu);
+	}
+	static void LD_a16_SP(Regs& cpu)
+	{
+		uint16_t addr = fetch_word(cpu);
+		write(cpu, addr, lsb(cpu.RSP));
+		write(cpu, addr + 1, msb(cpu.RSP));
+	}
+	static void LD_SP_HL(Regs& cpu)
+	{
+		cpu.RSP = cpu.RHL;
+	}
+	static void LD_HL_SP_n(Regs& cpu)
+	{
+		cpu.RHL = cpu.alu_add_sp(fetch(cpu));
+	}
+	template <R16 RR>
+	static void POP_rr(Regs& cpu)
+	{
+		cpu.*RR = pop(cpu);
+		if constexpr (RR == &Regs::RAF)
+			cpu.set_flags(cpu.RF); // the low nibble of F is always 0
+	}
+	template <R16 RR>
+	static void PUSH_rr(Regs& cpu)
+	{
+		if constexpr (RR == &Regs::RAF)
+			cpu.RF = cpu.flags();
+		push(cpu, cpu.*RR);
+	}
+
+
+	// 8-bit alu
+
+	template <AluOp Op, R8 R>
+	static void ALU_r(Regs& cpu)
+	{
+		Op(cpu, cpu.*R);
+	}
+	template <AluOp Op>
+	static void ALU_HL(Regs& cpu)
+	{
+		Op(cpu, read(cpu, cpu.RHL));
+	}
+	template <AluOp Op>
+	static void ALU_n(Regs& cpu)
+	{
+		Op(cpu, fetch(cpu));
+	}
+	template <ModifyOp Op, R8 R>
+	static void MODIFY_r(Regs& cpu)
+	{
+		cpu.*R = Op(cpu, cpu.*R);
+	}
+	template <ModifyOp Op>
+	static void MODIFY_HL(Regs& cpu)
+	{
+		write(cpu, cpu.RHL, Op(cpu, read(cpu, cpu.RHL)));
+	}
+	// RLCA, RRCA, RLA and RRA always clear Z
+	template <ModifyOp Op>
+	static void ROTATE_A(Regs& cpu)
+	{
+		cpu.RA = Op(cpu, cpu.RA);
+		cpu.set_flags(false, false, false, cpu.flag_c());
+	}
+	static void DAA(Regs& cpu)
+	{
+		cpu.alu_daa();
+	}
+	static void CPL(Regs& cpu)
+	{
+		cpu.RA = ~cpu.RA;
+		cpu.set_flags(cpu.flag_z(), true, true, cpu.flag_c());
+	}
+	static void SCF(Regs& cpu)
+	{
+		cpu.set_flags(cpu.flag_z(), false, false, true);
+	}
+	static void CCF(Regs& cpu)
+	{
+		cpu.set_flags(cpu.flag_z(), false, false, !cpu.flag_c());
+	}
+	template <uint8_t B, R8 R>
+	static void BIT_r(Regs& cpu)
+	{
+		cpu.alu_bit(B, cpu.*R);
+	}
+	template <uint8_t B>
+	static void BIT_HL(Regs& cpu)
+	{
+		cpu.alu_bit(B, read(cpu, cpu.RHL));
+	}
+
+
+	// 16-bit alu
+
+	template <R16 RR>
+	static void INC_rr(Regs& cpu)
+	{
+		++(cpu.*RR);
+	}
+	template <R16 RR>
+	static void DEC_rr(Regs& cpu)
+	{
+		--(cpu.*RR);
+	}
+	template <R16 RR>
+	static void ADD_HL_rr(Regs& cpu)
+	{
+		cpu.alu_add_hl(cpu.*RR);
+	}
+	static void ADD_SP_n(Regs& cpu)
+	{
+		cpu.RSP = cpu.alu_add_sp(fetch(cpu));
+	}
+
+
+	// jumps and calls, the conditional ones return whether they were taken
+
+	template <Cond CC>
+	static bool JR_cc_n(Regs& cpu)
+	{
+		int8_t offset = static_cast<int8_t>(fetch(cpu));
+		if (!Base::template cond<CC>(cpu))
+			return false;
+
+		cpu.RPC += offset;
+		return true;
+	}
+	template <Cond CC>
+	static bool JP_cc_nn(Regs& cpu)
+	{
+		uint16_t addr = fetch_word(cpu);
+		if (!Base::template cond<CC>(cpu))
+			return false;
+
+		cpu.RPC = addr;
+		return true;
+	}
+	static void JP_HL(Regs& cpu)
+	{
+		cpu.RPC = cpu.RHL;
+	}
+	template <Cond CC>
+	static bool CALL_cc_nn(Regs& cpu)
+	{
+		uint16_t addr = fetch_word(cpu);
+		if (!Base::template cond<CC>(cpu))
+			return false;
+
+		push(cpu, cpu.RPC);
+		cpu.RPC = addr;
+		return true;
+	}
+	template <uint8_t N>
+	static void RST(Regs& cpu)
+	{
+		push(cpu, cpu.RPC);
+		cpu.RPC = N;
+	}
+	template <Cond CC>
+	static bool RET_cc(Regs& cpu)
+	{
+		if (!Base::template cond<CC>(cpu))
+			return false;
+
+		cpu.RPC = pop(cpu);
+		return true;
+	}
+	static void RET(Regs& cpu)
+	{
+		cpu.RPC = pop(cpu);
+	}
+	static void RETI(Regs& cpu)
+	{
+		cpu.RPC = pop(cpu);
+		cpu.return_from_interrupt();
+	}
+
+
+	// misc/control
+
+	static void STOP(Regs& cpu)
+	{
+		(void)fetch(cpu);
+		cpu.stop();
+	}
+	static void HALT(Regs& cpu)
+	{
+		cpu.halt();
+	}
+	static void DI(Regs& cpu)
+	{
+		cpu.disable_interrupts();
+	}
+	static void EI(Regs& cpu)
+	{
+		cpu.enable_interrupts();
+	}
+	static void UNDEFINED(Regs& cpu)
+	{
+		cpu.undefined_opcode();
+	}
+	static uint8_t PREFIX_CB(Regs& cpu)
+	{
+		cpu.m_instruction_byte1 = fetch(cpu);
+		return s_step[0x100 | cpu.m_instruction_byte1](cpu);
+	}
+
+
+	// table
+
+	// The handler of an opcode, specialized on the operands of its s_opcodes entry. Returns
+	// the M-cycles from the entry.
+	template <uint16_t Op>
+	static uint8_t execute(Regs& cpu)
+	{
+		constexpr Opcode o = s_opcodes[Op];
+		constexpr R8 dst = r8(o.dst);
+		constexpr R8 src = r8(o.src);
+		constexpr R16 rr = r16(o.rr);
+
+		if constexpr (o.kind == Kind::JR)
+			return JR_cc_n<o.cc>(cpu) ? o.taken : o.cycles;
+		else if constexpr (o.kind == Kind::JP)
+			return JP_cc_nn<o.cc>(cpu) ? o.taken : o.cycles;
+		else if constexpr (o.kind == Kind::CALL)
+			return CALL_cc_nn<o.cc>(cpu) ? o.taken : o.cycles;
+		else if constexpr (o.kind == Kind::RET_cc)
+			return RET_cc<o.cc>(cpu) ? o.taken : o.cycles;
+		else if constexpr (o.kind == Kind::PREFIX_CB)
+			return PREFIX_CB(cpu);
+		else
+		{
+			if constexpr (o.kind == Kind::NOP) {}
+			else if constexpr (o.kind == Kind::DI) DI(cpu);
+			else if constexpr (o.kind == Kind::EI) EI(cpu);
+			else if constexpr (o.kind == Kind::STOP) STOP(cpu);
+			else if constexpr (o.kind == Kind::HALT) HALT(cpu);
+			else if constexpr (o.kind == Kind::UNDEFINED) UNDEFINED(cpu);
+			else if constexpr (o.kind == Kind::LD && dst == nullptr) LD_rr_address_r<&Regs::RHL, src>(cpu);
+			else if constexpr (o.kind == Kind::LD && src == nullptr) LD_r_rr_address<dst, &Regs::RHL>(cpu);
+			else if constexpr (o.kind == Kind::LD) LD_r_r<dst, src>(cpu);
+			else if constexpr (o.kind == Kind::LD_n && dst == nullptr) LD_HL_n(cpu);
+			else if constexpr (o.kind == Kind::LD_n) LD_r_n<dst>(cpu);
+			else if constexpr (o.kind == Kind::LD_rr_A) LD_rr_address_r<rr, &Regs::RA>(cpu);
+			else if constexpr (o.kind == Kind::LD_A_rr) LD_r_rr_address<&Regs::RA, rr>(cpu);
+			else if constexpr (o.kind == Kind::LD_HLi_A) LD_HLi_A<o.delta>(cpu);
+			else if constexpr (o.kind == Kind::LD_A_HLi) LD_A_HLi<o.delta>(cpu);
+			else if constexpr (o.kind == Kind::LDH_a8_A) LDH_a8_A(cpu);
+			else if constexpr (o.kind == Kind::LDH_A_a8) LDH_A_a8(cpu);
+			else if constexpr (o.kind == Kind::LD_C_A) LD_C_address_A(cpu);
+			else if constexpr (o.kind == Kind::LD_A_C) LD_A_C_address(cpu);
+			else if constexpr (o.kind == Kind::LD_a16_A) LD_a16_A(cpu);
+			else if constexpr (o.kind == Kind::LD_A_a16) LD_A_a16(cpu);
+			else if constexpr (o.kind == Kind::LD_rr_nn) LD_rr_nn<rr>(cpu);
+			else if constexpr (o.kind == Kind::LD_a16_SP) LD_a16_SP(cpu);
+			else if constexpr (o.kind == Kind::LD_SP_HL) LD_SP_HL(cpu);
+			else if constexpr (o.kind == Kind::LD_HL_SP_n) LD_HL_SP_n(cpu);
+			else if constexpr (o.kind == Kind::POP) POP_rr<rr>(cpu);
+			else if constexpr (o.kind == Kind::PUSH) PUSH_rr<rr>(cpu);
+			else if constexpr (o.kind == Kind::ALU && src == nullptr) ALU_HL<alu(o.alu)>(cpu);
+			else if constexpr (o.kind == Kind::ALU) ALU_r<alu(o.alu), src>(cpu);
+			else if constexpr (o.kind == Kind::ALU_n) ALU_n<alu(o.alu)>(cpu);
+			else if constexpr (o.kind == Kind::ROTATE_A) ROTATE_A<Base::template modify<Op>()>(cpu);
+			else if constexpr (o.kind == Kind::DAA) DAA(cpu);
+			else if constexpr (o.kind == Kind::CPL) CPL(cpu);
+			else if constexpr (o.kind == Kind::SCF) SCF(cpu);
+			else if constexpr (o.kind == Kind::CCF) CCF(cpu);
+			else if constexpr (o.kind == Kind::INC_rr) INC_rr<rr>(cpu);
+			else if constexpr (o.kind == Kind::DEC_rr) DEC_rr<rr>(cpu);
+			else if constexpr (o.kind == Kind::ADD_HL_rr) ADD_HL_rr<rr>(cpu);
+			else if constexpr (o.kind == Kind::ADD_SP_n) ADD_SP_n(cpu);
+			else if constexpr (o.kind == Kind::JP_HL) JP_HL(cpu);
+			else if constexpr (o.kind == Kind::RST) RST<o.n>(cpu);
+			else if constexpr (o.kind == Kind::RET) RET(cpu);
+			else if constexpr (o.kind == Kind::RETI) RETI(cpu);
+			else if constexpr (o.kind == Kind::BIT && dst == nullptr) BIT_HL<o.n>(cpu);
+			else if constexpr (o.kind == Kind::BIT) BIT_r<o.n, dst>(cpu);
+			// INC, DEC, SHIFT, RES and SET
+			else if constexpr (dst == nullptr) MODIFY_HL<Base::template modify<Op>()>(cpu);
+			else MODIFY_r<Base::template modify<Op>(), dst>(cpu);
+
+			return o.cycles;
+		}
+	}
+
+	template <size_t... Op>
+	static constexpr std::array<Step, 0x200> make_step_table(std::index_sequence<Op...>)
+	{
+		return { execute<Op>... };
+	}
+};
@@ -0,0 +1,85 @@
+#include "cpu.h"
+#include "cpu_step.h"
+
+// Threaded interpreter, GCC and Clang only.
+// Runs the handlers of cpu_step.h like step() does, but each of them is inlined at a label of
+// its own that ends by fetching the next opcode and jumping straight to its label through a
+// computed goto. Every opcode has its own indirect jump for the branch predictor to learn,
+// instead of all of them sharing the one call through s_step or the jump of the opcode switch.
+// CB prefixed opcodes get their own labels as well.
+// Only part of the build with GB_THREADED defined, see the linux-threaded and bench-threaded targets.
+
+// M-cycles run_threaded() runs at most before returning to Dmg
+static constexpr uint64_t s_threaded_slice = 1024;
+
+#define GB_THREADED_ROW(X, hi) \
+	X(hi, 0) X(hi, 1) X(hi, 2) X(hi, 3) X(hi, 4) X(hi, 5) X(hi, 6) X(hi, 7) \
+	X(hi, 8) X(hi, 9) X(hi, A) X(hi, B) X(hi, C) X(hi, D) X(hi, E) X(hi, F)
+#define GB_THREADED_ALL(X) \
+	GB_THREADED_ROW(X, 0) GB_THREADED_ROW(X, 1) GB_THREADED_ROW(X, 2) GB_THREADED_ROW(X, 3) \
+	GB_THREADED_ROW(X, 4) GB_THREADED_ROW(X, 5) GB_THREADED_ROW(X, 6) GB_THREADED_ROW(X, 7) \
+	GB_THREADED_ROW(X, 8) GB_THREADED_ROW(X, 9) GB_THREADED_ROW(X, A) GB_THREADED_ROW(X, B) \
+	GB_THREADED_ROW(X, C) GB_THREADED_ROW(X, D) GB_THREADED_ROW(X, E) GB_THREADED_ROW(X, F)
+
+#define GB_THREADED_LABEL(hi, lo) &&op_##hi##lo,
+#define GB_THREADED_PREFIXED_LABEL(hi, lo) &&cb_##hi##lo,
+
+// leaves between instructions like run_block() does, else dispatches the next opcode
+#define GB_THREADED_NEXT \
+	if (m_mem.cycles() >= m_mem.deadline() || m_mem.cycles() >= end) [[unlikely]] \
+		goto done; \
+	m_instruction_byte0 = m_mem.read(RPC++); \
+	goto *s_labels[m_instruction_byte0];
+
+#define GB_THREADED_OP(hi, lo) \
+	op_##hi##lo: \
+	if constexpr (0x##hi##lo == 0xCB) \
+	{ \
+		m_instruction_byte1 = m_mem.read(RPC++); \
+		goto *s_prefixed_labels[m_instruction_byte1]; \
+	} \
+	else \
+		m_mem.add_cycles(StepOps::execute<0x##hi##lo>(*this)); \
+	GB_THREADED_NEXT
+
+#define GB_THREADED_PREFIXED_OP(hi, lo) \
+	cb_##hi##lo: \
+	m_mem.add_cycles(StepOps::execute<0x100 | 0x##hi##lo>(*this)); \
+	GB_THREADED_NEXT
+
+uint32_t Cpu::run_threaded()
+{
+	if (m_stop)
+		return 0;
+
+	// clock() refetches from RPC when the M-cycle core takes over again
+	m_instruction_remaining_cycles = -1;
+
+	// interrupts, HALT and written code are handled between instructions
+	if (m_mem.cycles() >= m_mem.deadline())
+		return step();
+
+	static void* const s_labels[0x100] = { GB_THREADED_ALL(GB_THREADED_LABEL) };
+	static void* const s_prefixed_labels[0x100] = { GB_THREADED_ALL(GB_THREADED_PREFIXED_LABEL) };
+
+	uint64_t const start = m_mem.cycles();
+	uint64_t const end = start + s_threaded_slice;
+
+	m_instruction_byte0 = m_mem.read(RPC++);
+	goto *s_labels[m_instruction_byte0];
+
+	GB_THREADED_ALL(GB_THREADED_OP)
+	GB_THREADED_ALL(GB_THREADED_PREFIXED_OP)
+
+done:
+	// written code is dropped by the next step() through update()
+	return static_cast<uint32_t>(m_mem.cycles() - start);
+}
+
+#undef GB_THREADED_PREFIXED_OP
+#undef GB_THREADED_OP
+#undef GB_THREADED_NEXT
+#undef GB_THREADED_PREFIXED_LABEL
+#undef GB_THREADED_LABEL
+#undef GB_THREADED_ALL
+#undef GB_THREADED_ROW
@@ -1,55 +1,88 @@
 #include "dmg.h"
 
+#include <algorithm>
 #include <thread>
-// #include <fstream>
 #include <cstdio>
 
 Dmg::Dmg()
-	: m_bus()
+	: m_cartridge()
+	, m_bus()
 	, m_mem(m_bus)
 	, m_cpu(m_bus, m_mem)
 	, m_is_powered_on(false)
+	, m_execution(Execution::MCycle)
+	, m_fast_forward(true)
+	, m_idle_stats()
+	, m_skip_end(Mem::s_never)
+	, m_idle_loop()
 {
 	
 }
 
-void Dmg::insert_cartridge(std::string const& path)
+bool Dmg::insert_cartridge(std::string const& path, bool save)
 {
-	// std::ifstream cart(path, std::ios::binary);
-	FILE* cart = fopen(path.c_str(), "rb");
-	if (!cart)
-	{
-		printf("Could not open file '%s' for reading.\n", path.c_str());
-		return;
-	}
+	m_mem.map_cartridge(nullptr);
+	bool mapped = m_cartridge.map(path, save);
+	if (mapped)
+		m_mem.map_cartridge(&m_cartridge);
+
+	m_cpu.invalidate_blocks();
+	return mapped;
+}
+
+bool Dmg::insert_cartridge(uint8_t const* rom, size_t size)
+{
+	m_mem.map_cartridge(nullptr);
+	bool mapped = m_cartridge.map(rom, size);
+	if (mapped)
+		m_mem.map_cartridge(&m_cartridge);
+
+	m_cpu.invalidate_blocks();
+	return mapped;
+}
+
+void Dmg::save_state(State& state) const
+{
+	m_cpu.save_state(state.cpu);
+	state.bus = m_bus;
+	m_mem.save_state(state.mem);
+	state.idle_stats = m_idle_stats;
+}
 
-	int c;
-	uint16_t i = 0xffff;
+bool Dmg::load_state(State const& state)
+{
+	if (!m_mem.load_state(state.mem))
+		return false;
+	m_cpu.load_state(state.cpu);
+	m_bus = state.bus;
+	m_idle_stats = state.idle_stats;
+
+	// a loop seen before the load proves nothing about the one after
+	m_idle_loop = {};
+	return true;
+}
 
-	while ((c = fgetc(cart)) != EOF && ++i != 0xffff)
+void Dmg::fork(Dmg& child)
+{
+	// the rom stays mapped in the child across forks, blocks decoded from it stay valid
+	if (m_cartridge.mapped() && child.m_cartridge.rom() != m_cartridge.rom())
+		child.insert_cartridge(m_cartridge.rom(), m_cartridge.size());
+	else if (!m_cartridge.mapped() && child.m_cartridge.mapped())
 	{
-	 	// printf("$%04x: %02X\n", i, static_cast<uint8_t>(c));
-		m_mem.direct_ram()[i] = static_cast<uint8_t>(c);
+		child.m_mem.map_cartridge(nullptr);
+		child.m_cartridge.unmap();
+		child.m_cpu.invalidate_blocks();
 	}
-	
-	// int c;
-	// uint16_t i = 0xffff;
-	// uint8_t old_c = 0;
-
-	// while ((c = fgetc(cart)) != EOF && ++i != 0xffff)
-	// {
-	// 	if (i % 2 == 0)
-	// 		old_c = static_cast<uint8_t>(c);
-	// 	else
-	// 	{
-	// 		m_mem.direct_ram()[i - 1] = static_cast<uint8_t>(c);
-	// 		m_mem.direct_ram()[i] = old_c;
-	// 		printf("$%04x: %02X\n", i - 1, static_cast<uint8_t>(c));
-	// 		printf("$%04x: %02X\n", i, old_c);
-	// 	}
-	// }
-
-	fclose(cart);
+
+	m_mem.fork(child.m_mem);
+	Cpu::State cpu;
+	m_cpu.save_state(cpu);
+	child.m_cpu.load_state(cpu);
+	child.m_bus = m_bus;
+	child.m_execution = m_execution;
+	child.m_fast_forward = m_fast_forward;
+	child.m_idle_stats = m_idle_stats;
+	child.m_idle_loop = {};
 }
 
 void Dmg::power_on()
@@ -58,15 +91,190 @@ void Dmg::power_on()
 
 	while (m_is_powered_on)
 	{
-		m_cpu.clock();
-		m_mem.clock();
+		step();
+		// Mem::update() does too, but sees no events with the LCD and timer off
+		m_cartridge.sync_save();
+
+		if (m_cpu.stopped())
+		{
+			printf("CPU STOP!\n");
+			power_off();
+		}
 
 		// using namespace std::chrono_literals;
 		// std::this_thread::sleep_for(100ms);
 	}
+
+	// power_off() can come from a signal handler, the save is written back here instead
+	m_cartridge.flush_save();
 }
 
 void Dmg::power_off()
 {
 	m_is_powered_on = false;
-}
\ No newline at end of file
+}
+
+void Dmg::reset()
+{
+	m_mem.reset();
+	m_cpu.reset();
+	m_bus = Bus();
+	m_idle_stats = {};
+	m_idle_loop = {};
+}
+
+void Dmg::clock()
+{
+	m_cpu.clock();
+	m_mem.clock();
+}
+
+uint32_t Dmg::step()
+{
+	if (!m_fast_forward)
+		return run();
+
+	if (m_cpu.halted())
+		return skip_halt() + run();
+
+	uint16_t step_pc = m_cpu.pc();
+	uint32_t cycles = run();
+	return cycles + skip_idle_loop(step_pc);
+}
+
+uint32_t Dmg::step_until(uint64_t end)
+{
+	m_skip_end = end;
+	uint32_t cycles = step();
+	m_skip_end = Mem::s_never;
+	return cycles;
+}
+
+uint64_t Dmg::run_until(uint64_t end)
+{
+	uint64_t start = m_mem.cycles();
+	m_skip_end = end;
+	while (m_mem.cycles() < end && !m_cpu.stopped())
+		step();
+	m_skip_end = Mem::s_never;
+	m_cartridge.sync_save();
+	return m_mem.cycles() - start;
+}
+
+uint64_t Dmg::run_frame()
+{
+	return run_until((m_mem.cycles() / s_frame_cycles + 1) * s_frame_cycles);
+}
+
+uint32_t Dmg::run()
+{
+	if (m_execution == Execution::Instruction)
+		return m_cpu.step();
+	if (m_execution == Execution::Block)
+		return m_cpu.run_block();
+#ifdef GB_JIT
+	if (m_execution == Execution::Jit)
+		return m_cpu.run_jit();
+#endif
+#ifdef GB_THREADED
+	if (m_execution == Execution::Threaded)
+		return m_cpu.run_threaded();
+#endif
+
+	uint32_t cycles = 0;
+
+	// finish the startup fetch or whatever instruction is still in flight
+	while (!m_cpu.instruction_boundary() && !m_cpu.stopped())
+	{
+		clock();
+		++cycles;
+	}
+
+	do
+	{
+		clock();
+		++cycles;
+	} while (!m_cpu.instruction_boundary() && !m_cpu.stopped());
+
+	return cycles;
+}
+
+uint32_t Dmg::skip_halt()
+{
+	// the next run() wakes the cpu, or stops it when nothing ever will
+	uint8_t const* io = m_mem.io();
+	if (io[0xFF] & io[0x0F] & 0x1F)
+		return 0;
+	uint64_t wake = m_mem.next_interrupt();
+	if (wake == Mem::s_never || wake <= m_mem.cycles())
+		return 0;
+	// still halted at the end of the run, the next step idles on
+	wake = std::min(wake, std::max(m_skip_end, m_mem.cycles()));
+	if (wake == m_mem.cycles())
+		return 0;
+
+	uint32_t cycles = static_cast<uint32_t>(wake - m_mem.cycles());
+	m_mem.add_cycles(cycles);
+	m_idle_stats.halted += cycles;
+	return cycles;
+}
+
+uint32_t Dmg::skip_idle_loop(uint16_t step_pc)
+{
+	// Loops span a few bytes and are entered through a backward jump, or are a whole block
+	// jumping to itself. Nothing but an event can change what an iteration does when it ends
+	// with the registers it started with, wrote nothing, saw no update and read only timed
+	// registers that stayed the same. Then every iteration up to the next event or change of
+	// those registers does the same, and they can be skipped at once.
+	static constexpr uint16_t s_max_loop_bytes = 64;
+	// iterations without a change before the registers are looked at
+	static constexpr uint8_t s_settle = 4;
+	// skipping a loop nothing ever interrupts stops at least this often
+	static constexpr uint64_t s_max_skip = 1 << 20;
+
+	uint16_t pc = m_cpu.pc();
+	if (pc > step_pc || step_pc - pc > s_max_loop_bytes || m_cpu.stopped())
+		return 0;
+
+	IdleLoop& loop = m_idle_loop;
+
+	if (pc != loop.pc || m_mem.changes() != loop.changes)
+	{
+		loop.pc = pc;
+		loop.changes = m_mem.changes();
+		loop.visits = 0;
+		return 0;
+	}
+	if (++loop.visits < s_settle)
+		return 0;
+
+	uint64_t now = m_mem.cycles();
+	Cpu::Registers registers = m_cpu.registers();
+	uint32_t skipped = 0;
+
+	if (loop.visits > s_settle && registers == loop.registers)
+	{
+		uint64_t iteration = now - loop.cycles;
+		uint64_t end = std::min({ m_mem.deadline(), m_mem.next_timed_change(m_mem.timed_reads(), loop.cycles), now + s_max_skip,
+			m_skip_end });
+
+		if (end > now && iteration > 0)
+		{
+			skipped = static_cast<uint32_t>((end - now) / iteration * iteration);
+			if (skipped)
+			{
+				m_mem.add_cycles(skipped);
+				m_idle_stats.idle_loops += skipped;
+				++m_idle_stats.skips;
+			}
+		}
+	}
+
+	// compare the next iteration with this one
+	loop.visits = s_settle;
+	loop.registers = registers;
+	loop.cycles = m_mem.cycles();
+	m_mem.clear_timed_reads();
+
+	return skipped;
+}
@@ -3,26 +3,161 @@
 #include <string>
 
 #include "bus.h"
+#include "cartridge.h"
 #include "mem.h"
 #include "cpu.h"
 
 class Dmg
 {
 public:
+	enum class Execution
+	{
+		MCycle,      // cpu and memory interleaved every M-cycle through the bus
+		Instruction, // whole instructions with direct memory access
+		Block,       // predecoded basic blocks with direct memory access
+#ifdef GB_JIT
+		Jit,         // basic blocks translated to x86-64
+#endif
+#ifdef GB_THREADED
+		Threaded,    // whole instructions dispatched through computed gotos
+#endif
+	};
+
+	// time skipped instead of emulated, see skip_halt() and skip_idle_loop()
+	struct IdleStats
+	{
+		uint64_t halted;     // M-cycles skipped in HALT
+		uint64_t idle_loops; // M-cycles skipped in loops waiting for an event
+		uint64_t skips;      // times an idle loop was skipped
+	};
+
+	// Snapshot of the whole machine in one flat, fixed size block. Saving and loading copy
+	// memory and never allocate, so a state allocated once can be saved to and loaded from any
+	// number of times. Only good within the process that saved it and for the cartridge it
+	// was saved with.
+	struct State
+	{
+		Cpu::State cpu;
+		Bus bus;
+		Mem::State mem;
+		IdleStats idle_stats;
+	};
+
+	// joypad, bits of set_buttons()
+	enum Button : uint8_t
+	{
+		s_right = 0x01,
+		s_left = 0x02,
+		s_up = 0x04,
+		s_down = 0x08,
+		s_a = 0x10,
+		s_b = 0x20,
+		s_select = 0x40,
+		s_start = 0x80,
+	};
+
+	// M-cycles per frame of the LCD, 154 lines of 114
+	static constexpr uint32_t s_frame_cycles = Ppu::s_frame_cycles;
 
 	Dmg();
 	~Dmg() = default;
 
-	void insert_cartridge(std::string const& path);
+	// Maps the rom at path and its external ram in, returns false when it isn't a valid rom.
+	// Without save, battery backed ram starts blank and is gone with the cartridge.
+	bool insert_cartridge(std::string const& path, bool save = true);
+	// same with a rom image in memory, which has to outlive the Dmg
+	bool insert_cartridge(uint8_t const* rom, size_t size);
+	Cartridge const& cartridge() const { return m_cartridge; }
 
 	void power_on();
 	void power_off();
+	// back to the state after construction, keeping the cartridge, execution and settings
+	void reset();
+
+	// buttons held from now on, any number of Button bits
+	void set_buttons(uint8_t buttons) { m_mem.set_buttons(buttons); }
+	uint8_t buttons() const { return m_mem.buttons(); }
+
+	void save_state(State& state) const;
+	// returns false, changing nothing, when the state is of another cartridge
+	bool load_state(State const& state);
+
+	// Makes child a copy of this Dmg that runs on from the same state with the same cartridge,
+	// execution, PPU engine and frames drawn, for exploring many inputs from one state. Memory
+	// is shared copy-on-write: a page is copied when either Dmg first writes it, only external
+	// ram is copied whole. The child maps the rom image of this Dmg, whose cartridge has to stay
+	// inserted while the child runs. Forking more children from the same state copies next to
+	// nothing, and a child can be forked into again.
+	void fork(Dmg& child);
+
+	void set_execution(Execution execution) { m_execution = execution; }
+	Execution execution() const { return m_execution; }
+
+	// The engine drawing the LCD, Ppu::Engine::Scanline by default. May be switched between any
+	// two steps; save states load into either engine.
+	void set_ppu_engine(Ppu::Engine engine) { m_mem.set_ppu_engine(engine); }
+	Ppu::Engine ppu_engine() const { return m_mem.ppu().engine(); }
+	// Draws every frame for 1, the default, every Nth for N or none for 0, with the same timing
+	// either way. Saves the pixels for runs that look at few frames or none.
+	void set_render_every(uint32_t frames) { m_mem.set_render_every(frames); }
+	uint32_t render_every() const { return m_mem.ppu().render_every(); }
+
+	// advance the system by one M-cycle
+	void clock();
+	// advance the system by one instruction, one basic block in Execution::Block and Jit or one
+	// slice in Execution::Threaded, returns the M-cycles it took including any skipped
+	uint32_t step();
+	// step() with its skips stopping at the M-cycle end, see run_until()
+	uint32_t step_until(uint64_t end);
+	// Steps up to the M-cycle end or until the cpu stops, returns the M-cycles it took. Skips
+	// stop at end, where the caller may change what the guest sees.
+	uint64_t run_until(uint64_t end);
+	// run_until() the end of the current frame
+	uint64_t run_frame();
+
+	// Skipping HALT and idle loops up to the next event, on by default. Off, the cpu idles
+	// through HALT one M-cycle per step and runs every instruction of a loop.
+	void set_fast_forward(bool fast_forward) { m_fast_forward = fast_forward; }
+	IdleStats idle_stats() const { return m_idle_stats; }
+
+	// Bytes the game sends over the serial port are appended to output instead of printed,
+	// nullptr prints them again.
+	void set_serial_output(std::string* output) { m_mem.set_serial_output(output); }
+
+	Cpu& cpu() { return m_cpu; }
+	Mem& mem() { return m_mem; }
+	// the LCD, with the last frame drawn
+	Ppu const& ppu() const { return m_mem.ppu(); }
 
 private:
+	Cartridge m_cartridge;
 	Bus m_bus;
 	Mem m_mem;
 	Cpu m_cpu;
 
 	bool m_is_powered_on;
+	Execution m_execution;
+
+	bool m_fast_forward;
+	IdleStats m_idle_stats;
+	// M-cycle skips stop at, see run_until()
+	uint64_t m_skip_end;
+
+	// A loop waiting for an event, candidate for skip_idle_loop(). Counts the times a step
+	// ended at pc without a change in between, then compares the state of two of them.
+	struct IdleLoop
+	{
+		uint16_t pc;
+		uint64_t changes;
+		uint8_t visits;
+		Cpu::Registers registers;
+		uint64_t cycles;
+	};
+	IdleLoop m_idle_loop;
+
+	// steps of the selected execution, without skipping
+	uint32_t run();
+	uint32_t skip_halt();
+	uint32_t skip_idle_loop(uint16_t step_pc);
 
 };
\ No newline at end of file
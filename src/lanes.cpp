@@ -0,0 +1,521 @@
+#include "lanes.h"
+
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <utility>
+
+#include "cpu_alu.h"
+#include "cpu_opcodes.h"
+#include "cpu_step.h"
+
+// Lockstep core of many Dmgs.
+// Every round services the lanes whose Mem needs a look, then runs the group of lanes with the
+// lowest pc. A group is decoded once from its first lane, whose instruction bytes every other
+// member has to match, and runs the s_step handler of the opcode instantiated on the registers
+// of a lane, see Lane. Handlers without memory access run one loop over all lanes,
+// loading each lane's registers out of the arrays, running the instruction and storing them
+// back masked to the group. The loops have no branches left once inlined and the compiler
+// turns them into vector code, the 8-bit registers of 16 lanes fill one SSE register. Handlers
+// with memory access loop over the members only, each through its own Mem.
+// A group keeps running while its members stay at the same pc with budget left and no other
+// lane falls behind it. Code the members read from the same memory, the shared rom image, is
+// fetched from the page without looking at the others again; code in memory of their own is
+// compared byte by byte and ends the group after one instruction.
+
+struct Lanes::Group
+{
+	alignas(16) uint8_t mask[s_max_lanes]; // 0xFF for the members
+	uint8_t members[s_max_lanes];
+	uint32_t count;
+	uint16_t pc;
+	uint8_t bytes[3];
+	// the page every member reads the code at pc from, nullptr when they run code of their own
+	uint8_t const* code;
+	// lowest pc of the ready lanes outside the group, 0x10000 for none
+	uint32_t waiting;
+};
+
+// The registers of one lane under the names Cpu gives them, so the handlers of cpu_step.h and the
+// alu of cpu_alu.h run on it. M is the lane's Mem, or NoMem for the instructions without memory
+// access.
+template <typename M>
+struct Lanes::Lane : Alu<Lane<M>>
+{
+	union {
+		uint16_t RAF;
+		struct {
+			uint8_t RF;
+			uint8_t RA;
+		};
+	};
+	union {
+		uint16_t RBC;
+		struct {
+			uint8_t RC;
+			uint8_t RB;
+		};
+	};
+	union {
+		uint16_t RDE;
+		struct {
+			uint8_t RE;
+			uint8_t RD;
+		};
+	};
+	union {
+		uint16_t RHL;
+		struct {
+			uint8_t RL;
+			uint8_t RH;
+		};
+	};
+	uint16_t RSP;
+	uint16_t RPC;
+	uint16_t m_flag_result;
+	uint8_t m_flag_a;
+	uint8_t m_flag_b;
+	uint8_t m_flag_n;
+	M& m_mem;
+
+	int32_t budget;
+	// operand bytes of the group's instruction, lowest first
+	uint16_t operands;
+
+	explicit Lane(M& mem) : m_mem(mem) {}
+
+	// the operands come from the group, which has read them already
+	uint8_t fetch()
+	{
+		++RPC;
+		uint8_t n = lsb(operands);
+		operands >>= 8;
+		return n;
+	}
+};
+
+struct Lanes::Ops
+{
+	using Opcode = Cpu::Opcode;
+	using Kind = Opcode::Kind;
+	using Reg8 = Opcode::Reg8;
+
+	// stands in for Mem in the handlers without memory access, which never touch it
+	struct NoMem {};
+
+	// left to each lane's own cpu, these change what the arrays don't hold
+	static constexpr bool stepped(Opcode const& o)
+	{
+		switch (o.kind)
+		{
+			case Kind::STOP: case Kind::HALT: case Kind::DI: case Kind::EI: case Kind::RETI:
+			case Kind::UNDEFINED: case Kind::PREFIX_CB:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	static constexpr bool memory(Opcode const& o)
+	{
+		switch (o.kind)
+		{
+			case Kind::LD: case Kind::ALU:
+				return o.dst == Reg8::HL || o.src == Reg8::HL;
+			case Kind::LD_n: case Kind::INC: case Kind::DEC: case Kind::SHIFT: case Kind::BIT: case Kind::RES: case Kind::SET:
+				return o.dst == Reg8::HL;
+			case Kind::LD_rr_A: case Kind::LD_A_rr: case Kind::LD_HLi_A: case Kind::LD_A_HLi:
+			case Kind::LDH_a8_A: case Kind::LDH_A_a8: case Kind::LD_C_A: case Kind::LD_A_C:
+			case Kind::LD_a16_A: case Kind::LD_A_a16: case Kind::LD_a16_SP: case Kind::POP: case Kind::PUSH:
+			case Kind::CALL: case Kind::RST: case Kind::RET_cc: case Kind::RET:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	// One instruction at the group's pc on one lane, through the s_step handler of the opcode.
+	template <uint16_t Op, typename M>
+	static void apply(Lane<M>& l, uint16_t pc, uint16_t operands)
+	{
+		l.RPC = static_cast<uint16_t>(pc + (Op > 0xFF ? 2 : 1));
+		l.operands = operands;
+		l.budget -= Cpu::BasicStepOps<Lane<M>>::template execute<Op>(l);
+	}
+
+	template <uint16_t Op>
+	static bool execute(Lanes& lanes, Group const& g)
+	{
+		constexpr Opcode o = Cpu::s_opcodes[Op];
+		// copies, the compiler can't tell the group from the arrays the loops store to
+		uint16_t pc = g.pc;
+		uint16_t operands = static_cast<uint16_t>(g.bytes[2] << 8 | g.bytes[1]);
+
+		if constexpr (stepped(o))
+		{
+			lanes.step_members(g);
+			return false;
+		}
+		else if constexpr (memory(o))
+			return lanes.for_members(g, [pc, operands](Lane<Mem>& l) { apply<Op>(l, pc, operands); });
+		else
+			return lanes.for_lanes(g, [pc, operands](Lane<NoMem>& l) { apply<Op>(l, pc, operands); });
+	}
+
+	template <size_t... Op>
+	static constexpr std::array<Handler, 0x200> make_table(std::index_sequence<Op...>)
+	{
+		return { execute<Op>... };
+	}
+};
+
+constinit std::array<Lanes::Handler, 0x200> const Lanes::s_handlers = Lanes::Ops::make_table(std::make_index_sequence<0x200>());
+
+Lanes::Lanes(uint32_t count)
+	: m_count(std::min(count, s_max_lanes))
+	, m_dmgs()
+	, m_stats()
+	, m_end(0)
+	, m_r8()
+	, m_sp()
+	, m_pc()
+	, m_flag_result()
+	, m_flag_a()
+	, m_flag_b()
+	, m_flag_n()
+	, m_budget()
+	, m_limit()
+	, m_active()
+{
+	for (uint32_t lane = 0; lane < m_count; lane++)
+	{
+		m_dmgs[lane] = std::make_unique<Dmg>();
+		m_dmgs[lane]->set_execution(Dmg::Execution::Instruction);
+	}
+}
+
+Lanes::~Lanes() = default;
+
+void Lanes::run_until(uint64_t end)
+{
+	m_end = end;
+	for (uint32_t lane = 0; lane < m_count; lane++)
+	{
+		load_registers(lane);
+		arm(lane);
+		Mem const& mem = m_dmgs[lane]->mem();
+		m_active[lane] = mem.cycles() < end && !m_dmgs[lane]->cpu().stopped() ? 0xFF : 0;
+	}
+
+	while (true)
+	{
+		// the lanes whose Mem needs a look
+		uint32_t due = 0;
+		for (uint32_t lane = 0; lane < s_max_lanes; lane++)
+			due |= static_cast<uint32_t>(m_active[lane] && m_budget[lane] <= 0) << lane;
+		for (; due; due &= due - 1)
+			service(static_cast<uint32_t>(std::countr_zero(due)));
+
+		Group group;
+		if (form_group(group))
+			run_group(group);
+		else if (std::none_of(m_active, m_active + s_max_lanes, [](uint8_t active) { return active; }))
+			break;
+	}
+
+	for (uint32_t lane = 0; lane < m_count; lane++)
+	{
+		store_registers(lane);
+		sync_cycles(lane);
+	}
+}
+
+bool Lanes::form_group(Group& group)
+{
+	// the lowest pc among the lanes ready to run
+	alignas(16) uint8_t ready[s_max_lanes];
+	uint32_t lowest = 0x10000;
+	for (uint32_t lane = 0; lane < s_max_lanes; lane++)
+	{
+		ready[lane] = m_active[lane] && m_budget[lane] > 0;
+		lowest = std::min<uint32_t>(lowest, ready[lane] ? m_pc[lane] : 0x10000);
+	}
+	if (lowest == 0x10000)
+		return false;
+
+	uint32_t leader = 0;
+	while (!ready[leader] || m_pc[leader] != lowest)
+		++leader;
+
+	Mem& mem = m_dmgs[leader]->mem();
+	uint16_t pc = static_cast<uint16_t>(lowest);
+	group.pc = pc;
+	group.bytes[0] = mem.read(pc);
+	uint8_t length = Cpu::s_opcodes[group.bytes[0]].length;
+	for (uint8_t i = 1; i < 3; i++)
+		group.bytes[i] = i < length ? mem.read(static_cast<uint16_t>(pc + i)) : 0;
+
+	// Code in memory the members share, a rom bank, is the same for every member up to the
+	// end of the page. Code in memory of their own is compared byte by byte.
+	uint8_t const* code = mem.read_page(pc);
+	if (mem.read_page(static_cast<uint16_t>(pc + length - 1)) != code)
+		code = nullptr;
+
+	group.count = 0;
+	group.waiting = 0x10000;
+	for (uint32_t lane = 0; lane < s_max_lanes; lane++)
+	{
+		bool member = ready[lane] && m_pc[lane] == pc;
+		if (member && lane != leader)
+		{
+			Mem& lane_mem = m_dmgs[lane]->mem();
+			if (!code || lane_mem.read_page(pc) != code)
+			{
+				code = nullptr;
+				for (uint8_t i = 0; i < length && member; i++)
+					member = lane_mem.read(static_cast<uint16_t>(pc + i)) == group.bytes[i];
+			}
+		}
+
+		group.mask[lane] = member ? 0xFF : 0;
+		if (member)
+			group.members[group.count++] = static_cast<uint8_t>(lane);
+		else if (ready[lane])
+			group.waiting = std::min<uint32_t>(group.waiting, m_pc[lane]);
+	}
+	group.code = code;
+	return true;
+}
+
+void Lanes::run_group(Group& group)
+{
+	while (true)
+	{
+		uint16_t op = group.bytes[0] == 0xCB ? 0x100 | group.bytes[1] : group.bytes[0];
+		if (!s_handlers[op](*this, group) || !group.code)
+			return;
+
+		// the lanes behind go first, the group waits for them or takes them in
+		uint16_t pc = m_pc[group.members[0]];
+		if (pc >= group.waiting || (pc ^ group.pc) >> 8)
+			return;
+
+		uint8_t const* code = group.code + (pc & 0xFF);
+		uint8_t length = Cpu::s_opcodes[code[0]].length;
+		if ((pc & 0xFF) + length > 0x100)
+			return;
+		group.pc = pc;
+		group.bytes[0] = code[0];
+		group.bytes[1] = length > 1 ? code[1] : 0;
+		group.bytes[2] = length > 2 ? code[2] : 0;
+	}
+}
+
+void Lanes::load_registers(uint32_t lane)
+{
+	Cpu const& cpu = m_dmgs[lane]->cpu();
+	m_r8[0][lane] = cpu.RB;
+	m_r8[1][lane] = cpu.RC;
+	m_r8[2][lane] = cpu.RD;
+	m_r8[3][lane] = cpu.RE;
+	m_r8[4][lane] = cpu.RH;
+	m_r8[5][lane] = cpu.RL;
+	m_r8[7][lane] = cpu.RA;
+	m_sp[lane] = cpu.RSP;
+	m_pc[lane] = cpu.RPC;
+	m_flag_result[lane] = cpu.m_flag_result;
+	m_flag_a[lane] = cpu.m_flag_a;
+	m_flag_b[lane] = cpu.m_flag_b;
+	m_flag_n[lane] = cpu.m_flag_n;
+}
+
+void Lanes::store_registers(uint32_t lane)
+{
+	Cpu& cpu = m_dmgs[lane]->cpu();
+	cpu.RB = m_r8[0][lane];
+	cpu.RC = m_r8[1][lane];
+	cpu.RD = m_r8[2][lane];
+	cpu.RE = m_r8[3][lane];
+	cpu.RH = m_r8[4][lane];
+	cpu.RL = m_r8[5][lane];
+	cpu.RA = m_r8[7][lane];
+	cpu.RSP = m_sp[lane];
+	cpu.RPC = m_pc[lane];
+	cpu.m_flag_result = m_flag_result[lane];
+	cpu.m_flag_a = m_flag_a[lane];
+	cpu.m_flag_b = m_flag_b[lane];
+	cpu.m_flag_n = m_flag_n[lane];
+	// clock() refetches from RPC when the M-cycle core takes over
+	cpu.m_instruction_remaining_cycles = -1;
+}
+
+void Lanes::sync_cycles(uint32_t lane)
+{
+	*m_dmgs[lane]->mem().cycles_counter() = m_limit[lane] - static_cast<int64_t>(m_budget[lane]);
+}
+
+void Lanes::arm(uint32_t lane)
+{
+	Mem const& mem = m_dmgs[lane]->mem();
+	uint64_t cycles = mem.cycles();
+	uint64_t limit = std::min({ mem.deadline(), m_end, cycles + INT32_MAX });
+	// due already, an empty budget until service() has seen to it
+	limit = std::max(limit, cycles);
+	m_limit[lane] = limit;
+	m_budget[lane] = static_cast<int32_t>(limit - cycles);
+}
+
+void Lanes::service(uint32_t lane)
+{
+	sync_cycles(lane);
+	Dmg& dmg = *m_dmgs[lane];
+	Mem const& mem = dmg.mem();
+	if (mem.cycles() >= m_end || dmg.cpu().stopped())
+	{
+		m_active[lane] = 0;
+		return;
+	}
+
+	// or just the budget ran out before the deadline
+	if (mem.cycles() >= mem.deadline())
+		step_lane(lane);
+	arm(lane);
+}
+
+void Lanes::step_lane(uint32_t lane)
+{
+	Dmg& dmg = *m_dmgs[lane];
+	store_registers(lane);
+	if (dmg.cpu().halted())
+		dmg.step_until(m_end);
+	else
+		dmg.cpu().step();
+	load_registers(lane);
+	++m_stats.stepped;
+}
+
+bool Lanes::together(Group const& group) const
+{
+	uint16_t pc = m_pc[group.members[0]];
+	uint8_t apart = 0;
+	for (uint32_t i = 0; i < s_max_lanes; i++)
+		apart |= group.mask[i] & ((m_pc[i] != pc) | (m_budget[i] <= 0));
+	return !apart;
+}
+
+template <typename F>
+bool Lanes::for_lanes(Group const& group, F f)
+{
+	// every lane, masked to the group's when storing
+	alignas(16) uint8_t masks[s_max_lanes];
+	std::copy(group.mask, group.mask + s_max_lanes, masks);
+	Ops::NoMem none;
+	for (uint32_t i = 0; i < s_max_lanes; i++)
+	{
+		Lane<Ops::NoMem> lane(none);
+		lane.RB = m_r8[0][i];
+		lane.RC = m_r8[1][i];
+		lane.RD = m_r8[2][i];
+		lane.RE = m_r8[3][i];
+		lane.RH = m_r8[4][i];
+		lane.RL = m_r8[5][i];
+		lane.RA = m_r8[7][i];
+		lane.RSP = m_sp[i];
+		lane.RPC = m_pc[i];
+		lane.m_flag_result = m_flag_result[i];
+		lane.m_flag_a = m_flag_a[i];
+		lane.m_flag_b = m_flag_b[i];
+		lane.m_flag_n = m_flag_n[i];
+		lane.budget = m_budget[i];
+
+		f(lane);
+
+		uint8_t mask = masks[i];
+		uint16_t mask16 = static_cast<uint16_t>(static_cast<int8_t>(mask));
+		int32_t mask32 = static_cast<int8_t>(mask);
+		m_r8[0][i] = static_cast<uint8_t>((lane.RB & mask) | (m_r8[0][i] & ~mask));
+		m_r8[1][i] = static_cast<uint8_t>((lane.RC & mask) | (m_r8[1][i] & ~mask));
+		m_r8[2][i] = static_cast<uint8_t>((lane.RD & mask) | (m_r8[2][i] & ~mask));
+		m_r8[3][i] = static_cast<uint8_t>((lane.RE & mask) | (m_r8[3][i] & ~mask));
+		m_r8[4][i] = static_cast<uint8_t>((lane.RH & mask) | (m_r8[4][i] & ~mask));
+		m_r8[5][i] = static_cast<uint8_t>((lane.RL & mask) | (m_r8[5][i] & ~mask));
+		m_r8[7][i] = static_cast<uint8_t>((lane.RA & mask) | (m_r8[7][i] & ~mask));
+		m_sp[i] = static_cast<uint16_t>((lane.RSP & mask16) | (m_sp[i] & ~mask16));
+		m_pc[i] = static_cast<uint16_t>((lane.RPC & mask16) | (m_pc[i] & ~mask16));
+		m_flag_result[i] = static_cast<uint16_t>((lane.m_flag_result & mask16) | (m_flag_result[i] & ~mask16));
+		m_flag_a[i] = static_cast<uint8_t>((lane.m_flag_a & mask) | (m_flag_a[i] & ~mask));
+		m_flag_b[i] = static_cast<uint8_t>((lane.m_flag_b & mask) | (m_flag_b[i] & ~mask));
+		m_flag_n[i] = static_cast<uint8_t>((lane.m_flag_n & mask) | (m_flag_n[i] & ~mask));
+		m_budget[i] = (lane.budget & mask32) | (m_budget[i] & ~mask32);
+	}
+
+	++m_stats.groups;
+	m_stats.grouped += group.count;
+	return together(group);
+}
+
+template <typename F>
+bool Lanes::for_members(Group const& group, F f)
+{
+	for (uint32_t k = 0; k < group.count; k++)
+	{
+		uint32_t i = group.members[k];
+		// reads and writes see the time the instruction starts at
+		sync_cycles(i);
+		Mem& mem = m_dmgs[i]->mem();
+		Lane<Mem> lane(mem);
+		lane.RB = m_r8[0][i];
+		lane.RC = m_r8[1][i];
+		lane.RD = m_r8[2][i];
+		lane.RE = m_r8[3][i];
+		lane.RH = m_r8[4][i];
+		lane.RL = m_r8[5][i];
+		lane.RA = m_r8[7][i];
+		lane.RSP = m_sp[i];
+		lane.RPC = m_pc[i];
+		lane.m_flag_result = m_flag_result[i];
+		lane.m_flag_a = m_flag_a[i];
+		lane.m_flag_b = m_flag_b[i];
+		lane.m_flag_n = m_flag_n[i];
+		lane.budget = m_budget[i];
+
+		f(lane);
+
+		m_r8[0][i] = lane.RB;
+		m_r8[1][i] = lane.RC;
+		m_r8[2][i] = lane.RD;
+		m_r8[3][i] = lane.RE;
+		m_r8[4][i] = lane.RH;
+		m_r8[5][i] = lane.RL;
+		m_r8[7][i] = lane.RA;
+		m_sp[i] = lane.RSP;
+		m_pc[i] = lane.RPC;
+		m_flag_result[i] = lane.m_flag_result;
+		m_flag_a[i] = lane.m_flag_a;
+		m_flag_b[i] = lane.m_flag_b;
+		m_flag_n[i] = lane.m_flag_n;
+		m_budget[i] = lane.budget;
+
+		// a write may have brought the deadline forward
+		if (mem.deadline() < m_limit[i])
+		{
+			sync_cycles(i);
+			arm(i);
+		}
+	}
+
+	++m_stats.groups;
+	m_stats.grouped += group.count;
+	return together(group);
+}
+
+void Lanes::step_members(Group const& group)
+{
+	for (uint32_t k = 0; k < group.count; k++)
+	{
+		uint32_t i = group.members[k];
+		sync_cycles(i);
+		step_lane(i);
+		arm(i);
+	}
+}
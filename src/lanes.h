@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdint>
+#include <array>
+#include <memory>
+
+#include "dmg.h"
+
+// Lockstep core of many Dmgs, for running lots of copies of a game with different inputs.
+// The registers of every lane live in struct-of-arrays layout, one array element per lane.
+// Lanes at the same pc with the same instruction bytes form a group which runs the
+// instruction together: decoded once, with the register work done in loops over all lanes
+// that the compiler turns into vector code and masked to the group. Memory goes through each
+// lane's own Mem. Events, interrupts, HALT, EI, DI and STOP are left to each lane's own cpu.
+// Lanes that branch apart are regrouped by running the group with the lowest pc first, which
+// lets the lanes behind catch up with the ones ahead where their paths meet again.
+// See lanes.cpp.
+
+class Lanes
+{
+public:
+	static constexpr uint32_t s_max_lanes = 16;
+
+	struct Stats
+	{
+		uint64_t groups;  // instructions decoded once for a group of lanes
+		uint64_t grouped; // instructions the lanes ran in those groups
+		uint64_t stepped; // instructions and events left to a lane's own cpu
+	};
+
+	// count Dmgs of their own, in Execution::Instruction
+	explicit Lanes(uint32_t count);
+	~Lanes();
+
+	uint32_t count() const { return m_count; }
+	// Between runs the Dmgs are up to date and anything may be done with them: cartridges
+	// inserted, buttons set, states loaded.
+	Dmg& dmg(uint32_t lane) { return *m_dmgs[lane]; }
+
+	// Runs every lane up to the M-cycle end or until its cpu stops, ending where
+	// Dmg::run_until() would.
+	void run_until(uint64_t end);
+
+	Stats stats() const { return m_stats; }
+
+private:
+	template <typename M>
+	struct Lane;
+	struct Group;
+	struct Ops;
+	// run the instruction of the group, return whether its members are still together
+	using Handler = bool (*)(Lanes&, Group const&);
+	static std::array<Handler, 0x200> const s_handlers;
+
+	uint32_t m_count;
+	std::unique_ptr<Dmg> m_dmgs[s_max_lanes];
+	Stats m_stats;
+	// the end of the run
+	uint64_t m_end;
+
+	// Registers, in the order of Cpu::Opcode::Reg8 with the (HL) row unused, and lazy flags
+	// as in Cpu.
+	alignas(64) uint8_t m_r8[8][s_max_lanes];
+	alignas(32) uint16_t m_sp[s_max_lanes];
+	alignas(32) uint16_t m_pc[s_max_lanes];
+	alignas(32) uint16_t m_flag_result[s_max_lanes];
+	alignas(16) uint8_t m_flag_a[s_max_lanes];
+	alignas(16) uint8_t m_flag_b[s_max_lanes];
+	alignas(16) uint8_t m_flag_n[s_max_lanes];
+
+	// M-cycles a lane may run before its Mem needs a look, down to the deadline or the end of
+	// the run. Mem::cycles() is limit - budget and only kept current around memory accesses.
+	alignas(64) int32_t m_budget[s_max_lanes];
+	uint64_t m_limit[s_max_lanes];
+	// 0xFF for the lanes still running
+	alignas(16) uint8_t m_active[s_max_lanes];
+
+	void load_registers(uint32_t lane);
+	void store_registers(uint32_t lane);
+	// brings Mem::cycles() up to date
+	void sync_cycles(uint32_t lane);
+	// budget from the lane's deadline and the end of the run
+	void arm(uint32_t lane);
+	// a lane out of budget: stops it at the end, or steps its own cpu through what is due
+	void service(uint32_t lane);
+	// one instruction or event on the lane's own cpu
+	void step_lane(uint32_t lane);
+
+	// the ready lanes at the lowest pc running the same code, false when no lane is ready
+	bool form_group(Group& group);
+	// runs instructions of the group while it stays together and ahead of no other lane
+	void run_group(Group& group);
+	// at the same pc with budget left
+	bool together(Group const& group) const;
+
+	template <typename F>
+	bool for_lanes(Group const& group, F f);
+	template <typename F>
+	bool for_members(Group const& group, F f);
+	void step_members(Group const& group);
+};
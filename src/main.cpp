@@ -1,7 +1,11 @@
+#include <algorithm>
 #include <cstdio>
 #include <csignal>
+#include <cstdlib>
+#include <cstring>
 #include <memory>
 
+#include "batch.h"
 #include "dmg.h"
 
 std::weak_ptr<Dmg> dmg_ptr;
@@ -12,20 +16,59 @@ void sigint(int)
 		dmg_ptr.lock()->power_off();
 }
 
+#ifdef GB_JIT
+constexpr Dmg::Execution s_execution = Dmg::Execution::Jit;
+#elif defined(GB_THREADED)
+constexpr Dmg::Execution s_execution = Dmg::Execution::Threaded;
+#else
+constexpr Dmg::Execution s_execution = Dmg::Execution::MCycle;
+#endif
+
+// gb-emu --batch <jobs> <results> [threads], see batch.h
+int run_batch(int argc, char* argv[])
+{
+	if (argc < 4)
+	{
+		printf("usage: %s --batch <jobs> <results> [threads]\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<batch::Job> jobs;
+	if (!batch::read_jobs(argv[2], jobs))
+		return 1;
+
+	// nothing headless needs the M-cycle core for
+	Dmg::Execution execution = s_execution == Dmg::Execution::MCycle ? Dmg::Execution::Block : s_execution;
+	uint32_t threads = argc >= 5 ? static_cast<uint32_t>(strtoul(argv[4], nullptr, 10)) : 0;
+	std::vector<batch::Result> results = batch::run(jobs, execution, threads);
+	if (!batch::write_results(argv[3], jobs, results))
+		return 1;
+
+	// failed when any job did
+	return std::any_of(results.begin(), results.end(), [](batch::Result const& result) { return result.status == batch::Result::Status::Error; });
+}
+
 int main(int argc, char* argv[])
 {
+	if (argc >= 2 && strcmp(argv[1], "--batch") == 0)
+		return run_batch(argc, argv);
+
 	signal(SIGINT, sigint);
 
 	auto dmg = std::allocate_shared<Dmg>(std::allocator<Dmg>());
 	dmg_ptr = dmg;
 
-	if (argc == 2)
-		dmg->insert_cartridge(argv[1]);
-	else
-		dmg->insert_cartridge("roms/test-loop.gb");
+	dmg->set_execution(s_execution);
+
+	if (!dmg->insert_cartridge(argc == 2 ? argv[1] : "roms/test-loop.gb"))
+		return 1;
 
 	dmg->power_on();
 
+	if (uint64_t undefined = dmg->cpu().undefined_opcodes())
+		printf("Ignored %llu undefined opcodes, the last %#04x.\n", static_cast<unsigned long long>(undefined),
+			dmg->cpu().last_undefined_opcode());
+
 	printf("Goodbye!\n");
 
 	return 0;
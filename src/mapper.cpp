@@ -0,0 +1,221 @@
+#include "mapper.h"
+
+Mapper::Kind Mapper::kind(uint8_t cartridge_type)
+{
+	switch (cartridge_type)
+	{
+		case 0x00: case 0x08: case 0x09:
+			return Kind::None;
+		case 0x01: case 0x02: case 0x03:
+			return Kind::Mbc1;
+		case 0x05: case 0x06:
+			return Kind::Mbc2;
+		case 0x0F: case 0x10: case 0x11: case 0x12: case 0x13:
+			return Kind::Mbc3;
+		case 0x19: case 0x1A: case 0x1B: case 0x1C: case 0x1D: case 0x1E:
+			return Kind::Mbc5;
+		default:
+			return Kind::Unsupported;
+	}
+}
+
+Mapper::Mapper()
+{
+	reset(Kind::None, 2, 1);
+}
+
+void Mapper::reset(Kind kind, uint32_t rom_banks, uint32_t ram_banks)
+{
+	// bank counts are powers of two, bank numbers wrap around them
+	m_kind = kind;
+	m_rom_mask = rom_banks - 1;
+	m_ram_mask = ram_banks ? ram_banks - 1 : 0;
+
+	m_ram_enabled = kind == Kind::None;
+	m_rom_select = 1;
+	m_ram_select = 0;
+	m_mode = false;
+
+	m_rtc_seconds = 0;
+	m_rtc_time = 0;
+	m_rtc_carry = false;
+	m_rtc_halt = false;
+	m_rtc_latch_write = 0xFF;
+	latch_rtc();
+}
+
+uint8_t Mapper::write(uint16_t addr, uint8_t data, uint64_t now)
+{
+	switch (m_kind)
+	{
+		case Kind::None:
+		case Kind::Unsupported:
+			return 0;
+
+		case Kind::Mbc1:
+			switch (addr >> 13)
+			{
+				case 0:
+					m_ram_enabled = (data & 0x0F) == 0x0A;
+					return s_ram;
+				case 1:
+					m_rom_select = data & 0x1F ? data & 0x1F : 1;
+					return s_rom;
+				case 2:
+					m_ram_select = data & 0x03;
+					return s_rom0 | s_rom | s_ram;
+				default:
+					m_mode = data & 0x01;
+					return s_rom0 | s_ram;
+			}
+
+		case Kind::Mbc2:
+			// address bit 8 tells the two registers apart, both anywhere in $0000-$3FFF
+			if (addr >= 0x4000)
+				return 0;
+			if (addr & 0x0100)
+			{
+				m_rom_select = data & 0x0F ? data & 0x0F : 1;
+				return s_rom;
+			}
+			m_ram_enabled = (data & 0x0F) == 0x0A;
+			return s_ram;
+
+		case Kind::Mbc3:
+			switch (addr >> 13)
+			{
+				case 0:
+					m_ram_enabled = (data & 0x0F) == 0x0A;
+					return s_ram;
+				case 1:
+					m_rom_select = data & 0x7F ? data & 0x7F : 1;
+					return s_rom;
+				case 2:
+					m_ram_select = data & 0x0F;
+					return s_ram;
+				default:
+					// writing 0 then 1 copies the clock to the registers games read
+					if (m_rtc_latch_write == 0x00 && data == 0x01)
+					{
+						advance_rtc(now);
+						latch_rtc();
+					}
+					m_rtc_latch_write = data;
+					return 0;
+			}
+
+		case Kind::Mbc5:
+			switch (addr >> 12)
+			{
+				case 0: case 1:
+					m_ram_enabled = (data & 0x0F) == 0x0A;
+					return s_ram;
+				case 2:
+					m_rom_select = (m_rom_select & 0x100) | data;
+					return s_rom;
+				case 3:
+					m_rom_select = (m_rom_select & 0xFF) | (data & 0x01) << 8;
+					return s_rom;
+				case 4: case 5:
+					m_ram_select = data & 0x0F;
+					return s_ram;
+				default:
+					return 0;
+			}
+	}
+	return 0;
+}
+
+uint32_t Mapper::rom0_bank() const
+{
+	// MBC1's second banking mode puts the upper bits on $0000-$3FFF as well
+	if (m_kind == Kind::Mbc1 && m_mode)
+		return (m_ram_select << 5) & m_rom_mask;
+	return 0;
+}
+
+uint32_t Mapper::rom_bank() const
+{
+	if (m_kind == Kind::Mbc1)
+		return (m_ram_select << 5 | m_rom_select) & m_rom_mask;
+	return m_rom_select & m_rom_mask;
+}
+
+uint32_t Mapper::ram_bank() const
+{
+	switch (m_kind)
+	{
+		case Kind::Mbc1:
+			return m_mode ? m_ram_select & m_ram_mask : 0;
+		case Kind::Mbc3:
+		case Kind::Mbc5:
+			return m_ram_select & m_ram_mask;
+		default:
+			return 0;
+	}
+}
+
+void Mapper::advance_rtc(uint64_t now)
+{
+	if (m_rtc_halt)
+	{
+		m_rtc_time = now;
+		return;
+	}
+
+	uint64_t seconds = (now - m_rtc_time) / s_rtc_second;
+	m_rtc_seconds += seconds;
+	m_rtc_time += seconds * s_rtc_second;
+
+	// the day counter has 9 bits
+	if (m_rtc_seconds >= 512 * 86400)
+	{
+		m_rtc_seconds %= 512 * 86400;
+		m_rtc_carry = true;
+	}
+}
+
+void Mapper::latch_rtc()
+{
+	uint64_t days = m_rtc_seconds / 86400;
+	m_rtc_latched[0] = static_cast<uint8_t>(m_rtc_seconds % 60);
+	m_rtc_latched[1] = static_cast<uint8_t>(m_rtc_seconds / 60 % 60);
+	m_rtc_latched[2] = static_cast<uint8_t>(m_rtc_seconds / 3600 % 24);
+	m_rtc_latched[3] = static_cast<uint8_t>(days);
+	m_rtc_latched[4] = static_cast<uint8_t>(days >> 8 | m_rtc_halt << 6 | m_rtc_carry << 7);
+}
+
+uint8_t Mapper::read_rtc() const
+{
+	return m_ram_select <= 0x0C ? m_rtc_latched[m_ram_select - 0x08] : 0xFF;
+}
+
+void Mapper::write_rtc(uint8_t data, uint64_t now)
+{
+	if (m_ram_select > 0x0C)
+		return;
+
+	advance_rtc(now);
+
+	uint64_t seconds = m_rtc_seconds % 60;
+	uint64_t minutes = m_rtc_seconds / 60 % 60;
+	uint64_t hours = m_rtc_seconds / 3600 % 24;
+	uint64_t days = m_rtc_seconds / 86400;
+
+	switch (m_ram_select)
+	{
+		case 0x08: seconds = data % 60; break;
+		case 0x09: minutes = data % 60; break;
+		case 0x0A: hours = data % 24; break;
+		case 0x0B: days = (days & 0x100) | data; break;
+		case 0x0C:
+			days = (days & 0xFF) | (data & 0x01) << 8;
+			m_rtc_halt = data & 0x40;
+			m_rtc_carry = data & 0x80;
+			break;
+	}
+
+	// a write restarts the current second
+	m_rtc_seconds = ((days * 24 + hours) * 60 + minutes) * 60 + seconds;
+	m_rtc_time = now;
+}
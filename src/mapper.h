@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+
+// Memory bank controller of a cartridge.
+// Only keeps the registers the game writes to $0000-$7FFF and says which banks of rom and
+// external ram they select, Mem points its page table at them. MBC3's clock counts emulated
+// time, not wall clock time.
+// See mapper.cpp.
+
+class Mapper
+{
+public:
+	enum class Kind : uint8_t
+	{
+		None, // 32 KiB of rom, maybe 8 KiB of ram
+		Mbc1,
+		Mbc2,
+		Mbc3,
+		Mbc5,
+		Unsupported,
+	};
+
+	// mapper of the cartridge type at $0147
+	static Kind kind(uint8_t cartridge_type);
+
+	// windows write() can change
+	enum Window : uint8_t
+	{
+		s_rom0 = 1, // $0000-$3FFF
+		s_rom = 2,  // $4000-$7FFF
+		s_ram = 4,  // $A000-$BFFF
+	};
+
+	Mapper();
+
+	void reset(Kind kind, uint32_t rom_banks, uint32_t ram_banks);
+
+	// a write to $0000-$7FFF, returns the windows it switched
+	uint8_t write(uint16_t addr, uint8_t data, uint64_t now);
+
+	Kind kind() const { return m_kind; }
+	// 16 KiB banks at $0000-$3FFF and $4000-$7FFF, 8 KiB bank at $A000-$BFFF
+	uint32_t rom0_bank() const;
+	uint32_t rom_bank() const;
+	uint32_t ram_bank() const;
+	bool ram_enabled() const { return m_ram_enabled; }
+
+	// MBC3 maps a clock register at $A000-$BFFF instead of ram
+	bool rtc_mapped() const { return m_kind == Kind::Mbc3 && m_ram_select >= 0x08; }
+	uint8_t read_rtc() const;
+	void write_rtc(uint8_t data, uint64_t now);
+
+private:
+	// M-cycles per second of the clock
+	static constexpr uint64_t s_rtc_second = 1 << 20;
+
+	Kind m_kind;
+	uint32_t m_rom_mask;
+	uint32_t m_ram_mask;
+
+	bool m_ram_enabled;
+	uint16_t m_rom_select; // MBC1 low 5 bits, MBC5 9 bits
+	uint8_t m_ram_select;  // MBC1 upper 2 bits of the rom bank, MBC3 ram bank or clock register
+	bool m_mode;           // MBC1 banking mode
+
+	// MBC3 clock: seconds counted up to m_rtc_time, with the day counter overflow and halt bit
+	uint64_t m_rtc_seconds;
+	uint64_t m_rtc_time;
+	bool m_rtc_carry;
+	bool m_rtc_halt;
+	uint8_t m_rtc_latch_write;
+	uint8_t m_rtc_latched[5];
+
+	void advance_rtc(uint64_t now);
+	void latch_rtc();
+};
@@ -1,12 +1,319 @@
 #include "mem.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <cassert>
+#include <cstring>
+#include <iterator>
 
 Mem::Mem(Bus& bus)
 	: m_bus(bus)
 	, m_ram()
-{ }
+	, m_shared()
+	, m_shared_pages()
+	, m_copied(0)
+	, m_cartridge(nullptr)
+	, m_mapper()
+	, m_banks()
+	, m_read_pages()
+	, m_write_pages()
+	, m_code_pages()
+	, m_written_code_pages()
+	, m_code_written(false)
+	, m_timer()
+	, m_ppu()
+	, m_cycles(0)
+	, m_deadline(0)
+	, m_changes(0)
+	, m_timed_reads(0)
+	, m_buttons(0)
+	, m_serial_output(nullptr)
+{
+	for (uint32_t page = 0; page < 0x100; page++)
+		map_page(static_cast<uint8_t>(page));
+	remap(0);
+}
+
+void Mem::map_page(uint8_t page)
+{
+	if (m_cartridge && page < 0x80)
+	{
+		// writes go to the mapper
+		uint32_t bank = page < 0x40 ? m_mapper.rom0_bank() : m_mapper.rom_bank();
+		m_read_pages[page] = m_cartridge->rom() + bank * 0x4000 + ((page & 0x3F) << 8);
+		m_write_pages[page] = nullptr;
+		return;
+	}
+	if (m_cartridge && (page & 0xE0) == 0xA0)
+	{
+		// MBC2 keeps only the lower half of each byte
+		uint8_t* ram = cartridge_ram(static_cast<uint16_t>(page << 8));
+		m_read_pages[page] = ram;
+		m_write_pages[page] = m_mapper.kind() == Mapper::Kind::Mbc2 || m_code_pages[page] ? nullptr : ram;
+		return;
+	}
+
+	// the registers of the last page change with time and on access, a shared page is
+	// copied by the first write and the LCD is drawn up to the write before VRAM and OAM change
+	bool io = page == 0xFF;
+	bool video = (page & 0xE0) == 0x80 || page == 0xFE;
+	m_read_pages[page] = io ? nullptr : ram_page(page);
+	m_write_pages[page] = io || video || m_code_pages[page] || m_shared_pages[page] ? nullptr : m_ram + (page << 8);
+}
+
+bool Mem::shareable(uint8_t page) const
+{
+	if (m_cartridge && (page < 0x80 || (page & 0xE0) == 0xA0))
+		return false;
+	return page != 0xFF;
+}
+
+void Mem::share()
+{
+	uint32_t written = 0;
+	for (uint32_t page = 0; page < 0x100; page++)
+		written += shareable(static_cast<uint8_t>(page)) && !m_shared_pages[page];
+	if (!written)
+		return;
+
+	// the pages still shared stay where they are
+	auto shared = std::make_shared<Shared>();
+	shared->base = m_shared;
+	shared->pages = {};
+	shared->bytes = std::make_unique_for_overwrite<uint8_t[]>(written * 0x100);
+	uint8_t* bytes = shared->bytes.get();
+	for (uint32_t page = 0; page < 0x100; page++)
+	{
+		if (!shareable(static_cast<uint8_t>(page)))
+			continue;
+		if (m_shared_pages[page])
+			shared->pages[page] = m_shared->pages[page];
+		else
+		{
+			memcpy(bytes, m_ram + (page << 8), 0x100);
+			shared->pages[page] = bytes;
+			bytes += 0x100;
+			m_shared_pages[page] = true;
+		}
+	}
+	m_copied += written * 0x100;
+	m_shared = std::move(shared);
+	for (uint32_t page = 0; page < 0x100; page++)
+		map_page(static_cast<uint8_t>(page));
+}
+
+void Mem::own_page(uint8_t page)
+{
+	memcpy(m_ram + (page << 8), m_shared->pages[page], 0x100);
+	m_shared_pages[page] = false;
+	m_copied += 0x100;
+	map_page(page);
+}
+
+void Mem::own_pages()
+{
+	for (uint32_t page = 0; page < 0x100; page++)
+		if (m_shared_pages[page])
+			own_page(static_cast<uint8_t>(page));
+	m_shared.reset();
+}
+
+void Mem::fork(Mem& child)
+{
+	share();
+
+	// Blocks the child decoded from ram before are stale, the rom stays the same when the
+	// child maps the same cartridge.
+	for (uint32_t page = 0; page < 0x100; page++)
+	{
+		bool rom = child.m_cartridge && page < 0x80;
+		child.m_written_code_pages[page] = child.m_code_pages[page] && !rom;
+		child.m_code_written |= child.m_written_code_pages[page];
+		child.m_shared_pages[page] = m_shared_pages[page];
+	}
+	child.m_shared = m_shared;
+	memcpy(child.m_ram + 0xFF00, m_ram + 0xFF00, 0x100);
+	child.m_copied += 0x100;
+	if (m_cartridge && child.m_cartridge)
+	{
+		size_t size = std::min(m_cartridge->ram_size(), child.m_cartridge->ram_size());
+		memcpy(child.m_cartridge->ram(), m_cartridge->ram(), size);
+		child.m_copied += size;
+	}
+
+	child.m_mapper = m_mapper;
+	child.m_timer = m_timer;
+	m_ppu.fork(child.m_ppu);
+	child.m_cycles = m_cycles;
+	child.m_changes = m_changes;
+	child.m_timed_reads = m_timed_reads;
+	child.m_buttons = m_buttons;
+
+	// The same rom image and shared pages, every page but the external ram reads and writes
+	// as here. The next instruction starts after an update, as after a load.
+	child.m_read_pages = m_read_pages;
+	child.m_write_pages = m_write_pages;
+	std::copy(std::begin(m_banks), std::end(m_banks), child.m_banks);
+	if (child.m_cartridge)
+		for (uint32_t page = 0xA0; page < 0xC0; page++)
+			child.map_page(static_cast<uint8_t>(page));
+	child.m_deadline = 0;
+}
+
+void Mem::map_cartridge(Cartridge* cartridge)
+{
+	// which pages may be shared depends on the cartridge
+	if (m_shared)
+		own_pages();
+	m_cartridge = cartridge;
+	if (cartridge)
+	{
+		Cartridge::Header const& header = cartridge->header();
+		m_mapper.reset(header.mapper, header.rom_size / 0x4000, header.ram_size / 0x2000);
+	}
+	else
+		m_mapper.reset(Mapper::Kind::None, 2, 1);
+
+	for (uint32_t page = 0; page < 0x100; page++)
+		map_page(static_cast<uint8_t>(page));
+	remap(0);
+}
+
+void Mem::remap(uint8_t windows)
+{
+	if (m_cartridge)
+	{
+		// writes to the rom windows never go through the page table, a switch only moves
+		// the read pointers
+		if (windows & Mapper::s_rom0)
+			map_rom_window(0x00, m_mapper.rom0_bank());
+		if (windows & Mapper::s_rom)
+			map_rom_window(0x40, m_mapper.rom_bank());
+	}
+	if (windows & Mapper::s_ram)
+		for (uint32_t page = 0xA0; page < 0xC0; page++)
+			map_page(static_cast<uint8_t>(page));
+
+	bool banked = m_cartridge;
+	m_banks[0] = banked ? static_cast<uint16_t>(m_mapper.rom0_bank()) : 0;
+	m_banks[1] = banked ? static_cast<uint16_t>(m_mapper.rom_bank()) : 0;
+	m_banks[2] = banked ? static_cast<uint16_t>(m_mapper.ram_bank()) : 0;
+	m_deadline = 0;
+}
+
+void Mem::map_rom_window(uint8_t first_page, uint32_t bank)
+{
+	uint8_t const* rom = m_cartridge->rom() + bank * 0x4000;
+	for (uint32_t page = 0; page < 0x40; page++)
+		m_read_pages[first_page + page] = rom + (page << 8);
+}
+
+void Mem::reset()
+{
+	// code decoded from ram is gone with it
+	for (uint32_t page = 0; page < 0x100; page++)
+		m_written_code_pages[page] = m_code_pages[page];
+	m_code_written = true;
+
+	memset(m_ram, 0, sizeof(m_ram));
+	m_shared.reset();
+	std::fill(std::begin(m_shared_pages), std::end(m_shared_pages), false);
+	m_timer.reset();
+	m_ppu.reset();
+	m_cycles = 0;
+	m_changes = 0;
+	m_timed_reads = 0;
+	m_buttons = 0;
+	map_cartridge(m_cartridge);
+}
+
+void Mem::save_state(State& state) const
+{
+	// with a cartridge, rom and external ram come from it, not from m_ram
+	uint32_t first = m_cartridge ? 0x8000 : 0;
+	for (uint32_t page = first >> 8; page < 0x100; page++)
+		memcpy(state.ram + (page << 8), ram_page(static_cast<uint8_t>(page)), 0x100);
+	state.cartridge = m_cartridge;
+	state.cartridge_ram_size = m_cartridge ? m_cartridge->ram_size() : 0;
+	if (state.cartridge_ram_size)
+		memcpy(state.cartridge_ram, m_cartridge->ram(), state.cartridge_ram_size);
+
+	state.mapper = m_mapper;
+	state.timer = m_timer;
+	m_ppu.save_state(state.ppu);
+	state.cycles = m_cycles;
+	state.changes = m_changes;
+	state.timed_reads = m_timed_reads;
+	state.buttons = m_buttons;
+}
+
+bool Mem::load_state(State const& state)
+{
+	size_t ram_size = m_cartridge ? m_cartridge->ram_size() : 0;
+	if (state.cartridge != static_cast<bool>(m_cartridge) || state.cartridge_ram_size != ram_size
+		|| state.mapper.kind() != m_mapper.kind())
+		return false;
+
+	// Only code pages whose bytes change need their blocks dropped, the rom can't change.
+	// Whatever was decoded from external ram goes, comparing its banks isn't worth it.
+	uint32_t first = m_cartridge ? 0x8000 : 0;
+	for (uint32_t page = first >> 8; page < 0x100; page++)
+	{
+		if (!m_code_pages[page])
+			continue;
+		bool external = m_cartridge && (page & 0xE0) == 0xA0;
+		if (external || memcmp(ram_page(static_cast<uint8_t>(page)), state.ram + (page << 8), 0x100) != 0)
+		{
+			m_written_code_pages[page] = true;
+			m_code_written = true;
+		}
+	}
+
+	memcpy(m_ram + first, state.ram + first, sizeof(m_ram) - first);
+	// nothing left to share, every page is in m_ram again
+	if (m_shared)
+	{
+		m_shared.reset();
+		std::fill(std::begin(m_shared_pages), std::end(m_shared_pages), false);
+		for (uint32_t page = 0; page < 0x100; page++)
+			map_page(static_cast<uint8_t>(page));
+	}
+	if (ram_size)
+		memcpy(m_cartridge->ram(), state.cartridge_ram, ram_size);
+
+	m_mapper = state.mapper;
+	m_timer = state.timer;
+	m_ppu.load_state(state.ppu);
+	m_cycles = state.cycles;
+	m_changes = state.changes;
+	m_timed_reads = state.timed_reads;
+	m_buttons = state.buttons;
+
+	// sets the deadline to 0, the next update() finds the next event from the restored timer
+	remap(Mapper::s_rom0 | Mapper::s_rom | Mapper::s_ram);
+	return true;
+}
+
+uint8_t* Mem::cartridge_ram(uint16_t addr)
+{
+	size_t size = m_cartridge->ram_size();
+	if (!m_mapper.ram_enabled() || m_mapper.rtc_mapped() || !size)
+		return nullptr;
+	if (m_mapper.kind() == Mapper::Kind::Mbc2)
+		return m_cartridge->ram() + (addr & 0x01FF);
+	return m_cartridge->ram() + (m_mapper.ram_bank() * 0x2000 + (addr & 0x1FFF)) % size;
+}
+
+void Mem::write_cartridge_ram(uint16_t addr, uint8_t data)
+{
+	if (m_mapper.rtc_mapped())
+	{
+		if (m_mapper.ram_enabled())
+			m_mapper.write_rtc(data, m_cycles);
+	}
+	else if (uint8_t* ram = cartridge_ram(addr))
+		*ram = m_mapper.kind() == Mapper::Kind::Mbc2 ? data | 0xF0 : data;
+}
 
 void Mem::clock()
 {
@@ -16,16 +323,257 @@ void Mem::clock()
 	// 	printf("READ  RAM[$%04x]: $%02x\n", m_bus.read_addr(), m_ram[m_bus.read_addr()]);
 
 	if (m_bus.mem_data_ready())
+		write(m_bus.read_addr(), m_bus.read_data());
+	else
+		m_bus.write_data(read(m_bus.read_addr()));
+
+	m_bus.mem_did_read_data();
+}
+
+uint8_t Mem::read_handler(uint16_t addr)
+{
+	if (addr >= 0xFF00)
+		return read_io(addr);
+	if (m_cartridge && (addr & 0xE000) == 0xA000)
+		return m_mapper.rtc_mapped() && m_mapper.ram_enabled() ? m_mapper.read_rtc() : 0xFF;
+	return ram_page(addr >> 8)[addr & 0xFF];
+}
+
+void Mem::write_handler(uint16_t addr, uint8_t data)
+{
+	if (m_cartridge && addr < 0x8000)
+	{
+		if (uint8_t windows = m_mapper.write(addr, data, m_cycles))
+			remap(windows);
+		return;
+	}
+	if (m_code_pages[addr >> 8])
 	{
-		if (m_bus.read_addr() == 0xFF02 && m_bus.read_data() == 0x81)
+		m_written_code_pages[addr >> 8] = true;
+		m_code_written = true;
+		m_deadline = 0;
+	}
+	if (m_cartridge && (addr & 0xE000) == 0xA000)
+		write_cartridge_ram(addr, data);
+	else if (addr >= 0xFF00)
+		write_io(addr, data);
+	else
+	{
+		if ((addr & 0xE000) == 0x8000 || (addr >> 8) == 0xFE)
 		{
-			printf("%c", m_ram[0xFF01]);
-			fflush(stdout);
+			advance_ppu();
+			video_written(addr, data);
 		}
-		m_ram[m_bus.read_addr()] = m_bus.read_data();
+		if (m_shared_pages[addr >> 8])
+			own_page(addr >> 8);
+		m_ram[addr] = data;
 	}
-	else
-		m_bus.write_data(m_ram[m_bus.read_addr()]);
+}
 
-	m_bus.mem_did_read_data();
+uint8_t Mem::read_io(uint16_t addr)
+{
+	switch (addr)
+	{
+		case 0xFF00:
+		{
+			// P1, a pressed button reads 0 on the lines of the group selected by a 0 bit
+			uint8_t select = m_ram[0xFF00];
+			uint8_t pressed = 0;
+			if (!(select & 0x10))
+				pressed |= m_buttons & 0x0F;
+			if (!(select & 0x20))
+				pressed |= m_buttons >> 4;
+			return static_cast<uint8_t>(0xC0 | select | (~pressed & 0x0F));
+		}
+		case 0xFF04:
+			m_timed_reads |= s_timed_div;
+			return m_timer.div(m_cycles);
+		case 0xFF05:
+			m_timed_reads |= s_timed_tima;
+			advance_timer();
+			return m_timer.tima();
+		case 0xFF06:
+			return m_timer.tma();
+		case 0xFF07:
+			return m_timer.tac();
+		case 0xFF41:
+			// the FIFO may have ended mode 3 since
+			m_timed_reads |= s_timed_stat;
+			advance_ppu();
+			return m_ppu.read(addr, m_cycles);
+		case 0xFF44:
+			m_timed_reads |= s_timed_ly;
+			return m_ppu.read(addr, m_cycles);
+		case 0xFF40: case 0xFF42: case 0xFF43: case 0xFF45:
+		case 0xFF47: case 0xFF48: case 0xFF49: case 0xFF4A: case 0xFF4B:
+			return m_ppu.read(addr, m_cycles);
+		default:
+			return m_ram[addr];
+	}
+}
+
+void Mem::write_io(uint16_t addr, uint8_t data)
+{
+	switch (addr)
+	{
+		case 0xFF00:
+			m_ram[addr] = data & 0x30;
+			return;
+		case 0xFF02:
+			if (data == 0x81)
+			{
+				if (m_serial_output)
+					m_serial_output->push_back(static_cast<char>(m_ram[0xFF01]));
+				else
+				{
+					printf("%c", m_ram[0xFF01]);
+					fflush(stdout);
+				}
+			}
+			break;
+		case 0xFF04:
+			advance_timer();
+			m_timer.write_div(m_cycles);
+			m_deadline = 0;
+			return;
+		case 0xFF05:
+			advance_timer();
+			m_timer.write_tima(data);
+			m_deadline = 0;
+			return;
+		case 0xFF06:
+			advance_timer();
+			m_timer.write_tma(data);
+			return;
+		case 0xFF07:
+			advance_timer();
+			m_timer.write_tac(data);
+			m_deadline = 0;
+			return;
+		case 0xFF0F: // IF
+		case 0xFFFF: // IE
+			m_deadline = 0;
+			break;
+		case 0xFF40: case 0xFF41: case 0xFF42: case 0xFF43: case 0xFF44: case 0xFF45:
+		case 0xFF47: case 0xFF48: case 0xFF49: case 0xFF4A: case 0xFF4B:
+			advance_ppu();
+			m_ram[0xFF0F] |= m_ppu.write(addr, data, m_cycles);
+			m_deadline = 0;
+			return;
+		case 0xFF46:
+			dma(data);
+			break;
+	}
+	m_ram[addr] = data;
+}
+
+void Mem::set_buttons(uint8_t buttons)
+{
+	// a press pulls a line low and requests the joypad interrupt
+	if (buttons & ~m_buttons)
+	{
+		m_ram[0xFF0F] |= 0x10;
+		m_deadline = 0;
+	}
+	m_buttons = buttons;
+	++m_changes;
+}
+
+void Mem::advance_timer()
+{
+	if (m_timer.advance(m_cycles))
+		m_ram[0xFF0F] |= 0x04;
+}
+
+void Mem::advance_ppu()
+{
+	m_ram[0xFF0F] |= m_ppu.advance(m_cycles, m_read_pages);
+}
+
+void Mem::set_ppu_engine(Ppu::Engine engine)
+{
+	advance_ppu();
+	m_ppu.set_engine(engine, m_read_pages);
+	m_deadline = 0;
+}
+
+void Mem::set_render_every(uint32_t frames)
+{
+	// the frames up to now drawn as they were going to be
+	advance_ppu();
+	m_ppu.set_render_every(frames);
+}
+
+void Mem::dma(uint8_t page)
+{
+	// OAM as the PPU is about to see it, which the copy changes all at once
+	advance_ppu();
+	if (m_shared_pages[0xFE])
+		own_page(0xFE);
+	for (uint32_t i = 0; i < 0xA0; i++)
+	{
+		uint8_t data = read(static_cast<uint16_t>(page << 8 | i));
+		video_written(static_cast<uint16_t>(0xFE00 + i), data);
+		m_ram[0xFE00 + i] = data;
+	}
+}
+
+void Mem::video_written(uint16_t addr, uint8_t data)
+{
+	uint8_t const* page = m_read_pages[addr >> 8];
+	if (page[addr & 0xFF] == data)
+		return;
+	if (addr < 0xA000)
+		m_ppu.vram_written(addr);
+	else if (addr < 0xFEA0)
+	{
+		uint8_t y = page[addr & 0xFC];
+		m_ppu.oam_written(y, addr & 3 ? y : data);
+	}
+}
+
+void Mem::update()
+{
+	++m_changes;
+	// reached at every event, VBlank at least while the LCD is on
+	if (m_cartridge)
+		m_cartridge->sync_save();
+	advance_timer();
+	advance_ppu();
+	m_deadline = std::min(m_timer.next_overflow(), m_ppu.next_event());
+}
+
+uint64_t Mem::next_interrupt() const
+{
+	uint8_t enabled = m_ram[0xFFFF];
+	uint64_t timer = enabled & 0x04 ? m_timer.next_overflow() : s_never;
+	return std::min(timer, m_ppu.next_interrupt(enabled));
+}
+
+uint64_t Mem::next_timed_change(uint8_t timed_registers, uint64_t time) const
+{
+	uint64_t next = s_never;
+	if (timed_registers & s_timed_div)
+		next = std::min(next, m_timer.next_div_change(time));
+	if (timed_registers & s_timed_tima)
+		next = std::min(next, m_timer.next_tima_change(time));
+	if (timed_registers & s_timed_ly)
+		next = std::min(next, m_ppu.next_ly_change(time));
+	if (timed_registers & s_timed_stat)
+		next = std::min(next, m_ppu.next_stat_change(time));
+	return next;
+}
+
+void Mem::clear_written_code()
+{
+	for (uint32_t page = 0; page < 0x100; page++)
+	{
+		if (m_written_code_pages[page])
+		{
+			m_code_pages[page] = false;
+			map_page(static_cast<uint8_t>(page));
+		}
+		m_written_code_pages[page] = false;
+	}
+	m_code_written = false;
 }
\ No newline at end of file
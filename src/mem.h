@@ -1,22 +1,240 @@
 #pragma once
 #include <cstdint>
 #include <array>
+#include <memory>
+#include <string>
 
 #include "bus.h"
+#include "cartridge.h"
+#include "mapper.h"
+#include "ppu.h"
+#include "timer.h"
 
 class Mem
 {
 public:
 
+	// Memory, cartridge ram and mapper, timer and system time, see Dmg::State. Fixed size,
+	// with room for the most external ram a header can ask for.
+	struct State
+	{
+		uint8_t ram[0x10000];
+		uint8_t cartridge_ram[0x20000];
+		size_t cartridge_ram_size;
+		bool cartridge;
+		Mapper mapper;
+		Timer timer;
+		Ppu::State ppu;
+		uint64_t cycles;
+		uint64_t changes;
+		uint8_t timed_reads;
+		uint8_t buttons;
+	};
+
 	Mem(Bus& bus);
 	~Mem() = default;
 
+	static constexpr uint64_t s_never = Timer::s_never;
+
 	void clock();
 
-	uint8_t* direct_ram() { return m_ram; }
+	// Immediate access for the instruction stepped cores, bypassing the bus. Pages with a
+	// pointer in the page table are plain memory, the others go through a handler.
+	uint8_t read(uint16_t addr)
+	{
+		if (uint8_t const* page = m_read_pages[addr >> 8]) [[likely]]
+			return page[addr & 0xFF];
+		// HRAM, plain memory on the page of the registers, where the stack and the variables
+		// polled with LDH tend to be
+		if (hram(addr))
+			return m_ram[addr];
+		return read_handler(addr);
+	}
+	void write(uint16_t addr, uint8_t data)
+	{
+		++m_changes;
+		if (uint8_t* page = m_write_pages[addr >> 8]) [[likely]]
+			page[addr & 0xFF] = data;
+		else if (hram(addr) && !m_code_pages[0xFF])
+			m_ram[addr] = data;
+		else
+			write_handler(addr, data);
+	}
+
+	// All of memory as plain bytes. A forked Mem copies the pages it still shares first, and
+	// the PPU decodes every tile and draws every line again.
+	uint8_t* direct_ram()
+	{
+		if (m_shared)
+			own_pages();
+		m_ppu.invalidate_video();
+		return m_ram;
+	}
+	// $FF00-$FFFF, registers and high ram, which a fork never shares
+	uint8_t* io() { return m_ram + 0xFF00; }
+	// what the page of addr reads from, nullptr for a page going through a handler
+	uint8_t const* read_page(uint16_t addr) const { return m_read_pages[addr >> 8]; }
+
+	// clears memory and time and resets the timer and mapper, the cartridge stays mapped
+	void reset();
+
+	// where bytes sent over the serial port go, printed while nullptr
+	void set_serial_output(std::string* output) { m_serial_output = output; }
+
+	// Maps the rom and external ram of the cartridge in, banked by its mapper, which gets the
+	// writes to $0000-$7FFF. nullptr maps ram back in everywhere. The cartridge has to outlive
+	// the mapping.
+	void map_cartridge(Cartridge* cartridge);
+	Mapper const& mapper() const { return m_mapper; }
+
+	// Makes child, which maps the same rom image, a copy of this Mem sharing memory with it
+	// copy-on-write, see Dmg::fork(). Pages written since the last fork are copied once into
+	// the memory shared from now on, which then serves both until either writes a page.
+	void fork(Mem& child);
+	// bytes copied into shared memory and out of it by writes, on this Mem
+	uint64_t copied() const { return m_copied; }
+
+	void save_state(State& state) const;
+	// Returns false, changing nothing, when the state is of a different cartridge. Restored
+	// code leaves the cpu's block caches the same way written code does.
+	bool load_state(State const& state);
+
+	// bank mapped at addr, rom at $0000-$7FFF and external ram at $8000-$BFFF
+	uint16_t bank(uint16_t addr) const { return m_banks[addr >> 14]; }
+
+	// Pages of 256 bytes the cpu's block cache has decoded code from. Writes to them leave
+	// the page table for write_handler() and are recorded until the cache picks them up with
+	// clear_written_code().
+	void mark_code(uint16_t addr)
+	{
+		m_code_pages[addr >> 8] = true;
+		m_write_pages[addr >> 8] = nullptr;
+	}
+	bool code_written() const { return m_code_written; }
+	bool code_page_written(uint8_t page) const { return m_written_code_pages[page]; }
+	void clear_written_code();
+
+	// System time in M-cycles. Every core adds the cycles of an instruction once it is done,
+	// so everything in it sees the time the instruction started at.
+	uint64_t cycles() const { return m_cycles; }
+	void add_cycles(uint64_t cycles) { m_cycles += cycles; }
+	// for generated code keeping cycles() current and polling the deadline
+	uint64_t* cycles_counter() { return &m_cycles; }
+	uint64_t const* deadline_counter() const { return &m_deadline; }
+
+	// The cpu has to call update() before it starts an instruction at or after the deadline.
+	// It is the next event, or 0 after a write that needs a look between instructions: to
+	// code, IE, IF or the timer.
+	uint64_t deadline() const { return m_deadline; }
+	void request_update() { m_deadline = 0; }
+	// runs the events up to cycles(), then sets the deadline to the next one
+	void update();
+
+	// Buttons held, see Dmg::Button. P1 reads them until the next call, which requests the
+	// joypad interrupt when it presses any.
+	void set_buttons(uint8_t buttons);
+	uint8_t buttons() const { return m_buttons; }
+
+	// earliest M-cycle an interrupt enabled in IE gets requested, s_never if none is scheduled
+	uint64_t next_interrupt() const;
+
+	// the LCD, whose lines are drawn by update() and before VRAM, OAM or its registers change
+	Ppu const& ppu() const { return m_ppu; }
+	// switches the engine drawing the LCD at the current M-cycle, see Ppu::Engine
+	void set_ppu_engine(Ppu::Engine engine);
+	// which frames the LCD draws from the next one on, see Ppu::set_render_every()
+	void set_render_every(uint32_t frames);
+
+	// Writes and updates so far, and the registers read that change with time alone. Lets Dmg
+	// prove that a loop waits for nothing but an event, see Dmg::skip_idle_loop().
+	enum TimedRegister : uint8_t
+	{
+		s_timed_div = 1,
+		s_timed_tima = 2,
+		s_timed_ly = 4,
+		s_timed_stat = 8,
+	};
+	uint64_t changes() const { return m_changes; }
+	uint8_t timed_reads() const { return m_timed_reads; }
+	void clear_timed_reads() { m_timed_reads = 0; }
+	// first M-cycle after time at which one of the timed registers reads differently
+	uint64_t next_timed_change(uint8_t timed_registers, uint64_t time) const;
 
 private:
+	// Read-only pages of memory shared by forks, in bytes of its own or of the shared memory it
+	// was forked from.
+	struct Shared
+	{
+		std::shared_ptr<Shared const> base;
+		std::array<uint8_t const*, 0x100> pages;
+		std::unique_ptr<uint8_t[]> bytes;
+	};
+
 	Bus& m_bus;
 
 	uint8_t m_ram[0x10000];
+	// pages read from m_shared instead of m_ram until written
+	std::shared_ptr<Shared const> m_shared;
+	bool m_shared_pages[0x100];
+	uint64_t m_copied;
+
+	Cartridge* m_cartridge;
+	Mapper m_mapper;
+	uint16_t m_banks[4];
+
+	// memory each page of the address space reads from and writes to, nullptr for the
+	// pages read_handler() and write_handler() take care of
+	std::array<uint8_t const*, 0x100> m_read_pages;
+	std::array<uint8_t*, 0x100> m_write_pages;
+
+	bool m_code_pages[0x100];
+	bool m_written_code_pages[0x100];
+	bool m_code_written;
+
+	Timer m_timer;
+	Ppu m_ppu;
+	uint64_t m_cycles;
+	uint64_t m_deadline;
+	uint64_t m_changes;
+	uint8_t m_timed_reads;
+	uint8_t m_buttons;
+	std::string* m_serial_output;
+
+	// pages left out of the page table: I/O, code, mapper registers and external ram that
+	// isn't plain memory
+	uint8_t read_handler(uint16_t addr);
+	void write_handler(uint16_t addr, uint8_t data);
+	// $FF80-$FFFE, read and written by read() and write() before the handlers
+	static bool hram(uint16_t addr) { return addr >= 0xFF80 && addr != 0xFFFF; }
+	void map_page(uint8_t page);
+	// where the bytes of a page of m_ram are
+	uint8_t const* ram_page(uint8_t page) const
+	{
+		return m_shared_pages[page] ? m_shared->pages[page] : m_ram + (page << 8);
+	}
+	// pages of m_ram a fork shares: all but I/O, and the rom and external ram windows of a
+	// cartridge, which never use m_ram
+	bool shareable(uint8_t page) const;
+	// Moves the pages this Mem has written since it last shared them into new shared memory.
+	void share();
+	// copies a shared page into m_ram before it is written
+	void own_page(uint8_t page);
+	void own_pages();
+	// Points the windows the mapper switched at their new banks. The switch may have pulled
+	// the code being run away, so the next instruction starts after an update.
+	void remap(uint8_t windows);
+	void map_rom_window(uint8_t first_page, uint32_t bank);
+	// byte of external ram at addr, nullptr while ram is disabled or the clock is mapped
+	uint8_t* cartridge_ram(uint16_t addr);
+	void write_cartridge_ram(uint16_t addr, uint8_t data);
+
+	// $FF00-$FFFF
+	uint8_t read_io(uint16_t addr);
+	void write_io(uint16_t addr, uint8_t data);
+	void advance_timer();
+	void advance_ppu();
+	// $FF46, copies a page to OAM at once
+	void dma(uint8_t page);
+	// tells the PPU about a write to VRAM or OAM that changes it, before it does
+	void video_written(uint16_t addr, uint8_t data);
 };
\ No newline at end of file
@@ -0,0 +1,544 @@
+#include "ppu.h"
+#include "ppu_rows.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+// Timing, registers and the scanline engine, which draws lines in two passes of 64-bit words,
+// eight pixels each: the color numbers of background and window, then their shades with the
+// sprites of the line on top. See ppu_rows.h for the decoding.
+
+namespace
+{
+
+// shades of color numbers through a palette register
+uint64_t shade(uint64_t colors, uint8_t palette)
+{
+	uint64_t low = (colors & s_ones) * 0xFF;
+	uint64_t high = (colors >> 1 & s_ones) * 0xFF;
+	auto entry = [palette](uint32_t color) { return (palette >> color * 2 & 3) * s_ones; };
+	return (~high & ~low & entry(0)) | (~high & low & entry(1)) | (high & ~low & entry(2)) | (high & low & entry(3));
+}
+
+uint64_t load(uint8_t const* bytes)
+{
+	uint64_t word;
+	memcpy(&word, bytes, sizeof(word));
+	return word;
+}
+
+void store(uint8_t* bytes, uint64_t word)
+{
+	memcpy(bytes, &word, sizeof(word));
+}
+
+}
+
+Ppu::Ppu()
+	: m()
+	, m_engine(Engine::Scanline)
+	, m_next_vblank(s_never)
+	, m_next_stat(s_never)
+	, m_fifo()
+	, m_frames()
+	, m_front(0)
+	, m_frame_count(0)
+	, m_render_every(1)
+	, m_rendering(true)
+	, m_tiles()
+	, m_dirty_tiles()
+	, m_tile_counts()
+	, m_tile_stats()
+	, m_line_inputs()
+	, m_line_tiles()
+	, m_stale_lines()
+	, m_drawn_lines()
+	, m_changed_lines()
+{
+	reset();
+}
+
+void Ppu::reset()
+{
+	m = {};
+	m.lcdc = 0x91;
+	m.bgp = 0xFC;
+	m.obp0 = 0xFF;
+	m.obp1 = 0xFF;
+	m_fifo.line_start = s_never;
+	invalidate_video();
+	schedule();
+}
+
+void Ppu::vram_written(uint16_t addr)
+{
+	if (addr < 0x9800)
+	{
+		uint32_t tile = (addr - 0x8000u) >> 4;
+		uint64_t bit = 1ull << (tile & 63);
+		m_dirty_tiles[tile >> 6] |= bit;
+		for (uint32_t line = 0; line < s_height; line++)
+			if (m_line_tiles[line][tile >> 6] & bit)
+				m_stale_lines.set(line);
+		return;
+	}
+
+	// an entry of a map, on the lines that showed its row as background or window
+	uint32_t row = addr & 0xFFE0u;
+	for (uint32_t line = 0; line < s_height; line++)
+	{
+		LineInputs const& inputs = m_line_inputs[line];
+		uint32_t background = (inputs.lcdc & 0x08 ? 0x9C00u : 0x9800u) + ((inputs.scy + line) & 0xFF) / 8 * 32;
+		uint32_t window = (inputs.lcdc & 0x40 ? 0x9C00u : 0x9800u) + inputs.window_line / 8u * 32;
+		if (row == background || row == window)
+			m_stale_lines.set(line);
+	}
+}
+
+void Ppu::oam_written(uint8_t y_before, uint8_t y_after)
+{
+	// the lines of an 8x16 sprite at either Y
+	for (uint8_t y : { y_before, y_after })
+		for (uint32_t line = std::max(y, uint8_t(16)) - 16u; line < std::min<uint32_t>(y, s_height); line++)
+			m_stale_lines.set(line);
+}
+
+void Ppu::invalidate_video()
+{
+	std::fill(std::begin(m_dirty_tiles), std::end(m_dirty_tiles), ~0ull);
+	m_stale_lines.set();
+}
+
+void Ppu::set_engine(Engine engine, Pages const& pages)
+{
+	if (engine == m_engine)
+		return;
+
+	Position position = this->position(m.time);
+	bool in_line = lcd_on() && position.line < s_height && position.cycle >= s_mode3;
+	if (engine == Engine::Fifo)
+	{
+		// the scanline engine drew the line already and mode 3 ends when it says
+		m_fifo.line_start = in_line ? position.line_start : s_never;
+		m_fifo.mode0 = s_mode0;
+		m_fifo.done = true;
+	}
+	else
+	{
+		if (in_line && m_fifo.line_start == position.line_start && !m_fifo.done)
+			run_fifo(s_line_cycles * 4, pages);
+		m_fifo.line_start = s_never;
+	}
+	m_engine = engine;
+	schedule();
+}
+
+void Ppu::load_state(State const& state)
+{
+	m = state;
+	m_fifo.line_start = s_never;
+	invalidate_video();
+	schedule();
+}
+
+void Ppu::fork(Ppu& child) const
+{
+	child.m = m;
+	child.m_engine = m_engine;
+	child.m_next_vblank = m_next_vblank;
+	child.m_next_stat = m_next_stat;
+	child.m_fifo = m_fifo;
+	child.m_render_every = m_render_every;
+	child.m_rendering = m_rendering;
+	child.invalidate_video();
+}
+
+Ppu::Position Ppu::position(uint64_t time) const
+{
+	uint64_t in_frame = (time - m.start) % s_frame_cycles;
+	uint32_t line = static_cast<uint32_t>(in_frame / s_line_cycles);
+	uint32_t cycle = static_cast<uint32_t>(in_frame % s_line_cycles);
+	return { time - cycle, line, cycle };
+}
+
+uint32_t Ppu::mode0(Position const& position) const
+{
+	return position.line_start == m_fifo.line_start ? m_fifo.mode0 : s_mode0;
+}
+
+uint8_t Ppu::mode(Position const& position) const
+{
+	if (position.line >= s_height)
+		return 1;
+	if (position.cycle < s_mode3)
+		return 2;
+	return position.cycle < mode0(position) ? 3 : 0;
+}
+
+bool Ppu::stat_line(Position const& position) const
+{
+	uint8_t sources = m.stat;
+	uint8_t current = mode(position);
+	return ((sources & 0x40) && position.line == m.lyc) || ((sources & 0x20) && current == 2)
+		|| ((sources & 0x10) && current == 1) || ((sources & 0x08) && current == 0);
+}
+
+uint64_t Ppu::next_boundary(Position const& position) const
+{
+	if (position.line < s_height && position.cycle < s_mode3)
+		return position.line_start + s_mode3;
+	if (position.line < s_height && position.cycle < mode0(position))
+		return position.line_start + mode0(position);
+	return position.line_start + s_line_cycles;
+}
+
+uint64_t Ppu::next_vblank(uint64_t after) const
+{
+	if (!lcd_on())
+		return s_never;
+	uint64_t frame_start = after - (after - m.start) % s_frame_cycles;
+	uint64_t vblank = frame_start + s_height * s_line_cycles;
+	return vblank > after ? vblank : vblank + s_frame_cycles;
+}
+
+uint64_t Ppu::next_stat(uint64_t after) const
+{
+	if (!lcd_on() || !(m.stat & 0x78))
+		return s_never;
+
+	// the first rising edge within a frame, there is none when the line stays the same
+	Position position = this->position(after);
+	bool high = stat_line(position);
+	for (uint32_t boundary = 0; boundary <= s_lines * 3; boundary++)
+	{
+		uint64_t time = next_boundary(position);
+		position = this->position(time);
+		bool rises = !high && stat_line(position);
+		if (rises)
+			return time;
+		high = stat_line(position);
+	}
+	return s_never;
+}
+
+void Ppu::schedule()
+{
+	m_next_vblank = next_vblank(m.time);
+	m_next_stat = next_stat(m.time);
+}
+
+uint64_t Ppu::next_interrupt(uint8_t enabled) const
+{
+	uint64_t next = s_never;
+	if (enabled & s_vblank)
+		next = m_next_vblank;
+	if (enabled & s_stat)
+		next = std::min(next, m_next_stat);
+	return next;
+}
+
+uint64_t Ppu::next_ly_change(uint64_t now) const
+{
+	return lcd_on() ? position(now).line_start + s_line_cycles : s_never;
+}
+
+uint64_t Ppu::next_stat_change(uint64_t now) const
+{
+	return lcd_on() ? next_boundary(position(now)) : s_never;
+}
+
+uint8_t Ppu::advance(uint64_t now, Pages const& pages)
+{
+	if (now <= m.time)
+		return 0;
+
+	uint8_t requested = 0;
+	if (lcd_on())
+	{
+		draw(m.time, now, pages);
+		// mode 0 moves on as the FIFO turns out to take longer
+		if (m_engine == Engine::Fifo)
+			m_next_stat = next_stat(m.time);
+		if (m_next_vblank <= now)
+		{
+			requested |= s_vblank;
+			m_next_vblank = next_vblank(now);
+		}
+		if (m_next_stat <= now)
+		{
+			requested |= s_stat;
+			m_next_stat = next_stat(now);
+		}
+	}
+	m.time = now;
+	return requested;
+}
+
+uint8_t Ppu::read(uint16_t addr, uint64_t now) const
+{
+	switch (addr)
+	{
+		case 0xFF40: return m.lcdc;
+		case 0xFF41:
+		{
+			if (!lcd_on())
+				return static_cast<uint8_t>(0x80 | m.stat | (m.lyc == 0 ? 0x04 : 0));
+			Position position = this->position(now);
+			return static_cast<uint8_t>(0x80 | m.stat | (position.line == m.lyc ? 0x04 : 0) | mode(position));
+		}
+		case 0xFF42: return m.scy;
+		case 0xFF43: return m.scx;
+		case 0xFF44: return lcd_on() ? static_cast<uint8_t>(position(now).line) : 0;
+		case 0xFF45: return m.lyc;
+		case 0xFF47: return m.bgp;
+		case 0xFF48: return m.obp0;
+		case 0xFF49: return m.obp1;
+		case 0xFF4A: return m.wy;
+		case 0xFF4B: return m.wx;
+		default: return 0xFF;
+	}
+}
+
+uint8_t Ppu::write(uint16_t addr, uint8_t data, uint64_t now)
+{
+	bool was_high = lcd_on() && stat_line(position(now));
+
+	switch (addr)
+	{
+		case 0xFF40:
+			// switched on, the first frame starts now
+			if ((data & 0x80) && !lcd_on())
+			{
+				m.start = now;
+				m_fifo.line_start = s_never;
+			}
+			m.lcdc = data;
+			break;
+		case 0xFF41: m.stat = data & 0x78; break;
+		case 0xFF42: m.scy = data; break;
+		case 0xFF43: m.scx = data; break;
+		case 0xFF45: m.lyc = data; break;
+		case 0xFF47: m.bgp = data; break;
+		case 0xFF48: m.obp0 = data; break;
+		case 0xFF49: m.obp1 = data; break;
+		case 0xFF4A: m.wy = data; break;
+		case 0xFF4B: m.wx = data; break;
+	}
+	m.time = now;
+	schedule();
+
+	// a source switched on or LYC set to LY raises the line at once
+	bool high = lcd_on() && stat_line(position(now));
+	return !was_high && high ? s_stat : 0;
+}
+
+uint64_t Ppu::skip_frames(uint64_t from, uint64_t to)
+{
+	// frames nothing looked at are all the same, only the last two are drawn
+	if (to - from > 2 * s_frame_cycles)
+	{
+		uint64_t skipped = (to - from) / s_frame_cycles - 1;
+		from += skipped * s_frame_cycles;
+		m_frame_count += skipped;
+	}
+	return from;
+}
+
+void Ppu::finish_frame(uint32_t line)
+{
+	if (line == s_height - 1)
+	{
+		// a frame left undrawn leaves frame() as it is, the lines FIFO put out are thrown away
+		if (m_rendering)
+		{
+			m_front ^= 1;
+			m_tile_stats = m_tile_counts;
+			m_changed_lines = m_drawn_lines;
+		}
+		else
+			m_changed_lines.reset();
+		++m_frame_count;
+		m_tile_counts = {};
+		m_drawn_lines.reset();
+		start_frame();
+	}
+}
+
+void Ppu::draw(uint64_t from, uint64_t to, Pages const& pages)
+{
+	if (m_engine == Engine::Fifo)
+	{
+		draw_dots(from, to, pages);
+		return;
+	}
+	from = skip_frames(from, to);
+
+	// the first line whose pixels start going out after from
+	Position position = this->position(from);
+	uint32_t line = position.line;
+	uint64_t pixels = position.line_start + s_mode3;
+	if (line >= s_height || position.cycle >= s_mode3)
+	{
+		line = line + 1 < s_lines ? line + 1 : 0;
+		pixels += s_line_cycles;
+	}
+	if (line >= s_height)
+	{
+		pixels += (s_lines - line) * s_line_cycles;
+		line = 0;
+	}
+
+	for (; pixels <= to; pixels += s_line_cycles)
+	{
+		if (line == 0)
+			m.window_line = 0;
+		if (m_rendering)
+			draw_line(line, pages, m_frames[m_front ^ 1][line]);
+		else if (window_shown(line))
+			++m.window_line;
+		finish_frame(line);
+
+		if (++line == s_height)
+		{
+			pixels += (s_lines - s_height) * s_line_cycles;
+			line = 0;
+		}
+	}
+}
+
+uint64_t Ppu::tile_row(uint32_t tile, uint32_t row, Pages const& pages)
+{
+	++m_tile_counts.lookups;
+	uint64_t& dirty = m_dirty_tiles[tile >> 6];
+	uint64_t bit = 1ull << (tile & 63);
+	if (dirty & bit)
+	{
+		dirty &= ~bit;
+		++m_tile_counts.decodes;
+		uint16_t data = static_cast<uint16_t>(0x8000 + tile * 16);
+		for (uint32_t r = 0; r < 8; r++)
+			m_tiles[tile][r] = decode(vram(pages, static_cast<uint16_t>(data + r * 2)), vram(pages, static_cast<uint16_t>(data + r * 2 + 1)));
+	}
+	return m_tiles[tile][row];
+}
+
+void Ppu::draw_line(uint32_t line, Pages const& pages, uint8_t* out)
+{
+	// the line of the frame before when nothing it shows changed
+	LineInputs inputs = { m.lcdc, m.scy, m.scx, m.bgp, m.obp0, m.obp1, m.wy, m.wx, m.window_line };
+	if (!m_stale_lines[line] && inputs == m_line_inputs[line])
+	{
+		memcpy(out, m_frames[m_front][line], s_width);
+		if (window_shown(line))
+			++m.window_line;
+		return;
+	}
+	m_stale_lines.reset(line);
+	m_drawn_lines.set(line);
+	m_line_inputs[line] = inputs;
+	uint64_t* used = m_line_tiles[line];
+	std::fill(used, used + s_tiles / 64, 0);
+
+	// color numbers of background and window, with room for the tile the scroll cuts into
+	alignas(8) uint8_t colors[s_width];
+	alignas(8) uint8_t tiles[s_width + 8];
+
+	auto fetch = [&](uint16_t map, uint8_t first, uint8_t y)
+	{
+		// rows of the 21 tiles from first, wrapping around the map
+		uint16_t row = static_cast<uint16_t>(map + (y >> 3) * 32);
+		for (uint32_t tile = 0; tile < s_width / 8 + 1; tile++)
+		{
+			uint8_t index = vram(pages, static_cast<uint16_t>(row + ((first + tile) & 31)));
+			uint32_t number = m.lcdc & 0x10 ? index : 256 + static_cast<int8_t>(index);
+			used[number >> 6] |= 1ull << (number & 63);
+			store(tiles + tile * 8, tile_row(number, y & 7, pages));
+		}
+	};
+
+	if (m.lcdc & 0x01)
+	{
+		uint8_t y = static_cast<uint8_t>(m.scy + line);
+		fetch(m.lcdc & 0x08 ? 0x9C00 : 0x9800, m.scx >> 3, y);
+		memcpy(colors, tiles + (m.scx & 7), s_width);
+
+		// the window from WX-7, its own lines counted apart from LY
+		if (window_shown(line))
+		{
+			uint32_t x = m.wx >= 7 ? m.wx - 7u : 0;
+			uint32_t cut = m.wx >= 7 ? 0 : 7u - m.wx;
+			fetch(m.lcdc & 0x40 ? 0x9C00 : 0x9800, 0, m.window_line++);
+			memcpy(colors + x, tiles + cut, s_width - x);
+		}
+	}
+	else
+		memset(colors, 0, sizeof(colors));
+
+	for (uint32_t x = 0; x < s_width; x += 8)
+		store(out + x, shade(load(colors + x), m.bgp));
+
+	if (m.lcdc & 0x02)
+		draw_sprites(line, pages, colors, out);
+}
+
+void Ppu::draw_sprites(uint32_t line, Pages const& pages, uint8_t const* colors, uint8_t* out)
+{
+	// the first 10 sprites in OAM on the line, the one with the lower X on top of the other
+	// and the earlier one on top of the later at the same X
+	uint8_t const* oam = pages[0xFE];
+	uint32_t height = m.lcdc & 0x04 ? 16 : 8;
+	uint8_t sprites[10];
+	uint32_t count = 0;
+	for (uint32_t sprite = 0; sprite < 40 && count < 10; sprite++)
+	{
+		uint32_t row = line + 16 - oam[sprite * 4];
+		if (row < height)
+		{
+			// insertion by X keeps the ones at the same X in OAM order
+			uint32_t at = count++;
+			for (; at > 0 && oam[sprites[at - 1] * 4 + 1] > oam[sprite * 4 + 1]; at--)
+				sprites[at] = sprites[at - 1];
+			sprites[at] = static_cast<uint8_t>(sprite);
+		}
+	}
+	if (!count)
+		return;
+
+	// the sprite pixels on top, with 8 pixels on either side for sprites partly off screen
+	alignas(8) uint8_t layer_colors[s_width + 16] = {};
+	alignas(8) uint8_t layer_shades[s_width + 16] = {};
+	alignas(8) uint8_t layer_behind[s_width + 16] = {};
+	for (uint32_t i = count; i-- > 0;)
+	{
+		uint8_t const* sprite = oam + sprites[i] * 4;
+		uint8_t x = sprite[1];
+		if (x == 0 || x >= s_width + 8)
+			continue;
+
+		uint8_t attributes = sprite[3];
+		uint32_t row = line + 16 - sprite[0];
+		if (attributes & 0x40)
+			row = height - 1 - row;
+		// the second tile of 8x16 sprites from row 8
+		uint32_t tile = (height == 16 ? sprite[2] & 0xFE : sprite[2]) + (row >> 3);
+		m_line_tiles[line][tile >> 6] |= 1ull << (tile & 63);
+		uint64_t colors8 = tile_row(tile, row & 7, pages);
+		if (attributes & 0x20)
+			colors8 = reverse(colors8);
+
+		uint64_t mask = opaque(colors8);
+		uint64_t shades = shade(colors8, attributes & 0x10 ? m.obp1 : m.obp0);
+		uint64_t behind = attributes & 0x80 ? ~0ull : 0;
+		store(layer_colors + x, (colors8 & mask) | (load(layer_colors + x) & ~mask));
+		store(layer_shades + x, (shades & mask) | (load(layer_shades + x) & ~mask));
+		store(layer_behind + x, (behind & mask) | (load(layer_behind + x) & ~mask));
+	}
+
+	// a sprite behind the background shows only on its color 0
+	for (uint32_t x = 0; x < s_width; x += 8)
+	{
+		uint64_t shown = opaque(load(layer_colors + 8 + x)) & (~load(layer_behind + 8 + x) | ~opaque(load(colors + x)));
+		store(out + x, (load(layer_shades + 8 + x) & shown) | (load(out + x) & ~shown));
+	}
+}
@@ -0,0 +1,258 @@
+#pragma once
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <bitset>
+
+// LCD of the DMG, drawn by one of two engines.
+// Nothing is clocked, like the timer: LY and STAT are derived from the system time in M-cycles
+// when they are read, and the only events are the VBlank and STAT interrupts. Lines are drawn
+// from VRAM, OAM and the registers as they are when the time their pixels go out is passed, so
+// Mem brings the PPU up to date before any of them changes. The scanline engine draws a line
+// whole as mode 3 starts, decoding tile rows eight pixels at a time in a 64-bit word, and mode
+// 3 takes the same time on every line. It keeps the tiles decoded, one byte a pixel, and only
+// decodes a tile again after Mem reports a write changing it. A line drawn from the same
+// registers as in the frame before, with none of the tiles, map rows and sprites it showed
+// changed, is kept from that frame instead of drawn again. The FIFO engine runs mode 3 dot by
+// dot through the pixel FIFOs, so registers written during a line change the pixels after the
+// write and sprites, scrolling and the window make mode 3 longer. The cpu can always get at
+// VRAM and OAM.
+// Frames may be left undrawn, every one or all but every Nth: the lines, STAT and the
+// interrupts go on the same, only the pixels are not put out.
+// See ppu.cpp and ppu_fifo.cpp.
+
+class Ppu
+{
+public:
+	static constexpr uint64_t s_never = ~0ull;
+
+	static constexpr uint32_t s_width = 160;
+	static constexpr uint32_t s_height = 144;
+	// in M-cycles, 154 lines of which the last 10 are VBlank
+	static constexpr uint32_t s_line_cycles = 114;
+	static constexpr uint32_t s_lines = 154;
+	static constexpr uint32_t s_frame_cycles = s_line_cycles * s_lines;
+
+	// interrupts, bits of IF
+	static constexpr uint8_t s_vblank = 0x01;
+	static constexpr uint8_t s_stat = 0x02;
+
+	enum class Engine
+	{
+		Scanline, // a line at once as mode 3 starts, mode 3 always 43 M-cycles
+		Fifo,     // dot by dot through the pixel FIFOs, mode 3 as long as they take
+	};
+
+	// registers and timing, see Mem::State, the same for either engine
+	struct State
+	{
+		uint8_t lcdc;
+		uint8_t stat; // the interrupt sources, bits 3-6
+		uint8_t scy;
+		uint8_t scx;
+		uint8_t lyc;
+		uint8_t bgp;
+		uint8_t obp0;
+		uint8_t obp1;
+		uint8_t wy;
+		uint8_t wx;
+		uint8_t window_line; // line of the window drawn next
+		uint64_t start;      // M-cycle the LCD was switched on at, a frame boundary since
+		uint64_t time;       // M-cycle the lines and interrupts are up to date with
+	};
+
+	// memory each page of the address space reads from, VRAM and OAM are read through it
+	using Pages = std::array<uint8_t const*, 0x100>;
+
+	Ppu();
+
+	// the registers as the boot rom leaves them, LCD on
+	void reset();
+
+	// Switches engine, expects advance() up to the time. A line the FIFO is drawing is finished
+	// first.
+	void set_engine(Engine engine, Pages const& pages);
+	Engine engine() const { return m_engine; }
+
+	// Draws every frame for 1, the default, every Nth frame for N and none for 0, from the
+	// next frame on. LY, STAT, the interrupts, mode 3 of the FIFO engine and the state are the
+	// same whichever frames are drawn, and frame() keeps the last one that was.
+	void set_render_every(uint32_t frames) { m_render_every = frames; }
+	uint32_t render_every() const { return m_render_every; }
+
+	// Draws the lines up to now and returns the interrupts requested since the last call.
+	uint8_t advance(uint64_t now, Pages const& pages);
+
+	// $FF40-$FF4B but DMA, writes expect advance() up to now and return the interrupts they
+	// request
+	uint8_t read(uint16_t addr, uint64_t now) const;
+	uint8_t write(uint16_t addr, uint8_t data, uint64_t now);
+
+	// first M-cycle at which an interrupt gets requested, s_never while the LCD is off
+	uint64_t next_event() const { return std::min(m_next_vblank, m_next_stat); }
+	// the same for the interrupts enabled in IE
+	uint64_t next_interrupt(uint8_t enabled) const;
+	// first M-cycle after now at which LY or STAT read differently
+	uint64_t next_ly_change(uint64_t now) const;
+	uint64_t next_stat_change(uint64_t now) const;
+
+	// Last frame drawn whole, shades from 0 for white to 3 for black, s_width a line. Stays as
+	// it is while the LCD is off.
+	uint8_t const* frame() const { return &m_frames[m_front][0][0]; }
+	// frames the LCD went through since construction, drawn or not
+	uint64_t frames() const { return m_frame_count; }
+	// Lines of frame() drawn again instead of kept from the frame drawn before it, the others
+	// are the same as there, none after a frame left undrawn. Lets a consumer upload or encode
+	// only these.
+	std::bitset<s_height> const& changed_lines() const { return m_changed_lines; }
+
+	// Tile rows the scanline engine looked up in the last frame drawn, and the tiles among them
+	// it found changed and decoded again.
+	struct TileStats
+	{
+		uint64_t lookups;
+		uint64_t decodes;
+	};
+	TileStats tile_stats() const { return m_tile_stats; }
+
+	// Writes changing VRAM at addr, and OAM moving a sprite from one Y to another or changing
+	// it where it is. Both come before the PPU is up to date with the write.
+	void vram_written(uint16_t addr);
+	void oam_written(uint8_t y_before, uint8_t y_after);
+	// VRAM or OAM changed in a way Mem does not see, every tile is decoded and every line drawn
+	// again
+	void invalidate_video();
+
+	// A state can be loaded into either engine. Loaded during mode 3, the FIFO draws the line
+	// again from its start with the registers as they are.
+	void save_state(State& state) const { state = m; }
+	void load_state(State const& state);
+	// the state and engine of this PPU, with the line under way, but not the frames
+	void fork(Ppu& child) const;
+
+private:
+	// M-cycles into a line at which mode 3 starts and, in the scanline engine, mode 0
+	static constexpr uint32_t s_mode3 = 20;
+	static constexpr uint32_t s_mode0 = 63;
+
+	// where the lines are at a time, with the LCD on
+	struct Position
+	{
+		uint64_t line_start;
+		uint32_t line;
+		uint32_t cycle;
+	};
+
+	// the line the FIFO engine draws, see ppu_fifo.cpp
+	struct Fifo
+	{
+		uint64_t line_start; // of the line, s_never for none
+		uint32_t line;
+		uint32_t dot;        // dots of mode 3 run
+		uint32_t redrawn;    // dots of mode 3 drawn before, when the line was started again
+		uint32_t mode0;      // M-cycle into the line at which mode 0 starts, a lower bound until done
+		bool done;
+		// background fetcher
+		uint32_t step;       // dots into fetching a tile row, 6 with the row waiting to be pushed
+		uint32_t column;     // tile of the map row fetched next
+		bool window;
+		uint8_t window_y;
+		uint8_t index;
+		uint8_t low;
+		uint8_t high;
+		// the FIFOs, eight pixels in a word with the next one out in the lowest byte
+		uint64_t background;
+		uint32_t count;
+		uint64_t sprite_colors;
+		uint64_t sprite_attributes;
+		uint32_t x;          // pixels shifted out to the LCD
+		uint32_t discard;    // pixels still dropped for fine scrolling
+		uint32_t stall;      // dots left of a fetch that stops the pixels
+		// the sprites on the line by X, those before next fetched
+		uint8_t sprites[10];
+		uint32_t sprite_count;
+		uint32_t next_sprite;
+	};
+
+	State m;
+	Engine m_engine;
+	// cached from m
+	uint64_t m_next_vblank;
+	uint64_t m_next_stat;
+	Fifo m_fifo;
+
+	uint8_t m_frames[2][s_height][s_width];
+	uint8_t m_front;
+	uint64_t m_frame_count;
+	uint32_t m_render_every;
+	// whether the frame under way is drawn, set as the one before finishes
+	bool m_rendering;
+
+	// the 384 tiles of $8000-$97FF, rows of color numbers as decode() leaves them, and a bit
+	// for each tile changed since
+	static constexpr uint32_t s_tiles = 384;
+	alignas(64) uint64_t m_tiles[s_tiles][8];
+	uint64_t m_dirty_tiles[s_tiles / 64];
+	TileStats m_tile_counts;
+	TileStats m_tile_stats;
+
+	// the registers a line of the scanline engine was last drawn with
+	struct LineInputs
+	{
+		uint8_t lcdc;
+		uint8_t scy;
+		uint8_t scx;
+		uint8_t bgp;
+		uint8_t obp0;
+		uint8_t obp1;
+		uint8_t wy;
+		uint8_t wx;
+		uint8_t window_line;
+
+		bool operator==(LineInputs const&) const = default;
+	};
+	LineInputs m_line_inputs[s_height];
+	// the tiles a line showed, background, window and sprites
+	uint64_t m_line_tiles[s_height][s_tiles / 64];
+	// lines with tiles, map rows or sprites changed since they were drawn
+	std::bitset<s_height> m_stale_lines;
+	// lines of the frame under way drawn again, and of the last frame
+	std::bitset<s_height> m_drawn_lines;
+	std::bitset<s_height> m_changed_lines;
+
+	bool lcd_on() const { return m.lcdc & 0x80; }
+	Position position(uint64_t time) const;
+	// M-cycle into the line at which mode 0 starts, a lower bound for lines not drawn yet
+	uint32_t mode0(Position const& position) const;
+	uint8_t mode(Position const& position) const;
+	// the line into the STAT interrupt
+	bool stat_line(Position const& position) const;
+	// first M-cycle after time at which the mode or the line changes
+	uint64_t next_boundary(Position const& position) const;
+	uint64_t next_vblank(uint64_t after) const;
+	uint64_t next_stat(uint64_t after) const;
+	void schedule();
+
+	// the pixels going out after from, up to to
+	void draw(uint64_t from, uint64_t to, Pages const& pages);
+	// from moved on past frames nothing can look at
+	uint64_t skip_frames(uint64_t from, uint64_t to);
+	void draw_line(uint32_t line, Pages const& pages, uint8_t* out);
+	// row of a tile from the cache, decoding the tile first when it changed
+	uint64_t tile_row(uint32_t tile, uint32_t row, Pages const& pages);
+	void draw_sprites(uint32_t line, Pages const& pages, uint8_t const* colors, uint8_t* out);
+	// whether the window shows on the line, which counts it as one of its own
+	bool window_shown(uint32_t line) const { return (m.lcdc & 0x21) == 0x21 && m.wy <= line && m.wx < s_width + 7; }
+	// the line drawn whole, on to the next frame after the last line
+	void finish_frame(uint32_t line);
+	void start_frame() { m_rendering = m_render_every && m_frame_count % m_render_every == 0; }
+
+	// FIFO engine
+	void draw_dots(uint64_t from, uint64_t to, Pages const& pages);
+	// the line from the start of mode 3, with the sprites OAM holds for it
+	void start_fifo(uint32_t line, uint64_t line_start, uint32_t redrawn, Pages const& pages);
+	// runs mode 3 of the line up to dots into the line
+	void run_fifo(uint32_t dots, Pages const& pages);
+	void fetch_tile(Pages const& pages);
+	void fetch_sprite(Pages const& pages);
+};
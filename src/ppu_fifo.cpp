@@ -0,0 +1,210 @@
+#include "ppu.h"
+#include "ppu_rows.h"
+
+#include <algorithm>
+
+// FIFO engine.
+// Mode 3 runs a dot at a time like the pixel pipeline of the hardware, as described in
+// docs/gbctr.pdf. The background fetcher takes two dots each for the tile index and the two bit
+// planes of a row and pushes the row once the background FIFO is empty, and a pixel is shifted
+// out to the LCD on every dot the FIFO holds one. The first row of a line is fetched twice, the
+// pixels of SCX & 7 are dropped, the window throws the FIFO away and starts fetching again, and
+// a sprite waits for the fetcher to get to the end of its row before it is fetched itself for
+// six dots, with the pixels stopped all along. Without any of that mode 3 takes 172 dots, the
+// 43 M-cycles of the scanline engine.
+// Sprites are mixed into a FIFO of their own where it is still transparent, so the sprite with
+// the lower X and then the earlier one in OAM stays on top.
+
+void Ppu::draw_dots(uint64_t from, uint64_t to, Pages const& pages)
+{
+	from = skip_frames(from, to);
+
+	// every line whose mode 3 runs after from, up to to
+	Position position = this->position(from);
+	uint64_t line_start = position.line_start;
+	uint32_t line = position.line;
+	while (line_start + s_mode3 < to)
+	{
+		if (line < s_height)
+		{
+			// a line under way the FIFO never saw, after a state was loaded, starts over
+			if (m_fifo.line_start != line_start)
+			{
+				uint64_t drawn = std::max(from, line_start + s_mode3) - line_start - s_mode3;
+				start_fifo(line, line_start, static_cast<uint32_t>(std::min<uint64_t>(drawn, s_line_cycles) * 4), pages);
+			}
+			run_fifo(static_cast<uint32_t>(std::min<uint64_t>(to - line_start, s_line_cycles) * 4), pages);
+		}
+		line_start += s_line_cycles;
+		line = line + 1 < s_lines ? line + 1 : 0;
+	}
+}
+
+void Ppu::start_fifo(uint32_t line, uint64_t line_start, uint32_t redrawn, Pages const& pages)
+{
+	Fifo& f = m_fifo;
+	f = {};
+	f.line_start = line_start;
+	f.line = line;
+	f.redrawn = redrawn;
+	f.mode0 = s_mode0;
+	f.discard = m.scx & 7;
+	// the row the fetcher starts the line with is thrown away
+	f.stall = 6;
+	if (line == 0 && !redrawn)
+		m.window_line = 0;
+	// not kept from the frame before, nor from this one by the scanline engine
+	m_stale_lines.set(line);
+	m_drawn_lines.set(line);
+
+	// the first 10 sprites in OAM on the line, by X and in OAM order at the same X
+	uint8_t const* oam = pages[0xFE];
+	uint32_t height = m.lcdc & 0x04 ? 16 : 8;
+	for (uint32_t sprite = 0; sprite < 40 && f.sprite_count < 10; sprite++)
+	{
+		uint32_t row = line + 16 - oam[sprite * 4];
+		if (row < height)
+		{
+			uint32_t at = f.sprite_count++;
+			for (; at > 0 && oam[f.sprites[at - 1] * 4 + 1] > oam[sprite * 4 + 1]; at--)
+				f.sprites[at] = f.sprites[at - 1];
+			f.sprites[at] = static_cast<uint8_t>(sprite);
+		}
+	}
+}
+
+void Ppu::run_fifo(uint32_t dots, Pages const& pages)
+{
+	Fifo& f = m_fifo;
+	uint8_t* out = m_frames[m_front ^ 1][f.line];
+	uint32_t end = dots > s_mode3 * 4 ? dots - s_mode3 * 4 : 0;
+	while (!f.done && f.dot < end)
+	{
+		++f.dot;
+		if (f.stall)
+		{
+			--f.stall;
+			continue;
+		}
+
+		// the window from WX-7 on, counted as drawn already on a line drawn again
+		if (!f.window && (m.lcdc & 0x21) == 0x21 && m.wy <= f.line && m.wx < s_width + 7
+			&& f.x == (m.wx >= 7 ? m.wx - 7u : 0))
+		{
+			f.window = true;
+			f.window_y = f.dot <= f.redrawn ? static_cast<uint8_t>(m.window_line - 1) : m.window_line++;
+			f.background = 0;
+			f.count = 0;
+			f.step = 0;
+			f.column = 0;
+			f.discard = m.wx >= 7 ? 0 : 7u - m.wx;
+		}
+		fetch_tile(pages);
+
+		if ((m.lcdc & 0x02) && f.next_sprite < f.sprite_count && pages[0xFE][f.sprites[f.next_sprite] * 4 + 1] <= f.x + 8)
+		{
+			if (f.count && f.step >= 5)
+			{
+				fetch_sprite(pages);
+				f.stall = 5;
+			}
+			continue;
+		}
+		if (!f.count)
+			continue;
+
+		uint8_t color = static_cast<uint8_t>(f.background & 3);
+		f.background >>= 8;
+		--f.count;
+		if (f.discard)
+		{
+			--f.discard;
+			continue;
+		}
+		uint8_t sprite = static_cast<uint8_t>(f.sprite_colors & 3);
+		uint8_t attributes = static_cast<uint8_t>(f.sprite_attributes);
+		f.sprite_colors >>= 8;
+		f.sprite_attributes >>= 8;
+
+		// with the registers as they are now
+		uint8_t background = m.lcdc & 0x01 ? color : 0;
+		uint8_t shade = static_cast<uint8_t>(m.bgp >> background * 2 & 3);
+		if (sprite && (m.lcdc & 0x02) && !((attributes & 0x80) && background))
+			shade = static_cast<uint8_t>((attributes & 0x10 ? m.obp1 : m.obp0) >> sprite * 2 & 3);
+		out[f.x] = shade;
+
+		if (++f.x == s_width)
+		{
+			f.done = true;
+			f.mode0 = (s_mode3 * 4 + f.dot + 3) / 4;
+			finish_frame(f.line);
+		}
+	}
+
+	// mode 3 goes on at least past the dots run
+	if (!f.done)
+		f.mode0 = std::max(s_mode0, dots / 4 + 1);
+}
+
+void Ppu::fetch_tile(Pages const& pages)
+{
+	Fifo& f = m_fifo;
+	if (f.step == 6)
+	{
+		if (!f.count)
+		{
+			f.background = decode(f.low, f.high);
+			f.count = 8;
+			f.step = 0;
+			++f.column;
+		}
+		return;
+	}
+
+	// the map, SCX, SCY and LCDC as they are at each step
+	uint8_t y = f.window ? f.window_y : static_cast<uint8_t>(m.scy + f.line);
+	auto data = [&]
+	{
+		uint16_t base = m.lcdc & 0x10 ? static_cast<uint16_t>(0x8000 + f.index * 16)
+			: static_cast<uint16_t>(0x9000 + static_cast<int8_t>(f.index) * 16);
+		return static_cast<uint16_t>(base + (y & 7) * 2);
+	};
+	switch (++f.step)
+	{
+		case 2:
+		{
+			uint16_t map = f.window ? (m.lcdc & 0x40 ? 0x9C00 : 0x9800) : (m.lcdc & 0x08 ? 0x9C00 : 0x9800);
+			uint32_t column = f.window ? f.column : (m.scx >> 3) + f.column;
+			f.index = vram(pages, static_cast<uint16_t>(map + (y >> 3) * 32 + (column & 31)));
+			break;
+		}
+		case 4:
+			f.low = vram(pages, data());
+			break;
+		case 6:
+			f.high = vram(pages, static_cast<uint16_t>(data() + 1));
+			break;
+	}
+}
+
+void Ppu::fetch_sprite(Pages const& pages)
+{
+	Fifo& f = m_fifo;
+	uint8_t const* sprite = pages[0xFE] + f.sprites[f.next_sprite++] * 4;
+	uint32_t height = m.lcdc & 0x04 ? 16 : 8;
+	uint8_t attributes = sprite[3];
+	uint32_t row = (f.line + 16 - sprite[0]) & (height - 1);
+	if (attributes & 0x40)
+		row = height - 1 - row;
+	uint8_t tile = height == 16 ? sprite[2] & 0xFE : sprite[2];
+	uint16_t data = static_cast<uint16_t>(0x8000 + tile * 16 + row * 2);
+	uint64_t colors = decode(vram(pages, data), vram(pages, static_cast<uint16_t>(data + 1)),
+		attributes & 0x20 ? s_right_first : s_left_first);
+
+	// the pixels left of the screen are gone, the ones of sprites before stay on top
+	uint32_t gone = f.x + 8 - sprite[1];
+	colors = gone < 8 ? colors >> gone * 8 : 0;
+	uint64_t take = opaque(colors) & ~opaque(f.sprite_colors);
+	f.sprite_colors = (colors & take) | (f.sprite_colors & ~take);
+	f.sprite_attributes = ((attributes & 0x90) * s_ones & take) | (f.sprite_attributes & ~take);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+
+#include "ppu.h"
+
+// Tile rows as eight color numbers in a 64-bit word, for both engines. A row is decoded without
+// a loop over its bits: every byte of a word gets a copy of the row's bit plane and keeps its
+// own bit, which an add carries up to the same place in all of them.
+
+static_assert(std::endian::native == std::endian::little, "the leftmost pixel is the lowest byte of a word");
+
+constexpr uint64_t s_ones = 0x0101010101010101ull;
+// the bit of each pixel of a row, the leftmost pixel is bit 7 unless flipped
+constexpr uint64_t s_left_first = 0x0102040810204080ull;
+constexpr uint64_t s_right_first = 0x8040201008040201ull;
+
+// a bit plane of 8 pixels as 0 or 1 in each byte
+inline uint64_t spread(uint8_t plane, uint64_t bits)
+{
+	uint64_t kept = plane * s_ones & bits;
+	return (kept + 0x7F * s_ones) >> 7 & s_ones;
+}
+
+// color numbers 0-3 of a tile row
+inline uint64_t decode(uint8_t low, uint8_t high, uint64_t bits = s_left_first)
+{
+	return spread(low, bits) | spread(high, bits) << 1;
+}
+
+// 0xFF for the pixels of color number 1-3
+inline uint64_t opaque(uint64_t colors)
+{
+	return ((colors + 0x7F * s_ones) >> 7 & s_ones) * 0xFF;
+}
+
+// a row the other way round, for sprites flipped horizontally
+inline uint64_t reverse(uint64_t row)
+{
+	row = row >> 32 | row << 32;
+	row = (row & 0xFFFF0000FFFF0000ull) >> 16 | (row & 0x0000FFFF0000FFFFull) << 16;
+	return (row & 0xFF00FF00FF00FF00ull) >> 8 | (row & 0x00FF00FF00FF00FFull) << 8;
+}
+
+inline uint8_t vram(Ppu::Pages const& pages, uint16_t addr)
+{
+	return pages[addr >> 8][addr & 0xFF];
+}
@@ -0,0 +1,212 @@
+#include "rewind.h"
+
+#include <algorithm>
+#include <cstring>
+
+static_assert(sizeof(Dmg::State) % sizeof(uint64_t) == 0);
+
+Rewind::Rewind(size_t bytes, uint32_t frames, uint32_t keyframe_interval)
+	: m_ring(std::max(bytes, 2 * s_max_packed))
+	, m_head(0)
+	, m_entries(std::max(frames, 1u))
+	, m_first(0)
+	, m_count(0)
+	, m_keyframe_interval(std::max(keyframe_interval, 1u))
+	, m_since_key(0)
+	, m_key(std::make_unique<Dmg::State>())
+	, m_state(std::make_unique<Dmg::State>())
+{ }
+
+Rewind::~Rewind() = default;
+
+void Rewind::clear()
+{
+	m_head = 0;
+	m_first = 0;
+	m_count = 0;
+	m_since_key = 0;
+}
+
+size_t Rewind::bytes_used() const
+{
+	size_t used = 0;
+	for (uint32_t index = 0; index < m_count; index++)
+		used += m_entries[(m_first + index) % m_entries.size()].size;
+	return used;
+}
+
+void Rewind::capture(Dmg const& dmg)
+{
+	dmg.save_state(*m_state);
+
+	bool key = m_count == 0 || m_since_key >= m_keyframe_interval;
+	uint8_t* out = reserve();
+	// the ring was too small for more than the frames after the newest keyframe
+	key |= m_count == 0;
+
+	Entry frame;
+	frame.offset = static_cast<uint32_t>(out - m_ring.data());
+	frame.size = static_cast<uint32_t>(pack(*m_state, key ? nullptr : m_key.get(), out));
+	frame.key = key;
+	entry(m_count++) = frame;
+	m_head = frame.offset + frame.size;
+
+	if (key)
+	{
+		std::swap(m_key, m_state);
+		m_since_key = 0;
+	}
+	++m_since_key;
+}
+
+bool Rewind::rewind(Dmg& dmg, uint32_t frames)
+{
+	if (!m_count)
+		return false;
+
+	uint32_t target = m_count - 1 - std::min(frames, m_count - 1);
+	uint32_t key = target;
+	while (!entry(key).key)
+		--key;
+
+	// the keyframe is the newest one once the frames after target are gone
+	Entry const& key_frame = entry(key);
+	memset(static_cast<void*>(m_key.get()), 0, sizeof(Dmg::State));
+	unpack_xor(m_ring.data() + key_frame.offset, key_frame.size, *m_key);
+	memcpy(m_state.get(), m_key.get(), sizeof(Dmg::State));
+	if (target != key)
+		unpack_xor(m_ring.data() + entry(target).offset, entry(target).size, *m_state);
+
+	m_count = target + 1;
+	m_head = entry(target).offset + entry(target).size;
+	m_since_key = target - key + 1;
+
+	return dmg.load_state(*m_state);
+}
+
+uint8_t* Rewind::reserve()
+{
+	while (m_count)
+	{
+		if (m_count < m_entries.size())
+		{
+			size_t tail = entry(0).offset;
+			if (m_head >= tail)
+			{
+				// frames never wrap around the end, the rest of the ring stays unused
+				if (m_ring.size() - m_head >= s_max_packed)
+					return m_ring.data() + m_head;
+				if (tail >= s_max_packed)
+					return m_ring.data();
+			}
+			else if (tail - m_head >= s_max_packed)
+				return m_ring.data() + m_head;
+		}
+		drop_oldest();
+	}
+	m_head = 0;
+	return m_ring.data();
+}
+
+void Rewind::drop_oldest()
+{
+	// a keyframe and the frames XORed with it
+	do
+	{
+		m_first = static_cast<uint32_t>((m_first + 1) % m_entries.size());
+		--m_count;
+	} while (m_count && !entry(0).key);
+}
+
+// A frame is a sequence of runs: the number of zero words, the number of literal words, both
+// LEB128, and the literal words.
+static uint8_t* put_count(uint8_t* out, size_t count)
+{
+	while (count >= 0x80)
+	{
+		*out++ = static_cast<uint8_t>(count | 0x80);
+		count >>= 7;
+	}
+	*out++ = static_cast<uint8_t>(count);
+	return out;
+}
+
+static uint8_t const* get_count(uint8_t const* in, size_t& count)
+{
+	count = 0;
+	for (uint32_t shift = 0;; shift += 7)
+	{
+		uint8_t byte = *in++;
+		count |= static_cast<size_t>(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			return in;
+	}
+}
+
+static uint64_t load_word(uint8_t const* bytes, size_t word)
+{
+	uint64_t value;
+	memcpy(&value, bytes + word * sizeof(uint64_t), sizeof(value));
+	return value;
+}
+
+template <bool Xor>
+static size_t pack_words(uint8_t const* words, uint8_t const* key_words, size_t count, uint8_t* out)
+{
+	auto word = [&](size_t index) { return Xor ? load_word(words, index) ^ load_word(key_words, index) : load_word(words, index); };
+
+	uint8_t* start = out;
+	size_t index = 0;
+	while (index < count)
+	{
+		// most of a frame is zeros, four words at a time
+		size_t zeros = index;
+		while (index + 4 <= count && (word(index) | word(index + 1) | word(index + 2) | word(index + 3)) == 0)
+			index += 4;
+		while (index < count && word(index) == 0)
+			++index;
+		zeros = index - zeros;
+
+		// literals up to the next zero word
+		size_t literals = index;
+		while (index < count && word(index) != 0)
+			++index;
+
+		out = put_count(put_count(out, zeros), index - literals);
+		for (; literals < index; literals++)
+		{
+			uint64_t value = word(literals);
+			memcpy(out, &value, sizeof(value));
+			out += sizeof(value);
+		}
+	}
+	return static_cast<size_t>(out - start);
+}
+
+size_t Rewind::pack(Dmg::State const& state, Dmg::State const* key, uint8_t* out)
+{
+	uint8_t const* words = reinterpret_cast<uint8_t const*>(&state);
+	if (key)
+		return pack_words<true>(words, reinterpret_cast<uint8_t const*>(key), s_words, out);
+	return pack_words<false>(words, nullptr, s_words, out);
+}
+
+void Rewind::unpack_xor(uint8_t const* in, size_t size, Dmg::State& state)
+{
+	uint8_t* words = reinterpret_cast<uint8_t*>(&state);
+	uint8_t const* end = in + size;
+	size_t index = 0;
+	while (in < end)
+	{
+		size_t zeros;
+		size_t literals;
+		in = get_count(get_count(in, zeros), literals);
+		index += zeros;
+		for (size_t i = 0; i < literals; i++, index++)
+		{
+			uint64_t value = load_word(words, index) ^ load_word(in, i);
+			memcpy(words + index * sizeof(uint64_t), &value, sizeof(value));
+		}
+		in += literals * sizeof(uint64_t);
+	}
+}
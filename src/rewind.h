@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "dmg.h"
+
+// Rewind history: a save state per frame, kept in a ring of fixed size.
+// Every keyframe_interval frames a state is kept whole, the frames after it as the XOR of
+// their state with it, which is mostly zeros. Both are packed as runs of zero words and
+// literal words. The oldest keyframe and the frames after it go when the ring is full, so
+// the history holds as many seconds as fit. Capturing a frame never allocates.
+// See rewind.cpp.
+
+class Rewind
+{
+public:
+	static constexpr size_t s_default_bytes = 4 << 20;
+	// 60 seconds at 60 frames per second
+	static constexpr uint32_t s_default_frames = 3600;
+	static constexpr uint32_t s_default_keyframe_interval = 60;
+
+	Rewind(size_t bytes = s_default_bytes, uint32_t frames = s_default_frames,
+		uint32_t keyframe_interval = s_default_keyframe_interval);
+	~Rewind();
+
+	Rewind(Rewind const&) = delete;
+	Rewind& operator=(Rewind const&) = delete;
+
+	// adds the state of dmg as the newest frame, once per frame
+	void capture(Dmg const& dmg);
+	// Loads the frame captured frames before the newest one, or the oldest one, into dmg and
+	// forgets the frames after it. Returns false when there is none or it doesn't fit dmg.
+	bool rewind(Dmg& dmg, uint32_t frames = 0);
+	void clear();
+
+	uint32_t frames() const { return m_count; }
+	// bytes of the ring holding frames
+	size_t bytes_used() const;
+	size_t capacity() const { return m_ring.size(); }
+
+private:
+	struct Entry
+	{
+		uint32_t offset;
+		uint32_t size;
+		bool key;
+	};
+
+	static constexpr size_t s_words = sizeof(Dmg::State) / sizeof(uint64_t);
+	// bytes a frame can pack into at worst, every other word a literal
+	static constexpr size_t s_max_packed = sizeof(Dmg::State) + s_words + 32;
+
+	std::vector<uint8_t> m_ring;
+	size_t m_head; // where the next frame goes
+
+	// frames, oldest first, in a ring of their own
+	std::vector<Entry> m_entries;
+	uint32_t m_first;
+	uint32_t m_count;
+
+	uint32_t m_keyframe_interval;
+	uint32_t m_since_key; // frames captured since the newest keyframe, counting it
+
+	// newest keyframe unpacked and a state to unpack into
+	std::unique_ptr<Dmg::State> m_key;
+	std::unique_ptr<Dmg::State> m_state;
+
+	Entry& entry(uint32_t index) { return m_entries[(m_first + index) % m_entries.size()]; }
+	// room for s_max_packed bytes at m_head, dropping the oldest keyframes and their frames
+	uint8_t* reserve();
+	void drop_oldest();
+
+	// packs state, XORed with key unless it is nullptr, returns the bytes written
+	static size_t pack(Dmg::State const& state, Dmg::State const* key, uint8_t* out);
+	// XORs the packed frame into state
+	static void unpack_xor(uint8_t const* in, size_t size, Dmg::State& state);
+};
@@ -0,0 +1,92 @@
+#include "run_ahead.h"
+
+RunAhead::RunAhead(Dmg& dmg, uint32_t frames, bool second_thread)
+	: m_dmg(dmg)
+	, m_frames(frames)
+	, m_ahead(std::make_unique<Dmg>())
+	, m_state(std::make_unique<Dmg::State>())
+	, m_pending(false)
+	, m_stop(false)
+{
+	// The same rom from memory, the speculative Dmg has ram of its own and never writes a
+	// save file.
+	Cartridge const& cartridge = dmg.cartridge();
+	if (cartridge.mapped())
+		m_ahead->insert_cartridge(cartridge.rom(), cartridge.size());
+	m_ahead->set_execution(dmg.execution());
+	m_ahead->set_ppu_engine(dmg.ppu_engine());
+	m_ahead->set_render_every(dmg.render_every());
+
+	if (second_thread && frames)
+		m_thread = std::thread(&RunAhead::run, this);
+}
+
+RunAhead::~RunAhead()
+{
+	if (m_thread.joinable())
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			m_stop = true;
+		}
+		m_wake.notify_one();
+		m_thread.join();
+	}
+}
+
+Dmg& RunAhead::run_frame(uint8_t buttons)
+{
+	m_dmg.set_buttons(buttons);
+	if (!m_frames)
+	{
+		m_dmg.run_frame();
+		return m_dmg;
+	}
+
+	if (!m_thread.joinable())
+	{
+		m_dmg.run_frame();
+		m_dmg.save_state(*m_state);
+		run_ahead(m_frames);
+		return *m_ahead;
+	}
+
+	// both start from the state before the frame, the second thread runs it once more
+	m_dmg.save_state(*m_state);
+	{
+		std::lock_guard lock(m_mutex);
+		m_pending = true;
+	}
+	m_wake.notify_one();
+
+	m_dmg.run_frame();
+
+	std::unique_lock lock(m_mutex);
+	m_done.wait(lock, [this] { return !m_pending; });
+	return *m_ahead;
+}
+
+void RunAhead::run_ahead(uint32_t count)
+{
+	m_ahead->load_state(*m_state);
+	for (uint32_t frame = 0; frame < count; frame++)
+		m_ahead->run_frame();
+}
+
+void RunAhead::run()
+{
+	std::unique_lock lock(m_mutex);
+	while (true)
+	{
+		m_wake.wait(lock, [this] { return m_pending || m_stop; });
+		if (m_stop)
+			return;
+
+		lock.unlock();
+		run_ahead(m_frames + 1);
+		lock.lock();
+
+		m_pending = false;
+		m_done.notify_one();
+	}
+}
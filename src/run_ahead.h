@@ -0,0 +1,51 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "dmg.h"
+
+// Run-ahead: shows every frame as it will be some frames later, so input shows up that many
+// frames sooner.
+// Each frame the Dmg runs one frame with the buttons held. A second Dmg loads its state and
+// runs the frames ahead with the same buttons, then holds the frame to present until the
+// next one. With a second thread the speculative Dmg starts from the state before the frame
+// and runs it along with its frames ahead, while the Dmg runs the frame itself.
+// See run_ahead.cpp.
+
+class RunAhead
+{
+public:
+	// dmg has to have its cartridge inserted and outlive the RunAhead
+	RunAhead(Dmg& dmg, uint32_t frames, bool second_thread = false);
+	~RunAhead();
+
+	RunAhead(RunAhead const&) = delete;
+	RunAhead& operator=(RunAhead const&) = delete;
+
+	// Runs a frame with the buttons held, returns the Dmg holding the frame to present,
+	// valid until the next call.
+	Dmg& run_frame(uint8_t buttons);
+
+	uint32_t frames() const { return m_frames; }
+
+private:
+	Dmg& m_dmg;
+	uint32_t m_frames;
+	std::unique_ptr<Dmg> m_ahead;
+	std::unique_ptr<Dmg::State> m_state;
+
+	// the second thread runs m_ahead from m_state when m_pending is set and clears it
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	bool m_pending;
+	bool m_stop;
+
+	// loads m_state into m_ahead and runs count frames
+	void run_ahead(uint32_t count);
+	void run();
+};
@@ -0,0 +1,90 @@
+#include "timer.h"
+
+Timer::Timer()
+{
+	reset();
+}
+
+void Timer::reset()
+{
+	m_div_reset = 0;
+	m_time = 0;
+	m_tima = 0;
+	m_tma = 0;
+	m_tac = 0;
+}
+
+uint8_t Timer::div(uint64_t now) const
+{
+	return static_cast<uint8_t>((now - m_div_reset) >> 6);
+}
+
+uint8_t Timer::tima() const
+{
+	return m_tima;
+}
+
+void Timer::write_div(uint64_t now)
+{
+	m_div_reset = now;
+	m_time = now;
+}
+
+void Timer::write_tima(uint8_t data)
+{
+	m_tima = data;
+}
+
+void Timer::write_tma(uint8_t data)
+{
+	m_tma = data;
+}
+
+void Timer::write_tac(uint8_t data)
+{
+	m_tac = data & 0x07;
+}
+
+bool Timer::advance(uint64_t now)
+{
+	if (now <= m_time)
+		return false;
+
+	uint64_t ticks = 0;
+	if (enabled())
+		ticks = (now - m_div_reset) / period() - (m_time - m_div_reset) / period();
+	m_time = now;
+
+	if (ticks < 0x100u - m_tima)
+	{
+		m_tima = static_cast<uint8_t>(m_tima + ticks);
+		return false;
+	}
+
+	// TMA is reloaded on every overflow, only the ones after the last matter
+	ticks -= 0x100u - m_tima;
+	m_tima = static_cast<uint8_t>(m_tma + ticks % (0x100u - m_tma));
+	return true;
+}
+
+uint64_t Timer::next_tick(uint64_t time) const
+{
+	return m_div_reset + ((time - m_div_reset) / period() + 1) * period();
+}
+
+uint64_t Timer::next_overflow() const
+{
+	if (!enabled())
+		return s_never;
+	return next_tick(m_time) + (0xFFu - m_tima) * period();
+}
+
+uint64_t Timer::next_div_change(uint64_t now) const
+{
+	return m_div_reset + (((now - m_div_reset) >> 6) + 1) * 64;
+}
+
+uint64_t Timer::next_tima_change(uint64_t now) const
+{
+	return enabled() ? next_tick(now) : s_never;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+
+// DIV, TIMA, TMA and TAC ($FF04-$FF07).
+// Nothing is clocked: DIV and TIMA are derived from the system time in M-cycles when they are
+// read, and the only event is the TIMA overflow requesting the timer interrupt. Both DIV and
+// TIMA count on the same internal counter, which a write to DIV resets.
+// See timer.cpp.
+
+class Timer
+{
+public:
+	static constexpr uint64_t s_never = ~0ull;
+
+	Timer();
+
+	void reset();
+
+	// TIMA and the writes other than DIV expect advance() up to the current M-cycle
+	uint8_t div(uint64_t now) const;
+	uint8_t tima() const;
+	uint8_t tma() const { return m_tma; }
+	uint8_t tac() const { return m_tac | 0xF8; }
+
+	void write_div(uint64_t now);
+	void write_tima(uint8_t data);
+	void write_tma(uint8_t data);
+	void write_tac(uint8_t data);
+
+	// Brings TIMA up to now, returns true when it overflowed since the last call.
+	bool advance(uint64_t now);
+
+	// first M-cycle at which TIMA overflows, s_never while the timer is stopped
+	uint64_t next_overflow() const;
+	// first M-cycle after now at which DIV or TIMA read differently
+	uint64_t next_div_change(uint64_t now) const;
+	uint64_t next_tima_change(uint64_t now) const;
+
+private:
+	bool enabled() const { return m_tac & 0x04; }
+	// M-cycles per TIMA increment
+	uint64_t period() const { return s_periods[m_tac & 0x03]; }
+	// first increment after time
+	uint64_t next_tick(uint64_t time) const;
+
+	static constexpr uint64_t s_periods[4] = { 256, 4, 16, 64 };
+
+	uint64_t m_div_reset; // M-cycle of the last write to DIV
+	uint64_t m_time;      // M-cycle TIMA is up to date with
+	uint8_t m_tima;
+	uint8_t m_tma;
+	uint8_t m_tac;
+};